@@ -0,0 +1,517 @@
+#include <unistd.h>
+
+#include "batch.h"
+#include "calculator.h"
+
+struct BatchChunk{
+	int sequence;
+	char *input;
+	int inputLength, inputCapacity;
+	char *output;
+	int outputLength, outputCapacity;
+	int failed;
+	bool answered;					//whether any line had an answer, the last of them in answer
+	BString answer;
+};
+
+//A worker's queue of chunks. The owner takes the oldest chunk, thieves take the
+//newest, so the two only meet when there is one chunk left.
+struct BatchDeque{
+	pthread_mutex_t lock;
+	BatchChunk **chunks;
+	int capacity, head, count;
+};
+
+struct BatchShared{
+	int threadCount;
+	BatchDeque *deques;
+
+	pthread_mutex_t lock;			//everything from here down
+	pthread_cond_t workReady, chunkDone;
+	int pending;					//chunks sitting in deques
+	bool inputDone;
+	int chunkCount;					//chunks handed out in total
+
+	BatchChunk **freeChunks;
+	int freeCount;
+	BatchChunk **reorder;			//finished chunks, slot sequence % window
+	int window;
+
+	const CalcEngine *engine;		//every worker's Calculator shares it
+	int cacheSize;
+	CalcCacheStats cacheStats;		//summed up as workers finish
+};
+
+struct BatchWorker{
+	BatchShared *shared;
+	int index;
+	pthread_t thread;
+};
+
+LineReader::LineReader(FILE *file){
+	_file = file;
+	_capacity = BATCH_BUFFER_SIZE;
+	_buffer = new char[_capacity];
+	_start = _end = 0;
+	_eof = false;
+}
+
+LineReader::~LineReader(){
+	delete [] _buffer;
+}
+
+bool LineReader::nextLine(const char *&line, int &length){
+	for (;;){
+		char *newline = (char *)memchr(_buffer + _start, '\n', _end - _start);
+		
+		if ((newline != NULL) || (_eof && (_start < _end))){
+			line = _buffer + _start;
+			length = (newline != NULL) ? (newline - line) : (_end - _start);
+			_start += (newline != NULL) ? length + 1 : length;
+			
+			if ((length > 0) && (line[length - 1] == '\r')) length--;
+			return true;
+		}
+		
+		if (_eof) return false;
+		
+		//keep the partial line, and make room for the rest of it
+		memmove(_buffer, _buffer + _start, _end - _start);
+		_end -= _start;
+		_start = 0;
+		
+		if (_end == _capacity){
+			char *buffer = new char[_capacity * 2];
+			memcpy(buffer, _buffer, _end);
+			delete [] _buffer;
+			_buffer = buffer;
+			_capacity *= 2;
+		}
+		
+		size_t got = fread(_buffer + _end, 1, _capacity - _end, _file);
+		if (got == 0) _eof = true;
+		_end += got;
+	}
+}
+
+
+
+OutputBuffer::OutputBuffer(FILE *file){
+	_file = file;
+	_buffer = new char[BATCH_BUFFER_SIZE];
+	_length = 0;
+}
+
+OutputBuffer::~OutputBuffer(){
+	flush();
+	delete [] _buffer;
+}
+
+void OutputBuffer::append(const char *text, int length){
+	if (_length + length > BATCH_BUFFER_SIZE){
+		flush();
+		
+		if (length > BATCH_BUFFER_SIZE){
+			fwrite(text, 1, length, _file);
+			return;
+		}
+	}
+	
+	memcpy(_buffer + _length, text, length);
+	_length += length;
+}
+
+void OutputBuffer::append(const char *text){
+	append(text, strlen(text));
+}
+
+void OutputBuffer::flush(){
+	if (_length > 0) fwrite(_buffer, 1, _length, _file);
+	_length = 0;
+	fflush(_file);
+}
+
+
+
+//*******************************************************************
+//Threaded batch
+//*******************************************************************
+
+static void addCacheStats(CalcCacheStats *total, const CalcCacheStats &stats){
+	total->hits += stats.hits;
+	total->misses += stats.misses;
+	total->evictions += stats.evictions;
+	total->entries += stats.entries;
+	total->capacity += stats.capacity;
+}
+
+static void printCacheStats(const CalcCacheStats &stats){
+	int lookups = stats.hits + stats.misses;
+	
+	fprintf(stderr, "cache: %d hits, %d misses (%.1f%% hit rate), %d evictions, %d of %d entries used\n",
+		stats.hits, stats.misses, lookups ? 100.0 * stats.hits / lookups : 0.0, stats.evictions,
+		stats.entries, stats.capacity);
+}
+
+static void appendChunkOutput(BatchChunk *chunk, const char *text, int length){
+	if (chunk->outputLength + length > chunk->outputCapacity){
+		int capacity = chunk->outputCapacity * 2;
+		while (capacity < chunk->outputLength + length) capacity *= 2;
+		
+		char *output = new char[capacity];
+		memcpy(output, chunk->output, chunk->outputLength);
+		delete [] chunk->output;
+		chunk->output = output;
+		chunk->outputCapacity = capacity;
+	}
+	
+	memcpy(chunk->output + chunk->outputLength, text, length);
+	chunk->outputLength += length;
+}
+
+static void solveChunk(Calculator *calc, BatchChunk *chunk){
+	const char *line = chunk->input, *end = chunk->input + chunk->inputLength, *response;
+	
+	chunk->outputLength = 0;
+	chunk->failed = 0;
+	chunk->answered = false;
+	
+	while (line < end){
+		const char *newline = (const char *)memchr(line, '\n', end - line);
+		int selStart = 0, selStop = 0;
+		
+		if (calc->calculate(line, newline - line, &response, selStart, selStop)){
+			appendChunkOutput(chunk, "There was a syntactical error: ", 31);
+			chunk->failed++;
+		}
+		else
+			chunk->answered = true;
+		
+		appendChunkOutput(chunk, response, strlen(response));
+		appendChunkOutput(chunk, "\n", 1);
+		
+		line = newline + 1;
+	}
+	
+	if (chunk->answered) chunk->answer = calc->getLastAnswer();
+}
+
+static BatchChunk *popChunk(BatchShared *shared, int index){
+	//own queue first, oldest chunk, then steal the newest chunk from the others
+	for (int i = 0; i < shared->threadCount; i++){
+		BatchDeque &deque = shared->deques[(index + i) % shared->threadCount];
+		BatchChunk *chunk = NULL;
+		
+		pthread_mutex_lock(&deque.lock);
+		if (deque.count > 0){
+			if (i == 0){
+				chunk = deque.chunks[deque.head];
+				deque.head = (deque.head + 1) % deque.capacity;
+			}
+			else
+				chunk = deque.chunks[(deque.head + deque.count - 1) % deque.capacity];
+			deque.count--;
+		}
+		pthread_mutex_unlock(&deque.lock);
+		
+		if (chunk != NULL) return chunk;
+	}
+	
+	return NULL;
+}
+
+static void *batchWorker(void *data){
+	BatchWorker *worker = (BatchWorker *)data;
+	BatchShared *shared = worker->shared;
+	Calculator calc(shared->engine);
+	
+	calc.setCacheSize(shared->cacheSize);
+	
+	for (;;){
+		pthread_mutex_lock(&shared->lock);
+		while ((shared->pending == 0) && !shared->inputDone)
+			pthread_cond_wait(&shared->workReady, &shared->lock);
+		
+		if (shared->pending == 0){
+			pthread_mutex_unlock(&shared->lock);
+			break;
+		}
+		
+		//claim one of the pending chunks before going looking for it, so a
+		//sleeping worker can never miss one
+		shared->pending--;
+		pthread_mutex_unlock(&shared->lock);
+		
+		BatchChunk *chunk;
+		while ((chunk = popChunk(shared, worker->index)) == NULL)
+			sched_yield();
+		
+		solveChunk(&calc, chunk);
+		
+		pthread_mutex_lock(&shared->lock);
+		shared->reorder[chunk->sequence % shared->window] = chunk;
+		pthread_cond_signal(&shared->chunkDone);
+		pthread_mutex_unlock(&shared->lock);
+	}
+	
+	CalcCacheStats stats;
+	calc.getCacheStats(&stats);
+	
+	pthread_mutex_lock(&shared->lock);
+	addCacheStats(&shared->cacheStats, stats);
+	pthread_mutex_unlock(&shared->lock);
+	
+	return NULL;
+}
+
+static bool usesSession(const char *line, int length){
+	//'ans' in any form, or an '=' that may define a name: what makes a line depend on
+	//the ones before it. Anything else that matches only costs the parallelism.
+	for (int i = 0; i < length; i++){
+		if (line[i] == '=') return true;
+		if (((line[i] | 0x20) == 'a') && (i + 2 < length) && ((line[i + 1] | 0x20) == 'n') && ((line[i + 2] | 0x20) == 's'))
+			return true;
+	}
+	
+	return false;
+}
+
+static bool fillChunk(LineReader *reader, BatchChunk *chunk, bool &session){
+	//session is set if any of the lines depends on those before it
+	const char *line;
+	int length;
+	
+	chunk->inputLength = 0;
+	session = false;
+	
+	while ((chunk->inputLength < BATCH_CHUNK_SIZE) && reader->nextLine(line, length)){
+		if (!session) session = usesSession(line, length);
+		
+		if (chunk->inputLength + length + 1 > chunk->inputCapacity){
+			int capacity = chunk->inputCapacity * 2;
+			while (capacity < chunk->inputLength + length + 1) capacity *= 2;
+			
+			char *input = new char[capacity];
+			memcpy(input, chunk->input, chunk->inputLength);
+			delete [] chunk->input;
+			chunk->input = input;
+			chunk->inputCapacity = capacity;
+		}
+		
+		memcpy(chunk->input + chunk->inputLength, line, length);
+		chunk->input[chunk->inputLength + length] = '\n';
+		chunk->inputLength += length + 1;
+	}
+	
+	return (chunk->inputLength > 0);
+}
+
+static int runThreadedBatch(FILE *in, FILE *out, int threads, int cacheSize, const CalcEngine *engine){
+	BatchShared shared;
+	LineReader reader(in);
+	int failed = 0;
+	
+	shared.cacheSize = cacheSize;
+	shared.engine = engine;
+	memset(&shared.cacheStats, 0, sizeof(CalcCacheStats));
+	
+	shared.threadCount = threads;
+	shared.window = threads * BATCH_CHUNKS_PER_THREAD;
+	shared.pending = shared.chunkCount = 0;
+	shared.inputDone = false;
+	
+	pthread_mutex_init(&shared.lock, NULL);
+	pthread_cond_init(&shared.workReady, NULL);
+	pthread_cond_init(&shared.chunkDone, NULL);
+	
+	shared.freeChunks = new BatchChunk*[shared.window];
+	shared.reorder = new BatchChunk*[shared.window];
+	shared.freeCount = shared.window;
+	
+	for (int i = 0; i < shared.window; i++){
+		BatchChunk *chunk = new BatchChunk;
+		chunk->inputCapacity = BATCH_CHUNK_SIZE * 2;
+		chunk->input = new char[chunk->inputCapacity];
+		chunk->outputCapacity = BATCH_CHUNK_SIZE * 2;
+		chunk->output = new char[chunk->outputCapacity];
+		
+		shared.freeChunks[i] = chunk;
+		shared.reorder[i] = NULL;
+	}
+	
+	shared.deques = new BatchDeque[threads];
+	for (int i = 0; i < threads; i++){
+		pthread_mutex_init(&shared.deques[i].lock, NULL);
+		shared.deques[i].capacity = shared.window;
+		shared.deques[i].chunks = new BatchChunk*[shared.window];
+		shared.deques[i].head = shared.deques[i].count = 0;
+	}
+	
+	BatchWorker *workers = new BatchWorker[threads];
+	for (int i = 0; i < threads; i++){
+		workers[i].shared = &shared;
+		workers[i].index = i;
+		pthread_create(&workers[i].thread, NULL, batchWorker, &workers[i]);
+	}
+	
+	//this thread reads input and writes finished chunks back out in order, until a
+	//chunk depends on the lines before it. That one is held back, and once the
+	//chunks before it are out the rest of the input is evaluated here instead.
+	int written = 0;
+	bool reading = true, session = false;
+	BatchChunk *held = NULL;
+	BString lastAnswer;
+	bool haveAnswer = false;
+	
+	pthread_mutex_lock(&shared.lock);
+	
+	while (reading || (written < shared.chunkCount)){
+		BatchChunk *next = shared.reorder[written % shared.window];
+		
+		if ((next != NULL) && (next->sequence == written)){
+			shared.reorder[written % shared.window] = NULL;
+			pthread_mutex_unlock(&shared.lock);
+			
+			fwrite(next->output, 1, next->outputLength, out);
+			failed += next->failed;
+			if (next->answered){
+				lastAnswer = next->answer;
+				haveAnswer = true;
+			}
+			
+			pthread_mutex_lock(&shared.lock);
+			shared.freeChunks[shared.freeCount++] = next;
+			written++;
+			continue;
+		}
+		
+		if (reading && (shared.freeCount > 0)){
+			BatchChunk *chunk = shared.freeChunks[--shared.freeCount];
+			pthread_mutex_unlock(&shared.lock);
+			
+			reading = fillChunk(&reader, chunk, session) && !session;
+			
+			pthread_mutex_lock(&shared.lock);
+			if (!reading){
+				if (session) held = chunk;
+				else shared.freeChunks[shared.freeCount++] = chunk;
+				shared.inputDone = true;
+				pthread_cond_broadcast(&shared.workReady);
+				continue;
+			}
+			
+			chunk->sequence = shared.chunkCount++;
+			
+			BatchDeque &deque = shared.deques[chunk->sequence % threads];
+			pthread_mutex_lock(&deque.lock);
+			deque.chunks[(deque.head + deque.count) % deque.capacity] = chunk;
+			deque.count++;
+			pthread_mutex_unlock(&deque.lock);
+			
+			shared.pending++;
+			pthread_cond_signal(&shared.workReady);
+			continue;
+		}
+		
+		pthread_cond_wait(&shared.chunkDone, &shared.lock);
+	}
+	
+	pthread_mutex_unlock(&shared.lock);
+	
+	for (int i = 0; i < threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	
+	if (held != NULL){
+		//one session from here on, with the 'ans' the last line before it left, so
+		//the output is the same as with one thread
+		Calculator calc(engine);
+		calc.setCacheSize(cacheSize);
+		if (haveAnswer) calc.setLastAnswer(lastAnswer);
+		
+		do{
+			solveChunk(&calc, held);
+			fwrite(held->output, 1, held->outputLength, out);
+			failed += held->failed;
+		} while (fillChunk(&reader, held, session));
+		
+		CalcCacheStats stats;
+		calc.getCacheStats(&stats);
+		addCacheStats(&shared.cacheStats, stats);
+		shared.freeChunks[shared.freeCount++] = held;
+	}
+	fflush(out);
+	
+	if (cacheSize > 0) printCacheStats(shared.cacheStats);
+	
+	for (int i = 0; i < shared.freeCount; i++){
+		delete [] shared.freeChunks[i]->input;
+		delete [] shared.freeChunks[i]->output;
+		delete shared.freeChunks[i];
+	}
+	
+	for (int i = 0; i < threads; i++){
+		pthread_mutex_destroy(&shared.deques[i].lock);
+		delete [] shared.deques[i].chunks;
+	}
+	
+	delete [] workers;
+	delete [] shared.deques;
+	delete [] shared.freeChunks;
+	delete [] shared.reorder;
+	
+	pthread_cond_destroy(&shared.chunkDone);
+	pthread_cond_destroy(&shared.workReady);
+	pthread_mutex_destroy(&shared.lock);
+	
+	return failed;
+}
+
+int countProcessors(){
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? count : 1;
+}
+
+
+
+//*******************************************************************
+
+int runBatch(FILE *in, FILE *out, int threads, int cacheSize, int numericType){
+	//an unavailable type falls back to double, as setNumericType() always left it
+	CalcSettings settings;
+	settingsDefaults(&settings);
+	settings.numericType = numericType;
+	if (!settingsValid(settings)) settings.numericType = CALC_TYPE_DOUBLE;
+	
+	CalcEngine engine(settings);
+	if (threads > 1) return runThreadedBatch(in, out, threads, cacheSize, &engine);
+	
+	Calculator theCalc(&engine);
+	LineReader reader(in);
+	OutputBuffer output(out);
+	const char *line, *response;
+	int length, failed = 0;
+	
+	theCalc.setCacheSize(cacheSize);
+	
+	while (reader.nextLine(line, length)){
+		int selStart = 0, selStop = 0;
+		
+		if (theCalc.calculate(line, length, &response, selStart, selStop)){
+			output.append("There was a syntactical error: ");
+			failed++;
+		}
+		
+		output.append(response);
+		output.append("\n", 1);
+	}
+	
+	output.flush();
+	
+	if (cacheSize > 0){
+		CalcCacheStats stats;
+		theCalc.getCacheStats(&stats);
+		printCacheStats(stats);
+	}
+	
+	return failed;
+}
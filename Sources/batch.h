@@ -0,0 +1,68 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "numeric.h"
+
+#define BATCH_BUFFER_SIZE 65536
+#define BATCH_CHUNK_SIZE 16384		//bytes of input handed to a worker at a time
+#define BATCH_CHUNKS_PER_THREAD 8	//chunks in flight per worker, bounds memory and the reorder window
+
+//Reads newline delimited lines through one reusable buffer. The buffer only
+//grows when a single line is longer than it, so memory doesn't depend on how
+//much input there is.
+class LineReader{
+	private:
+		FILE *_file;
+		char *_buffer;
+		int _capacity, _start, _end;
+		bool _eof;
+
+	public:
+		LineReader(FILE *file);
+		~LineReader();
+
+		//line points into the internal buffer and is valid until the next call,
+		//it is not null terminated. Trailing '\r' is dropped.
+		bool nextLine(const char *&line, int &length);
+};
+
+//Collects output and hands it to the FILE in BATCH_BUFFER_SIZE chunks
+class OutputBuffer{
+	private:
+		FILE *_file;
+		char *_buffer;
+		int _length;
+
+	public:
+		OutputBuffer(FILE *file);
+		~OutputBuffer();
+
+		void append(const char *text, int length);
+		void append(const char *text);
+		void flush();
+};
+
+//Evaluates every line of in and writes one result per line to out, in the same
+//format as the single expression command line. Returns the number of lines that failed.
+//
+//With more than one thread the input is cut into chunks which are dealt out to
+//per-worker queues, each worker with its own Calculator, all of them sharing one
+//CalcEngine. Idle workers steal from the others, and a reorder buffer writes the
+//results back in input order. From the first chunk with a line that uses 'ans' or
+//defines a name on, the rest of the input is evaluated in order on one session
+//that carries on from the answers before it, so the output is always the same as
+//with one thread.
+//
+//A cacheSize above zero gives every Calculator a result cache of that many
+//entries, and the combined hit/miss/eviction counts are printed to stderr.
+//numericType is one of the CALC_TYPE_ constants.
+int runBatch(FILE *in, FILE *out, int threads = 1, int cacheSize = 0, int numericType = CALC_TYPE_DOUBLE);
+
+int countProcessors();
+
+#endif
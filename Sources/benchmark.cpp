@@ -0,0 +1,2514 @@
+#include <OS.h>
+#include <new>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "benchmark.h"
+#include "calculator.h"
+#include "batch.h"
+#include "worksheet.h"
+#include "server.h"
+
+#define BENCH_DEFAULT_ITERATIONS 200000
+
+struct BenchSuite{
+	const char *name;
+	bool (*run)(int iterations);		//false if one of its checks failed
+};
+
+
+
+//*******************************************************************
+//Helpers
+//*******************************************************************
+
+//With -j, every result reported is also written to this file as one JSON object
+//in a "results" array, so runs from different commits can be diffed.
+static FILE *sJson = NULL;
+static const char *sSuiteName = "";
+static int sJsonCount = 0;
+
+//Hardware counters, read around a measurement with -p, see openCounters()
+#define BENCH_COUNTER_CYCLES 0
+#define BENCH_COUNTER_INSTRUCTIONS 1
+#define BENCH_COUNTER_BRANCH_MISSES 2
+#define BENCH_COUNTER_L1D_MISSES 3		//level 1 data cache read misses
+#define BENCH_COUNTER_LLC_MISSES 4		//last level cache read misses
+#define BENCH_COUNTER_COUNT 5
+
+struct BenchCounters{
+	int fd[BENCH_COUNTER_COUNT];			//-1 if the counter couldn't be opened
+	double perCall[BENCH_COUNTER_COUNT];	//of the last measurement, negative if not counted
+	int available;
+};
+
+static const char *sCounterNames[BENCH_COUNTER_COUNT] = { "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses" };
+static bool sUseCounters = false;
+
+//one measurement, the latencies, allocations and exponent are left negative when not taken
+struct BenchResult{
+	double nsPerCall, perSecond;
+	double p50, p99, p999;
+	double allocations;
+	double exponent;		//of the growth with input size
+	const BenchCounters *counters;		//NULL when not read
+};
+
+static void writeJson(const char *name, int count, const BenchResult &result){
+	if (sJson == NULL) return;
+	
+	fprintf(sJson, "%s\n    { \"suite\": \"%s\", \"name\": \"%s\", \"count\": %d, \"ns_per_expr\": %.1f, \"expr_per_s\": %.0f",
+		sJsonCount++ ? "," : "", sSuiteName, name, count, result.nsPerCall, result.perSecond);
+	if (result.p50 >= 0)
+		fprintf(sJson, ", \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f", result.p50, result.p99, result.p999);
+	if (result.allocations >= 0)
+		fprintf(sJson, ", \"allocations_per_call\": %.3f", result.allocations);
+	if (result.exponent >= 0)
+		fprintf(sJson, ", \"exponent\": %.3f", result.exponent);
+	for (int c = 0; (result.counters != NULL) && (c < BENCH_COUNTER_COUNT); c++)
+		if (result.counters->perCall[c] >= 0)
+			fprintf(sJson, ", \"%s_per_expr\": %.2f", sCounterNames[c], result.counters->perCall[c]);
+	fprintf(sJson, " }");
+}
+
+static void report(const char *name, int count, bigtime_t elapsed){
+	BenchResult result = { 0, 0, -1, -1, -1, -1, -1, NULL };
+	result.nsPerCall = (count > 0) ? (elapsed * 1000.0 / count) : 0;
+	result.perSecond = (elapsed > 0) ? (count * 1000000.0 / elapsed) : 0;
+	
+	printf("  %-32s %12.1f ns/expr %14.0f expr/s\n", name, result.nsPerCall, result.perSecond);
+	writeJson(name, count, result);
+}
+
+static long long nanoseconds(){
+	//system_time() only counts microseconds, too coarse to time one expression
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int compareLatencies(const void *a, const void *b){
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return (x < y) ? -1 : (x > y);
+}
+
+
+
+//*******************************************************************
+//Hardware counters
+//*******************************************************************
+
+//The processor's own event counters, through Linux perf_event_open(), counting
+//this thread in user mode only. Each counter is opened on its own so a processor
+//or virtual machine lacking some still reports the rest. Where there are none at
+//all (another system, a container that blocks the call, perf_event_paranoid set
+//too high) the suites carry on with wall time alone.
+static int openCounters(BenchCounters &counters){
+	counters.available = 0;
+	for (int c = 0; c < BENCH_COUNTER_COUNT; c++){
+		counters.fd[c] = -1;
+		counters.perCall[c] = -1;
+	}
+	
+	#ifdef __linux__
+	static const int cacheMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	static const struct { int type; long long config; } events[BENCH_COUNTER_COUNT] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cacheMiss },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cacheMiss }
+	};
+	int firstError = 0;
+	
+	for (int c = 0; c < BENCH_COUNTER_COUNT; c++){
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[c].type;
+		attr.config = events[c].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		//the kernel shares out the hardware when asked for more counters than it has, these scale the counts back up
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		
+		counters.fd[c] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (counters.fd[c] >= 0) counters.available++;
+		else if (firstError == 0) firstError = errno;
+	}
+	
+	if (counters.available == 0)
+		printf("  hardware counters unavailable (%s), wall time only\n", strerror(firstError));
+	#else
+	printf("  hardware counters are only read on Linux, wall time only\n");
+	#endif
+	
+	return counters.available;
+}
+
+static void startCounters(BenchCounters &counters){
+	#ifdef __linux__
+	for (int c = 0; c < BENCH_COUNTER_COUNT; c++){
+		if (counters.fd[c] < 0) continue;
+		ioctl(counters.fd[c], PERF_EVENT_IOC_RESET, 0);
+		ioctl(counters.fd[c], PERF_EVENT_IOC_ENABLE, 0);
+	}
+	#endif
+}
+
+static void stopCounters(BenchCounters &counters, int calls){
+	//leaves each count divided by calls in perCall, negative for any that didn't count
+	for (int c = 0; c < BENCH_COUNTER_COUNT; c++){
+		counters.perCall[c] = -1;
+		
+		#ifdef __linux__
+		unsigned long long values[3];		//count, time enabled, time running
+		if (counters.fd[c] < 0) continue;
+		
+		ioctl(counters.fd[c], PERF_EVENT_IOC_DISABLE, 0);
+		if ((read(counters.fd[c], values, sizeof(values)) != sizeof(values)) || (values[2] == 0)) continue;
+		
+		double count = (double)values[0] * values[1] / values[2];
+		counters.perCall[c] = count / calls;
+		#endif
+	}
+}
+
+static void closeCounters(BenchCounters &counters){
+	#ifdef __linux__
+	for (int c = 0; c < BENCH_COUNTER_COUNT; c++)
+		if (counters.fd[c] >= 0) close(counters.fd[c]);
+	#endif
+	counters.available = 0;
+}
+
+static void printCounters(const BenchCounters &counters){
+	//one line under the measurement it belongs to, per expression
+	static const char *labels[BENCH_COUNTER_COUNT] = { "cycles", "instr", "br-miss", "L1d-miss", "LLC-miss" };
+	
+	printf("  %-12s", "");
+	for (int c = 0; c < BENCH_COUNTER_COUNT; c++){
+		if (counters.perCall[c] >= 0) printf(" %s %.1f", labels[c], counters.perCall[c]);
+		else printf(" %s -", labels[c]);
+		
+		if ((c == BENCH_COUNTER_INSTRUCTIONS) && (counters.perCall[BENCH_COUNTER_CYCLES] > 0) && (counters.perCall[c] >= 0))
+			printf(" (IPC %.2f)", counters.perCall[c] / counters.perCall[BENCH_COUNTER_CYCLES]);
+	}
+	printf("\n");
+}
+
+
+
+//*******************************************************************
+//Allocation counting
+//*******************************************************************
+
+//With CALC_BENCH_ALLOCATIONS defined, in a build made for benchmarking, every
+//operator new in the program comes through here and is counted while
+//sCountAllocations is set. Only the allocations suite sets it, on a single
+//thread. The engine allocates with new throughout, so nothing it does gets past
+//the count. All the forms are replaced so none of them mixes with a library one.
+//The application keeps the library's, and the counts are left out.
+static bool sCountAllocations = false;
+static long long sAllocations = 0;
+
+#ifdef CALC_BENCH_ALLOCATIONS
+static const bool sAllocationsCounted = true;
+
+static void *countedAllocation(size_t size){
+	if (sCountAllocations) sAllocations++;
+	
+	void *block = malloc(size ? size : 1);
+	if (block == NULL) throw std::bad_alloc();
+	return block;
+}
+
+void *operator new(size_t size){ return countedAllocation(size); }
+void *operator new[](size_t size){ return countedAllocation(size); }
+void operator delete(void *block) throw(){ free(block); }
+void operator delete[](void *block) throw(){ free(block); }
+void operator delete(void *block, size_t) throw(){ free(block); }
+void operator delete[](void *block, size_t) throw(){ free(block); }
+#else
+static const bool sAllocationsCounted = false;
+#endif
+
+
+
+//*******************************************************************
+//Suites
+//*******************************************************************
+
+static bool benchCompiled(int iterations){
+	//the same formula through the text path (the value substituted into the
+	//expression and parsed every time) and through a CompiledExpression
+	const char *formula = "(1.5*x + 2)^2 - sin(x)/3 + x*x*x - 4/(x + 1)";
+	Calculator calc;
+	CompiledExpression compiled;
+	BString expression(formula), text, response;
+	int selStart, selStop;
+	char number[64];
+	
+	printf("vm: %s\n", formula);
+	
+	if (calc.compile(&expression, &compiled, selStart, selStop) != CALC_OK){
+		printf("  compile failed\n");
+		return false;
+	}
+	
+	//the bitwise operators out of range, where C leaves them undefined, must give
+	//the text path's answer. x is a variable so nothing is folded before it runs.
+	static const struct { const char *formula; double x; } shifts[] = {
+		{ "x<<70", 1 }, { "x<<64", 1 }, { "x<<-1", 1 }, { "x<<63", 1 }, { "x>>70", -8 }, { "x>>-3", 8 },
+		{ "x<<0", 1e300 }, { "x>>1", -1e300 }, { "1<<x", 1e10 }, { "x&255", 1e19 }, { "x|1", -1e30 },
+		{ "x&-1", 5e9 }, { "x|0", -3e9 }
+	};
+	int shiftMismatches = 0;
+	for (unsigned int i = 0; i < sizeof(shifts) / sizeof(shifts[0]); i++){
+		CompiledExpression shift;
+		BString shiftFormula(shifts[i].formula), shiftText(shifts[i].formula);
+		double x = shifts[i].x;
+		float textAnswer;
+		
+		sprintf(number, "(%.17g)", x);
+		shiftText.IReplaceAll("x", number);
+		if ((calc.compile(&shiftFormula, &shift, selStart, selStop) != CALC_OK)
+			|| (calc.calculate(&shiftText, &textAnswer) != CALC_OK) || (textAnswer != (float)shift.evaluate(&x))){
+			printf("  %s with x = %g: text and compiled differ\n", shifts[i].formula, x);
+			shiftMismatches++;
+		}
+	}
+	
+	bigtime_t start = system_time();
+	float checksumText = 0, answer;
+	for (int i = 0; i < iterations; i++){
+		sprintf(number, "%d", i % 1000);
+		text.SetTo(formula);
+		text.IReplaceAll("x", number);
+		if (calc.calculate(&text, &answer) == CALC_OK) checksumText += answer;
+	}
+	bigtime_t textTime = system_time() - start;
+	
+	start = system_time();
+	double checksumCompiled = 0, x;
+	for (int i = 0; i < iterations; i++){
+		x = i % 1000;
+		checksumCompiled += compiled.evaluate(&x);
+	}
+	bigtime_t compiledTime = system_time() - start;
+	
+	report("text (calculate)", iterations, textTime);
+	report("compiled (evaluate)", iterations, compiledTime);
+	printf("  speedup %.1fx, %d instructions, checksums %g / %g, %d out of range bitwise mismatches\n",
+		(compiledTime > 0) ? (double)textTime / compiledTime : 0, compiled.codeLength(), checksumText, checksumCompiled,
+		shiftMismatches);
+	return (shiftMismatches == 0);
+}
+
+static bool benchOptimize(int iterations){
+	//a machine generated looking formula, the same subterms over and over and
+	//constant sub-trees, compiled as parsed, with strict rewrites and with fast ones
+	BString formula;
+	char term[160];
+	
+	for (int k = 1; k <= 12; k++){
+		sprintf(term, "%ssin(x*pi/180)*(%d + 2^8/4) + cos(x*pi/180)^2 * (3*%d - 1) - sin(x*pi/180)/(y + 1) + ((y - %d)^3)/8",
+			(k > 1) ? " + " : "", k, k, k);
+		formula.Append(term);
+	}
+	
+	Calculator calc;
+	BString expression(formula);
+	int selStart, selStop;
+	
+	printf("optimize: %d terms like %s\n", 12, term + 3);
+	
+	static const char *levels[] = { "as parsed", "strict", "fast" };
+	double parsedChecksum = 0;
+	bool passed = true;
+	
+	for (int level = CALC_OPTIMIZE_NONE; level <= CALC_OPTIMIZE_FAST; level++){
+		CompiledExpression compiled;
+		CalcCompileStats stats;
+		
+		compiled.setOptimization(level);
+		if (calc.compile(&expression, &compiled, selStart, selStop) != CALC_OK){
+			printf("  compile failed\n");
+			return false;
+		}
+		compiled.getStats(&stats);
+		
+		double vars[2], checksum = 0;
+		bigtime_t start = system_time();
+		for (int i = 0; i < iterations; i++){
+			vars[0] = i % 360;
+			vars[1] = i % 7;
+			checksum += compiled.evaluate(vars);
+		}
+		bigtime_t elapsed = system_time() - start;
+		
+		//strict rewrites mustn't change a single bit
+		if (level == CALC_OPTIMIZE_NONE) parsedChecksum = checksum;
+		bool same = (level != CALC_OPTIMIZE_STRICT) || !memcmp(&checksum, &parsedChecksum, sizeof(double));
+		passed = passed && same;
+		
+		report(levels[level], iterations, elapsed);
+		printf("  %-32s %d nodes -> %d, %d folded, %d shared, %d instructions, checksum %.17g%s\n", "",
+			stats.nodesBefore, stats.nodesAfter, stats.folded, stats.shared, stats.instructions, checksum,
+			same ? "" : "  MISMATCH");
+		
+		bool any = false;
+		for (int rule = 0; rule < CALC_RULE_COUNT; rule++){
+			if (!stats.rules[rule]) continue;
+			printf("%s%s %d", any ? ", " : "                                   rules: ", CompiledExpression::ruleName(rule), stats.rules[rule]);
+			any = true;
+		}
+		if (any) printf("\n");
+	}
+	
+	return passed;
+}
+
+static bool benchColumns(int iterations){
+	//one formula over columns of x and y, a row at a time through evaluate() and
+	//then columnar on every target this processor has. All of them have to agree
+	//with the row at a time answers to the last bit.
+	static const char *formulas[] = {
+		"x*y + 3*x - y/2",
+		"(x + 1)*(y - 1)/(x*x + 1) - -x",
+		"(x & 255) | (y >> 3)",
+		"((x^9 & y^11) | (x*1e17 >> y/4)) + ((x/0*0) << y*2)",
+		"sin(x)*cos(y) + x^2",
+		NULL
+	};
+	
+	//the AVX-512 kernel's branch-free conversion has to match the one the rows
+	//use: every special double, then random bit patterns
+	static const double specials[] = { 0.0, -0.0, 0.5, -0.5, 1.9999, -1.9999, 4503599627370495.5, 9007199254740993.0,
+		9223372036854774784.0, -9223372036854774784.0, 9223372036854775808.0, -9223372036854775808.0, 1e19, -1e300,
+		HUGE_VAL, -HUGE_VAL, NAN, -NAN, 5e-324, -2.2250738585072014e-308 };
+	int conversionMismatches = 0;
+	unsigned int seed = 12345;
+	
+	for (int i = 0; i < (int)(sizeof(specials) / sizeof(specials[0])) + 100000; i++){
+		double value = 0;
+		if (i < (int)(sizeof(specials) / sizeof(specials[0]))) value = specials[i];
+		else{
+			calc_uint64 bits = 0;
+			for (int part = 0; part < 4; part++){
+				seed = seed * 1103515245 + 12345;
+				bits = (bits << 16) | (seed >> 16);
+			}
+			memcpy(&value, &bits, sizeof(value));
+		}
+		if (calcToInt64Packed(value) != calcToInt64(value)) conversionMismatches++;
+	}
+	if (conversionMismatches) printf("  %d doubles convert to calc_int64 differently\n", conversionMismatches);
+	
+	int rows = iterations, passes = (rows < 4000000) ? 4000000 / rows : 1;
+	double *x = new double[rows], *y = new double[rows];
+	double *expected = new double[rows], *results = new double[rows];
+	
+	for (int i = 0; i < rows; i++){
+		seed = seed * 1103515245 + 12345;
+		x[i] = ((int)(seed >> 8) % 200000) / 1000.0 - 100;
+		seed = seed * 1103515245 + 12345;
+		y[i] = ((int)(seed >> 8) % 200000) / 1000.0 - 100;
+	}
+	
+	printf("columns: %d rows, %d passes\n", rows, passes);
+	bool passed = (conversionMismatches == 0);
+	
+	for (int f = 0; formulas[f] != NULL; f++){
+		Calculator calc;
+		CompiledExpression compiled;
+		BString expression(formulas[f]);
+		int selStart, selStop;
+		
+		calc.useRadians();
+		if ((calc.compile(&expression, &compiled, selStart, selStop) != CALC_OK) || (compiled.countVariables() != 2)){
+			printf("  %s: compile failed\n", formulas[f]);
+			continue;
+		}
+		
+		//columns in the order the expression names its variables
+		const double *columns[2];
+		columns[compiled.variableIndex("x")] = x;
+		columns[compiled.variableIndex("y")] = y;
+		double bytes = 3.0 * sizeof(double) * rows * passes;
+		
+		printf("  %s\n", formulas[f]);
+		
+		double vars[2];
+		bigtime_t start = system_time();
+		for (int p = 0; p < passes; p++){
+			for (int i = 0; i < rows; i++){
+				vars[0] = columns[0][i];
+				vars[1] = columns[1][i];
+				expected[i] = compiled.evaluate(vars);
+			}
+		}
+		bigtime_t elapsed = system_time() - start;
+		printf("    %-10s %10.1f Mrows/s %8.2f GB/s\n", "rows", rows * (double)passes / elapsed,
+			elapsed ? bytes / elapsed / 1000 : 0.0);
+		
+		for (int target = 0; target < CALC_COLUMNS_COUNT; target++){
+			if (!compiled.setColumnTarget(target)) continue;
+			
+			start = system_time();
+			for (int p = 0; p < passes; p++)
+				compiled.evaluate(columns, results, rows);
+			elapsed = system_time() - start;
+			
+			bool same = !memcmp(expected, results, rows * sizeof(double));
+			passed = passed && same;
+			printf("    %-10s %10.1f Mrows/s %8.2f GB/s  %s\n", CompiledExpression::columnTargetName(target),
+				rows * (double)passes / elapsed, elapsed ? bytes / elapsed / 1000 : 0.0, same ? "identical" : "MISMATCH");
+		}
+	}
+	
+	delete [] x;
+	delete [] y;
+	delete [] expected;
+	delete [] results;
+	
+	return passed;
+}
+
+static bool benchScaling(int iterations){
+	//batch throughput for 1, 2, 4 ... threads up to the processor count. Every
+	//tenth line is a long operator chain, so a static split of the input would
+	//leave threads idle and work stealing has something to do.
+	FILE *in = tmpfile();
+	FILE *out = fopen("/dev/null", "w");
+	unsigned int seed = 12345;
+	
+	if ((in == NULL) || (out == NULL)){
+		printf("scaling: unable to create scratch files\n");
+		return false;
+	}
+	
+	for (int i = 0; i < iterations; i++){
+		seed = seed * 1103515245 + 12345;
+		int terms = ((seed >> 16) % 10 == 0) ? 200 : 3;
+		
+		for (int t = 0; t < terms; t++)
+			fprintf(in, "%s%d*(%d+sin(%d))", t ? "+" : "", (i + t) % 97, t % 13, (i * t) % 360);
+		fprintf(in, "\n");
+	}
+	
+	int processors = countProcessors();
+	bigtime_t single = 0;
+	
+	printf("scaling: %d lines, %d processors\n", iterations, processors);
+	
+	for (int threads = 1; ; threads *= 2){
+		if (threads > processors) threads = processors;
+		
+		rewind(in);
+		bigtime_t start = system_time();
+		runBatch(in, out, threads);
+		bigtime_t elapsed = system_time() - start;
+		
+		if (threads == 1) single = elapsed;
+		
+		char name[32];
+		sprintf(name, "%d thread%s", threads, (threads == 1) ? "" : "s");
+		report(name, iterations, elapsed);
+		printf("  %-32s %12.2fx speedup %10.0f%% efficiency\n", "", (double)single / elapsed,
+			100.0 * single / elapsed / threads);
+		
+		if (threads == processors) break;
+	}
+	
+	fclose(in);
+	fclose(out);
+	
+	//independent lines, then ones that lean on them through 'ans' and a defined
+	//name, must come out the same on any number of threads
+	FILE *sessionIn = tmpfile(), *outputs[2];
+	for (int i = 0; i < 6000; i++)
+		fprintf(sessionIn, "%d*(%d+1)\n", i % 97, i % 13);
+	fprintf(sessionIn, "ans+1\nrate = 3\n");
+	for (int i = 0; i < 20000; i++)
+		fprintf(sessionIn, (i % 1000 == 999) ? "1/*\n" : ((i % 7) ? "ans+1\n" : "ans*rate - %d\n"), i);
+	
+	int mismatches = 0;
+	for (int run = 0; run < 2; run++){
+		rewind(sessionIn);
+		outputs[run] = tmpfile();
+		runBatch(sessionIn, outputs[run], run ? ((processors < 4) ? 4 : processors) : 1);
+		rewind(outputs[run]);
+	}
+	
+	int one, other;
+	do{
+		one = fgetc(outputs[0]);
+		other = fgetc(outputs[1]);
+	} while ((one == other) && (one != EOF));
+	if (one != other) mismatches++;
+	printf("  %d mismatches against one thread, where lines use 'ans'\n", mismatches);
+	
+	fclose(sessionIn);
+	fclose(outputs[0]);
+	fclose(outputs[1]);
+	return (mismatches == 0);
+}
+
+static bool benchNumeric(int iterations){
+	//throughput against precision for every numeric backend, over expressions
+	//that mean something to both the integer and the floating point types
+	static const char *corpus[] = {
+		"12345*678 + 91011/12 - 1314",
+		"(7^5 - 3^9) * (2^10 + 17) % 1000003",
+		"((1 << 20) | 4095) & 65535 >> 3",
+		"1/3 + 1/7 + 1/11 + 1/13",
+		"1000000007 % 97 + 255 * 255 - 65535 / 7",
+		"-(2^31 - 1) * -(2^31 - 1)",
+		NULL
+	};
+	
+	Calculator calc;
+	BString expression, response;
+	int selStart, selStop, count = 0;
+	
+	//the programmer types wrap around, the narrow ones too, where C promotes to int
+	static const struct { int type; const char *expression, *expected; } wraps[] = {
+		{ CALC_TYPE_UINT16, "65535*65535", "1" }, { CALC_TYPE_UINT16, "65535^2", "1" },
+		{ CALC_TYPE_UINT16, "65535<<15", "32768" }, { CALC_TYPE_INT16, "182*182", "-32412" },
+		{ CALC_TYPE_INT16, "-32768*-1", "-32768" }, { CALC_TYPE_UINT8, "255*255", "1" },
+		{ CALC_TYPE_UINT8, "3^7", "139" }, { CALC_TYPE_UINT32, "65537*65537", "131073" }
+	};
+	int mismatches = 0;
+	
+	while (corpus[count] != NULL) count++;
+	
+	for (unsigned int i = 0; i < sizeof(wraps) / sizeof(wraps[0]); i++){
+		calc.setNumericType(wraps[i].type);
+		expression.SetTo(wraps[i].expression);
+		if ((calc.calculate(&expression, &response, selStart, selStop) != CALC_OK) || strcmp(response.String(), wraps[i].expected)){
+			printf("  %s as %s gave %s, not %s\n", wraps[i].expression, numericTypeName(wraps[i].type), response.String(),
+				wraps[i].expected);
+			mismatches++;
+		}
+	}
+	
+	printf("numeric: %d expressions, %d wrap-around mismatches\n", count, mismatches);
+	printf("  %-12s %6s %8s %14s %14s\n", "type", "bits", "digits", "ns/expr", "expr/s");
+	
+	for (int type = 0; type < CALC_TYPE_COUNT; type++){
+		if (!calc.setNumericType(type)) continue;
+		
+		//decimal digits the type carries, the integer types are exact over their range
+		int bits = numericTypeBits(type), digits;
+		switch (type){
+			case CALC_TYPE_FLOAT: digits = 7; break;
+			case CALC_TYPE_DOUBLE: digits = 15; break;
+			case CALC_TYPE_LONG_DOUBLE: digits = 18; break;
+			case CALC_TYPE_FLOAT128: digits = 33; break;
+			default: digits = (int)(bits * 0.30103); break;
+		}
+		
+		bigtime_t start = system_time();
+		for (int i = 0; i < iterations; i++){
+			expression.SetTo(corpus[i % count]);
+			calc.calculate(&expression, &response, selStart, selStop);
+		}
+		bigtime_t elapsed = system_time() - start;
+		
+		BenchResult result = { elapsed * 1000.0 / iterations, elapsed ? iterations * 1000000.0 / elapsed : 0.0, -1, -1, -1, -1, -1, NULL };
+		printf("  %-12s %6d %8d %14.1f %14.0f\n", numericTypeName(type), bits, digits, result.nsPerCall, result.perSecond);
+		writeJson(numericTypeName(type), iterations, result);
+	}
+	
+	return (mismatches == 0);
+}
+
+//the shapes of expression calculate() sees, for the engine suite
+#define BENCH_SHORT 0			//what gets typed in interactively
+#define BENCH_NESTED 1			//parentheses 32 to 64 deep
+#define BENCH_CHAIN 2			//100 to 200 operators in a row
+#define BENCH_TRIG 3
+#define BENCH_BITWISE 4			//programmer mode
+#define BENCH_CORPUS_COUNT 5
+
+#define BENCH_CORPUS_LINES 256
+
+static int benchRandom(unsigned int &seed, int range){
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % range;
+}
+
+static void generateLine(int kind, BString &line, unsigned int &seed){
+	static const char *ops = "+-*/";
+	char text[128];
+	int a = benchRandom(seed, 1000) + 1, b = benchRandom(seed, 1000) + 1, c = benchRandom(seed, 100) + 1;
+	
+	line.SetTo("");
+	
+	switch (kind){
+		case BENCH_SHORT: {
+			static const char *forms[] = { "%d + %d", "%d * %d - %d", "%d / %d", "%d^2 + %d", "(%d + %d) * %d", "ans * 2 + %d" };
+			sprintf(text, forms[benchRandom(seed, 6)], a, b, c);
+			line.Append(text);
+			break;
+		}
+		
+		case BENCH_NESTED: {
+			int depth = 32 + benchRandom(seed, 33);
+			line.Append('(', depth);
+			line << a;
+			for (int i = 0; i < depth; i++){
+				sprintf(text, " %c %d)", ops[benchRandom(seed, 4)], benchRandom(seed, 9) + 1);
+				line.Append(text);
+			}
+			break;
+		}
+		
+		case BENCH_CHAIN: {
+			int terms = 100 + benchRandom(seed, 101);
+			line << a;
+			for (int i = 0; i < terms; i++){
+				sprintf(text, " %c %d", ops[benchRandom(seed, 4)], benchRandom(seed, 1000) + 1);
+				line.Append(text);
+			}
+			break;
+		}
+		
+		case BENCH_TRIG: {
+			sprintf(text, "sin(%d)*cos(%d) + tan(%d)/2 - atan(%d.5) + asin(0.%d) * acos(0.%d)", a, b, c, c, c % 10, a % 10);
+			line.Append(text);
+			break;
+		}
+		
+		case BENCH_BITWISE: {
+			static const char *forms[] = { "(%d & %d) | (%d << 3)", "((%d << 8) | %d) >> %d", "%d %% 256 & %d | 1 << (%d %% 16)" };
+			sprintf(text, forms[benchRandom(seed, 3)], a * 1021, b, c % 24);
+			line.Append(text);
+			break;
+		}
+	}
+}
+
+static void measureLines(const char *name, Calculator &calc, const BString *lines, int count, int iterations, BenchCounters *counters){
+	//every call timed on its own for the percentiles, and the allocations (and
+	//hardware counters, if there are any) counted once the calculator has been
+	//through the lines twice to grow its buffers
+	long long *latencies = new long long[iterations];
+	const char *response;
+	int selStart, selStop;
+	
+	for (int i = 0; i < 2 * count; i++)
+		calc.calculate(lines[i % count].String(), lines[i % count].Length(), &response, selStart, selStop);
+	
+	sAllocations = 0;
+	sCountAllocations = true;
+	if (counters != NULL) startCounters(*counters);
+	
+	long long start = nanoseconds(), last = start;
+	for (int i = 0; i < iterations; i++){
+		const BString &line = lines[i % count];
+		calc.calculate(line.String(), line.Length(), &response, selStart, selStop);
+		
+		long long now = nanoseconds();
+		latencies[i] = now - last;
+		last = now;
+	}
+	
+	if (counters != NULL) stopCounters(*counters, iterations);
+	sCountAllocations = false;
+	qsort(latencies, iterations, sizeof(long long), compareLatencies);
+	
+	BenchResult result;
+	long long elapsed = last - start;
+	result.nsPerCall = (double)elapsed / iterations;
+	result.perSecond = (elapsed > 0) ? iterations * 1000000000.0 / elapsed : 0;
+	result.p50 = latencies[iterations / 2];
+	result.p99 = latencies[(int)((long long)iterations * 99 / 100)];
+	result.p999 = latencies[(int)((long long)iterations * 999 / 1000)];
+	result.allocations = sAllocationsCounted ? (double)sAllocations / iterations : -1;
+	result.exponent = -1;
+	result.counters = counters;
+	
+	printf("  %-12s %12.1f %12.0f %9.0f %9.0f %9.0f %10.3f\n", name, result.nsPerCall, result.perSecond,
+		result.p50, result.p99, result.p999, result.allocations);
+	if (counters != NULL) printCounters(*counters);
+	writeJson(name, iterations, result);
+	
+	delete [] latencies;
+}
+
+static bool benchEngine(int iterations){
+	//Calculator::calculate() itself, over generated corpora of every shape and then
+	//the programmer mode lines in each output base
+	static const char *names[BENCH_CORPUS_COUNT] = { "short", "nested", "chain", "trig", "bitwise" };
+	static const int bases[] = { 2, 8, 10, 16 };
+	BString *corpus[BENCH_CORPUS_COUNT];
+	unsigned int seed = 12345;
+	Calculator calc;
+	char name[32];
+	BenchCounters counters, *measured = NULL;
+	
+	if (iterations < 1) iterations = 1;
+	
+	for (int kind = 0; kind < BENCH_CORPUS_COUNT; kind++){
+		corpus[kind] = new BString[BENCH_CORPUS_LINES];
+		for (int i = 0; i < BENCH_CORPUS_LINES; i++)
+			generateLine(kind, corpus[kind][i], seed);
+	}
+	
+	printf("engine: calculate() over %d generated lines of each kind, latencies in ns\n", BENCH_CORPUS_LINES);
+	if (sUseCounters && (openCounters(counters) > 0)) measured = &counters;
+	printf("  %-12s %12s %12s %9s %9s %9s %10s\n", "corpus", "ns/expr", "expr/s", "p50", "p99", "p999", "allocs");
+	
+	for (int kind = 0; kind < BENCH_CORPUS_COUNT; kind++)
+		measureLines(names[kind], calc, corpus[kind], BENCH_CORPUS_LINES, iterations, measured);
+	
+	for (int b = 0; b < 4; b++){
+		sprintf(name, "base %d", bases[b]);
+		calc.setResponseBase(bases[b]);
+		measureLines(name, calc, corpus[BENCH_BITWISE], BENCH_CORPUS_LINES, iterations, measured);
+	}
+	
+	if (measured != NULL) closeCounters(counters);
+	for (int kind = 0; kind < BENCH_CORPUS_COUNT; kind++)
+		delete [] corpus[kind];
+	
+	return true;
+}
+
+//expression families for the growth suite, each stressing one way the input can get big
+#define GROWTH_FLAT 0			//operator count: 1 + 2 * 3 - 4 ...
+#define GROWTH_PARENS 1			//nesting depth alone: ((((1))))
+#define GROWTH_NESTED 2			//nesting with an operator at every level: (((1 + 2) * 3) - 4)
+#define GROWTH_RIGHT 3			//right leaning, every operand pending at once: 1 + (2 * (3 - (4 ...)))
+#define GROWTH_FUNCTIONS 4		//nested prefix operators: sin(cos(sin(...)))
+#define GROWTH_UNARY 5			//unary minus density: ---1 * ---2 + ...
+#define GROWTH_FAMILY_COUNT 6
+
+#define GROWTH_SIZES 6			//10 to 10^6 characters
+#define GROWTH_FIT_FROM 2		//the exponent is fitted from 1000 characters up, below that the fixed cost dominates
+#define GROWTH_DEFAULT_BOUND 1.3
+
+static double sGrowthBound = GROWTH_DEFAULT_BOUND;
+
+static int generateGrowth(int family, char *text, int length, unsigned int &seed){
+	//writes an expression of about length characters into text, which has room for
+	//length + 64, and returns its actual length
+	static const char *ops = "+-*/";
+	int pos = 0, depth;
+	
+	switch (family){
+		case GROWTH_FLAT:
+			text[pos++] = '1';
+			while (pos < length){
+				text[pos++] = ops[benchRandom(seed, 4)];
+				text[pos++] = '1' + benchRandom(seed, 9);
+			}
+			break;
+		
+		case GROWTH_PARENS:
+			depth = length / 2;
+			memset(text, '(', depth);
+			text[depth] = '1';
+			memset(text + depth + 1, ')', depth);
+			pos = 2 * depth + 1;
+			break;
+		
+		case GROWTH_NESTED:
+			depth = length / 4;
+			memset(text, '(', depth);
+			pos = depth;
+			text[pos++] = '1';
+			for (int i = 0; i < depth; i++){
+				text[pos++] = ops[benchRandom(seed, 4)];
+				text[pos++] = '1' + benchRandom(seed, 9);
+				text[pos++] = ')';
+			}
+			break;
+		
+		case GROWTH_RIGHT:
+			depth = length / 4;
+			for (int i = 0; i < depth; i++){
+				text[pos++] = '1' + benchRandom(seed, 9);
+				text[pos++] = ops[benchRandom(seed, 4)];
+				text[pos++] = '(';
+			}
+			text[pos++] = '1';
+			memset(text + pos, ')', depth);
+			pos += depth;
+			break;
+		
+		case GROWTH_FUNCTIONS:
+			depth = length / 5;
+			for (int i = 0; i < depth; i++){
+				memcpy(text + pos, benchRandom(seed, 2) ? "sin(" : "cos(", 4);
+				pos += 4;
+			}
+			text[pos++] = '1';
+			memset(text + pos, ')', depth);
+			pos += depth;
+			break;
+		
+		case GROWTH_UNARY:
+			while (pos < length){
+				if (pos > 0) text[pos++] = ops[benchRandom(seed, 3)];
+				for (int minus = 1 + benchRandom(seed, 4); minus > 0; minus--)
+					text[pos++] = '-';
+				text[pos++] = '1' + benchRandom(seed, 9);
+			}
+			break;
+	}
+	
+	text[pos] = '\0';
+	return pos;
+}
+
+static bool benchGrowth(int){
+	//Times calculate() on every family from 10 to 10^6 characters and fits the
+	//exponent of the growth, time ~ length^k, by least squares on the logs. Every
+	//stage of the engine is meant to be linear, so anything steeper than the bound
+	//(-b, 1.3 unless given) is a regression and fails the suite.
+	static const char *names[GROWTH_FAMILY_COUNT] = { "flat", "parens", "nested", "right", "functions", "unary" };
+	Calculator calc;
+	char *text = new char[1000000 + 64];
+	const char *response;
+	unsigned int seed = 12345;
+	int selStart, selStop;
+	bool passed = true;
+	
+	printf("growth: microseconds per calculate() from 10 to 10^6 characters, fitted from 10^%d, bound %.2f\n",
+		GROWTH_FIT_FROM + 1, sGrowthBound);
+	printf("  %-10s", "family");
+	for (int size = 10; size <= 1000000; size *= 10)
+		printf(" %10d", size);
+	printf(" %9s\n", "exponent");
+	
+	for (int family = 0; family < GROWTH_FAMILY_COUNT; family++){
+		double x[GROWTH_SIZES], y[GROWTH_SIZES], largest = 0;
+		int points = 0;
+		bool solved = true;
+		
+		printf("  %-10s", names[family]);
+		
+		for (int s = 0, size = 10; s < GROWTH_SIZES; s++, size *= 10){
+			int length = generateGrowth(family, text, size, seed);
+			
+			//one call to grow the buffers, then as many as fit in 20 milliseconds
+			if (calc.calculate(text, length, &response, selStart, selStop)) solved = false;
+			
+			int calls = 0;
+			long long start = nanoseconds(), elapsed;
+			do{
+				calc.calculate(text, length, &response, selStart, selStop);
+				calls++;
+				elapsed = nanoseconds() - start;
+			}while (elapsed < 20000000);
+			
+			double perCall = (double)elapsed / calls;
+			printf(" %10.2f", perCall / 1000);
+			largest = perCall;
+			
+			if (s >= GROWTH_FIT_FROM){
+				x[points] = log((double)length);
+				y[points] = log(perCall);
+				points++;
+			}
+		}
+		
+		double meanX = 0, meanY = 0, covariance = 0, variance = 0;
+		for (int i = 0; i < points; i++){
+			meanX += x[i] / points;
+			meanY += y[i] / points;
+		}
+		for (int i = 0; i < points; i++){
+			covariance += (x[i] - meanX) * (y[i] - meanY);
+			variance += (x[i] - meanX) * (x[i] - meanX);
+		}
+		
+		double exponent = covariance / variance;
+		bool within = solved && (exponent <= sGrowthBound);
+		passed = passed && within;
+		
+		printf(" %9.2f%s\n", exponent, !solved ? "  FAILED TO SOLVE" : within ? "" : "  TOO STEEP");
+		
+		//the largest size's time, with the exponent
+		BenchResult result = { largest, largest > 0 ? 1000000000.0 / largest : 0, -1, -1, -1, -1, exponent, NULL };
+		writeJson(names[family], GROWTH_SIZES, result);
+	}
+	
+	delete [] text;
+	return passed;
+}
+
+static bool benchCache(int iterations){
+	//the result cache: an expression that only differs from a cached one by blanks
+	//must not get its answer unless it reads as the same tokens, and then a hit
+	//against a miss
+	static const char *lines[][2] = {
+		{ "12", "1 2" },
+		{ "2e3", "2 e3" },
+		{ "0x10", "0x1 0" },
+		{ "1.5", "1. 5" },
+		{ "1<<3", "1< <3" },
+		{ "sin(30)", "s in(30)" },
+		{ "1+2", " 1 +  2 " },
+		{ "PI*2", "pi * 2" },
+		{ NULL, NULL }
+	};
+	Calculator calc, fresh;
+	const char *response;
+	int selStart, selStop, mismatches = 0;
+	
+	calc.setCacheSize(64);
+	for (int i = 0; lines[i][0] != NULL; i++){
+		//what the second gives on its own, with nothing cached
+		int error = fresh.calculate(lines[i][1], strlen(lines[i][1]), &response, selStart, selStop);
+		BString expected(response);
+		
+		calc.calculate(lines[i][0], strlen(lines[i][0]), &response, selStart, selStop);
+		if ((calc.calculate(lines[i][1], strlen(lines[i][1]), &response, selStart, selStop) != error)
+			|| strcmp(response, expected.String())){
+			printf("  '%s' after '%s' gave %s, not %s\n", lines[i][1], lines[i][0], response, expected.String());
+			mismatches++;
+		}
+	}
+	
+	CalcCacheStats stats;
+	calc.getCacheStats(&stats);
+	if (stats.hits != 2) mismatches++;		//only the blanks around '+' and the case of 'PI' are left out
+	
+	static const char *expression = "(7^5 - 3^9) * (2^10 + 17) % 1000003";
+	int length = strlen(expression);
+	for (int cached = 0; cached < 2; cached++){
+		calc.setCacheSize(cached ? 64 : 0);
+		bigtime_t start = system_time();
+		for (int i = 0; i < iterations; i++)
+			calc.calculate(expression, length, &response, selStart, selStop);
+		report(cached ? "cached" : "not cached", iterations, system_time() - start);
+	}
+	
+	printf("  %d mismatches\n", mismatches);
+	return (mismatches == 0);
+}
+
+static bool benchAllocations(int iterations){
+	//Once a Calculator has seen an expression, evaluating it again must not touch
+	//the heap at all: every numeric type through the text path, with 'ans' and
+	//through the cache, and a CompiledExpression both ways.
+	static const char *corpus[] = {
+		"12345*678 + 91011/12 - 1314",
+		"(7^5 - 3^9) * (2^10 + 17) % 1000003",
+		"((1 << 20) | 4095) & 65535 >> 3",
+		"1/3 + 1/7 + 1/11 + 1/13",
+		"ans / 2 + 1",
+		"-(2^31 - 1) * -(2^31 - 1)",
+		"(1 + 2",
+		NULL
+	};
+	
+	Calculator calc;
+	const char *response;
+	int selStart, selStop, count = 0;
+	bool passed = true;
+	
+	while (corpus[count] != NULL) count++;
+	
+	if (!sAllocationsCounted){
+		printf("allocations: not counted, build with CALC_BENCH_ALLOCATIONS\n");
+		return true;
+	}
+	
+	printf("allocations: %d expressions, %d calls each way after two warming passes\n", count, iterations);
+	
+	for (int way = 0; way < CALC_TYPE_COUNT + 4; way++){
+		char name[64];
+		int type = (way < CALC_TYPE_COUNT) ? way : CALC_TYPE_DOUBLE;
+		
+		if (!calc.setNumericType(type)) continue;
+		calc.setCacheSize((way == CALC_TYPE_COUNT) ? 64 : 0);
+		calc.setResponseBase((way == CALC_TYPE_COUNT + 1) ? 2 : 10);
+		
+		if (way < CALC_TYPE_COUNT) sprintf(name, "%s", numericTypeName(type));
+		else if (way == CALC_TYPE_COUNT) sprintf(name, "double, cached");
+		else if (way == CALC_TYPE_COUNT + 1) sprintf(name, "double, binary");
+		else sprintf(name, "compiled%s", (way == CALC_TYPE_COUNT + 3) ? ", columns" : "");
+		
+		CompiledExpression compiled;
+		BString formula("x*y + sin(x)/(y + 1) - 2^x");
+		double x[CALC_COLUMN_BLOCK], y[CALC_COLUMN_BLOCK], results[CALC_COLUMN_BLOCK];
+		const double *columns[2] = { x, y };
+		
+		if ((way >= CALC_TYPE_COUNT + 2) && (calc.compile(&formula, &compiled, selStart, selStop) != CALC_OK)){
+			printf("  compile failed\n");
+			return false;
+		}
+		for (int i = 0; i < CALC_COLUMN_BLOCK; i++){
+			x[i] = i % 17;
+			y[i] = i % 5;
+		}
+		
+		//two passes, as the answer and 'ans' swap buffers and each has to grow
+		for (int pass = 0; pass < 3; pass++){
+			int calls = (pass < 2) ? 2 * count : iterations;
+			
+			if (pass == 2){
+				sAllocations = 0;
+				sCountAllocations = true;
+			}
+			
+			for (int i = 0; i < calls; i++){
+				if (way < CALC_TYPE_COUNT + 2)
+					calc.calculate(corpus[i % count], strlen(corpus[i % count]), &response, selStart, selStop);
+				else if (way == CALC_TYPE_COUNT + 2)
+					compiled.evaluate(x + (i % (CALC_COLUMN_BLOCK - 1)));
+				else if ((i % 64) == 0)
+					compiled.evaluate(columns, results, CALC_COLUMN_BLOCK);
+			}
+			
+			sCountAllocations = false;
+		}
+		
+		printf("  %-20s %10lld allocations %8.3f per call  %s\n", name, sAllocations,
+			(double)sAllocations / iterations, sAllocations ? "ALLOCATES" : "allocation free");
+		passed = passed && (sAllocations == 0);
+	}
+	
+	return passed;
+}
+
+static void randomBigInt(BigInt &value, int bits, unsigned int &seed){
+	//through hex text, with the top bit set so the size is exact
+	int digits = bits / 4;
+	char *text = new char[digits + 3];
+	
+	text[0] = '0';
+	text[1] = 'x';
+	for (int i = 0; i < digits; i++){
+		seed = seed * 1103515245 + 12345;
+		text[i + 2] = "0123456789abcdef"[(seed >> 16) & 15];
+	}
+	text[2] = '8';
+	text[digits + 2] = '\0';
+	
+	value.parse(text);
+	delete [] text;
+}
+
+static bool benchBigInt(int iterations){
+	//multiplication, 2n/n division and decimal conversion both ways from 64 bits
+	//to a megabit. Going up 4x in size costs 16x when an algorithm is quadratic,
+	//Karatsuba and the halving conversions should come in well under that.
+	unsigned int seed = 12345;
+	double last[4] = { 0, 0, 0, 0 };
+	bool passed = true;
+	
+	printf("bigint: microseconds per operation, and the growth over the size before\n");
+	printf("  %8s %18s %18s %18s %18s\n", "bits", "multiply", "divide", "to decimal", "from decimal");
+	
+	for (int bits = 64; bits <= (1 << 20); bits *= 4){
+		BigInt a, b, dividend, product, quotient, remainder, parsed;
+		randomBigInt(a, bits, seed);
+		randomBigInt(b, bits, seed);
+		randomBigInt(dividend, 2 * bits, seed);
+		
+		int size = a.formatSize(10);
+		char *text = new char[size];
+		int repeats = iterations / (bits / 64);
+		if (repeats < 1) repeats = 1;
+		
+		double times[4];
+		bigtime_t start = system_time();
+		for (int i = 0; i < repeats; i++) BigInt::multiply(product, a, b);
+		times[0] = (double)(system_time() - start) / repeats;
+		
+		start = system_time();
+		for (int i = 0; i < repeats; i++) BigInt::divide(&quotient, &remainder, dividend, b);
+		times[1] = (double)(system_time() - start) / repeats;
+		
+		start = system_time();
+		for (int i = 0; i < repeats; i++) a.format(text, size, 10);
+		times[2] = (double)(system_time() - start) / repeats;
+		
+		start = system_time();
+		for (int i = 0; i < repeats; i++) parsed.parse(text);
+		times[3] = (double)(system_time() - start) / repeats;
+		
+		printf("  %8d", bits);
+		for (int k = 0; k < 4; k++){
+			char growth[16] = "";
+			if ((last[k] > 0) && (times[k] > 0)) sprintf(growth, "x%.1f", times[k] / last[k]);
+			printf(" %11.2f %6s", times[k], growth);
+			last[k] = times[k];
+		}
+		printf("%s\n", parsed.compare(a) ? "  MISMATCH" : "");
+		passed = passed && !parsed.compare(a);
+		
+		delete [] text;
+	}
+	
+	return passed;
+}
+
+static int legacyRadix(calc_uint64 number, int base, int width, bool exactWidth, char *digits){
+	//how calculate() wrote the other bases before radix.cpp, kept to measure against
+	int minimum;
+	
+	switch (base){
+		case 2: {
+			for (int r = width - 1; r >= 0; r--)
+				digits[width - 1 - r] = ((number >> r) & 1) ? '1' : '0';
+			digits[width] = '\0';
+			return width;
+		}
+		case 8: minimum = exactWidth ? (width + 2) / 3 : 11; return sprintf(digits, "%.*llo", minimum, number);
+		case 16: minimum = exactWidth ? width / 4 : 8; return sprintf(digits, "%.*llx", minimum, number);
+	}
+	
+	return -1;
+}
+
+static calc_uint64 randomValue(unsigned int &seed){
+	//anything from a few bits to all 64, so every digit count turns up
+	calc_uint64 value = 0;
+	for (int i = 0; i < 4; i++){
+		seed = seed * 1103515245 + 12345;
+		value = (value << 16) | ((seed >> 8) & 0xffff);
+	}
+	
+	seed = seed * 1103515245 + 12345;
+	int bits = 1 + (seed >> 16) % 64;
+	return (bits == 64) ? value : (value & (((calc_uint64)1 << bits) - 1));
+}
+
+#define RADIX_VALUES 1024
+
+static bool benchRadix(int iterations){
+	//the table driven formatter against sprintf and the bit loop calculate() used
+	//to have, after checking the two agree and that every base reads back
+	calc_uint64 *values = new calc_uint64[RADIX_VALUES];
+	unsigned int seed = 2718;
+	char digits[72], text[160], legacy[72];
+	CalcRadixFormat format;
+	int mismatches = 0;
+	
+	for (int i = 0; i < RADIX_VALUES; i++)
+		values[i] = randomValue(seed);
+	
+	for (int i = 0; i < RADIX_VALUES; i++){
+		for (int base = CALC_RADIX_MIN; base <= CALC_RADIX_MAX; base++){
+			radixDefaults(&format, base);
+			int count = radixDigits(values[i], base, digits);
+			
+			//the old padding, for the integer types and for everything else
+			if ((base == 2) || (base == 8) || (base == 16)){
+				for (int exact = 0; exact < 2; exact++){
+					int width = exact ? radixWidth(64, base) : ((base == 2) ? 64 : ((base == 8) ? 11 : 8));
+					radixLayout(digits, count, false, width, format, text, sizeof(text));
+					legacyRadix(values[i], base, 64, exact, legacy);
+					if (strcmp(text, legacy)) mismatches++;
+				}
+			}
+			
+			//grouped, upper case and signed it should still read back as the same number
+			format.group = 1 + i % 5;
+			format.upperCase = true;
+			radixLayout(digits, count, true, 0, format, text, sizeof(text));
+			int kept = 0;
+			for (char *c = text + 1; *c != '\0'; c++)
+				if (*c != format.separator) text[kept++] = *c;
+			text[kept] = '\0';
+			if (strtoull(text, NULL, base) != values[i]) mismatches++;
+			
+			//and BigInt, which has its own path for the bases that aren't powers of two
+			BigInt big((long long)(values[i] >> 1));
+			big.format(text, sizeof(text), base);
+			count = radixDigits(values[i] >> 1, base, digits);
+			if ((strlen(text) != (size_t)count) || strncmp(text, digits, count)) mismatches++;
+		}
+	}
+	
+	//a bigint many limbs long, read back digit by digit
+	for (int base = CALC_RADIX_MIN; base <= CALC_RADIX_MAX; base++){
+		BigInt big, back, digit, radix(base);
+		randomBigInt(big, 1024, seed);
+		
+		char *bigText = new char[big.formatSize(base)];
+		big.format(bigText, big.formatSize(base), base);
+		for (char *c = bigText; *c != '\0'; c++){
+			digit.setTo((*c <= '9') ? (*c - '0') : (*c - 'a' + 10));
+			BigInt::multiply(back, back, radix);
+			BigInt::add(back, back, digit);
+		}
+		if (back.compare(big) != 0) mismatches++;
+		delete [] bigText;
+	}
+	
+	printf("radix: %d values, %d mismatches over bases %d to %d\n", RADIX_VALUES, mismatches, CALC_RADIX_MIN, CALC_RADIX_MAX);
+	
+	static const int bases[] = { 2, 8, 16 };
+	char name[48];
+	unsigned int checksum = 0;
+	
+	for (int b = 0; b < 3; b++){
+		int base = bases[b], width = radixWidth(64, base);
+		radixDefaults(&format, base);
+		
+		bigtime_t start = system_time();
+		for (int i = 0; i < iterations; i++)
+			checksum += legacyRadix(values[i % RADIX_VALUES], base, 64, true, legacy);
+		bigtime_t legacyTime = system_time() - start;
+		
+		start = system_time();
+		for (int i = 0; i < iterations; i++){
+			int count = radixDigits(values[i % RADIX_VALUES], base, digits);
+			checksum += radixLayout(digits, count, false, width, format, text, sizeof(text));
+		}
+		bigtime_t tableTime = system_time() - start;
+		
+		sprintf(name, "base %d, %s", base, (base == 2) ? "bit loop" : "sprintf");
+		report(name, iterations, legacyTime);
+		sprintf(name, "base %d, table", base);
+		report(name, iterations, tableTime);
+	}
+	
+	//the bases there was no way to print before, and the fancier layouts
+	static const int others[] = { 3, 10, 36 };
+	for (int b = 0; b < 3; b++){
+		radixDefaults(&format, others[b]);
+		
+		bigtime_t start = system_time();
+		for (int i = 0; i < iterations; i++){
+			int count = radixDigits(values[i % RADIX_VALUES], others[b], digits);
+			checksum += radixLayout(digits, count, false, 0, format, text, sizeof(text));
+		}
+		
+		sprintf(name, "base %d, table", others[b]);
+		report(name, iterations, system_time() - start);
+	}
+	
+	radixDefaults(&format, 16);
+	format.group = 4;
+	format.prefix = format.upperCase = true;
+	
+	bigtime_t start = system_time();
+	for (int i = 0; i < iterations; i++){
+		int count = radixDigits(values[i % RADIX_VALUES], 16, digits);
+		checksum += radixLayout(digits, count, false, 16, format, text, sizeof(text));
+	}
+	report("base 16, 0xDEAD_BEEF style", iterations, system_time() - start);
+	
+	if (checksum == 0) printf("  (checksum %u)\n", checksum);
+	delete [] values;
+	
+	return (mismatches == 0);
+}
+
+static double randomDouble(unsigned int &seed, int kind){
+	//any bit pattern, short decimals like people type, and integers scaled by powers of ten
+	calc_uint64 bits = randomValue(seed) | ((calc_uint64)1 << 62);
+	double value;
+	
+	switch (kind){
+		case 0:
+			bits = (bits & 0x7fffffffffffffffULL) | ((calc_uint64)(seed & 1) << 63);
+			if ((bits >> 52 & 0x7ff) == 0x7ff) bits ^= (calc_uint64)1 << 62;		//no inf or nan
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		case 1:
+			return (double)(long long)(bits % 2000001) / 1000 - 1000;
+		default:
+			return (double)(bits % 100000) * pow(10.0, (int)(seed >> 8) % 40 - 20);
+	}
+}
+
+#define DECIMAL_VALUES 4096
+
+static bool benchDecimal(int iterations){
+	//shortest output should read back as the same value, and be no longer than
+	//the fewest %.*e digits that do, fixed and scientific should be exactly what
+	//printf writes. Then the time against the printf calls they replace.
+	double *values = new double[DECIMAL_VALUES];
+	unsigned int seed = 1414;
+	char text[400], expected[400], digits[24];
+	int mismatches = 0, longer = 0, exponent;
+	
+	for (int i = 0; i < DECIMAL_VALUES; i++)
+		values[i] = randomDouble(seed, i % 3);
+	
+	for (int i = 0; i < DECIMAL_VALUES; i++){
+		double value = values[i];
+		float single = (float)value;
+		
+		formatDecimal(value, CALC_DECIMAL_SHORTEST, 0, text, sizeof(text));
+		if (strtod(text, NULL) != value) mismatches++;
+		
+		if (isfinite(single)){
+			formatDecimal(single, CALC_DECIMAL_SHORTEST, 0, text, sizeof(text));
+			if (strtof(text, NULL) != single) mismatches++;
+		}
+		
+		if (value != 0){
+			int count = decimalShortest(fabs(value), digits, &exponent), fewest = 1;
+			for (; fewest < 17; fewest++){
+				snprintf(expected, sizeof(expected), "%.*e", fewest - 1, value);
+				if (strtod(expected, NULL) == value) break;
+			}
+			if (count > fewest) longer++;
+		}
+		
+		for (int precision = 0; precision <= 20; precision += 4){
+			formatDecimal(value, CALC_DECIMAL_FIXED, precision, text, sizeof(text));
+			snprintf(expected, sizeof(expected), "%.*f", precision, value);
+			if (strcmp(text, expected)) mismatches++;
+			
+			formatDecimal(value, CALC_DECIMAL_SCIENTIFIC, precision, text, sizeof(text));
+			snprintf(expected, sizeof(expected), "%.*e", precision, value);
+			if (strcmp(text, expected)) mismatches++;
+		}
+	}
+	
+	printf("decimal: %d values, %d mismatches, %d shortest a digit longer than need be\n", DECIMAL_VALUES, mismatches, longer);
+	
+	//the response used to be %f, and %.17g is what it takes to round trip with printf
+	static const struct{
+		const char *name;
+		int mode;
+		const char *format;
+	} cases[] = {
+		{ "shortest", CALC_DECIMAL_SHORTEST, "%.17g" },
+		{ "fixed", CALC_DECIMAL_FIXED, "%.6f" },
+		{ "scientific", CALC_DECIMAL_SCIENTIFIC, "%.6e" }
+	};
+	char name[48];
+	unsigned int checksum = 0;
+	
+	for (int c = 0; c < 3; c++){
+		bigtime_t start = system_time();
+		for (int i = 0; i < iterations; i++)
+			checksum += snprintf(text, sizeof(text), cases[c].format, values[i % DECIMAL_VALUES]);
+		bigtime_t printfTime = system_time() - start;
+		
+		start = system_time();
+		for (int i = 0; i < iterations; i++)
+			checksum += formatDecimal(values[i % DECIMAL_VALUES], cases[c].mode, 6, text, sizeof(text));
+		bigtime_t decimalTime = system_time() - start;
+		
+		sprintf(name, "%s, printf %s", cases[c].name, cases[c].format);
+		report(name, iterations, printfTime);
+		sprintf(name, "%s, formatDecimal", cases[c].name);
+		report(name, iterations, decimalTime);
+	}
+	
+	bigtime_t start = system_time();
+	for (int i = 0; i < iterations; i++)
+		checksum += formatDecimal(values[i % DECIMAL_VALUES], CALC_DECIMAL_ENGINEERING, 6, text, sizeof(text));
+	report("engineering, formatDecimal", iterations, system_time() - start);
+	
+	if (checksum == 0) printf("  (checksum %u)\n", checksum);
+	delete [] values;
+	
+	return (mismatches == 0);
+}
+
+#define SCAN_LITERALS 4096
+#define SCAN_LITERAL_SIZE 48
+
+static void randomLiteral(char *text, unsigned int &seed, int kind){
+	//what people type, what printf writes, and long mantissas only strtod can round.
+	//No signs, the lexer leaves those to the parser.
+	calc_uint64 value = randomValue(seed);
+	
+	switch (kind){
+		case 0: sprintf(text, "%.17g", fabs(randomDouble(seed, 0))); break;
+		case 1: sprintf(text, "%.6g", randomDouble(seed, 2)); break;
+		case 2: sprintf(text, "%d.%02d", (int)(value % 100000), (int)(seed % 100)); break;
+		case 3: sprintf(text, "%llu%llue%d", value, randomValue(seed) % 1000000, (int)(seed >> 8) % 60 - 30); break;
+		case 4: sprintf(text, "0x%llx", value); break;
+		case 5: sprintf(text, "%llu", value); break;
+	}
+	
+	//anything without an exponent can have some of its digits grouped
+	if ((kind >= 2) && (kind != 3) && (seed & 0x100)){
+		int length = strlen(text);
+		for (int i = length - 2; i > 2; i -= 3){
+			if ((text[i] < '0') || (text[i] > '9') || (text[i - 1] < '0') || (text[i - 1] > '9')) continue;
+			memmove(text + i + 1, text + i, length - i + 1);
+			text[i] = '_';
+			length++;
+		}
+	}
+}
+
+static bool benchScan(int iterations){
+	//the lexer's number scanner against strtod on the same text without separators,
+	//then against the sscanf and strtod it replaced
+	char (*literals)[SCAN_LITERAL_SIZE] = new char[SCAN_LITERALS][SCAN_LITERAL_SIZE];
+	char clean[128], based[96];
+	unsigned int seed = 1732;
+	int mismatches = 0;
+	CalcNumberScan scan;
+	
+	for (int i = 0; i < SCAN_LITERALS; i++)
+		randomLiteral(literals[i], seed, i % 6);
+	
+	for (int i = 0; i < SCAN_LITERALS; i++){
+		const char *literal = literals[i];
+		int length = strlen(literal), kept = 0;
+		
+		for (int k = 0; k <= length; k++)
+			if (literal[k] != '_') clean[kept++] = literal[k];
+		
+		if ((scanNumber(literal, length, &scan) != CALC_SCAN_OK) || (scan.length != length)
+			|| (scan.value != strtod(clean, NULL))) mismatches++;
+		
+		//and every 64 bit value in the other bases, grouped or not
+		calc_uint64 value = randomValue(seed);
+		static const int bases[] = { 2, 8, 16 };
+		for (int b = 0; b < 3; b++){
+			char digits[72];
+			int count = radixDigits(value, bases[b], digits), out = 2;
+			
+			based[0] = '0';
+			based[1] = (bases[b] == 2) ? 'b' : ((bases[b] == 8) ? 'O' : 'X');
+			for (int k = 0; k < count; k++){
+				if ((k > 0) && (i & 1) && ((count - k) % 4 == 0)) based[out++] = '_';
+				based[out++] = digits[k];
+			}
+			based[out] = '\0';
+			
+			if ((scanNumber(based, out, &scan) != CALC_SCAN_OK) || (scan.value != (double)value)) mismatches++;
+			
+			//the numeric types only read 0x, so the rest are rewritten into it
+			canonicalNumber(based, scan, clean, sizeof(clean));
+			if (strtoull(clean, NULL, 16) != value) mismatches++;
+		}
+	}
+	
+	//what is refused, and exactly which characters get selected for it
+	static const struct{
+		const char *text;
+		int error, start, stop;
+	} refused[] = {
+		{ ".", CALC_SCAN_NO_DIGITS, 0, 1 },
+		{ "0x", CALC_SCAN_NO_DIGITS, 0, 2 },
+		{ "0b+1", CALC_SCAN_NO_DIGITS, 0, 2 },
+		{ "0b102", CALC_SCAN_BAD_DIGIT, 4, 5 },
+		{ "0o78", CALC_SCAN_BAD_DIGIT, 3, 4 },
+		{ "0xfg", CALC_SCAN_BAD_DIGIT, 3, 4 },
+		{ "1__000", CALC_SCAN_BAD_SEPARATOR, 1, 2 },
+		{ "1000_", CALC_SCAN_BAD_SEPARATOR, 4, 5 },
+		{ "1_.5", CALC_SCAN_BAD_SEPARATOR, 1, 2 },
+		{ "1._5", CALC_SCAN_BAD_SEPARATOR, 2, 3 },
+		{ "0x_ff", CALC_SCAN_BAD_SEPARATOR, 2, 3 },
+		{ "1e_5", CALC_SCAN_BAD_SEPARATOR, 2, 3 },
+		{ "2e", CALC_SCAN_BAD_EXPONENT, 1, 2 },
+		{ "2.5e+*3", CALC_SCAN_BAD_EXPONENT, 3, 5 },
+		{ "1.2.3", CALC_SCAN_BAD_POINT, 3, 4 },
+		{ "0x1.8", CALC_SCAN_BAD_POINT, 3, 4 }
+	};
+	int refusedCount = sizeof(refused) / sizeof(refused[0]);
+	
+	for (int i = 0; i < refusedCount; i++){
+		scanNumber(refused[i].text, strlen(refused[i].text), &scan);
+		if ((scan.error != refused[i].error) || (scan.errorStart != refused[i].start) || (scan.errorStop != refused[i].stop)){
+			printf("  %s: error %d at %d to %d\n", refused[i].text, scan.error, scan.errorStart, scan.errorStop);
+			mismatches++;
+		}
+	}
+	
+	printf("scan: %d literals, %d refused, %d mismatches\n", SCAN_LITERALS, refusedCount, mismatches);
+	
+	//Only decimal literals, as that is all the old path read, without separators.
+	//First the short ones people type, then the 17 digits printf writes to round
+	//trip a double, which are past what the fast path can be sure of.
+	static const int kinds[2][3] = { { 1, 2, 5 }, { 0, 0, 3 } };
+	double sum = 0, number;
+	char name[48];
+	
+	for (int group = 0; group < 2; group++){
+		for (int i = 0; i < SCAN_LITERALS; i++){
+			randomLiteral(literals[i], seed, kinds[group][i % 3]);
+			int kept = 0;
+			for (char *c = literals[i]; ; c++){
+				if (*c != '_') literals[i][kept++] = *c;
+				if (*c == '\0') break;
+			}
+		}
+		
+		const char *groupName = (group == 0) ? "typed" : "17 digits";
+		bigtime_t start = system_time();
+		for (int i = 0; i < iterations; i++){
+			char after;
+			if (sscanf(literals[i % SCAN_LITERALS], "%lf%c", &number, &after) >= 1) sum += number;
+		}
+		sprintf(name, "%s, sscanf %%lf", groupName);
+		report(name, iterations, system_time() - start);
+		
+		start = system_time();
+		for (int i = 0; i < iterations; i++)
+			sum += strtod(literals[i % SCAN_LITERALS], NULL);
+		sprintf(name, "%s, strtod", groupName);
+		report(name, iterations, system_time() - start);
+		
+		start = system_time();
+		for (int i = 0; i < iterations; i++){
+			const char *literal = literals[i % SCAN_LITERALS];
+			scanNumber(literal, strlen(literal), &scan);
+			sum += scan.value;
+		}
+		sprintf(name, "%s, scanNumber", groupName);
+		report(name, iterations, system_time() - start);
+	}
+	
+	//and the kind that fill a programmer's expression
+	for (int i = 0; i < SCAN_LITERALS; i++)
+		sprintf(literals[i], "0x%llx", randomValue(seed));
+	
+	bigtime_t start = system_time();
+	for (int i = 0; i < iterations; i++)
+		sum += (double)strtoull(literals[i % SCAN_LITERALS], NULL, 16);
+	report("hex, strtoull", iterations, system_time() - start);
+	
+	start = system_time();
+	for (int i = 0; i < iterations; i++){
+		const char *literal = literals[i % SCAN_LITERALS];
+		scanNumber(literal, strlen(literal), &scan);
+		sum += scan.value;
+	}
+	report("hex, scanNumber", iterations, system_time() - start);
+	
+	if (sum == 0) printf("  (checksum %g)\n", sum);
+	delete [] literals;
+	
+	return (mismatches == 0);
+}
+
+#define HISTORY_PER_ITERATION 5
+#define HISTORY_SEARCHES 64
+
+static void historyEntry(int entry, char *expression, char *answer){
+	//a few thousand distinct expressions over and over, like a session's worth
+	int a = ((unsigned int)entry * 7919) % 1000, b = ((unsigned int)entry * 104729) % 97;
+	sprintf(expression, "%d*%d + %d", a, b, entry % 64);
+	sprintf(answer, "%d", a * b + entry % 64);
+}
+
+static int historyPrefixMatches(AnswerHistory &history, const char *prefix, int *backs, int count){
+	//the same as findPrefix(), the slow way: from the newest back, each expression
+	//not seen yet goes in in order while it's among the first count
+	int length = strlen(prefix), found = 0;
+	
+	for (int back = 0; back < history.count(); back++){
+		const char *text = history.expression(back);
+		if (strncmp(text, prefix, length) != 0) continue;
+		
+		int at = 0, order = 1;
+		while ((at < found) && ((order = strcmp(history.expression(backs[at]), text)) < 0)) at++;
+		if ((order == 0) || (at == count)) continue;
+		
+		if (found < count) found++;
+		memmove(backs + at + 1, backs + at, (found - at - 1) * sizeof(int));
+		backs[at] = back;
+	}
+	
+	return found;
+}
+
+static int historyRandom(unsigned int &seed, int entries){
+	//benchRandom() only goes to 65535
+	return (benchRandom(seed, 32768) * 32768 + benchRandom(seed, 32768)) % entries;
+}
+
+static bool benchHistory(int iterations){
+	//appending to the mapped log, 'ansN' by number, opening it again, and prefix
+	//searches over all of it, each checked against the entries as they were made
+	char path[] = "/tmp/gigo_historyXXXXXX";
+	int file = mkstemp(path);
+	if (file < 0){
+		printf("history: unable to create a scratch file\n");
+		return false;
+	}
+	close(file);
+	unlink(path);
+	
+	int entries = iterations * HISTORY_PER_ITERATION, mismatches = 0;
+	char expression[64], answer[64];
+	AnswerHistory *history = new AnswerHistory();
+	
+	if (!history->open(path)){
+		printf("history: unable to open %s\n", path);
+		return false;
+	}
+	
+	printf("history: %d entries\n", entries);
+	
+	bigtime_t start = system_time();
+	for (int i = 0; i < entries; i++){
+		historyEntry(i, expression, answer);
+		history->append(expression, strlen(expression), answer, NULL, atof(answer), CALC_TYPE_DOUBLE);
+	}
+	report("append", entries, system_time() - start);
+	
+	unsigned int seed = 4242;
+	double sum = 0;
+	start = system_time();
+	for (int i = 0; i < iterations; i++){
+		int back = historyRandom(seed, entries);
+		sum += history->value(back) + history->answer(back)[0];
+	}
+	report("ansN, random N", iterations, system_time() - start);
+	
+	delete history;
+	history = new AnswerHistory();
+	start = system_time();
+	bool opened = history->open(path);
+	report("open again", 1, system_time() - start);
+	
+	if (!opened || (history->count() != entries)) mismatches++;
+	
+	//a second history on the same log is refused it, and still takes answers in memory
+	AnswerHistory *second = new AnswerHistory();
+	if (second->open(path) || second->isPersistent() || (second->count() != 0)) mismatches++;
+	for (int i = 0; i < 2000; i++){
+		historyEntry(i, expression, answer);
+		if (!second->append(expression, strlen(expression), answer, NULL, atof(answer), CALC_TYPE_DOUBLE)) mismatches++;
+	}
+	if ((second->count() != 2000) || (history->count() != entries)) mismatches++;
+	delete second;
+	
+	for (int i = 0; (i < 4096) && (mismatches == 0); i++){
+		int back = historyRandom(seed, entries);
+		historyEntry(entries - 1 - back, expression, answer);
+		if (strcmp(history->expression(back), expression) || strcmp(history->answer(back), answer)) mismatches++;
+	}
+	
+	//the first search sorts the lot, the rest are binary searches
+	int backs[HISTORY_SEARCHES], expected[HISTORY_SEARCHES];
+	start = system_time();
+	history->findPrefix("1", 1, backs, HISTORY_SEARCHES);
+	report("first search, sorting", 1, system_time() - start);
+	
+	char prefixes[HISTORY_SEARCHES][16];
+	for (int i = 0; i < HISTORY_SEARCHES; i++){
+		historyEntry(historyRandom(seed, entries), expression, answer);
+		int length = 1 + benchRandom(seed, strlen(expression));
+		memcpy(prefixes[i], expression, length);
+		prefixes[i][length] = '\0';
+	}
+	
+	int found = 0;
+	start = system_time();
+	for (int i = 0; i < iterations; i++){
+		const char *prefix = prefixes[i % HISTORY_SEARCHES];
+		found += history->findPrefix(prefix, strlen(prefix), backs, 8);
+	}
+	report("prefix search, 8 results", iterations, system_time() - start);
+	
+	//and after more have come in, which are merged into the sorted index
+	start = system_time();
+	for (int i = 0; i < 1000; i++){
+		historyEntry(entries + i, expression, answer);
+		history->append(expression, strlen(expression), answer, NULL, atof(answer), CALC_TYPE_DOUBLE);
+		found += history->findPrefix(prefixes[i % HISTORY_SEARCHES], 3, backs, 8);
+	}
+	report("append and search", 1000, system_time() - start);
+	
+	for (int i = 0; i < 8; i++){
+		int count = history->findPrefix(prefixes[i], strlen(prefixes[i]), backs, HISTORY_SEARCHES);
+		if (count != historyPrefixMatches(*history, prefixes[i], expected, HISTORY_SEARCHES)) mismatches++;
+		else if (memcmp(backs, expected, count * sizeof(int))) mismatches++;
+	}
+	
+	//'ans1' on in an expression come straight from the log
+	Calculator calc;
+	const char *response;
+	int selStart, selStop;
+	calc.setHistory(history);
+	
+	for (int i = 1; i < 64; i++){
+		BString expected(history->answer(i));
+		sprintf(expression, "ans%d", i);
+		if (calc.calculate(expression, strlen(expression), &response, selStart, selStop) || (expected != response)) mismatches++;
+	}
+	
+	start = system_time();
+	for (int i = 0; i < iterations; i++){
+		sprintf(expression, "ans%d + ans%d*2", 1 + i % 100, 1000 + i % 5000);
+		calc.calculate(expression, strlen(expression), &response, selStart, selStop);
+	}
+	report("calculate with two ansN", iterations, system_time() - start);
+	
+	printf("  %d mismatches\n", mismatches);
+	if ((sum == 0) && (found == 0)) printf("  (checksum %g)\n", sum);
+	
+	delete history;
+	unlink(path);
+	return (mismatches == 0);
+}
+
+#define SYMBOL_NAMES 10000
+#define SYMBOL_VARIABLES 100
+#define SYMBOL_COMPILED 1000
+#define SYMBOL_DEPENDENTS 20
+
+static void symbolName(int index, char *name){
+	//names are letters only, so a number is written in base 26
+	int length = 0;
+	name[length++] = 'v';
+	do{
+		name[length++] = 'a' + index % 26;
+		index /= 26;
+	} while (index > 0);
+	name[length] = '\0';
+}
+
+static bool symbolCheck(Calculator &calc, const char *expression, const char *expected){
+	const char *response;
+	int selStart, selStop;
+	
+	calc.calculate(expression, strlen(expression), &response, selStart, selStop);
+	if (!strcmp(response, expected)) return true;
+	
+	printf("  %s gave '%s', not '%s'\n", expression, response, expected);
+	return false;
+}
+
+static bool benchSymbols(int iterations){
+	//interning, a variable against the literal it stands for, a call against its
+	//body written out, and how much a redefinition invalidates
+	int mismatches = 0;
+	char name[32], expression[128];
+	const char *response;
+	int selStart, selStop;
+	
+	SymbolTable table;
+	bigtime_t start = system_time();
+	for (int i = 0; i < SYMBOL_NAMES; i++){
+		symbolName(i, name);
+		if (table.intern(name, strlen(name)) != i) mismatches++;
+	}
+	report("intern new names", SYMBOL_NAMES, system_time() - start);
+	
+	unsigned int seed = 2323;
+	int found = 0;
+	start = system_time();
+	for (int i = 0; i < iterations; i++){
+		symbolName(benchRandom(seed, SYMBOL_NAMES), name);
+		found += table.find(name, strlen(name));
+	}
+	report("find, with naming", iterations, system_time() - start);
+	if (table.find("nowhere", 7) != -1) mismatches++;
+	
+	Calculator calc;
+	static const char *session[][2] = {
+		{ "rate = 0.07", "0.07" }, { "fee = 2.5", "2.5" },
+		{ "f(x) = x*rate + 3", "f(x)" }, { "f(100)", "10" },
+		{ "RATE = 0.1", "0.1" }, { "f(100)", "13" },
+		{ "g(a, b) = f(a)*b - a", "g(a, b)" }, { "g(100, 2)", "-74" },
+		{ "f(x) = x/2", "f(x)" }, { "g(100, 2)", "0" },
+		{ "sq(x) = x*x", "sq(x)" }, { "sq(sq(2) + 1) + sq(3)", "34" },
+		{ "h() = pi/pi", "h()" }, { "h() + 1", "2" },
+		{ "w(x) = x + later", "w(x)" }, { "w(1)", "Unknown name." }, { "later = 4", "4" }, { "w(1)", "5" },
+		{ "f(x) = g(x, 1)", "A definition can't call itself." }, { "f(8)", "4" },
+		{ "r(x) = r(x - 1)", "A definition can't call itself." }, { "r(1)", "Unknown name." },
+		{ "sin = 1", "That can't be defined." }, { "k(x, x) = 1", "That can't be defined." },
+		{ "z =", "That can't be defined." }, { "z(x) = ", "That can't be defined." },
+		{ "f(1, 2)", "Wrong number of arguments." }, { "f + 1", "Wrong number of arguments." },
+		{ "nothing + 1", "Unknown name." }, { "1, 2", "Invalid expression." },
+		{ "f = 3", "3" }, { "g(1, 1)", "Unknown name." }, { "f(x) = x + 1", "f(x)" }, { "g(1, 1)", "1" }
+	};
+	for (unsigned int i = 0; i < sizeof(session) / sizeof(session[0]); i++)
+		if (!symbolCheck(calc, session[i][0], session[i][1])) mismatches++;
+	
+	//a bound variable is read the same way as the literal it stands for
+	static const char *pairs[][2] = {
+		{ "0.07*12 + 2.5", "rate*12 + fee" },
+		{ "(100 + 1)*0.1 + 3 - (7 + 1)*0.1 - 3", "f(100) - f(7)" }
+	};
+	calc.calculate("rate = 0.07", 11, &response, selStart, selStop);
+	calc.calculate("f(x) = x*RATE + 3", 17, &response, selStart, selStop);
+	
+	for (int p = 0; p < 2; p++){
+		for (int form = 0; form < 2; form++){
+			const char *text = pairs[p][form];
+			int length = strlen(text);
+			
+			start = system_time();
+			for (int i = 0; i < iterations; i++)
+				calc.calculate(text, length, &response, selStart, selStop);
+			report(text, iterations, system_time() - start);
+		}
+	}
+	
+	//each compiled expression uses one of the variables, and only those that use
+	//the one redefined are stale after
+	for (int i = 0; i < SYMBOL_VARIABLES; i++){
+		symbolName(i, name);
+		sprintf(expression, "%s = %d", name, i);
+		calc.calculate(expression, strlen(expression), &response, selStart, selStop);
+	}
+	
+	CompiledExpression *compiled = new CompiledExpression[SYMBOL_COMPILED];
+	for (int i = 0; i < SYMBOL_COMPILED; i++){
+		symbolName(i % SYMBOL_VARIABLES, name);
+		sprintf(expression, "x*%s + %d", name, i);
+		BString text(expression);
+		if (calc.compile(&text, &compiled[i], selStart, selStop) != CALC_OK) mismatches++;
+	}
+	
+	double vars[1] = { 2 };
+	if (compiled[SYMBOL_VARIABLES + 7].evaluate(vars) != 2 * 7 + SYMBOL_VARIABLES + 7) mismatches++;
+	
+	symbolName(7, name);
+	sprintf(expression, "%s = 70", name);
+	calc.calculate(expression, strlen(expression), &response, selStart, selStop);
+	
+	int stale = 0;
+	start = system_time();
+	for (int i = 0; i < SYMBOL_COMPILED; i++)
+		stale += calc.isCurrent(&compiled[i]) ? 0 : 1;
+	report("isCurrent", SYMBOL_COMPILED, system_time() - start);
+	if (stale != SYMBOL_COMPILED / SYMBOL_VARIABLES) mismatches++;
+	delete [] compiled;
+	
+	//redefining a function parses again only the functions built on it
+	calc.calculate("base(x) = x + 1", 15, &response, selStart, selStop);
+	for (int i = 0; i < 2 * SYMBOL_DEPENDENTS; i++){
+		symbolName(i, name);
+		if (i < SYMBOL_DEPENDENTS) sprintf(expression, "d%s(x) = base(x)*%d", name + 1, i);
+		else sprintf(expression, "d%s(x) = x*%d", name + 1, i);
+		calc.calculate(expression, strlen(expression), &response, selStart, selStop);
+	}
+	
+	SymbolTable *symbols = calc.symbols();
+	int *versions = new int[symbols->count()], count = symbols->count();
+	for (int i = 0; i < count; i++)
+		versions[i] = symbols->symbol(i)->version;
+	
+	start = system_time();
+	calc.calculate("base(x) = x + 2", 15, &response, selStart, selStop);
+	report("redefine, 20 dependents", 1, system_time() - start);
+	
+	int changed = 0;
+	for (int i = 0; i < count; i++)
+		changed += (symbols->symbol(i)->version != versions[i]) ? 1 : 0;
+	if (changed != SYMBOL_DEPENDENTS + 1) mismatches++;
+	if (!symbolCheck(calc, "db(5)", "7") || !symbolCheck(calc, "dab(5)", "130")) mismatches++;
+	delete [] versions;
+	
+	printf("  %d mismatches\n", mismatches);
+	if (found == 0) printf("  (checksum %d)\n", found);
+	return (mismatches == 0);
+}
+
+#define SHEET_COLUMNS 100			//independent branches, each an input and a chain of cells
+#define SHEET_ROWS 200
+
+static void sheetName(int index, char *name){
+	//'k' and four letters, so every name is one word and none is a word the lexer knows
+	name[0] = 'k';
+	for (int i = 4; i > 0; i--){
+		name[i] = 'a' + index % 26;
+		index /= 26;
+	}
+	name[5] = '\0';
+}
+
+static int sheetCell(int columns, int column, int row){
+	//the inputs come first, then each column's chain
+	return (row < 0) ? column : columns + column * SHEET_ROWS + row;
+}
+
+static void sheetSet(Worksheet &sheet, int cell, const char *formula){
+	char line[128], name[8];
+	int selStart, selStop;
+	
+	sheetName(cell, name);
+	sprintf(line, "%s = %s", name, formula);
+	sheet.setLine(line, strlen(line), selStart, selStop);
+}
+
+static void buildSheet(Worksheet &sheet, int columns){
+	char formula[64], input[8], previous[8];
+	
+	for (int c = 0; c < columns; c++){
+		sprintf(formula, "%d", c + 1);
+		sheetSet(sheet, sheetCell(columns, c, -1), formula);
+	}
+	
+	for (int c = 0; c < columns; c++){
+		for (int r = 0; r < SHEET_ROWS; r++){
+			sheetName(sheetCell(columns, c, -1), input);
+			sheetName(sheetCell(columns, c, r - 1), previous);
+			if (r == 0) sprintf(formula, "%s*1.5 + 1", input);
+			else sprintf(formula, "%s*0.5 + %s", previous, input);
+			sheetSet(sheet, sheetCell(columns, c, r), formula);
+		}
+	}
+}
+
+static int checkSheet(Worksheet &sheet, int columns, const double *inputs){
+	//every cell against the same arithmetic done here
+	int mismatches = 0;
+	
+	for (int c = 0; c < columns; c++){
+		double value = inputs[c] * 1.5 + 1;
+		for (int r = 0; r < SHEET_ROWS; r++){
+			if (r > 0) value = value * 0.5 + inputs[c];
+			int cell = sheetCell(columns, c, r);
+			if ((sheet.error(cell) != CALC_OK) || (sheet.value(cell) != value)) mismatches++;
+		}
+	}
+	
+	return mismatches;
+}
+
+static double timeChanges(Worksheet &sheet, int columns, double *inputs, int changed, int rounds, int &cells){
+	//microseconds per round of changing inputs and recalculating
+	char formula[32];
+	cells = 0;
+	
+	bigtime_t start = system_time();
+	for (int i = 0; i < rounds; i++){
+		for (int c = 0; c < changed; c++){
+			int column = (i * changed + c) % columns;
+			inputs[column] += 1;
+			sprintf(formula, "%g", inputs[column]);
+			sheetSet(sheet, sheetCell(columns, column, -1), formula);
+		}
+		cells += sheet.recalculate();
+	}
+	
+	return (double)(system_time() - start) / rounds;
+}
+
+static bool benchWorksheet(int iterations){
+	//building a sheet, recomputing all of it on one thread and on all of them, and
+	//then changes of one, ten and every input, against a sheet twice the size
+	int mismatches = 0, cells, columns = SHEET_COLUMNS, threads = countProcessors();
+	if (threads < 4) threads = 4;		//the parallel pass is checked even where it can't be faster
+	int rounds = (iterations / 100 > 10) ? iterations / 100 : 10;
+	double inputs[2 * SHEET_COLUMNS];
+	char name[8], line[128];
+	int selStart, selStop;
+	
+	for (int c = 0; c < 2 * SHEET_COLUMNS; c++)
+		inputs[c] = c + 1;
+	
+	Worksheet *sheet = new Worksheet;
+	bigtime_t start = system_time();
+	buildSheet(*sheet, columns);
+	int total = sheet->count();
+	report("set a cell", total, system_time() - start);
+	
+	start = system_time();
+	if (sheet->recalculate() != total) mismatches++;
+	report("recompute all, one thread", total, system_time() - start);
+	mismatches += checkSheet(*sheet, columns, inputs);
+	
+	sheet->setThreads(threads);
+	printf("  %d cells, %d threads\n", total, threads);
+	
+	double perRound = timeChanges(*sheet, columns, inputs, columns, 4, cells);
+	printf("  %-32s %12.1f us %10d cells\n", "change every input", perRound, cells / 4);
+	mismatches += checkSheet(*sheet, columns, inputs);
+	
+	sheet->setThreads(1);
+	double one = timeChanges(*sheet, columns, inputs, 1, rounds, cells);
+	printf("  %-32s %12.1f us %10d cells\n", "change one input", one, cells / rounds);
+	if (cells != rounds * (SHEET_ROWS + 1)) mismatches++;
+	
+	double ten = timeChanges(*sheet, columns, inputs, 10, rounds, cells);
+	printf("  %-32s %12.1f us %10d cells\n", "change ten inputs", ten, cells / rounds);
+	if (cells != rounds * 10 * (SHEET_ROWS + 1)) mismatches++;
+	mismatches += checkSheet(*sheet, columns, inputs);
+	
+	//a cycle through an input, reported with its path, then broken again
+	int input = sheetCell(columns, 0, -1), last = sheetCell(columns, 0, SHEET_ROWS - 1);
+	sheetName(last, name);
+	sprintf(line, "%s + 1", name);
+	sheetSet(*sheet, input, line);
+	sheet->recalculate();
+	
+	char expected[64];
+	sheetName(input, name);
+	sprintf(expected, "In %s: Circular reference: %s -> ", name, name);
+	if (strncmp(sheet->describe(last), expected, strlen(expected)) || (sheet->error(last) != CALC_CIRCULAR_REFERENCE))
+		mismatches++;
+	if (sheet->error(sheetCell(columns, 1, 0)) != CALC_OK) mismatches++;
+	
+	sprintf(line, "%s = %g", name, inputs[0]);
+	if (sheet->setLine(line, strlen(line), selStart, selStop) != CALC_OK) mismatches++;
+	if (sheet->recalculate() != SHEET_ROWS + 1) mismatches++;
+	mismatches += checkSheet(*sheet, columns, inputs);
+	delete sheet;
+	
+	//twice the cells, and a change costs the same
+	sheet = new Worksheet;
+	columns = 2 * SHEET_COLUMNS;
+	for (int c = 0; c < columns; c++)
+		inputs[c] = c + 1;
+	buildSheet(*sheet, columns);
+	sheet->recalculate();
+	
+	double bigger = timeChanges(*sheet, columns, inputs, 1, rounds, cells);
+	printf("  %-32s %12.1f us %10d cells, %d in the sheet\n", "change one input, bigger sheet", bigger, cells / rounds, sheet->count());
+	if (cells != rounds * (SHEET_ROWS + 1)) mismatches++;
+	mismatches += checkSheet(*sheet, columns, inputs);
+	delete sheet;
+	
+	printf("  %d mismatches\n", mismatches);
+	return (mismatches == 0);
+}
+
+#define THREAD_ENGINES 4
+#define THREAD_SCRIPT_LINES 8
+#define THREAD_MAX 16
+
+//every line after the first leans on 'ans', so a session that saw another's answer shows it
+static const char *sThreadScript[THREAD_SCRIPT_LINES] = {
+	"12345*678 + 91011/12",
+	"ans*3 - 7",
+	"sin(30) + cos(ans % 90)",
+	"(ans + 1)^2 % 1000003",
+	"ans / 7 + pi",
+	"-(ans) + 0xff",
+	"ans << 3 | 5",
+	"(ans - 1) * 1_000 + 0b101"
+};
+
+struct ThreadRun{
+	const CalcEngine *engine;
+	const BString *expected;		//THREAD_SCRIPT_LINES responses, from one session on its own
+	int rounds;
+	bool cached;
+	bool detour;					//changes its own settings and back, which must leave the engine alone
+	int mismatches;
+	pthread_t thread;
+};
+
+static void *threadSession(void *data){
+	ThreadRun *run = (ThreadRun *)data;
+	Calculator calc(run->engine);
+	const char *response;
+	int selStart, selStop;
+	
+	if (run->cached) calc.setCacheSize(64);
+	
+	for (int round = 0; round < run->rounds; round++){
+		if (run->detour && (round == run->rounds / 2)){
+			calc.setDecimalFormat(CALC_DECIMAL_FIXED, 2);
+			calc.useRadians();
+			calc.setSettings(run->engine->settings());
+		}
+		
+		for (int line = 0; line < THREAD_SCRIPT_LINES; line++){
+			const char *expression = sThreadScript[line];
+			calc.calculate(expression, strlen(expression), &response, selStart, selStop);
+			if (strcmp(response, run->expected[line].String())) run->mismatches++;
+		}
+	}
+	
+	return NULL;
+}
+
+static bool benchThreads(int iterations){
+	//many sessions at once on a few shared engines, each checked line by line
+	//against what a session on its own gives. Nothing is locked, so this is also
+	//the suite to run under -fsanitize=thread.
+	CalcEngine *engines[THREAD_ENGINES];
+	BString expected[THREAD_ENGINES][THREAD_SCRIPT_LINES];
+	CalcSettings settings;
+	
+	settingsDefaults(&settings);
+	engines[0] = new CalcEngine(settings);
+	
+	settings.useRadians = true;
+	settings.decimalMode = CALC_DECIMAL_FIXED;
+	settings.decimalPrecision = 4;
+	engines[1] = new CalcEngine(settings);
+	
+	settingsDefaults(&settings);
+	settings.numericType = CALC_TYPE_INT64;
+	radixDefaults(&settings.responseFormat, 16);
+	settings.responseFormat.group = 4;
+	settings.responseFormat.separator = '_';
+	engines[2] = new CalcEngine(settings);
+	
+	settingsDefaults(&settings);
+	settings.numericType = CALC_TYPE_BIGINT;
+	engines[3] = new CalcEngine(settingsValid(settings) ? settings : engines[0]->settings());
+	
+	for (int e = 0; e < THREAD_ENGINES; e++){
+		Calculator calc(engines[e]);
+		const char *response;
+		int selStart, selStop;
+		
+		for (int line = 0; line < THREAD_SCRIPT_LINES; line++){
+			const char *expression = sThreadScript[line];
+			calc.calculate(expression, strlen(expression), &response, selStart, selStop);
+			expected[e][line].SetTo(response);
+		}
+	}
+	
+	int processors = countProcessors();
+	int threads = processors * 2;
+	if (threads < 8) threads = 8;
+	if (threads > THREAD_MAX) threads = THREAD_MAX;
+	
+	int rounds = iterations / THREAD_SCRIPT_LINES;
+	if (rounds < 2) rounds = 2;
+	
+	ThreadRun runs[THREAD_MAX];
+	for (int t = 0; t < threads; t++){
+		runs[t].engine = engines[t % THREAD_ENGINES];
+		runs[t].expected = expected[t % THREAD_ENGINES];
+		runs[t].rounds = rounds;
+		runs[t].cached = ((t / THREAD_ENGINES) % 2 == 1);
+		runs[t].detour = ((t % 3) == 2);
+		runs[t].mismatches = 0;
+	}
+	
+	printf("threads: %d sessions on %d shared engines, %d lines each, %d processors\n", threads, THREAD_ENGINES,
+		rounds * THREAD_SCRIPT_LINES, processors);
+	
+	//one session on its own first, for the per line cost without contention
+	bigtime_t start = system_time();
+	threadSession(&runs[0]);
+	report("1 session", rounds * THREAD_SCRIPT_LINES, system_time() - start);
+	
+	start = system_time();
+	for (int t = 0; t < threads; t++)
+		pthread_create(&runs[t].thread, NULL, threadSession, &runs[t]);
+	for (int t = 0; t < threads; t++)
+		pthread_join(runs[t].thread, NULL);
+	bigtime_t elapsed = system_time() - start;
+	
+	char name[32];
+	sprintf(name, "%d sessions", threads);
+	report(name, threads * rounds * THREAD_SCRIPT_LINES, elapsed);
+	
+	int mismatches = 0;
+	for (int t = 0; t < threads; t++)
+		mismatches += runs[t].mismatches;
+	printf("  %d mismatches\n", mismatches);
+	
+	for (int e = 0; e < THREAD_ENGINES; e++)
+		delete engines[e];
+	
+	return (mismatches == 0);
+}
+
+#define SERVER_CLIENTS 64
+#define SERVER_PIPELINE 256
+
+static bool serverCheck(Calculator &calc, const char *request, const char *expected){
+	//one request through handleRequest(), without a socket
+	char line[256];
+	char *output = new char[64];
+	int length = strlen(request), outputLength = 0, outputCapacity = 64;
+	memcpy(line, request, length);
+	
+	CalcServer::handleRequest(&calc, line, length, output, outputLength, outputCapacity);
+	bool same = (outputLength == (int)strlen(expected) + 1) && !memcmp(output, expected, outputLength - 1);
+	if (!same) printf("  %s gave %.*s", request, outputLength, output);
+	
+	delete [] output;
+	return same;
+}
+
+static void *serverThread(void *data){
+	((CalcServer *)data)->run();
+	return NULL;
+}
+
+static int serverConnect(const char *path){
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((fd >= 0) && (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)){
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+static bool serverSend(int fd, const char *text, int length){
+	while (length > 0){
+		int sent = write(fd, text, length);
+		if (sent <= 0) return false;
+		text += sent;
+		length -= sent;
+	}
+	return true;
+}
+
+static int serverReplies(int fd, char *buffer, int capacity, int lines){
+	//reads until that many lines are in, their length or -1
+	int length = 0;
+	while (lines > 0){
+		int got = read(fd, buffer + length, capacity - length);
+		if (got <= 0) return -1;
+		for (int i = length; i < length + got; i++)
+			if (buffer[i] == '\n') lines--;
+		length += got;
+	}
+	return length;
+}
+
+static bool benchServer(int iterations){
+	//the protocol on its own, then requests over a Unix socket: one at a time for
+	//the round trip, pipelined on one connection, and from many connections at
+	//once, each with its own 'ans'
+	Calculator calc;
+	int mismatches = 0;
+	
+	if (!serverCheck(calc, "{\"id\":1,\"expr\":\"1+2\"}", "{\"id\":1,\"ok\":true,\"result\":\"3\"}")) mismatches++;
+	if (!serverCheck(calc, " { \"expr\" : \"ans*2\" , \"base\" : 2 , \"x\" : [1, {\"y\": \"}\"}] } ",
+		"{\"id\":null,\"ok\":true,\"result\":\"0000000000000000000000000000000000000000000000000000000000000110\"}")) mismatches++;
+	if (!serverCheck(calc, "{\"id\":\"a\\\"b\",\"expr\":\"ans\",\"base\":10}", "{\"id\":\"a\\\"b\",\"ok\":true,\"result\":\"6\"}"))
+		mismatches++;
+	if (!serverCheck(calc, "{\"expr\":\"sin(90)\"}", "{\"id\":null,\"ok\":true,\"result\":\"1\"}")) mismatches++;
+	if (!serverCheck(calc, "{\"trig\":\"radians\",\"type\":\"int64\"}", "{\"id\":null,\"ok\":true}")) mismatches++;
+	if (!serverCheck(calc, "{\"expr\":\"7/2\"}", "{\"id\":null,\"ok\":true,\"result\":\"3\"}")) mismatches++;
+	if (!serverCheck(calc, "{\"id\":[2],\"expr\":\"\\u0031/0\"}",
+		"{\"id\":[2],\"ok\":false,\"error\":\"Division by zero.\",\"start\":3,\"stop\":3}")) mismatches++;
+	if (!serverCheck(calc, "{\"expr\":\"2*(3\"}", "{\"id\":null,\"ok\":false,\"error\":\"Unmatched parens.\",\"start\":2,\"stop\":3}"))
+		mismatches++;
+	if (!serverCheck(calc, "{\"expr\":1}", "{\"id\":null,\"ok\":false,\"error\":\"\\\"expr\\\" must be a string.\"}")) mismatches++;
+	if (!serverCheck(calc, "{\"id\":3,\"base\":37}", "{\"id\":3,\"ok\":false,\"error\":\"\\\"base\\\" must be from 2 to 36.\"}"))
+		mismatches++;
+	if (!serverCheck(calc, "{\"id\":4,\"expr\":\"1\"", "{\"id\":4,\"ok\":false,\"error\":\"Malformed request.\"}")) mismatches++;
+	if (!serverCheck(calc, "expr", "{\"id\":null,\"ok\":false,\"error\":\"Malformed request.\"}")) mismatches++;
+	
+	int threads = countProcessors();
+	if (threads < 4) threads = 4;		//more workers than connections that are busy is checked too
+	char path[64];
+	sprintf(path, "/tmp/gigo-bench-%d.sock", (int)getpid());
+	
+	CalcServer *server = new CalcServer(threads, 0, CALC_TYPE_DOUBLE);
+	if (!server->listen(path)){
+		printf("  Unable to listen on %s\n", path);
+		delete server;
+		return false;
+	}
+	
+	pthread_t thread;
+	pthread_create(&thread, NULL, serverThread, server);
+	printf("  %d worker threads, %d processors\n", threads, countProcessors());
+	
+	int capacity = SERVER_PIPELINE * 64;
+	char *buffer = new char[capacity];
+	char request[SERVER_PIPELINE * 48];
+	
+	//one request at a time, so each is the whole round trip
+	int fd = serverConnect(path);
+	int count = (iterations / 10 > 1000) ? iterations / 10 : 1000;
+	long long *latencies = new long long[count];
+	static const char simple[] = "{\"id\":1,\"expr\":\"12345*678 + 91011/12\"}\n";
+	static const char reply[] = "{\"id\":1,\"ok\":true,\"result\":\"8377494.25\"}\n";
+	
+	for (int i = 0; i < count / 10; i++){
+		serverSend(fd, simple, sizeof(simple) - 1);
+		serverReplies(fd, buffer, capacity, 1);
+	}
+	
+	long long start = nanoseconds(), last = start;
+	for (int i = 0; i < count; i++){
+		if (!serverSend(fd, simple, sizeof(simple) - 1)) mismatches++;
+		int length = serverReplies(fd, buffer, capacity, 1);
+		if ((length != (int)sizeof(reply) - 1) || memcmp(buffer, reply, length)) mismatches++;
+		
+		long long now = nanoseconds();
+		latencies[i] = now - last;
+		last = now;
+	}
+	qsort(latencies, count, sizeof(long long), compareLatencies);
+	
+	BenchResult result = { 0, 0, -1, -1, -1, -1, -1, NULL };
+	result.nsPerCall = (double)(last - start) / count;
+	result.perSecond = (last > start) ? count * 1000000000.0 / (last - start) : 0;
+	result.p50 = latencies[count / 2];
+	result.p99 = latencies[(int)((long long)count * 99 / 100)];
+	result.p999 = latencies[(int)((long long)count * 999 / 1000)];
+	printf("  %-32s %12.0f ns p50 %9.0f ns p99 %9.0f ns p99.9\n", "round trip", result.p50, result.p99, result.p999);
+	writeJson("round trip", count, result);
+	delete [] latencies;
+	
+	//a batch of requests written at once, every answer in order
+	int requestLength = 0;
+	for (int i = 0; i < SERVER_PIPELINE; i++)
+		requestLength += sprintf(request + requestLength, "{\"id\":%d,\"expr\":\"%d*3\"}\n", i, i);
+	
+	int rounds = count / SERVER_PIPELINE;
+	if (rounds < 4) rounds = 4;
+	bigtime_t begin = system_time();
+	for (int r = 0; r < rounds; r++){
+		serverSend(fd, request, requestLength);
+		int length = serverReplies(fd, buffer, capacity, SERVER_PIPELINE);
+		
+		if (r > 0) continue;
+		char expected[64];
+		for (int i = 0, pos = 0; i < SERVER_PIPELINE; i++){
+			int size = sprintf(expected, "{\"id\":%d,\"ok\":true,\"result\":\"%d\"}\n", i, i * 3);
+			if ((pos + size > length) || memcmp(buffer + pos, expected, size)) mismatches++;
+			pos += size;
+		}
+	}
+	report("pipelined, one connection", rounds * SERVER_PIPELINE, system_time() - begin);
+	close(fd);
+	
+	//a last request without a newline from a client that has shut its side, with an
+	//answer bigger than the socket holds, still comes back whole before the close
+	static const char large[] = "{\"id\":9,\"expr\":\"2^2000000\",\"type\":\"bigint\",\"base\":2}";
+	static const char largeReply[] = "{\"id\":9,\"ok\":true,\"result\":\"1";
+	int largeLength = sizeof(largeReply) - 1 + 2000000 + 3, largeGot = 0, got;
+	char *largeBuffer = new char[largeLength + 1];
+	
+	fd = serverConnect(path);
+	serverSend(fd, large, sizeof(large) - 1);
+	shutdown(fd, SHUT_WR);
+	usleep(20000);
+	while ((largeGot <= largeLength) && ((got = read(fd, largeBuffer + largeGot, largeLength + 1 - largeGot)) > 0))
+		largeGot += got;
+	if ((largeGot != largeLength) || memcmp(largeBuffer, largeReply, sizeof(largeReply) - 1)
+		|| memcmp(largeBuffer + largeLength - 3, "\"}\n", 3)){
+		printf("  %d of %d characters of a large last answer\n", largeGot, largeLength);
+		mismatches++;
+	}
+	delete [] largeBuffer;
+	close(fd);
+	
+	//many connections at once, the same requests on each but a different 'ans'
+	int clients[SERVER_CLIENTS];
+	for (int c = 0; c < SERVER_CLIENTS; c++){
+		clients[c] = serverConnect(path);
+		if (clients[c] < 0) mismatches++;
+	}
+	
+	rounds = (count / SERVER_CLIENTS > 4) ? count / SERVER_CLIENTS : 4;
+	begin = system_time();
+	for (int r = 0; r < rounds; r++){
+		for (int c = 0; c < SERVER_CLIENTS; c++){
+			int length = sprintf(request, "{\"expr\":\"%d\"}\n{\"expr\":\"ans*2\"}\n", c + r);
+			serverSend(clients[c], request, length);
+		}
+		
+		for (int c = 0; c < SERVER_CLIENTS; c++){
+			char expected[128];
+			int size = sprintf(expected, "{\"id\":null,\"ok\":true,\"result\":\"%d\"}\n{\"id\":null,\"ok\":true,\"result\":\"%d\"}\n",
+				c + r, 2 * (c + r));
+			int length = serverReplies(clients[c], buffer, capacity, 2);
+			if ((length != size) || memcmp(buffer, expected, size)) mismatches++;
+		}
+	}
+	char name[48];
+	sprintf(name, "%d connections", SERVER_CLIENTS);
+	report(name, 2 * rounds * SERVER_CLIENTS, system_time() - begin);
+	
+	for (int c = 0; c < SERVER_CLIENTS; c++)
+		close(clients[c]);
+	
+	server->stop();
+	pthread_join(thread, NULL);
+	delete server;
+	delete [] buffer;
+	
+	//the socket is gone with the server
+	if (access(path, F_OK) == 0) mismatches++;
+	
+	printf("  %d mismatches\n", mismatches);
+	return (mismatches == 0);
+}
+
+static BenchSuite sSuites[] = {
+	{ "engine", benchEngine },
+	{ "growth", benchGrowth },
+	{ "vm", benchCompiled },
+	{ "optimize", benchOptimize },
+	{ "columns", benchColumns },
+	{ "scaling", benchScaling },
+	{ "numeric", benchNumeric },
+	{ "bigint", benchBigInt },
+	{ "radix", benchRadix },
+	{ "decimal", benchDecimal },
+	{ "scan", benchScan },
+	{ "threads", benchThreads },
+	{ "cache", benchCache },
+	{ "history", benchHistory },
+	{ "symbols", benchSymbols },
+	{ "worksheet", benchWorksheet },
+	{ "server", benchServer },
+	{ "allocations", benchAllocations },
+	{ NULL, NULL }
+};
+
+
+
+//*******************************************************************
+
+int runBenchmark(int argc, char **argv){
+	int iterations = BENCH_DEFAULT_ITERATIONS;
+	bool any = false, ran = false, passed = true;
+	const char *jsonPath = NULL;
+	
+	for (int i = 0; i < argc; i++){
+		if (!strcmp(argv[i], "-n") && (i + 1 < argc)) iterations = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-j") && (i + 1 < argc)) jsonPath = argv[++i];
+		else if (!strcmp(argv[i], "-b") && (i + 1 < argc)) sGrowthBound = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-p")) sUseCounters = true;
+		else any = true;
+	}
+	
+	if (jsonPath != NULL){
+		sJson = fopen(jsonPath, "w");
+		if (sJson == NULL){
+			printf("Unable to open %s\n", jsonPath);
+			return 1;
+		}
+		fprintf(sJson, "{\n  \"iterations\": %d,\n  \"results\": [", iterations);
+	}
+	
+	for (int s = 0; sSuites[s].name != NULL; s++){
+		bool wanted = !any;
+		for (int i = 0; i < argc; i++)
+			if (!strcmp(argv[i], sSuites[s].name)) wanted = true;
+			
+		if (wanted){
+			sSuiteName = sSuites[s].name;
+			if (!sSuites[s].run(iterations)) passed = false;
+			ran = true;
+		}
+	}
+	
+	if (sJson != NULL){
+		fprintf(sJson, "\n  ],\n  \"passed\": %s\n}\n", passed ? "true" : "false");
+		fclose(sJson);
+		sJson = NULL;
+	}
+	
+	if (!ran){
+		printf("Unknown benchmark suite. Available:");
+		for (int s = 0; sSuites[s].name != NULL; s++)
+			printf(" %s", sSuites[s].name);
+		printf("\n");
+		return 1;
+	}
+	
+	return passed ? 0 : 1;
+}
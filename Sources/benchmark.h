@@ -0,0 +1,12 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+//Engine benchmarks, run from the command line with 'GIGOcalc --bench [suite ...] [-n iterations] [-j results.json] [-b bound] [-p]'.
+//With no suite named every suite is run. -j also writes the measurements to a JSON file, to
+//compare runs across commits, and -b sets the exponent the growth suite fails above. -p reads
+//the processor's counters (cycles, instructions, misses) around the engine suite's measurements,
+//where the system lets it.
+//Non-zero if a suite was unknown or one of its checks failed.
+int runBenchmark(int argc, char **argv);
+
+#endif
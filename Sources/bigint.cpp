@@ -0,0 +1,1103 @@
+#include "bigint.h"
+#include "radix.h"
+
+//*******************************************************************
+//Limb arrays. Everything here works on bare magnitudes, least
+//significant limb first, lengths in limbs.
+//*******************************************************************
+
+static int trimmedLength(const bigint_limb *a, int n){
+	while ((n > 0) && (a[n - 1] == 0)) n--;
+	return n;
+}
+
+static int leadingZeros(bigint_limb x){
+	int count = 0;
+
+	if (x == 0) return 32;
+	while (!(x & 0x80000000u)){
+		x <<= 1;
+		count++;
+	}
+	return count;
+}
+
+static int compareLimbs(const bigint_limb *a, int an, const bigint_limb *b, int bn){
+	if (an != bn) return (an < bn) ? -1 : 1;
+
+	for (int i = an - 1; i >= 0; i--)
+		if (a[i] != b[i]) return (a[i] < b[i]) ? -1 : 1;
+
+	return 0;
+}
+
+//r = a + b for an >= bn, r holds an limbs and may be a or b. Returns the carry out.
+static bigint_limb addLimbs(bigint_limb *r, const bigint_limb *a, int an, const bigint_limb *b, int bn){
+	bigint_wide carry = 0;
+	int i;
+
+	for (i = 0; i < bn; i++){
+		carry += (bigint_wide)a[i] + b[i];
+		r[i] = (bigint_limb)carry;
+		carry >>= 32;
+	}
+	for (; i < an; i++){
+		carry += a[i];
+		r[i] = (bigint_limb)carry;
+		carry >>= 32;
+	}
+
+	return (bigint_limb)carry;
+}
+
+//r = a - b for a >= b and an >= bn, r holds an limbs and may be a or b
+static void subtractLimbs(bigint_limb *r, const bigint_limb *a, int an, const bigint_limb *b, int bn){
+	bigint_wide borrow = 0, difference;
+	int i;
+
+	for (i = 0; i < bn; i++){
+		difference = (bigint_wide)a[i] - b[i] - borrow;
+		r[i] = (bigint_limb)difference;
+		borrow = (difference >> 32) & 1;
+	}
+	for (; i < an; i++){
+		difference = (bigint_wide)a[i] - borrow;
+		r[i] = (bigint_limb)difference;
+		borrow = (difference >> 32) & 1;
+	}
+}
+
+//q = a / d, returns the remainder. q may be a.
+static bigint_limb divideSmall(bigint_limb *q, const bigint_limb *a, int n, bigint_limb d){
+	bigint_wide remainder = 0;
+
+	for (int i = n - 1; i >= 0; i--){
+		bigint_wide current = (remainder << 32) | a[i];
+		q[i] = (bigint_limb)(current / d);
+		remainder = current % d;
+	}
+
+	return (bigint_limb)remainder;
+}
+
+//r = a * b, r holds an + bn limbs and is neither a nor b
+static void multiplySchoolbook(bigint_limb *r, const bigint_limb *a, int an, const bigint_limb *b, int bn){
+	memset(r, 0, (an + bn) * sizeof(bigint_limb));
+
+	for (int i = 0; i < bn; i++){
+		bigint_wide carry = 0, digit = b[i];
+		if (digit == 0) continue;
+
+		for (int j = 0; j < an; j++){
+			carry += a[j] * digit + r[i + j];
+			r[i + j] = (bigint_limb)carry;
+			carry >>= 32;
+		}
+		r[i + an] = (bigint_limb)carry;
+	}
+}
+
+//r = a * b for two n limb numbers, r holds 2n limbs. With a = a1.B + a0 and
+//b = b1.B + b0 the middle term is (a0 + a1)(b0 + b1) - a0.b0 - a1.b1, three
+//half size products instead of four. scratch needs 4n + 512 limbs.
+static void multiplyKaratsuba(bigint_limb *r, const bigint_limb *a, const bigint_limb *b, int n, bigint_limb *scratch){
+	if (n < BIGINT_KARATSUBA_THRESHOLD){
+		multiplySchoolbook(r, a, n, b, n);
+		return;
+	}
+
+	int low = n / 2, high = n - low;
+	bigint_limb *sumA = scratch, *sumB = scratch + high + 1, *middle = scratch + 2 * (high + 1);
+	bigint_limb *next = middle + 2 * (high + 1);
+
+	sumA[high] = addLimbs(sumA, a + low, high, a, low);
+	sumB[high] = addLimbs(sumB, b + low, high, b, low);
+
+	multiplyKaratsuba(r, a, b, low, next);
+	multiplyKaratsuba(r + 2 * low, a + low, b + low, high, next);
+	multiplyKaratsuba(middle, sumA, sumB, high + 1, next);
+
+	subtractLimbs(middle, middle, 2 * (high + 1), r, 2 * low);
+	subtractLimbs(middle, middle, 2 * (high + 1), r + 2 * low, 2 * high);
+
+	addLimbs(r + low, r + low, 2 * n - low, middle, trimmedLength(middle, 2 * (high + 1)));
+}
+
+//r = a * b for an >= bn >= 1, r holds an + bn limbs and is neither a nor b
+static void multiplyLimbs(bigint_limb *r, const bigint_limb *a, int an, const bigint_limb *b, int bn){
+	if (bn < BIGINT_KARATSUBA_THRESHOLD){
+		multiplySchoolbook(r, a, an, b, bn);
+		return;
+	}
+
+	bigint_limb *scratch = new bigint_limb[6 * bn + 512];
+
+	if (an == bn)
+		multiplyKaratsuba(r, a, b, bn, scratch);
+	else{
+		//lopsided, so multiply b by one bn limb slice of a at a time
+		bigint_limb *product = scratch + 4 * bn + 512;
+		memset(r, 0, (an + bn) * sizeof(bigint_limb));
+
+		for (int i = 0; i < an; i += bn){
+			int slice = (an - i < bn) ? an - i : bn;
+
+			if (slice == bn) multiplyKaratsuba(product, a + i, b, bn, scratch);
+			else multiplyLimbs(product, b, bn, a + i, slice);
+
+			addLimbs(r + i, r + i, an + bn - i, product, slice + bn);
+		}
+	}
+
+	delete [] scratch;
+}
+
+static char *writeChunk(char *out, bigint_limb chunk, bool pad){
+	//one base 10^9 limb, all nine digits when padded
+	char digits[9];
+	int count = 0;
+
+	do{
+		digits[count++] = '0' + chunk % 10;
+		chunk /= 10;
+	}while (chunk != 0);
+
+	if (pad)
+		while (count < 9) digits[count++] = '0';
+
+	while (count > 0) *out++ = digits[--count];
+	return out;
+}
+
+
+
+//*******************************************************************
+//Storage
+//*******************************************************************
+
+BigInt::BigInt(){
+	_limbs = _inline;
+	_length = 0;
+	_capacity = BIGINT_INLINE_LIMBS;
+	_negative = false;
+}
+
+BigInt::BigInt(long long value){
+	_limbs = _inline;
+	_length = 0;
+	_capacity = BIGINT_INLINE_LIMBS;
+	setTo(value);
+}
+
+BigInt::BigInt(const BigInt &other){
+	_limbs = _inline;
+	_length = 0;
+	_capacity = BIGINT_INLINE_LIMBS;
+	_negative = false;
+	*this = other;
+}
+
+BigInt::~BigInt(){
+	if (_limbs != _inline) delete [] _limbs;
+}
+
+BigInt &BigInt::operator=(const BigInt &other){
+	if (this != &other){
+		reserve(other._length);
+		if (other._length > 0) memcpy(_limbs, other._limbs, other._length * sizeof(bigint_limb));
+		_length = other._length;
+		_negative = other._negative;
+	}
+	return *this;
+}
+
+void BigInt::swap(BigInt &other){
+	//heap buffers change hands, inline limbs have to be copied across
+	if ((_limbs == _inline) && (other._limbs != other._inline)){
+		other.swap(*this);
+		return;
+	}
+
+	bigint_limb *limbs = _limbs, saved[BIGINT_INLINE_LIMBS];
+	int length = _length, capacity = _capacity;
+	bool negative = _negative;
+	memcpy(saved, _inline, sizeof(saved));
+
+	if (other._limbs == other._inline){
+		memcpy(_inline, other._inline, sizeof(_inline));
+		_limbs = _inline;
+	}
+	else
+		_limbs = other._limbs;
+	_length = other._length;
+	_capacity = other._capacity;
+	_negative = other._negative;
+
+	if (limbs == _inline){
+		memcpy(other._inline, saved, sizeof(saved));
+		other._limbs = other._inline;
+	}
+	else
+		other._limbs = limbs;
+	other._length = length;
+	other._capacity = capacity;
+	other._negative = negative;
+}
+
+void BigInt::reserve(int limbs){
+	//grows the buffer, keeping the value
+	if (limbs <= _capacity) return;
+
+	int capacity = (_capacity * 2 > limbs) ? _capacity * 2 : limbs;
+
+	bigint_limb *grown = new bigint_limb[capacity];
+	if (_length > 0) memcpy(grown, _limbs, _length * sizeof(bigint_limb));
+
+	if (_limbs != _inline) delete [] _limbs;
+	_limbs = grown;
+	_capacity = capacity;
+}
+
+void BigInt::trim(){
+	_length = trimmedLength(_limbs, _length);
+	if (_length == 0) _negative = false;
+}
+
+void BigInt::setTo(long long value){
+	unsigned long long magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+	reserve(2);
+	_limbs[0] = (bigint_limb)magnitude;
+	_limbs[1] = (bigint_limb)(magnitude >> 32);
+	_length = 2;
+	_negative = (value < 0);
+	trim();
+}
+
+void BigInt::setToLimbs(const BigInt &from, int start, int stop){
+	//the magnitude of limbs [start, stop) of from
+	if (stop > from._length) stop = from._length;
+	int count = (stop > start) ? stop - start : 0;
+
+	reserve(count);
+	if (count > 0) memcpy(_limbs, from._limbs + start, count * sizeof(bigint_limb));
+	_length = count;
+	_negative = false;
+	trim();
+}
+
+void BigInt::shiftLimbsUp(int count){
+	if ((_length == 0) || (count <= 0)) return;
+
+	reserve(_length + count);
+	memmove(_limbs + count, _limbs, _length * sizeof(bigint_limb));
+	memset(_limbs, 0, count * sizeof(bigint_limb));
+	_length += count;
+}
+
+bool BigInt::isZero() const{
+	return (_length == 0);
+}
+
+bool BigInt::isNegative() const{
+	return _negative;
+}
+
+int BigInt::length() const{
+	return _length;
+}
+
+int BigInt::bitLength() const{
+	if (_length == 0) return 0;
+	return _length * 32 - leadingZeros(_limbs[_length - 1]);
+}
+
+long long BigInt::lowBits() const{
+	unsigned long long magnitude = 0;
+
+	if (_length > 0) magnitude = _limbs[0];
+	if (_length > 1) magnitude |= (unsigned long long)_limbs[1] << 32;
+
+	return (long long)(_negative ? 0ULL - magnitude : magnitude);
+}
+
+int BigInt::compare(const BigInt &other) const{
+	if (_negative != other._negative) return _negative ? -1 : 1;
+
+	int result = compareMagnitude(*this, other);
+	return _negative ? -result : result;
+}
+
+int BigInt::compareMagnitude(const BigInt &a, const BigInt &b){
+	return compareLimbs(a._limbs, a._length, b._limbs, b._length);
+}
+
+
+
+//*******************************************************************
+//Arithmetic
+//*******************************************************************
+
+void BigInt::addMagnitude(BigInt &result, const BigInt &a, const BigInt &b){
+	//|a| + |b|, positive. The limbs are read after the reserve as result may be a or b.
+	const BigInt &longer = (a._length >= b._length) ? a : b;
+	const BigInt &shorter = (a._length >= b._length) ? b : a;
+	int n = longer._length;
+
+	result.reserve(n + 1);
+	result._limbs[n] = addLimbs(result._limbs, longer._limbs, n, shorter._limbs, shorter._length);
+	result._length = n + 1;
+	result._negative = false;
+	result.trim();
+}
+
+void BigInt::subtractMagnitude(BigInt &result, const BigInt &a, const BigInt &b){
+	//|a| - |b| for |a| >= |b|, positive
+	int n = a._length;
+
+	result.reserve(n);
+	subtractLimbs(result._limbs, a._limbs, n, b._limbs, b._length);
+	result._length = n;
+	result._negative = false;
+	result.trim();
+}
+
+void BigInt::add(BigInt &result, const BigInt &a, const BigInt &b){
+	bool negative;
+
+	if (a._negative == b._negative){
+		negative = a._negative;
+		addMagnitude(result, a, b);
+	}
+	else if (compareMagnitude(a, b) >= 0){
+		negative = a._negative;
+		subtractMagnitude(result, a, b);
+	}
+	else{
+		negative = b._negative;
+		subtractMagnitude(result, b, a);
+	}
+
+	result._negative = negative;
+	result.trim();
+}
+
+void BigInt::subtract(BigInt &result, const BigInt &a, const BigInt &b){
+	bool negative, bNegative = !b._negative;
+
+	if (a._negative == bNegative){
+		negative = a._negative;
+		addMagnitude(result, a, b);
+	}
+	else if (compareMagnitude(a, b) >= 0){
+		negative = a._negative;
+		subtractMagnitude(result, a, b);
+	}
+	else{
+		negative = bNegative;
+		subtractMagnitude(result, b, a);
+	}
+
+	result._negative = negative;
+	result.trim();
+}
+
+void BigInt::negate(BigInt &result, const BigInt &a){
+	result = a;
+	result._negative = !a._negative;
+	result.trim();
+}
+
+bool BigInt::multiply(BigInt &result, const BigInt &a, const BigInt &b){
+	if ((a._length == 0) || (b._length == 0)){
+		result.setTo(0);
+		return true;
+	}
+
+	if ((long long)a.bitLength() + b.bitLength() > BIGINT_MAX_BITS + 1) return false;
+
+	if ((&result == &a) || (&result == &b)){
+		BigInt product;
+		multiply(product, a, b);
+		result.swap(product);
+		return true;
+	}
+
+	result.reserve(a._length + b._length);
+	if (a._length >= b._length) multiplyLimbs(result._limbs, a._limbs, a._length, b._limbs, b._length);
+	else multiplyLimbs(result._limbs, b._limbs, b._length, a._limbs, a._length);
+
+	result._length = a._length + b._length;
+	result._negative = (a._negative != b._negative);
+	result.trim();
+	return true;
+}
+
+bool BigInt::power(BigInt &result, const BigInt &base, const BigInt &exponent){
+	bool unit = (base._length == 1) && (base._limbs[0] == 1);
+	bool odd = (exponent._length > 0) && (exponent._limbs[0] & 1);
+
+	//only 0, 1 and -1 keep their size, and negative exponents truncate to 0 unless the base is 1 or -1
+	if (unit){
+		result.setTo((base._negative && odd) ? -1 : 1);
+		return true;
+	}
+	if (exponent._negative){
+		result.setTo(0);
+		return true;
+	}
+	if (exponent._length == 0){
+		result.setTo(1);
+		return true;
+	}
+	if (base._length == 0){
+		result.setTo(0);
+		return true;
+	}
+
+	if ((exponent._length > 1) || ((double)(base.bitLength() - 1) * exponent._limbs[0] > BIGINT_MAX_BITS))
+		return false;
+
+	//left to right binary exponentiation
+	bigint_limb e = exponent._limbs[0];
+	BigInt x(base), accumulator(1), temp;
+
+	for (int bit = 31 - leadingZeros(e); bit >= 0; bit--){
+		if (!multiply(temp, accumulator, accumulator)) return false;
+		accumulator.swap(temp);
+
+		if ((e >> bit) & 1){
+			if (!multiply(temp, accumulator, x)) return false;
+			accumulator.swap(temp);
+		}
+	}
+
+	result.swap(accumulator);
+	return true;
+}
+
+bool BigInt::divide(BigInt *quotient, BigInt *remainder, const BigInt &a, const BigInt &b){
+	if (b._length == 0) return false;
+
+	bool quotientNegative = (a._negative != b._negative), remainderNegative = a._negative;
+	BigInt localQuotient, localRemainder;
+	BigInt *q = ((quotient != NULL) && (quotient != &a) && (quotient != &b)) ? quotient : &localQuotient;
+	BigInt *r = ((remainder != NULL) && (remainder != &a) && (remainder != &b)) ? remainder : &localRemainder;
+
+	divideMagnitude(*q, *r, a, b);
+
+	q->_negative = quotientNegative;
+	q->trim();
+	r->_negative = remainderNegative;
+	r->trim();
+
+	if ((quotient != NULL) && (q != quotient)) quotient->swap(*q);
+	if ((remainder != NULL) && (r != remainder)) remainder->swap(*r);
+
+	return true;
+}
+
+void BigInt::divideMagnitude(BigInt &quotient, BigInt &remainder, const BigInt &a, const BigInt &b){
+	//|a| / |b| into two distinct objects that are neither a nor b, both positive
+	if (compareMagnitude(a, b) < 0){
+		remainder = a;
+		remainder._negative = false;
+		quotient.setTo(0);
+		return;
+	}
+
+	if ((b._length < BIGINT_BURNIKEL_THRESHOLD) || (a._length - b._length < BIGINT_BURNIKEL_THRESHOLD)){
+		divideKnuth(quotient, remainder, a, b);
+		return;
+	}
+
+	//Burnikel-Ziegler. The divisor is padded to n = j.2^k limbs with j below the
+	//threshold and its top bit set, so it halves cleanly all the way down; the
+	//dividend is then taken n limbs at a time, two blocks per 2n/n division.
+	int s = b._length, m = 1;
+	while (m * BIGINT_BURNIKEL_THRESHOLD <= s) m *= 2;
+	int n = ((s + m - 1) / m) * m;
+	int sigma = n * 32 - b.bitLength();
+
+	BigInt divisor, dividend, z, block, q;
+	if (!shiftLeft(dividend, a, sigma)){
+		divideKnuth(quotient, remainder, a, b);
+		return;
+	}
+	shiftLeft(divisor, b, sigma);
+	divisor._negative = dividend._negative = false;
+
+	//enough blocks that the top one is below the divisor
+	int blocks = (dividend.bitLength() + n * 32) / (n * 32);
+	if (blocks < 2) blocks = 2;
+
+	z.setToLimbs(dividend, (blocks - 2) * n, dividend._length);
+	quotient.setTo(0);
+
+	for (int i = blocks - 2; ; i--){
+		divide2n1n(q, remainder, z, divisor, n);
+		quotient.shiftLimbsUp(n);
+		add(quotient, quotient, q);
+
+		if (i == 0) break;
+
+		block.setToLimbs(dividend, (i - 1) * n, i * n);
+		remainder.shiftLimbsUp(n);
+		add(z, remainder, block);
+	}
+
+	shiftRight(remainder, remainder, sigma);
+}
+
+void BigInt::divide2n1n(BigInt &quotient, BigInt &remainder, const BigInt &a, const BigInt &b, int n){
+	//a < b.B^n with b exactly n limbs and its top bit set
+	if ((n & 1) || (n < BIGINT_BURNIKEL_THRESHOLD)){
+		divideKnuth(quotient, remainder, a, b);
+		return;
+	}
+
+	int half = n / 2;
+	BigInt top, low, q1, r1;
+
+	top.setToLimbs(a, half, a._length);
+	divide3n2n(q1, r1, top, b, half);
+
+	low.setToLimbs(a, 0, half);
+	r1.shiftLimbsUp(half);
+	add(r1, r1, low);
+	divide3n2n(quotient, remainder, r1, b, half);
+
+	q1.shiftLimbsUp(half);
+	add(quotient, quotient, q1);
+}
+
+void BigInt::divide3n2n(BigInt &quotient, BigInt &remainder, const BigInt &a, const BigInt &b, int half){
+	//a is three half limb blocks [a1 a2 a3] and b two [b1 b2], with a < b.B^half.
+	//Estimate the quotient from [a1 a2] / b1, then correct it by at most two.
+	BigInt a12, a1, a3, b1, b2, r1, d;
+
+	a12.setToLimbs(a, half, a._length);
+	a1.setToLimbs(a, 2 * half, a._length);
+	a3.setToLimbs(a, 0, half);
+	b1.setToLimbs(b, half, b._length);
+	b2.setToLimbs(b, 0, half);
+
+	if (compareMagnitude(a1, b1) < 0)
+		divide2n1n(quotient, r1, a12, b1, half);
+	else{
+		//the quotient is B^half - 1, and [a1 a2] - (B^half - 1).b1 = [a1 a2] - b1.B^half + b1
+		quotient.reserve(half);
+		memset(quotient._limbs, 0xff, half * sizeof(bigint_limb));
+		quotient._length = half;
+		quotient._negative = false;
+
+		BigInt shifted(b1);
+		shifted.shiftLimbsUp(half);
+		subtract(r1, a12, shifted);
+		add(r1, r1, b1);
+	}
+
+	multiply(d, quotient, b2);
+	r1.shiftLimbsUp(half);
+	add(remainder, r1, a3);
+	subtract(remainder, remainder, d);
+
+	BigInt one(1);
+	while (remainder._negative){
+		subtract(quotient, quotient, one);
+		add(remainder, remainder, b);
+	}
+}
+
+void BigInt::divideKnuth(BigInt &quotient, BigInt &remainder, const BigInt &a, const BigInt &b){
+	//Knuth's algorithm D, quadratic but with nothing to set up
+	int an = a._length, bn = b._length;
+
+	if (compareMagnitude(a, b) < 0){
+		remainder = a;
+		remainder._negative = false;
+		quotient.setTo(0);
+		return;
+	}
+
+	quotient.reserve(an - bn + 1);
+	remainder.reserve(bn);
+	quotient._negative = remainder._negative = false;
+
+	if (bn == 1){
+		remainder._limbs[0] = divideSmall(quotient._limbs, a._limbs, an, b._limbs[0]);
+		quotient._length = an;
+		remainder._length = 1;
+		quotient.trim();
+		remainder.trim();
+		return;
+	}
+
+	//normalize so the divisor's top bit is set, which keeps each quotient estimate within two
+	int s = leadingZeros(b._limbs[bn - 1]);
+	bigint_limb *work = new bigint_limb[an + 1 + bn];
+	bigint_limb *un = work, *vn = work + an + 1, *q = quotient._limbs;
+	const bigint_limb *u = a._limbs, *v = b._limbs;
+	const bigint_wide base = (bigint_wide)1 << 32;
+
+	for (int i = bn - 1; i > 0; i--)
+		vn[i] = (v[i] << s) | (s ? v[i - 1] >> (32 - s) : 0);
+	vn[0] = v[0] << s;
+
+	un[an] = s ? u[an - 1] >> (32 - s) : 0;
+	for (int i = an - 1; i > 0; i--)
+		un[i] = (u[i] << s) | (s ? u[i - 1] >> (32 - s) : 0);
+	un[0] = u[0] << s;
+
+	for (int j = an - bn; j >= 0; j--){
+		bigint_wide numerator = ((bigint_wide)un[j + bn] << 32) | un[j + bn - 1];
+		bigint_wide qhat = numerator / vn[bn - 1];
+		bigint_wide rhat = numerator % vn[bn - 1];
+
+		while ((qhat >= base) || (qhat * vn[bn - 2] > ((rhat << 32) | un[j + bn - 2]))){
+			qhat--;
+			rhat += vn[bn - 1];
+			if (rhat >= base) break;
+		}
+
+		//multiply and subtract
+		long long t, k = 0;
+		for (int i = 0; i < bn; i++){
+			bigint_wide p = qhat * vn[i];
+			t = (long long)un[i + j] - k - (long long)(p & 0xffffffffULL);
+			un[i + j] = (bigint_limb)t;
+			k = (long long)(p >> 32) - (t >> 32);
+		}
+		t = (long long)un[j + bn] - k;
+		un[j + bn] = (bigint_limb)t;
+		q[j] = (bigint_limb)qhat;
+
+		//the estimate was one too big, add the divisor back
+		if (t < 0){
+			bigint_wide carry = 0;
+			q[j]--;
+			for (int i = 0; i < bn; i++){
+				carry += (bigint_wide)un[i + j] + vn[i];
+				un[i + j] = (bigint_limb)carry;
+				carry >>= 32;
+			}
+			un[j + bn] += (bigint_limb)carry;
+		}
+	}
+
+	for (int i = 0; i < bn - 1; i++)
+		remainder._limbs[i] = (un[i] >> s) | (s ? un[i + 1] << (32 - s) : 0);
+	remainder._limbs[bn - 1] = un[bn - 1] >> s;
+
+	delete [] work;
+
+	quotient._length = an - bn + 1;
+	remainder._length = bn;
+	quotient.trim();
+	remainder.trim();
+}
+
+
+
+//*******************************************************************
+//Bits
+//*******************************************************************
+
+bool BigInt::shiftLeft(BigInt &result, const BigInt &a, long long bits){
+	//bits >= 0
+	if (a._length == 0){
+		result.setTo(0);
+		return true;
+	}
+	if (a.bitLength() + bits > BIGINT_MAX_BITS) return false;
+
+	int limbShift = (int)(bits / 32), bitShift = (int)(bits % 32), n = a._length;
+	bool negative = a._negative;
+
+	//top down, so result may be a
+	result.reserve(n + limbShift + 1);
+	const bigint_limb *source = a._limbs;
+	bigint_limb *destination = result._limbs;
+
+	destination[n + limbShift] = bitShift ? source[n - 1] >> (32 - bitShift) : 0;
+	for (int i = n - 1; i > 0; i--)
+		destination[i + limbShift] = (source[i] << bitShift) | (bitShift ? source[i - 1] >> (32 - bitShift) : 0);
+	destination[limbShift] = source[0] << bitShift;
+	memset(destination, 0, limbShift * sizeof(bigint_limb));
+
+	result._length = n + limbShift + 1;
+	result._negative = negative;
+	result.trim();
+	return true;
+}
+
+void BigInt::shiftRight(BigInt &result, const BigInt &a, long long bits){
+	//bits >= 0. Negative values round toward minus infinity: -((|a| - 1) >> bits) - 1
+	if (a._negative){
+		BigInt one(1);
+		add(result, a, one);
+		result._negative = false;
+		shiftRight(result, result, bits);
+		add(result, result, one);
+		result._negative = true;
+		return;
+	}
+
+	int n = a._length;
+	if (bits >= (long long)n * 32){
+		result.setTo(0);
+		return;
+	}
+
+	int limbShift = (int)(bits / 32), bitShift = (int)(bits % 32), count = n - limbShift;
+
+	//bottom up, so result may be a
+	result.reserve(n);
+	const bigint_limb *source = a._limbs;
+	bigint_limb *destination = result._limbs;
+
+	for (int i = 0; i < count; i++){
+		bigint_limb next = (bitShift && (i + limbShift + 1 < n)) ? source[i + limbShift + 1] << (32 - bitShift) : 0;
+		destination[i] = (source[i + limbShift] >> bitShift) | next;
+	}
+
+	result._length = count;
+	result._negative = false;
+	result.trim();
+}
+
+void BigInt::bitwise(BigInt &result, const BigInt &a, const BigInt &b, bool isAnd){
+	//in two's complement, one limb wider than either operand so the sign survives
+	int n = ((a._length > b._length) ? a._length : b._length) + 1;
+	bigint_limb local[4 * BIGINT_INLINE_LIMBS];
+	bigint_limb *x = (2 * n <= 4 * BIGINT_INLINE_LIMBS) ? local : new bigint_limb[2 * n], *y = x + n;
+	const BigInt *operands[2] = { &a, &b };
+	bigint_limb *words[2] = { x, y };
+
+	for (int k = 0; k < 2; k++){
+		const BigInt &value = *operands[k];
+		bigint_limb *w = words[k];
+
+		memset(w, 0, n * sizeof(bigint_limb));
+		if (value._length > 0) memcpy(w, value._limbs, value._length * sizeof(bigint_limb));
+
+		if (value._negative){
+			bigint_wide carry = 1;
+			for (int i = 0; i < n; i++){
+				carry += (bigint_limb)~w[i];
+				w[i] = (bigint_limb)carry;
+				carry >>= 32;
+			}
+		}
+	}
+
+	for (int i = 0; i < n; i++)
+		x[i] = isAnd ? (x[i] & y[i]) : (x[i] | y[i]);
+
+	bool negative = (x[n - 1] >> 31) != 0;
+	if (negative){
+		bigint_wide carry = 1;
+		for (int i = 0; i < n; i++){
+			carry += (bigint_limb)~x[i];
+			x[i] = (bigint_limb)carry;
+			carry >>= 32;
+		}
+	}
+
+	result.reserve(n);
+	memcpy(result._limbs, x, n * sizeof(bigint_limb));
+	result._length = n;
+	result._negative = negative;
+	result.trim();
+
+	if (x != local) delete [] x;
+}
+
+void BigInt::bitwiseAnd(BigInt &result, const BigInt &a, const BigInt &b){
+	bitwise(result, a, b, true);
+}
+
+void BigInt::bitwiseOr(BigInt &result, const BigInt &a, const BigInt &b){
+	bitwise(result, a, b, false);
+}
+
+
+
+//*******************************************************************
+//Text. Decimal goes both ways by halving: the number is split around
+//10^(9.2^k), from a table built by repeated squaring, and each half done
+//on its own, so conversion costs about as much as a multiplication or
+//division of the full size rather than growing with the square.
+//*******************************************************************
+
+bool BigInt::parse(const char *text){
+	const char *p = text;
+	bool negative = false;
+
+	if ((*p == '-') || (*p == '+')) negative = (*p++ == '-');
+
+	if ((p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X'))){
+		const char *first = p + 2;
+		int count = 0;
+
+		for (p = first; ; p++, count++)
+			if (!(((*p >= '0') && (*p <= '9')) || ((*p >= 'a') && (*p <= 'f')) || ((*p >= 'A') && (*p <= 'F')))) break;
+
+		if ((double)count * 4 > BIGINT_MAX_BITS) return false;
+
+		int limbs = (count + 7) / 8;
+		reserve(limbs);
+		memset(_limbs, 0, limbs * sizeof(bigint_limb));
+
+		for (int i = 0; i < count; i++){
+			char c = first[count - 1 - i];
+			int digit = (c <= '9') ? c - '0' : ((c | 0x20) - 'a' + 10);
+			_limbs[i / 8] |= (bigint_limb)digit << ((i % 8) * 4);
+		}
+
+		_length = limbs;
+		_negative = negative;
+		trim();
+		return true;
+	}
+
+	//decimal with an optional fraction and exponent, truncated toward zero
+	const char *mantissa = p;
+	int wholeDigits = 0, fractionDigits = 0;
+	while ((*p >= '0') && (*p <= '9')) { p++; wholeDigits++; }
+	if (*p == '.'){
+		p++;
+		while ((*p >= '0') && (*p <= '9')) { p++; fractionDigits++; }
+	}
+
+	long long exponent = 0;
+	if (((*p == 'e') || (*p == 'E')) && ((p[1] == '-') || (p[1] == '+') || ((p[1] >= '0') && (p[1] <= '9')))){
+		bool negativeExponent = false;
+		p++;
+		if ((*p == '-') || (*p == '+')) negativeExponent = (*p++ == '-');
+		while ((*p >= '0') && (*p <= '9') && (exponent < 1000000000))
+			exponent = exponent * 10 + (*p++ - '0');
+		if (negativeExponent) exponent = -exponent;
+	}
+
+	long long point = wholeDigits + exponent, kept = point, zeros = 0;
+	if (kept < 0) kept = 0;
+	if (kept > wholeDigits + fractionDigits){
+		zeros = kept - (wholeDigits + fractionDigits);
+		kept = wholeDigits + fractionDigits;
+	}
+
+	if ((double)(kept + zeros) * 3.3219280948873623 > BIGINT_MAX_BITS) return false;
+
+	//the digits that survive, without the point
+	const char *digits = mantissa;
+	char *joined = NULL;
+	if (kept > wholeDigits){
+		joined = new char[kept];
+		memcpy(joined, mantissa, wholeDigits);
+		memcpy(joined + wholeDigits, mantissa + wholeDigits + 1, kept - wholeDigits);
+		digits = joined;
+	}
+
+	BigInt powers[32];
+	int powerCount = 0;
+	parseDecimal(digits, (int)kept, powers, powerCount);
+	delete [] joined;
+
+	if (zeros > 0){
+		BigInt ten(10), count(zeros), scale;
+		if (!power(scale, ten, count) || !multiply(*this, *this, scale)) return false;
+	}
+
+	_negative = negative;
+	trim();
+	return true;
+}
+
+void BigInt::parseDecimal(const char *digits, int count, BigInt *powers, int &powerCount){
+	_negative = false;
+
+	if (count <= 9 * BIGINT_CONVERSION_LIMBS){
+		//nine digits at a time, the first group short so the rest line up
+		reserve(count / 9 + 2);
+		_length = 0;
+
+		for (int i = 0; i < count; ){
+			int take = (i == 0) ? ((count - 1) % 9) + 1 : 9;
+			bigint_limb chunk = 0, scale = 1;
+
+			for (int t = 0; t < take; t++){
+				chunk = chunk * 10 + (digits[i + t] - '0');
+				scale *= 10;
+			}
+			i += take;
+
+			bigint_wide carry = chunk;
+			for (int j = 0; j < _length; j++){
+				carry += (bigint_wide)_limbs[j] * scale;
+				_limbs[j] = (bigint_limb)carry;
+				carry >>= 32;
+			}
+			if (carry) _limbs[_length++] = (bigint_limb)carry;
+		}
+
+		trim();
+		return;
+	}
+
+	//the low 9.2^k digits and whatever is left above them
+	int k = 0;
+	while ((9 << (k + 1)) < count) k++;
+	int lowCount = 9 << k;
+
+	for (; powerCount <= k; powerCount++){
+		if (powerCount == 0) powers[0].setTo(1000000000);
+		else multiply(powers[powerCount], powers[powerCount - 1], powers[powerCount - 1]);
+	}
+
+	BigInt high, low;
+	high.parseDecimal(digits, count - lowCount, powers, powerCount);
+	low.parseDecimal(digits + count - lowCount, lowCount, powers, powerCount);
+
+	multiply(*this, high, powers[k]);
+	add(*this, *this, low);
+}
+
+void BigInt::writeDecimal(char *&out, int level, bool pad, BigInt *powers) const{
+	//writes the magnitude, which is below 10^(9.2^(level + 1)). Padded, that is
+	//exactly 9.2^(level + 1) digits.
+	if ((level < 0) || (_length <= BIGINT_CONVERSION_LIMBS)){
+		//up to BIGINT_CONVERSION_LIMBS, which is the most this is ever called with, fits on the stack
+		bigint_limb local[2 * BIGINT_CONVERSION_LIMBS + BIGINT_CONVERSION_LIMBS / 8 + 2];
+		int chunkCount = 0, size = 2 * _length + _length / 8 + 2;
+		bigint_limb *work = (size <= (int)(sizeof(local) / sizeof(local[0]))) ? local : new bigint_limb[size];
+		bigint_limb *chunks = work + _length;
+		int n = _length;
+
+		if (n > 0) memcpy(work, _limbs, n * sizeof(bigint_limb));
+		while (n > 0){
+			chunks[chunkCount++] = divideSmall(work, work, n, 1000000000);
+			n = trimmedLength(work, n);
+		}
+
+		if (pad){
+			for (int zeros = (9 << (level + 1)) - 9 * chunkCount; zeros > 0; zeros--)
+				*out++ = '0';
+		}
+		else{
+			if (chunkCount == 0) *out++ = '0';
+			else out = writeChunk(out, chunks[--chunkCount], false);
+		}
+
+		while (chunkCount > 0)
+			out = writeChunk(out, chunks[--chunkCount], true);
+
+		if (work != local) delete [] work;
+		return;
+	}
+
+	if (!pad && (compareMagnitude(*this, powers[level]) < 0)){
+		writeDecimal(out, level - 1, false, powers);
+		return;
+	}
+
+	BigInt quotient, remainder;
+	divideMagnitude(quotient, remainder, *this, powers[level]);
+	quotient.writeDecimal(out, level - 1, pad, powers);
+	remainder.writeDecimal(out, level - 1, true, powers);
+}
+
+int BigInt::formatSize(int base) const{
+	long long bits = bitLength(), digits;
+
+	if ((base < CALC_RADIX_MIN) || (base > CALC_RADIX_MAX)) return 1;
+
+	if (base == 10)
+		digits = bits * 1234 / 4096 + 1;		//log10(2) is just under 1234/4096
+	else{
+		//a digit holds at least the whole bits of log2(base)
+		int whole = 0;
+		while ((2 << whole) <= base) whole++;
+		digits = bits / whole + 1;
+	}
+
+	return (int)digits + 3;		//sign, at least one digit and the terminator
+}
+
+int BigInt::format(char *buffer, int size, int base) const{
+	if ((base < CALC_RADIX_MIN) || (base > CALC_RADIX_MAX)) return -1;
+	
+	int shift = radixShift(base);
+
+	//written straight into buffer when it is big enough, otherwise into scratch and cut to fit
+	int needed = formatSize(base);
+	char *text = (size >= needed) ? buffer : new char[needed];
+	char *out = text;
+
+	if (_negative) *out++ = '-';
+
+	if (_length == 0)
+		*out++ = '0';
+	else if (base == 10){
+		BigInt powers[32];
+		int level = -1;
+
+		if (_length > BIGINT_CONVERSION_LIMBS){
+			//the smallest 10^(9.2^k) above the value, its square root is where the first split goes
+			powers[0].setTo(1000000000);
+			for (level = 0; compareMagnitude(powers[level], *this) <= 0; level++)
+				multiply(powers[level + 1], powers[level], powers[level]);
+			level--;
+		}
+
+		writeDecimal(out, level, false, powers);
+	}
+	else if (shift > 0){
+		static const char *digitText = "0123456789abcdefghijklmnopqrstuv";
+		int digits = (bitLength() + shift - 1) / shift;
+
+		for (int d = digits - 1; d >= 0; d--){
+			int bit = d * shift, limb = bit / 32;
+			bigint_wide window = _limbs[limb];
+			if (limb + 1 < _length) window |= (bigint_wide)_limbs[limb + 1] << 32;
+			*out++ = digitText[(window >> (bit % 32)) & (base - 1)];
+		}
+	}
+	else{
+		//the other bases a chunk at a time, as in writeDecimal() but without the halving,
+		//they are for looking at rather than for numbers thousands of digits long
+		int chunkDigits;
+		bigint_limb chunk = radixChunk(base, &chunkDigits);
+		bigint_limb local[4 * BIGINT_INLINE_LIMBS];
+		int chunkCount = 0, room = 3 * _length + 1;		//a chunk holds at least 27 bits
+		bigint_limb *work = (room <= (int)(sizeof(local) / sizeof(local[0]))) ? local : new bigint_limb[room];
+		bigint_limb *chunks = work + _length;
+		int n = _length;
+
+		memcpy(work, _limbs, n * sizeof(bigint_limb));
+		while (n > 0){
+			chunks[chunkCount++] = divideSmall(work, work, n, chunk);
+			n = trimmedLength(work, n);
+		}
+
+		out += radixDigits(chunks[--chunkCount], base, out);
+		while (chunkCount > 0)
+			out = radixWriteChunk(out, chunks[--chunkCount], base, chunkDigits);
+
+		if (work != local) delete [] work;
+	}
+
+	*out = '\0';
+	int length = out - text;
+
+	if (text != buffer){
+		if (size > 0){
+			int copied = (length < size - 1) ? length : size - 1;
+			memcpy(buffer, text, copied);
+			buffer[copied] = '\0';
+		}
+		delete [] text;
+	}
+
+	return length;
+}
@@ -0,0 +1,90 @@
+#ifndef BIGINT_H
+#define BIGINT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+//Multiplication switches from schoolbook to Karatsuba, and division from
+//Knuth's algorithm D to Burnikel-Ziegler, once the operands reach these many limbs
+#define BIGINT_KARATSUBA_THRESHOLD 40
+#define BIGINT_BURNIKEL_THRESHOLD 80
+//below this many limbs decimal conversion is done a limb at a time rather than by halving
+#define BIGINT_CONVERSION_LIMBS 40
+//values are limited to this many bits, so a typo like 10^10^10 fails instead of eating all memory
+#define BIGINT_MAX_BITS (1 << 25)
+//limbs kept inside the object itself, so values up to 128 bits never touch the heap
+#define BIGINT_INLINE_LIMBS 4
+
+typedef unsigned int bigint_limb;
+typedef unsigned long long bigint_wide;
+
+//Arbitrary precision signed integer. The magnitude is kept as 32 bit limbs,
+//least significant first, with no leading zero limbs, and the sign separately.
+//The buffer is only ever grown, so a BigInt that is assigned to over and over
+//(as the values in Calculator::solve() are) stops allocating once it is big enough.
+//Small values live in the object itself, which keeps temporaries off the heap too.
+//
+//Division truncates toward zero and % takes the sign of the dividend, like the
+//native integers. & and | treat negative values as infinitely sign extended
+//two's complement, >> rounds toward minus infinity. The operations that can fail
+//return false for a zero divisor or a result over BIGINT_MAX_BITS. The result may
+//be the same object as an operand.
+class BigInt{
+	private:
+		bigint_limb *_limbs;		//_inline until the value outgrows it
+		int _length, _capacity;
+		bool _negative;
+		bigint_limb _inline[BIGINT_INLINE_LIMBS];
+
+		void reserve(int limbs);
+		void trim();
+		void setToLimbs(const BigInt &from, int start, int stop);
+		void shiftLimbsUp(int count);
+
+		static int compareMagnitude(const BigInt &a, const BigInt &b);
+		static void addMagnitude(BigInt &result, const BigInt &a, const BigInt &b);
+		static void subtractMagnitude(BigInt &result, const BigInt &a, const BigInt &b);
+		static void divideMagnitude(BigInt &quotient, BigInt &remainder, const BigInt &a, const BigInt &b);
+		static void divideKnuth(BigInt &quotient, BigInt &remainder, const BigInt &a, const BigInt &b);
+		static void divide2n1n(BigInt &quotient, BigInt &remainder, const BigInt &a, const BigInt &b, int n);
+		static void divide3n2n(BigInt &quotient, BigInt &remainder, const BigInt &a, const BigInt &b, int half);
+		static void bitwise(BigInt &result, const BigInt &a, const BigInt &b, bool isAnd);
+
+		void parseDecimal(const char *digits, int count, BigInt *powers, int &powerCount);
+		void writeDecimal(char *&out, int level, bool pad, BigInt *powers) const;
+
+	public:
+		BigInt(void);
+		BigInt(long long value);
+		BigInt(const BigInt &other);
+		~BigInt(void);
+
+		BigInt &operator=(const BigInt &other);
+		void swap(BigInt &other);
+		void setTo(long long value);
+
+		bool isZero() const;
+		bool isNegative() const;
+		int length() const;			//in limbs
+		int bitLength() const;		//of the magnitude
+		long long lowBits() const;	//the lowest 64 bits in two's complement
+		int compare(const BigInt &other) const;
+
+		bool parse(const char *text);		//decimal with optional fraction and exponent (truncated), or 0x hex
+		int format(char *buffer, int size, int base) const;		//base 2 to 36, returns the full length like snprintf or -1 for other bases
+		int formatSize(int base) const;		//enough room for format(), including the terminator
+
+		static void add(BigInt &result, const BigInt &a, const BigInt &b);
+		static void subtract(BigInt &result, const BigInt &a, const BigInt &b);
+		static bool multiply(BigInt &result, const BigInt &a, const BigInt &b);
+		static bool divide(BigInt *quotient, BigInt *remainder, const BigInt &a, const BigInt &b);
+		static bool power(BigInt &result, const BigInt &base, const BigInt &exponent);
+		static bool shiftLeft(BigInt &result, const BigInt &a, long long bits);
+		static void shiftRight(BigInt &result, const BigInt &a, long long bits);
+		static void bitwiseAnd(BigInt &result, const BigInt &a, const BigInt &b);
+		static void bitwiseOr(BigInt &result, const BigInt &a, const BigInt &b);
+		static void negate(BigInt &result, const BigInt &a);
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "cache.h"
+
+ResultCache::ResultCache(int capacity){
+	_capacity = (capacity > 0) ? capacity : 1;
+	
+	_bucketCount = 1;
+	while (_bucketCount < _capacity * 2) _bucketCount *= 2;
+	
+	_entries = new CacheEntry[_capacity];
+	_buckets = new int[_bucketCount];
+	
+	memset(&_stats, 0, sizeof(_stats));
+	clear();
+}
+
+ResultCache::~ResultCache(){
+	delete [] _entries;
+	delete [] _buckets;
+}
+
+void ResultCache::clear(){
+	for (int i = 0; i < _bucketCount; i++)
+		_buckets[i] = -1;
+		
+	_count = 0;
+	_newest = _oldest = -1;
+}
+
+void ResultCache::getStats(CalcCacheStats *stats){
+	*stats = _stats;
+	stats->entries = _count;
+	stats->capacity = _capacity;
+}
+
+unsigned int ResultCache::hash(const char *key, int length, int mode){
+	//FNV-1a
+	unsigned int h = 2166136261u;
+	
+	for (int i = 0; i < length; i++)
+		h = (h ^ (unsigned char)key[i]) * 16777619u;
+	
+	return (h ^ mode) * 16777619u;
+}
+
+void ResultCache::unlink(int index){
+	CacheEntry &entry = _entries[index];
+	
+	if (entry.newer >= 0) _entries[entry.newer].older = entry.older;
+	else _newest = entry.older;
+	
+	if (entry.older >= 0) _entries[entry.older].newer = entry.newer;
+	else _oldest = entry.newer;
+}
+
+void ResultCache::pushNewest(int index){
+	CacheEntry &entry = _entries[index];
+	
+	entry.newer = -1;
+	entry.older = _newest;
+	
+	if (_newest >= 0) _entries[_newest].newer = index;
+	_newest = index;
+	
+	if (_oldest < 0) _oldest = index;
+}
+
+bool ResultCache::lookup(const char *key, int length, int mode, const char **response, const char **answer){
+	unsigned int h = hash(key, length, mode);
+	
+	for (int i = _buckets[h & (_bucketCount - 1)]; i >= 0; i = _entries[i].next){
+		CacheEntry &entry = _entries[i];
+		
+		if ((entry.hash == h) && (entry.mode == mode) && (entry.key.Length() == length)
+			&& !memcmp(entry.key.String(), key, length)){
+			
+			if (i != _newest){
+				unlink(i);
+				pushNewest(i);
+			}
+			
+			*response = entry.response.String();
+			*answer = entry.answer.String();
+			_stats.hits++;
+			return true;
+		}
+	}
+	
+	_stats.misses++;
+	return false;
+}
+
+void ResultCache::insert(const char *key, int length, int mode, const char *response, const char *answer){
+	int index;
+	
+	if (_count < _capacity){
+		index = _count++;
+	}
+	else{
+		//recycle the least recently used entry, it has to come off its hash chain too
+		index = _oldest;
+		unlink(index);
+		
+		int *link = &_buckets[_entries[index].hash & (_bucketCount - 1)];
+		while (*link != index)
+			link = &_entries[*link].next;
+		*link = _entries[index].next;
+		
+		_stats.evictions++;
+	}
+	
+	CacheEntry &entry = _entries[index];
+	entry.key.SetTo(key, length);
+	entry.mode = mode;
+	entry.hash = hash(key, length, mode);
+	entry.response.SetTo(response);
+	entry.answer.SetTo(answer);
+	
+	int bucket = entry.hash & (_bucketCount - 1);
+	entry.next = _buckets[bucket];
+	_buckets[bucket] = index;
+	
+	pushNewest(index);
+}
@@ -0,0 +1,52 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <String.h>
+
+struct CalcCacheStats{
+	int hits, misses, evictions;
+	int entries, capacity;
+};
+
+struct CacheEntry{
+	BString key;
+	int mode;
+	unsigned int hash;
+	BString response, answer;
+	int next;				//hash chain
+	int newer, older;		//LRU list
+};
+
+//Bounded LRU map from (normalized expression, evaluation mode) to the finished
+//response and the value 'ans' takes after it. Entries live in one array sized
+//at construction, chained into buckets and into a recency list by index, so a
+//full cache recycles its oldest entry instead of allocating.
+class ResultCache{
+	private:
+		CacheEntry *_entries;
+		int *_buckets;
+		int _capacity, _bucketCount, _count;
+		int _newest, _oldest;
+		CalcCacheStats _stats;
+
+		unsigned int hash(const char *key, int length, int mode);
+		void unlink(int index);
+		void pushNewest(int index);
+
+	public:
+		ResultCache(int capacity);
+		~ResultCache();
+
+		//lookup() points response and answer at the entry's own text, valid until the next insert()
+		bool lookup(const char *key, int length, int mode, const char **response, const char **answer);
+		void insert(const char *key, int length, int mode, const char *response, const char *answer);
+		void clear();
+
+		void getStats(CalcCacheStats *stats);
+};
+
+#endif
@@ -1,52 +1,242 @@
 #include "calculator.h"
 
+#ifdef CALC_STATS
+#include <time.h>
+
+static long long phaseClock(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//STATS_PHASE charges the time since the last mark to a phase and moves the mark on
+#define STATS_START(length) { memset(&_phaseStats, 0, sizeof(CalcPhaseStats)); _phaseStats.characters = (length); \
+	_phaseMark = phaseClock(); _phaseStats.total = -_phaseMark; }
+#define STATS_PHASE(phase) { long long now = phaseClock(); _phaseStats.nanoseconds[phase] += now - _phaseMark; _phaseMark = now; }
+#define STATS_COUNT(field, n) _phaseStats.field += (n)
+#define STATS_SET(field, n) _phaseStats.field = (n)
+#define STATS_END(code) { _phaseStats.total += phaseClock(); _phaseStats.error = (code); }
+#else
+#define STATS_START(length)
+#define STATS_PHASE(phase)
+#define STATS_COUNT(field, n)
+#define STATS_SET(field, n)
+#define STATS_END(code)
+#endif
+
 Calculator::Calculator(){
+	_engine = &_ownEngine;
+	setUp();
+}
+
+Calculator::Calculator(const CalcEngine *engine){
+	_engine = engine;
+	setUp();
+}
+
+void Calculator::setUp(){
 	_theExpression = NULL;
-	_lastAnswer = NULL;
+	_expressionLength = 0;
 	_errorCode = 0;
 	
-	_traditionalOperators = new BString("*/^%><&|+-");
-
-	_operators = new BString(*_traditionalOperators);
-	_operators->Prepend("sctSCT");
+	_nodeCount = _operandCount = _operatorCount = 0;
+	_nodeCapacity = _operandCapacity = _operatorCapacity = 64;
+	_nodes = new CalcNode[_nodeCapacity];
+	_operandStack = new int[_operandCapacity];
+	_operatorStack = new CalcToken[_operatorCapacity];
+	_literalLength = 0;
+	_literalCapacity = 256;
+	_literalText = new char[_literalCapacity];
+	
+	_cache = NULL;
+	_cacheKey = NULL;
+	_cacheKeyCapacity = 0;
+	_history = NULL;
+	
+	_defining = NULL;
+	_dependencyCount = 0;
+	_dependencyCapacity = 16;
+	_dependencies = new CalcDependency[_dependencyCapacity];
+	_callMap = NULL;
+	_callMapCapacity = 0;
 	
-	useDegrees();
-	setResponseBase(10);
+	_values = NULL;
+	_valueCapacity = 0;
+	_bigValues = NULL;
+	_bigValueCapacity = 0;
+	
+	_answerCapacity = _responseCapacity = _lastAnswerCapacity = 255;
+	_answerText = new char[_answerCapacity];
+	_responseText = new char[_responseCapacity];
+	_lastAnswer = new char[_lastAnswerCapacity];
+	_lastAnswer[0] = '\0';
+	_haveLastAnswer = false;
+	_digitText = NULL;
+	_digitCapacity = 0;
+	
+	memset(&_phaseStats, 0, sizeof(CalcPhaseStats));
+	_phaseMark = 0;
 }
 
 Calculator::~Calculator(){
-	delete _operators;
-	delete _traditionalOperators;
-
-	if (_lastAnswer) delete _lastAnswer;
+	delete [] _nodes;
+	delete [] _operandStack;
+	delete [] _operatorStack;
+	delete [] _literalText;
+
+	delete _cache;
+	delete [] _cacheKey;
+	delete [] _dependencies;
+	delete [] _callMap;
+	delete [] _values;
+	delete [] _bigValues;
+	delete [] _answerText;
+	delete [] _responseText;
+	delete [] _lastAnswer;
+	delete [] _digitText;
 }
 
 void Calculator::setLastAnswer(BString ans){
-	_lastAnswer = new BString(ans);
+	copyText(ans.String(), ans.Length(), _lastAnswer, _lastAnswerCapacity);
+	_haveLastAnswer = true;
 }
 
 BString Calculator::getLastAnswer(){
 	BString la;
 	
-	if (_lastAnswer)
-		la.SetTo(*_lastAnswer);
+	if (_haveLastAnswer)
+		la.SetTo(_lastAnswer);
 	
 	return la;
 }
 
+bool Calculator::setSettings(const CalcSettings &settings){
+	if (!settingsValid(settings)) return false;
+	
+	//the cache is keyed on CalcEngine::cacheMode(), so a change to the rest of the format empties it
+	const CalcRadixFormat &format = settings.responseFormat, &current = _engine->settings().responseFormat;
+	bool layoutChanged = (format.width != current.width) || (format.group != current.group)
+		|| (format.separator != current.separator) || (format.isSigned != current.isSigned)
+		|| (format.prefix != current.prefix) || (format.upperCase != current.upperCase);
+	if (layoutChanged && (_cache != NULL)) _cache->clear();
+	
+	//a shared engine is left as it is, this Calculator goes on with its own
+	_ownEngine = CalcEngine(settings);
+	_engine = &_ownEngine;
+	return true;
+}
+
+const CalcEngine *Calculator::engine(){
+	return _engine;
+}
+
 void Calculator::useRadians(){
-	_useRadians = true;
+	CalcSettings settings = _engine->settings();
+	settings.useRadians = true;
+	setSettings(settings);
 }
 void Calculator::useDegrees(){
-	_useRadians = false;
+	CalcSettings settings = _engine->settings();
+	settings.useRadians = false;
+	setSettings(settings);
 }
 
 int Calculator::responseBase(){
-	return _responseBase;
+	return _engine->settings().responseFormat.base;
+}
+
+bool Calculator::setResponseBase(int base){
+	CalcRadixFormat format = _engine->settings().responseFormat;
+	format.base = base;
+	return setResponseBase(format);
+}
+
+bool Calculator::setResponseBase(const CalcRadixFormat &format){
+	CalcSettings settings = _engine->settings();
+	settings.responseFormat = format;
+	return setSettings(settings);
+}
+
+void Calculator::getResponseFormat(CalcRadixFormat *format){
+	*format = _engine->settings().responseFormat;
+}
+
+bool Calculator::setDecimalFormat(int mode, int precision){
+	CalcSettings settings = _engine->settings();
+	settings.decimalMode = mode;
+	settings.decimalPrecision = precision;
+	return setSettings(settings);
+}
+
+int Calculator::decimalMode(){
+	return _engine->settings().decimalMode;
+}
+
+int Calculator::decimalPrecision(){
+	return _engine->settings().decimalPrecision;
+}
+
+bool Calculator::setNumericType(int type){
+	CalcSettings settings = _engine->settings();
+	settings.numericType = type;
+	return setSettings(settings);
 }
 
-void Calculator::setResponseBase(int base){
-	_responseBase = base;
+int Calculator::numericType(){
+	return _engine->settings().numericType;
+}
+
+void Calculator::setCacheSize(int entries){
+	delete _cache;
+	_cache = (entries > 0) ? new ResultCache(entries) : NULL;
+}
+
+void Calculator::setHistory(AnswerHistory *history){
+	_history = history;
+}
+
+AnswerHistory *Calculator::history(){
+	return _history;
+}
+
+SymbolTable *Calculator::symbols(){
+	return &_symbols;
+}
+
+bool Calculator::isCurrent(CompiledExpression *compiled){
+	return _symbols.isCurrent(compiled->dependencies(), compiled->countDependencies());
+}
+
+void Calculator::logAnswer(const char *expression, int length){
+	//the answer goes in as it is and in the form the numeric types read, with its
+	//value, so binding to it later doesn't need it scanned again
+	double value;
+	int literal = bindAnswer(_lastAnswer, value);
+	
+	_history->append(expression, length, _lastAnswer, (literal >= 0) ? _literalText + literal : NULL, value,
+		_engine->settings().numericType);
+}
+
+void Calculator::getCacheStats(CalcCacheStats *stats){
+	if (_cache) _cache->getStats(stats);
+	else memset(stats, 0, sizeof(CalcCacheStats));
+}
+
+bool Calculator::getPhaseStats(CalcPhaseStats *stats){
+	#ifdef CALC_STATS
+	*stats = _phaseStats;
+	return true;
+	#else
+	memset(stats, 0, sizeof(CalcPhaseStats));
+	return false;
+	#endif
+}
+
+const char *Calculator::phaseName(int phase){
+	static const char *names[CALC_PHASE_COUNT] = {"normalize", "lookup", "parse", "solve", "format", "store"};
+	
+	if ((phase < 0) || (phase >= CALC_PHASE_COUNT)) return "unknown";
+	return names[phase];
 }
 
 
@@ -55,529 +245,1061 @@ void Calculator::setResponseBase(int base){
 //Internal utilities, helpers
 //*******************************************************************
 
-void Calculator::findFirstSolvable(int &start, int &stop){
-	if ((_theExpression == NULL) || (!_theExpression->CountChars())){
-		#ifdef DEBUG
-		printf("\nCalculator::findFirstSolvable() : _theExpression is empty.\n");
-		#endif
+void Calculator::nextToken(const char *exp, int length, int &pos, CalcToken &token){
+	//scans exactly one token starting at pos and leaves pos just past it
+	while ((pos < length) && charIs(exp[pos], CALC_CHAR_BLANK))
+		pos++;
+
+	token.start = pos;
+	token.length = 1;
+	token.value = 0;
+	token.literal = -1;
+	
+	if (pos >= length){
+		token.type = CALC_TOKEN_END;
+		token.length = 0;
 		return;
 	}
 	
-	int index, length = _theExpression->Length();
+	char c = exp[pos];
 	
-	for (index = 0; index < length; index++){
-		if (_theExpression->ByteAt(index) == '(') start = index;
-		if (_theExpression->ByteAt(index) == ')'){
-			stop = index;
-			break;
+	if (charIs(c, CALC_CHAR_DIGIT) || (c == '.')){
+		CalcNumberScan scan;
+		
+		if (scanNumber(exp + pos, length - pos, &scan) != CALC_SCAN_OK){
+			//the token is just the characters at fault, so they are what gets selected
+			token.type = CALC_TOKEN_BAD_NUMBER;
+			token.start = pos + scan.errorStart;
+			token.length = scan.errorStop - scan.errorStart;
+			pos += scan.length;
+			return;
 		}
+		
+		token.type = CALC_TOKEN_NUMBER;
+		token.value = scan.value;
+		token.length = scan.length;
+		if (!scan.plain) token.literal = addLiteral(exp + pos, scan, false);
+	}
+	else if (charIs(c, CALC_CHAR_LETTER)){
+		//words are matched case insensitively and as a whole, so 'asin' is never read as 'a' 'sin'
+		int end = pos;
+		while ((end < length) && charIs(exp[end], CALC_CHAR_LETTER))
+			end++;
+		
+		token.length = end - pos;
+		token.type = _engine->lookupWord(exp + pos, token.length);
+		if (token.type == CALC_TOKEN_PI) token.value = CalcNumeric<double>::pi();
+		
+		//'ans' straight followed by digits counts back through the history
+		if (token.type == CALC_TOKEN_ANS){
+			int back = 0;
+			for (; (end < length) && charIs(exp[end], CALC_CHAR_DIGIT); end++)
+				back = (back < 100000000) ? back * 10 + (exp[end] - '0') : back;
+			
+			token.value = back;
+			token.length = end - pos;
+		}
+	}
+	else if (((c == '<') || (c == '>')) && (pos + 1 < length) && (exp[pos + 1] == c)){
+		token.type = c; //'<<' and '>>', the single character forms are still accepted
+		token.length = 2;
+	}
+	else if ((c == '(') || (c == ')') || (c == ',') || _engine->isOperator(c)){
+		token.type = c;
+	}
+	else{
+		token.type = CALC_TOKEN_INVALID;
 	}
 	
-	stop++;
-	#ifdef DEBUG
-	printf("\nCalculator::findFirstSolvable() : first solvable at (%d to %d) in %s\n\n", start, stop, _theExpression->String());
-	#endif
+	pos += token.length;
 }
 
-bool Calculator::isOperator(char o){
-	BString *ops = _operators;
-	
-	for (int i = 0; i < ops->Length(); i++){
-		if (ops->ByteAt(i) == o) return true;
-	}		
-	return false;
+void Calculator::reserveLiteral(int size){
+	//offsets rather than pointers are kept into _literalText, as it may grow along the way
+	if (_literalLength + size > _literalCapacity){
+		int capacity = (_literalLength + size > 2 * _literalCapacity) ? _literalLength + size : 2 * _literalCapacity;
+		char *grown = new char[capacity];
+		memcpy(grown, _literalText, _literalLength);
+		delete [] _literalText;
+		_literalText = grown;
+		_literalCapacity = capacity;
+	}
 }
 
-bool Calculator::isNegativeModifier(BString *exp, int p){
-	//hateful. But there needs to be a mechanism to distinguish when a minus sign means 'subtract' and
-	//when it means 'make the following number negative' -- exp is assumed to include parenthesizing
-	//(30 - 50) vs (-50 * 2)
+int Calculator::addLiteral(const char *text, const CalcNumberScan &scan, bool negative){
+	//appends the number to _literalText as canonicalNumber() writes it, and returns where
+	int size = canonicalNumberSize(scan) + 1;
+	reserveLiteral(size);
 	
-	//first is it actually a '-'?
-	if (exp->ByteAt(p) == '-'){
+	int offset = _literalLength;
+	if (negative) _literalText[_literalLength++] = '-';
+	_literalLength += canonicalNumber(text, scan, _literalText + _literalLength, size - 1) + 1;
 	
-		if (p == 0) return true; //just in case (HACK! HACK!)
-		if (isOperator(exp->ByteAt(p - 1))) return true;
-		if (exp->ByteAt(p - 1) == '(') return true;
+	return offset;
+}
 
-	}
+int Calculator::addLiteralText(const char *text, int length){
+	//appends text that is already canonical, like an answer from the history
+	reserveLiteral(length + 1);
 	
-	return false;
-} 
+	int offset = _literalLength;
+	memcpy(_literalText + offset, text, length);
+	_literalText[offset + length] = '\0';
+	_literalLength += length + 1;
+	
+	return offset;
+}
 
-int Calculator::expressionType(BString *exp){
-	//this function simply tries to determine which of three formats the expression might be
-	// 1 (operand operator operand) -- CALC_NORMAL_EXP
-	// 2 (trigfunction operand) -- CALC_TRIG_EXP
-	// 3 (operand) -- CALC_SOLVED_EXP
+int Calculator::bindAnswer(const char *answer, double &value){
+	//an answer is text with a point like any other, so it's rewritten the same way.
+	//Returns where in _literalText, -1 if the text was fine as it was.
+	const char *digits = answer + ((answer[0] == '-') ? 1 : 0);
+	int length = strlen(digits);
+	CalcNumberScan scan;
 	
+	if ((scanNumber(digits, length, &scan) != CALC_SCAN_OK) || (scan.length != length)){
+		value = strtod(answer, NULL);		//inf and nan
+		return -1;
+	}
 	
-		
-	if (			countOccurances(exp, 's') + countOccurances(exp, 'c') + countOccurances(exp, 't') + 
-					countOccurances(exp, 'S') + countOccurances(exp, 'C') + countOccurances(exp, 'T')
-		 > 0 ) return CALC_TRIG_EXP;
+	value = (digits != answer) ? -scan.value : scan.value;
+	return scan.plain ? -1 : addLiteral(digits, scan, digits != answer);
+}
+
+int Calculator::addNode(char op, int left, int right, double value){
+	if (_nodeCount == _nodeCapacity){
+		CalcNode *nodes = new CalcNode[_nodeCapacity * 2];
+		memcpy(nodes, _nodes, _nodeCount * sizeof(CalcNode));
+		delete [] _nodes;
+		_nodes = nodes;
+		_nodeCapacity *= 2;
+	}
 	
-	if (				countOccurances(exp, '+') + countOccurances(exp, '*') +
-						countOccurances(exp, '/') + countOccurances(exp, '^') + countOccurances(exp, '%') +
-						countOccurances(exp, '<') + countOccurances(exp, '>') + countOccurances(exp, '&') +
-						countOccurances(exp, '|')
-		> 0) return CALC_NORMAL_EXP;
+	CalcNode &node = _nodes[_nodeCount];
+	node.op = op;
+	node.left = left;
+	node.right = right;
+	node.value = value;
+	node.start = -1;
+	node.literal = -1;
 	
-	//the minus sign as operator vs negator is a tough nut to crack
-	if (countOccurances(exp, '-') > 1) return CALC_NORMAL_EXP;
+	return _nodeCount++;
+}
+
+void Calculator::addDependency(int slot, int version){
+	//each symbol once, however often it is used
+	for (int i = 0; i < _dependencyCount; i++)
+		if (_dependencies[i].slot == slot) return;
 	
-	int minusPos = exp->FindFirst('-');
-	if (minusPos != B_ERROR)
-		if (!isNegativeModifier(exp, minusPos)) return CALC_NORMAL_EXP;
+	if (_dependencyCount == _dependencyCapacity){
+		CalcDependency *dependencies = new CalcDependency[_dependencyCapacity * 2];
+		memcpy(dependencies, _dependencies, _dependencyCount * sizeof(CalcDependency));
+		delete [] _dependencies;
+		_dependencies = dependencies;
+		_dependencyCapacity *= 2;
+	}
 	
-	return CALC_SOLVED_EXP;
+	_dependencies[_dependencyCount].slot = slot;
+	_dependencies[_dependencyCount++].version = version;
 }
 
+int Calculator::bindVariable(int slot){
+	//a variable is its stored answer, read the same way as a literal would be
+	const CalcSymbol *variable = _symbols.symbol(slot);
+	const char *text = (variable->canonical != NULL) ? variable->canonical : variable->answer;
+	int node = addNode(CALC_TOKEN_NUMBER, -1, -1, variable->value);
+	
+	_nodes[node].literal = addLiteralText(text, strlen(text));
+	addDependency(slot, variable->version);
+	return node;
+}
 
-
-//*******************************************************************
-//*******************************************************************
-//*******************************************************************
-//*******************************************************************
-
-int Calculator::calculate(BString *expression, float *answer){
-	BString answerStr;
-	int start, stop;
+int Calculator::bindWord(const char *exp, int length, int &pos, CalcToken &token, CompiledExpression *compiling){
+	//a name where an operand should be: a parameter of the function being defined,
+	//a call, a variable, or when compiling one of the compiled expression's inputs
+	const char *name = exp + token.start;
 	
-	int success;
+	if (_defining != NULL){
+		for (int i = 0; i < _defining->parameterCount; i++){
+			if ((_defining->parameterLength[i] == token.length)
+				&& !strncasecmp(_defining->text + _defining->parameterStart[i], name, token.length))
+				return pushOperand(addNode(CALC_TOKEN_PARAMETER, i, -1, 0)) ? CALC_OK : CALC_SOMETHING_HORRIBLY_WRONG;
+		}
+	}
 	
-	int rb = responseBase();
-	setResponseBase(10);
-	success = calculate(expression, &answerStr, start, stop);
-	setResponseBase(rb);
-
-	if (success == CALC_OK){
-		*answer = atof(answerStr.String());
+	int slot = _symbols.find(name, token.length);
+	int type = (slot >= 0) ? _symbols.symbol(slot)->type : CALC_SYMBOL_UNDEFINED;
+	int next = pos;
+	while ((next < length) && charIs(exp[next], CALC_CHAR_BLANK))
+		next++;
+	
+	if ((next < length) && (exp[next] == '(')){
+		//the '(' is taken with the name, and the call stays on the operator stack until its ')'.
+		//A function that calls itself isn't one yet the first time it is defined.
+		if ((_defining != NULL) && (slot == _defining->slot)) return CALC_RECURSIVE_DEFINITION;
+		if (type != CALC_SYMBOL_FUNCTION) return CALC_UNKNOWN_NAME;
+		
+		pos = next + 1;
+		token.type = CALC_TOKEN_CALL;
+		token.value = slot;
+		token.literal = _operandCount;
+		pushOperator(token);
 		return CALC_OK;
 	}
-	else
-		return success;
+	
+	if (type == CALC_SYMBOL_FUNCTION) return CALC_WRONG_ARGUMENTS;
+	
+	//a function's variables are looked up each time it is called, so they can be defined after it
+	if (_defining != NULL) pushOperand(addNode(CALC_TOKEN_SYMBOL, _symbols.intern(name, token.length), -1, 0));
+	else if (type == CALC_SYMBOL_VARIABLE) pushOperand(bindVariable(slot));
+	else if (compiling != NULL) pushOperand(addNode(CALC_TOKEN_VARIABLE, compiling->addVariable(name, token.length), -1, 0));
+	else return CALC_UNKNOWN_NAME;
+	
+	return CALC_OK;
 }
-		
 
-int Calculator::calculate(BString *expression, BString *response, int &selStart, int &selStop){
-	_theExpression = expression;
-	_errorCode = 0;
+int Calculator::expandCall(const CalcToken &call){
+	//Copies the function's nodes in, its parameters replaced by the arguments' nodes
+	//and its variables bound as they are now. The arguments are already in _nodes,
+	//so an argument used twice is solved once.
+	int slot = (int)call.value, base = call.literal;
+	const CalcSymbol *function = _symbols.symbol(slot);
 	
-	#ifdef DEBUG
-	printf("Calculator::calculate() : starting new calculation. ----------------------- \n");
-	#endif
+	if (_operandCount - base != function->parameterCount) return CALC_WRONG_ARGUMENTS;
+	if (function->error != CALC_OK) return function->error;
+	if ((_defining != NULL) && ((slot == _defining->slot) || _symbols.dependsOn(slot, _defining->slot)))
+		return CALC_RECURSIVE_DEFINITION;
 	
-	cleanUpSyntax();
+	if (_callMapCapacity < function->nodeCount){
+		delete [] _callMap;
+		_callMapCapacity = 2 * function->nodeCount;
+		_callMap = new int[_callMapCapacity];
+	}
 	
-	while ((_theExpression->ByteAt(0) == '(') && (_errorCode == 0)){
-		findFirstSolvable(selStart, selStop);
-		solve(selStart, selStop);
-	}				
+	//the body's literals go in as they are, so its nodes' offsets only move along
+	reserveLiteral(function->literalLength);
+	int literals = _literalLength;
+	memcpy(_literalText + literals, function->literals, function->literalLength);
+	_literalLength += function->literalLength;
 	
-	if (_errorCode != 0){
+	const int *arguments = _operandStack + base;
+	
+	for (int i = 0; i < function->nodeCount; i++){
+		const CalcNode &node = function->nodes[i];
 		
-		switch(_errorCode){
-			case CALC_UNMATCHED_PARENS:{
-				response->SetTo("Unmatched parens.");		
-				break;
-			}
+		switch (node.op){
+			case CALC_TOKEN_PARAMETER: _callMap[i] = arguments[node.left]; break;
 			
-			case CALC_INVALID_OPERATOR:{
-				response->SetTo("Invalid operator used.");
-				break;
-			}
-			
-			case CALC_NO_LAST_ANSWER:{
-				response->SetTo("'ans' has not been stored yet.");
-				break;
-			}
-			
-			case CALC_NO_EXPRESSION:{
-				response->SetTo("");
+			case CALC_TOKEN_SYMBOL: {
+				if (_defining != NULL){
+					_callMap[i] = addNode(CALC_TOKEN_SYMBOL, node.left, -1, 0);
+					break;
+				}
+				
+				if (_symbols.symbol(node.left)->type != CALC_SYMBOL_VARIABLE) return CALC_UNKNOWN_NAME;
+				_callMap[i] = bindVariable(node.left);
 				break;
 			}
 			
 			default: {
-				*response = response->SetTo("Default error. Sorry we can't be more specific.");
+				int copy = addNode(node.op, (node.left >= 0) ? _callMap[node.left] : -1,
+					(node.right >= 0) ? _callMap[node.right] : -1, node.value);
+				if (node.literal >= 0) _nodes[copy].literal = literals + node.literal;
+				_callMap[i] = copy;
 				break;
 			}
 		}
 	}
-	else{
+	
+	addDependency(slot, function->version);
+	_operandCount = base;
+	return pushOperand(_callMap[function->nodeCount - 1]) ? CALC_OK : CALC_SOMETHING_HORRIBLY_WRONG;
+}
 
-		if (_lastAnswer) delete _lastAnswer;
-		_lastAnswer = new BString(*_theExpression);
+bool Calculator::pushOperand(int node){
+	if (_operandCount == _operandCapacity){
+		int *stack = new int[_operandCapacity * 2];
+		memcpy(stack, _operandStack, _operandCount * sizeof(int));
+		delete [] _operandStack;
+		_operandStack = stack;
+		_operandCapacity *= 2;
+	}
+	
+	_operandStack[_operandCount++] = node;
+	return true;
+}
 
-		if (_responseBase != 10){
-			char answer[255];
-			switch(_responseBase){
-				case 2: {
+bool Calculator::pushOperator(const CalcToken &token){
+	if (_operatorCount == _operatorCapacity){
+		CalcToken *stack = new CalcToken[_operatorCapacity * 2];
+		memcpy(stack, _operatorStack, _operatorCount * sizeof(CalcToken));
+		delete [] _operatorStack;
+		_operatorStack = stack;
+		_operatorCapacity *= 2;
+	}
+	
+	_operatorStack[_operatorCount++] = token;
+	
+	#ifdef CALC_STATS
+	if (_operatorCount > _phaseStats.deepestStack) _phaseStats.deepestStack = _operatorCount;
+	#endif
+	
+	return true;
+}
 
-					int shift = sizeof(long) * 8 - 1;
-					long mask = 0;
+bool Calculator::reduce(){
+	//pops the top operator and its operands off the stacks, and pushes the resulting node
+	char op = _operatorStack[--_operatorCount].type;
+	STATS_COUNT(reductions, 1);
+	
+	if (_engine->isPrefixOperator(op)){
+		if (_operandCount < 1) return false;
+		int operand = _operandStack[--_operandCount];
+		return pushOperand(addNode(op, operand, -1, 0));
+	}
+	
+	if (_operandCount < 2) return false;
+	int right = _operandStack[--_operandCount];
+	int left = _operandStack[--_operandCount];
+	return pushOperand(addNode(op, left, right, 0));
+}
 
-					long number = (long)atof(_theExpression->String());
-					BString binaryStr;
+int Calculator::parse(int &errStart, int &errStop, CompiledExpression *compiling){
+	//Precedence climbing done with explicit stacks rather than recursion, so the cost is
+	//a single linear pass over the expression and deep nesting can't blow the stack.
+	//Nodes come out in postorder, see CalcNode. When compiling, unknown words are
+	//taken to be variables of the compiled expression. While a function is being
+	//defined, every number is put in _literalText, as its body is kept apart from
+	//the text it came from.
+	const char *exp = _theExpression;
+	int length = _expressionLength;
+	int pos = 0;
+	bool expectOperand = true;
+	CalcToken token;
+	
+	_nodeCount = _operandCount = _operatorCount = 0;
+	_literalLength = 0;
+	_dependencyCount = 0;
+	
+	for (;;){
+		nextToken(exp, length, pos, token);
+		STATS_COUNT(tokens, 1);
+		errStart = token.start;
+		errStop = token.start + token.length;
+		
+		if (token.type == CALC_TOKEN_INVALID) return CALC_INVALID_OPERATOR;
+		if (token.type == CALC_TOKEN_BAD_NUMBER) return CALC_INVALID_NUMBER;
+		
+		if (expectOperand){
+			switch (token.type){
+				case CALC_TOKEN_NUMBER:
+				case CALC_TOKEN_PI: {
+					int node = addNode(token.type, -1, -1, token.value);
+					_nodes[node].start = token.start;
+					_nodes[node].literal = token.literal;
+					if ((_defining != NULL) && (token.type == CALC_TOKEN_NUMBER) && (token.literal < 0))
+						_nodes[node].literal = addLiteralText(exp + token.start, token.length);
+					pushOperand(node);
+					expectOperand = false;
+					break;
+				}
+				
+				case CALC_TOKEN_WORD: {
+					int error = bindWord(exp, length, pos, token, compiling);
+					if (error != CALC_OK) return error;
 					
-					for (int r = 0; r <= shift; r++){
-						mask = (1 << (shift - r));
+					//a call's arguments come next
+					expectOperand = (token.type == CALC_TOKEN_CALL);
+					break;
+				}
+				
+				case CALC_TOKEN_ANS: {
+					//'ans' is the last answer, 'ans1' on are bound to the stored value and text
+					int back = (int)token.value;
+					int node = addNode(CALC_TOKEN_ANS, -1, -1, 0);
+					
+					if (back == 0){
+						if (!_haveLastAnswer) return CALC_NO_LAST_ANSWER;
+						_nodes[node].literal = bindAnswer(_lastAnswer, _nodes[node].value);
+						if ((_defining != NULL) && (_nodes[node].literal < 0))
+							_nodes[node].literal = addLiteralText(_lastAnswer, strlen(_lastAnswer));
+					}
+					else{
+						if ((_history == NULL) || (back >= _history->count())) return CALC_NO_LAST_ANSWER;
 						
-						if (mask & number) binaryStr.Append('1', 1);
-						else binaryStr.Append('0', 1);
+						const char *canonical = _history->canonical(back);
+						_nodes[node].value = _history->value(back);
+						_nodes[node].literal = addLiteralText(canonical, strlen(canonical));
 					}
 					
-					response->SetTo(binaryStr);
-					break;					
+					pushOperand(node);
+					expectOperand = false;
+					break;
+				}
+				
+				case '-': {
+					token.type = CALC_TOKEN_NEGATE;
+					pushOperator(token);
+					break;
+				}
+				
+				case CALC_TOKEN_LEFT_PAREN: {
+					pushOperator(token);
+					break;
+				}
+				
+				case CALC_TOKEN_RIGHT_PAREN: {
+					//only a call without arguments has nothing before its ')'
+					if ((_operatorCount == 0) || (_operatorStack[_operatorCount - 1].type != CALC_TOKEN_CALL)
+						|| (_operatorStack[_operatorCount - 1].literal != _operandCount))
+						return CALC_INVALID_EXPRESSION;
+					
+					const CalcToken &call = _operatorStack[--_operatorCount];
+					errStart = call.start;
+					int error = expandCall(call);
+					if (error != CALC_OK) return error;
+					expectOperand = false;
+					break;
 				}
-				case 8: sprintf(answer, "%.11lo", (unsigned long)atof(_theExpression->String())); response->SetTo(answer); break;
-				case 16: sprintf(answer, "%.8lx", (unsigned long)atof(_theExpression->String())); response->SetTo(answer); break;
 				
-				default: response->SetTo("Unimplemented numerical base. Try 2, 8, 10 or 16."); _errorCode = CALC_UNKNOWN_RADIX;
-			}		
+				case CALC_TOKEN_END: {
+					if (_nodeCount == 0 && _operatorCount == 0) return CALC_NO_EXPRESSION;
+					return CALC_INVALID_EXPRESSION;
+				}
+				
+				default: {
+					if (!_engine->isPrefixOperator(token.type)) return CALC_INVALID_EXPRESSION;
+					pushOperator(token);
+					break;
+				}
+			}
+			continue;
 		}
-		else{
-			response->SetTo(*_theExpression);
+		
+		if ((token.type == CALC_TOKEN_RIGHT_PAREN) || (token.type == CALC_TOKEN_END) || (token.type == CALC_TOKEN_COMMA)){
+			//a call is a '(' too, and its arguments are what is left on the operand stack
+			while ((_operatorCount > 0) && (_operatorStack[_operatorCount - 1].type != CALC_TOKEN_LEFT_PAREN)
+				&& (_operatorStack[_operatorCount - 1].type != CALC_TOKEN_CALL))
+				if (!reduce()) return CALC_INVALID_EXPRESSION;
+			
+			if (token.type == CALC_TOKEN_COMMA){
+				if ((_operatorCount == 0) || (_operatorStack[_operatorCount - 1].type != CALC_TOKEN_CALL))
+					return CALC_INVALID_EXPRESSION;
+				expectOperand = true;
+				continue;
+			}
+			
+			if (token.type == CALC_TOKEN_END){
+				if (_operatorCount > 0){
+					errStart = _operatorStack[_operatorCount - 1].start;
+					errStop = errStart + 1;
+					return CALC_UNMATCHED_PARENS;
+				}
+				break;
+			}
+			
+			if (_operatorCount == 0) return CALC_UNMATCHED_PARENS;
+			
+			const CalcToken &open = _operatorStack[--_operatorCount]; //the '('
+			if (open.type == CALC_TOKEN_CALL){
+				errStart = open.start;
+				int error = expandCall(open);
+				if (error != CALC_OK) return error;
+			}
+			continue;
 		}
 		
+		if (token.type == CALC_TOKEN_WORD) return CALC_INVALID_OPERATOR;
 		
+		int prec = _engine->precedence(token.type);
+		if ((prec == 0) || _engine->isPrefixOperator(token.type)) return CALC_INVALID_EXPRESSION;
 		
-		#ifdef DEBUG
-		printf("Calculator::calculate() : stored %s as _lastAnswer\n", _lastAnswer->String());
-		#endif
-	}	
-	return (_errorCode != CALC_OK);
-}	
-
-
-//*************************************************
-//*************************************************
-//*************************************************
-//*************************************************
-
-
-void Calculator::solve(int iStart, int iEnd){
-	float firstOp, secondOp;
-	const char *start;
-	char op;
-	BString exp;
+		//everything is left associative
+		while ((_operatorCount > 0) && (_engine->precedence(_operatorStack[_operatorCount - 1].type) >= prec))
+			if (!reduce()) return CALC_INVALID_EXPRESSION;
+		
+		pushOperator(token);
+		expectOperand = true;
+	}
+	
+	if (_operandCount != 1) return CALC_INVALID_EXPRESSION;
 	
-	_theExpression->MoveInto(exp, iStart, iEnd - iStart);
-	start = exp.String();
-
 	#ifdef DEBUG
-	printf("Calculator::solve() : working expression is %s\n", start);	
+	printf("Calculator::parse() : %d nodes from %s\n", _nodeCount, exp);
 	#endif
 	
-	int expType = expressionType(&exp);
-	
-	if (expType == CALC_SOLVED_EXP){
-		sscanf(start, "(%f)", &secondOp);
-
-		#ifdef DEBUG
-		printf("Calculator::solve() : CALC_SOLVED_EXP 2nd: %f\n", secondOp);
-		#endif
-	}	
+	return CALC_OK;
+}
 
-	else if (expType == CALC_NORMAL_EXP){ 
-	
-		sscanf(start, "(%f%c%f)",&firstOp,&op, &secondOp);
-	
-		#ifdef DEBUG
-		printf("Calculator::solve() : CALC_NORMAL_EXP 1st: %f op: %c 2nd: %f\n", firstOp, op, secondOp);
-		#endif
+template <typename T>
+T *Calculator::valueScratch(int count){
+	int bytes = count * sizeof(T);
+	if (_valueCapacity < bytes){
+		delete [] _values;
+		_valueCapacity = bytes * 2;
+		_values = new char[_valueCapacity];		//aligned for any type, as new char[] always is
+	}
 	
-		switch (op){
-			case '+': {
-				secondOp = secondOp + firstOp;		
-				break;
-			}
-			
-			case '-': {
-				secondOp = firstOp - secondOp;		
-				break;
-			}
+	return (T *)_values;
+}
+
+template <>
+BigInt *Calculator::valueScratch<BigInt>(int count){
+	//kept between calls like the rest, so the limbs are reused too
+	if (_bigValueCapacity < count){
+		delete [] _bigValues;
+		_bigValueCapacity = count * 2;
+		_bigValues = new BigInt[_bigValueCapacity];
+	}
 	
-			case '*': {
-				secondOp = secondOp * firstOp;		
-				break;
-			}
+	return _bigValues;
+}
+
+template <typename T>
+int Calculator::formatText(const T &value, int base, int mode, int precision, char *&text, int &capacity){
+	//formats into text, growing it to fit. -1 if the type can't do that base.
+	int size = CalcNumeric<T>::formatSize(value, base);
 	
-			case '/': {
-				secondOp = firstOp / secondOp;		
-				break;
-			}
-			
-			case '^': {
-				secondOp = pow(firstOp, secondOp);
-				break;
-			}
-			
-			case '%': {
-				while (firstOp >= secondOp)
-					firstOp -= secondOp;
-				secondOp = firstOp;
-				break;
-			}
-					
-			case '>': {
-				secondOp = (long)firstOp >> (long)secondOp;
-				break;
-			}
-			
-			case '<': {
-				secondOp = (long)firstOp << (long)secondOp;
-				break;
-			}
-			
-			case '&': {
-				secondOp = (long) firstOp & (long)secondOp;
-				break;
-			}
-			
-			case '|': {
-				secondOp = (long) firstOp | (long)secondOp;
-				break;
-			}
-			
-			default: {
-				_errorCode = CALC_INVALID_OPERATOR;
-				break;
-			}
+	for (;;){
+		if (capacity < size){
+			delete [] text;
+			capacity = size;
+			text = new char[capacity];
 		}
+		
+		int length = (base == 10) ? CalcNumeric<T>::format(value, text, capacity, mode, precision)
+			: CalcNumeric<T>::formatRadix(value, base, text, capacity);
+		if (length < capacity) return length;
+		
+		size = length + 1;
 	}
+}
 
-	else if (expType == CALC_TRIG_EXP){
-
-		sscanf(start, "(%c%f)",&op, &secondOp);
+template <typename T>
+int Calculator::solve(calc_int64 &bits, bool &inBase){
+	//children precede parents in _nodes, so one forward sweep solves the whole
+	//tree. Every value along the way is a T, see numeric.h
+	T *values = valueScratch<T>(_nodeCount);
+	const T none = T();
+	const char *exp = _theExpression;
+	const CalcSettings &settings = _engine->settings();
+	int error;
 	
-		#ifdef DEBUG
-		printf("Calculator::solve() : TRIG Expression op: %c radians: %f\n", op, secondOp);
-		#endif
-
-		switch (op){
-			case 's': {
-				secondOp = sin((double)	_useRadians ? secondOp : (secondOp * PI / 180.0));
-				break;
-			}
-			
-			case 'c': {
-				secondOp = cos((double)	_useRadians ? secondOp : (secondOp * PI / 180.0));
-				break;
-			}
-			
-			case 't': {
-				secondOp = tan((double)	_useRadians ? secondOp : (secondOp * PI / 180.0));
-				break;
-			}	
-			
-			case 'S': {
-				secondOp = asin((double)	_useRadians ? secondOp : (secondOp * PI / 180.0));
-				break;
-			}
-			
-			case 'C': {
-				secondOp = acos((double)	_useRadians ? secondOp : (secondOp * PI / 180.0));
+	for (int i = 0; i < _nodeCount; i++){
+		const CalcNode &node = _nodes[i];
+		
+		switch (node.op){
+			case CALC_TOKEN_NUMBER:
+			case CALC_TOKEN_ANS: {
+				const char *text = (node.op == CALC_TOKEN_ANS) ? _lastAnswer : exp + node.start;
+				error = CalcNumeric<T>::parse((node.literal >= 0) ? _literalText + node.literal : text, values[i]);
 				break;
 			}
-			
-			case 'T': {
-				secondOp = atan((double)	_useRadians ? secondOp : (secondOp * PI / 180.0));
-				break;
-			}	
+			case CALC_TOKEN_PI: values[i] = CalcNumeric<T>::pi(); error = CALC_OK; break;
 			
 			default: {
-				_errorCode = CALC_INVALID_OPERATOR;
+				const T &secondOp = (node.right >= 0) ? values[node.right] : none;
+				error = CalcNumeric<T>::apply(node.op, values[node.left], secondOp, settings.useRadians, values[i]);
 				break;
 			}
-		}			
+		}
+		
+		if (error != CALC_OK) return error;
 	}
+	
+	STATS_PHASE(CALC_PHASE_SOLVE);
+	
+	const T &result = values[_nodeCount - 1];
+	
+	//the answer is kept at full precision for 'ans', as the shortest text that reads
+	//back the same. The response is in the decimal mode, which for an integer or the
+	//shortest mode is the same text. In other bases the types that can print themselves
+	//do, the rest are left to calculate() through bits.
+	int length = formatText(result, 10, CALC_DECIMAL_SHORTEST, 0, _answerText, _answerCapacity);
+	int base = settings.responseFormat.base;
+	inBase = true;
+	
+	if ((base == 10) && (CalcNumeric<T>::isInteger || (settings.decimalMode == CALC_DECIMAL_SHORTEST)))
+		copyText(_answerText, length, _responseText, _responseCapacity);
+	else if (base == 10)
+		formatText(result, 10, settings.decimalMode, settings.decimalPrecision, _responseText, _responseCapacity);
 	else{
-		_errorCode = CALC_INVALID_EXPRESSION;
+		//a bigint has no width, so it is always signed and only padded when asked
+		int count = formatText(result, base, 0, 0, _digitText, _digitCapacity);
+		inBase = (count >= 0);
+		
+		if (inBase){
+			bool negative = (_digitText[0] == '-');
+			int width = (settings.responseFormat.width > 0) ? settings.responseFormat.width : 0;
+			layoutResponse(_digitText + (negative ? 1 : 0), count - (negative ? 1 : 0), negative, width);
+		}
 	}
 	
-	//NOW PUT ANSWER BACK INTO EQUATION STRING
-	if (_errorCode == CALC_OK){
-		char number[255];
-		memset(number, '\0', 255);
-		sprintf(number, "%f", secondOp);
-				
-		BString result( number );
-		*_theExpression = _theExpression->Insert(result, iStart);	
+	bits = CalcNumeric<T>::toInteger(result);
+	
+	return CALC_OK;
+}
 
-		#ifdef DEBUG
-		printf("Calculator::solve() : Calculation successful, master expression is now %s\n\n", _theExpression->String());	
-		#endif
+void Calculator::copyText(const char *text, int length, char *&buffer, int &capacity){
+	//copies text and a terminator into buffer, growing it only if it's too small
+	if (capacity <= length){
+		delete [] buffer;
+		capacity = length + 1;
+		buffer = new char[capacity];
 	}
-	else{
-		*_theExpression = _theExpression->Insert(exp, iStart);
 	
-		#ifdef DEBUG
-		printf("Calculator::solve() : Calculation failed, master expression is now %s\n\n", _theExpression->String());	
-		#endif
-	}
+	memcpy(buffer, text, length);
+	buffer[length] = '\0';
 }
 
-
-void Calculator::cleanUpSyntax()
-{
-
-	#ifdef DEBUG
-	printf("Calculator::cleanUpSyntax() : BEGIN : master expression is %s\n", _theExpression->String());	
-	#endif
-
-	_theExpression->ToLower();	
-	_theExpression->RemoveSet(" "); //trim out spaces
+void Calculator::layoutResponse(const char *digits, int count, bool negative, int width){
+	//writes the digits into _responseText as the response format says, see radixLayout()
+	const CalcRadixFormat &format = _engine->settings().responseFormat;
+	int size = radixLayoutSize(count, width, format);
+	if (_responseCapacity < size){
+		delete [] _responseText;
+		_responseCapacity = size;
+		_responseText = new char[_responseCapacity];
+	}
 	
-	if (_theExpression->Length() == 0){
-		_errorCode = CALC_NO_EXPRESSION;
+	radixLayout(digits, count, negative, width, format, _responseText, _responseCapacity);
+}
 
-		#ifdef DEBUG
-		printf("Calculator::cleanUpSyntax() : No expression, leaving...\n");	
-		#endif
+const char *Calculator::errorResponse(int error){
+	switch(error){
+		case CALC_UNMATCHED_PARENS: return "Unmatched parens.";
+		case CALC_INVALID_OPERATOR: return "Invalid operator used.";
+		case CALC_INVALID_EXPRESSION: return "Invalid expression.";
+		case CALC_DIVISION_BY_ZERO: return "Division by zero.";
+		case CALC_OVERFLOW: return "Result too large.";
+		case CALC_INVALID_NUMBER: return "Invalid number.";
+		case CALC_NO_LAST_ANSWER: return "'ans' has not been stored yet.";
+		case CALC_UNKNOWN_NAME: return "Unknown name.";
+		case CALC_BAD_DEFINITION: return "That can't be defined.";
+		case CALC_RECURSIVE_DEFINITION: return "A definition can't call itself.";
+		case CALC_WRONG_ARGUMENTS: return "Wrong number of arguments.";
+		case CALC_CIRCULAR_REFERENCE: return "Circular reference.";
+		case CALC_NO_EXPRESSION: return "";
+		default: return "Default error. Sorry we can't be more specific.";
+	}
+}
 
-		return;
+int Calculator::normalize(const char *exp, int length, bool &usesAns){
+	//builds the cache key in _cacheKey: the expression lowercased, with blanks dropped
+	//except where they keep apart characters that would otherwise read as one token
+	//('1 2' and '12', '2 e3' and '2e3', '< <' and '<<'), which are left as one space
+	if (_cacheKeyCapacity < length + 1){
+		delete [] _cacheKey;
+		_cacheKeyCapacity = length + 64;
+		_cacheKey = new char[_cacheKeyCapacity];
+	}
+	
+	int keyLength = 0;
+	bool blank = false;
+	for (int i = 0; i < length; i++){
+		char c = exp[i];
+		if (charIs(c, CALC_CHAR_BLANK)){
+			blank = (keyLength > 0);
+			continue;
+		}
+		if (charIs(c, CALC_CHAR_UPPER)) c += 'a' - 'A';
+		
+		if (blank){
+			char last = _cacheKey[keyLength - 1];
+			bool word = charIs(c, CALC_CHAR_LETTER | CALC_CHAR_DIGIT) || (c == '.') || (c == '_');
+			bool lastWord = charIs(last, CALC_CHAR_LETTER | CALC_CHAR_DIGIT) || (last == '.') || (last == '_');
+			if ((word && lastWord) || ((c == last) && ((c == '<') || (c == '>')))) _cacheKey[keyLength++] = ' ';
+			blank = false;
+		}
+		_cacheKey[keyLength++] = c;
 	}
+	_cacheKey[keyLength] = '\0';
 	
+	//the answer of anything using 'ans' depends on what came before, so it can't be cached
+	usesAns = (strstr(_cacheKey, "ans") != NULL);
 	
-	//for the time being, wrap all master expressions in parens.
-	//*_theExpression = _theExpression->Insert('(', 1, 0);
-	//*_theExpression = _theExpression->Insert(')', 1, _theExpression->Length());
+	return keyLength;
+}
+
 
 
-	//replace instances of 'ans' with the string value of the last answer
-	if (_theExpression->IFindFirst("ans") != B_ERROR)
-		if (_lastAnswer != NULL)
-			*_theExpression = _theExpression->IReplaceAll("ans", _lastAnswer->String());
-		else
-			_errorCode = CALC_NO_LAST_ANSWER;	
 
+//*******************************************************************
+//Definitions
+//*******************************************************************
 
-	//replace operator strings with single-byte codes or expressions
-	*_theExpression = _theExpression->IReplaceAll("sin", "s");
-	*_theExpression = _theExpression->IReplaceAll("cos", "c");	
-	*_theExpression = _theExpression->IReplaceAll("tan", "t");
-	*_theExpression = _theExpression->IReplaceAll("asin", "S");
-	*_theExpression = _theExpression->IReplaceAll("acos", "C");
-	*_theExpression = _theExpression->IReplaceAll("atan", "T");
-	*_theExpression = _theExpression->IReplaceAll(">>", ">");
-	*_theExpression = _theExpression->IReplaceAll("<<", "<");
-	*_theExpression = _theExpression->IReplaceAll("and", "&");
-	*_theExpression = _theExpression->IReplaceAll("or", "|");	
-	*_theExpression = _theExpression->IReplaceAll("pi", "3.14159265");	
+bool Calculator::readDefinition(const char *exp, int length, CalcDefinition &definition){
+	//'name =' or 'name(a, b) =' at the start, the '=' not the first of '=='.
+	//Only the shape is read here, see checkDefinition().
+	int pos = 0;
+	while ((pos < length) && charIs(exp[pos], CALC_CHAR_BLANK))
+		pos++;
+	if ((pos == length) || !charIs(exp[pos], CALC_CHAR_LETTER)) return false;
 	
+	definition.text = exp;
+	definition.nameStart = pos;
+	while ((pos < length) && charIs(exp[pos], CALC_CHAR_LETTER))
+		pos++;
+	definition.nameLength = pos - definition.nameStart;
+	definition.headLength = definition.nameLength;
+	definition.isFunction = false;
+	definition.parameterCount = 0;
+	definition.slot = -1;
 	
+	while ((pos < length) && charIs(exp[pos], CALC_CHAR_BLANK))
+		pos++;
+	
+	if ((pos < length) && (exp[pos] == '(')){
+		definition.isFunction = true;
+		
+		for (pos++;;){
+			while ((pos < length) && charIs(exp[pos], CALC_CHAR_BLANK))
+				pos++;
+			if ((pos < length) && (exp[pos] == ')') && (definition.parameterCount == 0)) break;
+			if ((pos == length) || !charIs(exp[pos], CALC_CHAR_LETTER)) return false;
 			
-	parenthetize();
-
-	//count if there are an equal number of left and right parens	
-	int count = 0;
-	for (int index = 0; index < _theExpression->Length(); index ++)
-	{
-		if (_theExpression->ByteAt(index) == '(')
-			count++;
-		else if (_theExpression->ByteAt(index) == ')')
-			count--;
+			int start = pos;
+			while ((pos < length) && charIs(exp[pos], CALC_CHAR_LETTER))
+				pos++;
+			
+			if (definition.parameterCount < CALC_MAX_PARAMETERS){
+				definition.parameterStart[definition.parameterCount] = start;
+				definition.parameterLength[definition.parameterCount] = pos - start;
+			}
+			definition.parameterCount++;
+			
+			while ((pos < length) && charIs(exp[pos], CALC_CHAR_BLANK))
+				pos++;
+			if ((pos < length) && (exp[pos] == ')')) break;
+			if ((pos == length) || (exp[pos] != ',')) return false;
+			pos++;
+		}
+		
+		pos++;
+		definition.headLength = pos - definition.nameStart;
+		while ((pos < length) && charIs(exp[pos], CALC_CHAR_BLANK))
+			pos++;
 	}
+	
+	if ((pos == length) || (exp[pos] != '=') || ((pos + 1 < length) && (exp[pos + 1] == '='))) return false;
+	
+	definition.equals = pos;
+	return true;
+}
 
-	if (count != 0){
-		_errorCode = CALC_UNMATCHED_PARENS; 
-		return;
+int Calculator::checkDefinition(CalcDefinition &definition, int &errStart, int &errStop){
+	//the words the lexer already knows can't be defined, nor can a parameter be named twice
+	const char *text = definition.text;
+	errStart = definition.nameStart;
+	errStop = errStart + definition.nameLength;
+	
+	if (_engine->lookupWord(text + definition.nameStart, definition.nameLength) != CALC_TOKEN_WORD)
+		return CALC_BAD_DEFINITION;
+	
+	if (definition.parameterCount > CALC_MAX_PARAMETERS){
+		errStart = definition.parameterStart[CALC_MAX_PARAMETERS - 1];
+		errStop = definition.nameStart + definition.headLength;
+		return CALC_BAD_DEFINITION;
 	}
 	
-
-
-	#ifdef DEBUG	
-	printf("Calculator::cleanUpSyntax() : END : cleaned master expression is %s\n\n", _theExpression->String());	
-	#endif
+	for (int i = 0; i < definition.parameterCount; i++){
+		const char *name = text + definition.parameterStart[i];
+		int length = definition.parameterLength[i];
+		errStart = definition.parameterStart[i];
+		errStop = errStart + length;
+		
+		if (_engine->lookupWord(name, length) != CALC_TOKEN_WORD) return CALC_BAD_DEFINITION;
+		for (int j = 0; j < i; j++)
+			if ((definition.parameterLength[j] == length) && !strncasecmp(text + definition.parameterStart[j], name, length))
+				return CALC_BAD_DEFINITION;
+	}
+	
+	definition.slot = _symbols.intern(text + definition.nameStart, definition.nameLength);
+	return CALC_OK;
 }
 
-void Calculator::parenthetize(){
-//General idea: see 'equations.txt'
-
-	char op;
+int Calculator::define(const char *exp, int length, CalcDefinition &definition, const char **response, int &selStart, int &selStop){
+	//'name = expression' keeps the answer under the name. 'name(a, b) = expression'
+	//keeps the expression, parsed, to be called with a and b bound to what it is given;
+	//the response is then the name and parameters. Either way, the functions that were
+	//built on what the name was before are parsed again.
+	int offset = definition.equals + 1;
+	_errorCode = checkDefinition(definition, selStart, selStop);
 	
-	//cycle through operators
-	for (int opIndex = 0; opIndex < _operators->Length(); opIndex++){
-		op = _operators->ByteAt(opIndex);	
-		
-		int opCount = countOccurances(_theExpression, op);
-		
-		//find each occurance of said operator
-		for (int i = 0; i < opCount; i++){
+	if ((_errorCode == CALC_OK) && !definition.isFunction){
+		if (evaluate(exp + offset, length - offset, response, selStart, selStop) == CALC_OK){
+			double value;
+			int literal = bindAnswer(_lastAnswer, value);
+			_symbols.defineVariable(definition.slot, _lastAnswer, (literal >= 0) ? _literalText + literal : NULL, value);
+			refreshFunctions();
+			return 0;
+		}
 		
-			int opPos = findNthOccurance(_theExpression, op, i);
-						
-			if (opPos == -1){
-				#ifdef DEBUG
-				printf("Calculator::parenthetize : couldn't find instance %d of operator %c\n", i, op);
-				#endif
-				break;
-			}
-			
-			if (!isNegativeModifier(_theExpression, opPos)){
+		selStart += offset;
+		selStop += offset;
+	}
+	else if (_errorCode == CALC_OK) _errorCode = defineFunction(exp, length, definition, selStart, selStop);
 	
-				
+	if (_errorCode == CALC_NO_EXPRESSION){
+		//nothing after the '=', which has no message of its own
+		_errorCode = CALC_BAD_DEFINITION;
+		selStart = offset;
+		selStop = length;
+	}
 	
-				#ifdef DEBUG
-				printf("Calculator::parenthetize : about to mangle operator %c(occurance %d) expression is %s\n", op, i, _theExpression->String());
-				#endif
+	if (_errorCode != CALC_OK){
+		*response = errorResponse(_errorCode);
+		return 1;
+	}
 	
+	refreshFunctions();
+	copyText(exp + definition.nameStart, definition.headLength, _responseText, _responseCapacity);
+	*response = _responseText;
+	return 0;
+}
+
+int Calculator::defineFunction(const char *exp, int length, const CalcDefinition &definition, int &errStart, int &errStop){
+	//parses the body on its own, with the parameters bound by position
+	int offset = definition.equals + 1;
+	_theExpression = exp + offset;
+	_expressionLength = length - offset;
 	
+	_defining = &definition;
+	int error = parse(errStart, errStop, NULL);
+	_defining = NULL;
 	
-				//********************************************
-				//what we've got to do is find the first operators to left and right of this operator
-				//which are not inside of a nested () group;
+	errStart += offset;
+	errStop += offset;
+	if (error != CALC_OK) return error;
 	
-				int leftParenPoint = 0, rightParenPoint = _theExpression->Length();								
-				int parenSum, j;
-				
-				parenSum = 0;
-				for (j = opPos - 1; j >= 0; j--){
-					if (_theExpression->ByteAt(j) == '(') parenSum--;
-					if (_theExpression->ByteAt(j) == ')') parenSum++;
-					
-					if (isOperator(_theExpression->ByteAt(j)) && (!isNegativeModifier(_theExpression, j)) && (parenSum <= 0)){
-						leftParenPoint = j + 1; //we want it to be to the right of the operator
-						break;
-					}			
-				}
-				
-				parenSum = 0;
-				for (j = opPos + 1; j < _theExpression->Length(); j++){
-					if (_theExpression->ByteAt(j) == '(') parenSum++;
-					if (_theExpression->ByteAt(j) == ')') parenSum--;
-					
-					if (isOperator(_theExpression->ByteAt(j)) && (!isNegativeModifier(_theExpression, j)) && (parenSum <= 0)){
-						rightParenPoint = j; //insert function of string pushes remainder right
-						break;				//so this will insert to left of operator
-					}			
-				}
-				
-	
-				//do right side first so as to not corrupt indices into string 
-				_theExpression->Insert(')', 1, rightParenPoint);
-				_theExpression->Insert('(', 1, leftParenPoint);
-				
-				
-				
-				#ifdef DEBUG
-				printf("\t\toperator %c(occurance %d) expression is now %s\n\n", op, i, _theExpression->String());
-				#endif
-				
-			}//if(!isNegativeModifier())...
-				
-					
-		} //for (int i
-	} //for (int opIndex
+	_symbols.defineFunction(definition.slot, exp, length, definition.parameterCount, _nodes, _nodeCount,
+		_literalText, _literalLength, _dependencies, _dependencyCount);
+	return CALC_OK;
+}
 
+void Calculator::refreshFunctions(){
+	//parses again each function that inlined an old version of another, from its
+	//own definition. One that no longer parses gives its error when called.
+	int *stale = new int[_symbols.count()];
+	int count;
+	
+	while ((count = _symbols.staleFunctions(stale)) > 0){
+		for (int i = 0; i < count; i++){
+			const CalcSymbol *function = _symbols.symbol(stale[i]);
+			const char *text = function->definition;
+			int length = function->definitionLength, start, stop;
+			CalcDefinition definition;
+			
+			readDefinition(text, length, definition);
+			definition.slot = stale[i];
+			
+			int error = defineFunction(text, length, definition, start, stop);
+			if (error != CALC_OK) _symbols.setError(stale[i], error);
+		}
+	}
+	
+	delete [] stale;
 }
 
 
 
 
+//*******************************************************************
+//*******************************************************************
+//*******************************************************************
+//*******************************************************************
+
+
+int Calculator::calculate(BString *expression, float *answer){
+	const char *response;
+	int start, stop;
+	
+	int success;
+	
+	//read from 'ans', which is decimal and full precision whatever the response is
+	success = calculate(expression->String(), expression->Length(), &response, start, stop);
 
+	if (success == CALC_OK){
+		*answer = scanDouble(_lastAnswer);
+		return CALC_OK;
+	}
+	else
+		return success;
+}
+		
 
+int Calculator::compile(BString *expression, CompiledExpression *compiled, int &selStart, int &selStop){
+	//parses once and lowers to bytecode, see CompiledExpression
+	_theExpression = expression->String();
+	_expressionLength = expression->Length();
+	compiled->clear();
+	STATS_START(_expressionLength);
+	
+	_errorCode = parse(selStart, selStop, compiled);
+	STATS_PHASE(CALC_PHASE_PARSE);
+	STATS_SET(nodes, _nodeCount);
+	
+	if ((_errorCode == CALC_OK) && !compiled->build(_nodes, _nodeCount, _engine->settings().useRadians))
+		_errorCode = CALC_SOMETHING_HORRIBLY_WRONG;
+	compiled->setDependencies(_dependencies, (_errorCode == CALC_OK) ? _dependencyCount : 0);
+	
+	STATS_END(_errorCode);
+	return _errorCode;
+}
 
+int Calculator::calculate(BString *expression, BString *response, int &selStart, int &selStop){
+	const char *text;
+	int result = calculate(expression->String(), expression->Length(), &text, selStart, selStop);
+	
+	response->SetTo(text);
+	return result;
+}
 
+int Calculator::calculate(const char *expression, int length, const char **response, int &selStart, int &selStop){
+	CalcDefinition definition;
+	
+	if (readDefinition(expression, length, definition))
+		return define(expression, length, definition, response, selStart, selStop);
+	
+	return evaluate(expression, length, response, selStart, selStop);
+}
 
+int Calculator::evaluate(const char *expression, int length, const char **response, int &selStart, int &selStop){
+	_theExpression = expression;
+	_expressionLength = length;
+	_errorCode = 0;
+	STATS_START(length);
+	
+	const CalcSettings &settings = _engine->settings();
+	
+	#ifdef DEBUG
+	printf("Calculator::calculate() : starting new calculation. ----------------------- \n");
+	#endif
+	
+	calc_int64 bits = 0;
+	bool inBase = false;
+	int keyLength = 0;
+	bool cacheable = false;
+	
+	if (_cache != NULL){
+		bool usesAns;
+		keyLength = normalize(expression, length, usesAns);
+		cacheable = !usesAns;
+		STATS_PHASE(CALC_PHASE_NORMALIZE);
+		
+		const char *responseText, *answerText;
+		if (cacheable && _cache->lookup(_cacheKey, keyLength, _engine->cacheMode(), &responseText, &answerText)){
+			copyText(answerText, strlen(answerText), _lastAnswer, _lastAnswerCapacity);
+			copyText(responseText, strlen(responseText), _responseText, _responseCapacity);
+			_haveLastAnswer = true;
+			*response = _responseText;
+			
+			STATS_PHASE(CALC_PHASE_LOOKUP);
+			if (_history != NULL){
+				logAnswer(expression, length);
+				STATS_PHASE(CALC_PHASE_STORE);
+			}
+			STATS_SET(cacheHit, true);
+			STATS_END(CALC_OK);
+			return 0;
+		}
+		STATS_PHASE(CALC_PHASE_LOOKUP);
+	}
+	
+	_errorCode = parse(selStart, selStop, NULL);
+	STATS_PHASE(CALC_PHASE_PARSE);
+	STATS_SET(nodes, _nodeCount);
+	
+	//what a defined name stands for can change, so neither can be cached
+	if (_dependencyCount > 0) cacheable = false;
+	
+	if (_errorCode == CALC_OK){
+		switch (settings.numericType){
+			case CALC_TYPE_FLOAT: _errorCode = solve<float>(bits, inBase); break;
+			case CALC_TYPE_DOUBLE: _errorCode = solve<double>(bits, inBase); break;
+			case CALC_TYPE_LONG_DOUBLE: _errorCode = solve<long double>(bits, inBase); break;
+			case CALC_TYPE_INT64: _errorCode = solve<calc_int64>(bits, inBase); break;
+			#ifdef CALC_HAVE_INT128
+			case CALC_TYPE_INT128: _errorCode = solve<calc_int128>(bits, inBase); break;
+			#endif
+			#ifdef CALC_HAVE_FLOAT128
+			case CALC_TYPE_FLOAT128: _errorCode = solve<calc_float128>(bits, inBase); break;
+			#endif
+			case CALC_TYPE_INT8: _errorCode = solve<calc_int8>(bits, inBase); break;
+			case CALC_TYPE_INT16: _errorCode = solve<calc_int16>(bits, inBase); break;
+			case CALC_TYPE_INT32: _errorCode = solve<calc_int32>(bits, inBase); break;
+			case CALC_TYPE_UINT8: _errorCode = solve<calc_uint8>(bits, inBase); break;
+			case CALC_TYPE_UINT16: _errorCode = solve<calc_uint16>(bits, inBase); break;
+			case CALC_TYPE_UINT32: _errorCode = solve<calc_uint32>(bits, inBase); break;
+			case CALC_TYPE_UINT64: _errorCode = solve<calc_uint64>(bits, inBase); break;
+			case CALC_TYPE_BIGINT: _errorCode = solve<BigInt>(bits, inBase); break;
+			default: _errorCode = CALC_SOMETHING_HORRIBLY_WRONG;
+		}
+		
+		//solve<T>() marks where solving ends and formatting starts, unless it failed
+		STATS_PHASE((_errorCode == CALC_OK) ? CALC_PHASE_FORMAT : CALC_PHASE_SOLVE);
+	}
+	
+	if (_errorCode != 0){
+		*response = errorResponse(_errorCode);
+	}
+	else{
+		//the new answer takes the old one's buffer, rather than a copy being made
+		char *swapText = _lastAnswer;
+		int swapCapacity = _lastAnswerCapacity;
+		_lastAnswer = _answerText;
+		_lastAnswerCapacity = _answerCapacity;
+		_answerText = swapText;
+		_answerCapacity = swapCapacity;
+		_haveLastAnswer = true;
+		
+		*response = _responseText;
+
+		if (!inBase){
+			//integer types are shown at exactly their own width, in two's complement when
+			//negative unless the format is signed. Anything else as a 64 bit integer,
+			//padded the way it always was.
+			int base = settings.responseFormat.base;
+			calc_uint64 number = (calc_uint64)bits;
+			int width = 64, minimum;
+			char digits[64];
+			bool exactWidth = numericTypeIsInteger(settings.numericType) && (numericTypeBits(settings.numericType) <= 64);
+			bool negative = settings.responseFormat.isSigned && numericTypeIsSigned(settings.numericType) && (bits < 0);
+			
+			if (exactWidth) width = numericTypeBits(settings.numericType);
+			if (negative) number = (calc_uint64)0 - number;
+			else if (width < 64) number &= ((calc_uint64)1 << width) - 1;
+			
+			if (settings.responseFormat.width != CALC_RADIX_WIDTH_DEFAULT) minimum = settings.responseFormat.width;
+			else if (settings.responseFormat.isSigned) minimum = 0;
+			else if (exactWidth) minimum = radixWidth(width, base);
+			else minimum = (base == 2) ? 64 : ((base == 8) ? 11 : ((base == 16) ? 8 : 0));
+			
+			layoutResponse(digits, radixDigits(number, base, digits), negative, minimum);
+			
+			STATS_PHASE(CALC_PHASE_FORMAT);
+		}
+		
+		
+		
+		if (cacheable && (_errorCode == CALC_OK)){
+			_cache->insert(_cacheKey, keyLength, _engine->cacheMode(), _responseText, _lastAnswer);
+			STATS_PHASE(CALC_PHASE_STORE);
+		}
+		
+		if (_history != NULL){
+			logAnswer(expression, length);
+			STATS_PHASE(CALC_PHASE_STORE);
+		}
+		
+		STATS_SET(answerLength, strlen(_lastAnswer));
+		STATS_SET(responseLength, strlen(*response));
+		
+		#ifdef DEBUG
+		printf("Calculator::calculate() : stored %s as _lastAnswer\n", _lastAnswer);
+		#endif
+	}	
+	
+	STATS_END(_errorCode);
+	return (_errorCode != CALC_OK);
+}	
@@ -3,14 +3,28 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <math.h>
 
 #include <String.h> //thank god
 #include "strutil.h"
+#include "compiled.h"
+#include "cache.h"
+#include "numeric.h"
+#include "radix.h"
+#include "scan.h"
+#include "engine.h"
+#include "history.h"
+#include "symbols.h"
 
 //#define DEBUG 666
 
+//Times every phase of calculate() and counts the work done in it, see
+//CalcPhaseStats. Off unless defined here or built with STATS=TRUE (see the
+//Makefile), and when off none of it is compiled in.
+//#define CALC_STATS
+
 //Error codes
 #define CALC_OK 0
 #define CALC_INVALID_OPERATOR 1
@@ -20,47 +34,211 @@
 #define CALC_INVALID_EXPRESSION 5
 #define CALC_UNKNOWN_RADIX 6
 #define CALC_NO_EXPRESSION 7
+#define CALC_DIVISION_BY_ZERO 8
+#define CALC_OVERFLOW 9
+#define CALC_INVALID_NUMBER 10
+#define CALC_UNKNOWN_NAME 11
+#define CALC_BAD_DEFINITION 12
+#define CALC_RECURSIVE_DEFINITION 13
+#define CALC_WRONG_ARGUMENTS 14
+#define CALC_CIRCULAR_REFERENCE 15
+
+struct CalcToken{
+	char type;
+	int start, length;		//position in the source expression, for error selection
+	double value;			//only meaningful for CALC_TOKEN_NUMBER, how far back for CALC_TOKEN_ANS and the slot for CALC_TOKEN_CALL
+	int literal;			//where a number rewritten for the numeric types is in _literalText, -1 if it wasn't,
+							//and for CALC_TOKEN_CALL how many operands were stacked before its arguments
+};
+
+//'name = ...' or 'name(a, b) = ...' as read by readDefinition(), positions in text
+struct CalcDefinition{
+	const char *text;
+	int nameStart, nameLength;
+	int headLength;				//the name and parameters, what the response repeats
+	int equals;
+	bool isFunction;
+	int parameterCount;			//all of them, even past CALC_MAX_PARAMETERS, which define() refuses
+	int parameterStart[CALC_MAX_PARAMETERS];
+	int parameterLength[CALC_MAX_PARAMETERS];
+	int slot;					//the name's, once define() has checked it
+};
+
+//Phases of a calculate() call, in the order they run
+#define CALC_PHASE_NORMALIZE 0		//building the cache key
+#define CALC_PHASE_LOOKUP 1			//looking the key up in the cache
+#define CALC_PHASE_PARSE 2			//tokenizing and building the node array
+#define CALC_PHASE_SOLVE 3			//the sweep over the nodes
+#define CALC_PHASE_FORMAT 4			//the answer and response text
+#define CALC_PHASE_STORE 5			//putting the result in the cache
+#define CALC_PHASE_COUNT 6
 
-#define CALC_TRIG_EXP 6
-#define CALC_NORMAL_EXP 7
-#define CALC_SOLVED_EXP 8
+//What the last calculate() did. Phases that didn't run (no cache, an error
+//part way) are left at zero.
+struct CalcPhaseStats{
+	long long nanoseconds[CALC_PHASE_COUNT];
+	long long total;			//from entering calculate() to returning
+	int characters;				//length of the expression
+	int tokens;					//read by the parser, the end included
+	int nodes;					//in the node array
+	int reductions;				//operators popped off the stack into nodes
+	int deepestStack;			//most operators pending at once
+	int answerLength;			//characters of the full precision answer
+	int responseLength;			//characters of the response
+	bool cacheHit;
+	int error;
+};
 
+//A calculating session: 'ans', the names it has defined, the optional cache and
+//the scratch every call reuses, with the settings and tables in a CalcEngine. A Calculator is only ever
+//used by one thread at a time, but any number of them can share an engine. One
+//made without an engine has its own, which the setters below replace; one that
+//shares an engine gets its own copy the first time a setter changes something,
+//so the shared one is never written to.
 class Calculator{
 	private:
-		BString *_operators;
-		BString *_traditionalOperators;
-		
-		BString *_theExpression;		
+		CalcEngine _ownEngine;
+		const CalcEngine *_engine;		//_ownEngine, or one shared with other Calculators
+
+		const char *_theExpression;
+		int _expressionLength;
 		int _errorCode;
-		BString *_lastAnswer;
-		
-		int _responseBase;
-		bool _useRadians;
 		
-		int expressionType(BString *exp);
-		bool isOperator(char c);
-		bool isNegativeModifier(BString *exp, int p);
+		//the full precision text 'ans' stands for, swapped with _answerText after each answer
+		char *_lastAnswer;
+		int _lastAnswerCapacity;
+		bool _haveLastAnswer;
+
+		//parser scratch, grown on demand and reused between calls
+		CalcNode *_nodes;
+		int _nodeCount, _nodeCapacity;
+		int *_operandStack;
+		int _operandCount, _operandCapacity;
+		CalcToken *_operatorStack;
+		int _operatorCount, _operatorCapacity;
+		char *_literalText;		//numbers with a point, separators or a 0b/0o prefix, as the numeric types read them
+		int _literalLength, _literalCapacity;
+
+		//optional result cache, keyed on the expression with whitespace stripped and lowercased
+		ResultCache *_cache;
+		char *_cacheKey;
+		int _cacheKeyCapacity;
+
+		AnswerHistory *_history;		//optional, where every answer is logged and 'ans1' on come from
+
+		//names defined with 'rate = 0.07' and 'f(x) = x*rate', and what the last parse
+		//bound of them, which is also what a compiled expression depends on
+		SymbolTable _symbols;
+		const CalcDefinition *_defining;		//the function whose body is being parsed, NULL otherwise
+		CalcDependency *_dependencies;
+		int _dependencyCount, _dependencyCapacity;
+		int *_callMap;				//a called function's nodes to the ones they were copied to
+		int _callMapCapacity;
+
+		//scratch for solve<T>(), sized in bytes as it holds a different type from call to call.
+		//BigInt needs constructing, so it has an array of its own.
+		char *_values;
+		int _valueCapacity;
+		BigInt *_bigValues;
+		int _bigValueCapacity;
+
+		//the answer and response text from solve<T>(), grown to fit as a bigint can run to many thousands of digits
+		char *_answerText, *_responseText;
+		int _answerCapacity, _responseCapacity;
+		char *_digitText;		//a bigint's digits in another base, before they are laid out
+		int _digitCapacity;
 		
-		void cleanUpSyntax();	
-		void parenthetize();
-		void findFirstSolvable(int &start, int &stop);
-		void solve(int start, int stop);	
+		CalcPhaseStats _phaseStats;		//only filled in with CALC_STATS
+		long long _phaseMark;
 		
+		//Everything above is grown on demand and kept, so once the buffers have seen
+		//an expression of a given size, evaluating another never touches the heap.
+
+		void setUp();
+		void nextToken(const char *exp, int length, int &pos, CalcToken &token);
+		void reserveLiteral(int size);
+		int addLiteral(const char *text, const CalcNumberScan &scan, bool negative);
+		int addLiteralText(const char *text, int length);
+		int bindAnswer(const char *answer, double &value);
+		void logAnswer(const char *expression, int length);
+		int addNode(char op, int left, int right, double value);
+		void addDependency(int slot, int version);
+		int bindVariable(int slot);
+		int bindWord(const char *exp, int length, int &pos, CalcToken &token, CompiledExpression *compiling);
+		int expandCall(const CalcToken &call);
+		bool pushOperand(int node);
+		bool pushOperator(const CalcToken &token);
+		bool reduce();
+		int parse(int &errStart, int &errStop, CompiledExpression *compiling);
+		template <typename T> T *valueScratch(int count);
+		template <typename T> int formatText(const T &value, int base, int mode, int precision, char *&text, int &capacity);
+		template <typename T> int solve(calc_int64 &bits, bool &inBase);
+		static void copyText(const char *text, int length, char *&buffer, int &capacity);
+		void layoutResponse(const char *digits, int count, bool negative, int width);
+		int normalize(const char *exp, int length, bool &usesAns);
+		int evaluate(const char *expression, int length, const char **response, int &selStart, int &selStop);
+		bool readDefinition(const char *exp, int length, CalcDefinition &definition);
+		int checkDefinition(CalcDefinition &definition, int &errStart, int &errStop);
+		int define(const char *exp, int length, CalcDefinition &definition, const char **response, int &selStart, int &selStop);
+		int defineFunction(const char *exp, int length, const CalcDefinition &definition, int &errStart, int &errStop);
+		void refreshFunctions();
+
 	public:
 		Calculator(void);
+		Calculator(const CalcEngine *engine);		//shared, and must outlive the Calculator
 		~Calculator(void);
 		int calculate(BString *expression, BString *response, int &selStart, int &selStop);
 		int calculate(BString *expression, float *answer);
+		//the same without BString, the response stays valid until the next call.
+		//'name = expression' and 'name(a, b) = expression' define a name, see define().
+		int calculate(const char *expression, int length, const char **response, int &selStart, int &selStop);
+		int compile(BString *expression, CompiledExpression *compiled, int &selStart, int &selStop);
+		
+		//Defined names are bound when an expression is parsed, so a compiled expression
+		//keeps the values its variables had and the functions as they were. False
+		//once any of those has been defined again, and it should be compiled again.
+		bool isCurrent(CompiledExpression *compiled);
+		SymbolTable *symbols();
 		
+		static const char *errorResponse(int error);		//the response calculate() gives for an error code
+
 		BString getLastAnswer();
 		void setLastAnswer(BString ans);
-		
+
+		//every setting at once, false (and nothing changed) if they aren't valid
+		bool setSettings(const CalcSettings &settings);
+		const CalcEngine *engine();
+
 		void useRadians();
 		void useDegrees();
-		
-		void setResponseBase(int b);
+
+		//any base from 2 to 36, false (and nothing changed) for another. The second form
+		//also sets the width, grouping and sign of the digits, see CalcRadixFormat.
+		bool setResponseBase(int b);
+		bool setResponseBase(const CalcRadixFormat &format);
 		int responseBase();
+		void getResponseFormat(CalcRadixFormat *format);
 		
+		//how base 10 responses of the floating point types are written, one of the
+		//CALC_DECIMAL_ modes and its digits, false if either is out of range. Shortest
+		//by default. 'ans' always keeps the shortest text that reads back the same.
+		bool setDecimalFormat(int mode, int precision);
+		int decimalMode();
+		int decimalPrecision();
+
+		bool setNumericType(int type);		//one of the CALC_TYPE_ constants, false if not available in this build
+		int numericType();
+
+		void setCacheSize(int entries);		//0 turns the cache off, which is the default
+		void getCacheStats(CalcCacheStats *stats);
+
+		//not owned, NULL (the default) for only 'ans'
+		void setHistory(AnswerHistory *history);
+		AnswerHistory *history();
+		
+		bool getPhaseStats(CalcPhaseStats *stats);		//of the last calculate(), false if built without CALC_STATS
+		static const char *phaseName(int phase);
+
 };
 
-#endif
\ No newline at end of file
+#endif
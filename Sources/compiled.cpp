@@ -0,0 +1,820 @@
+#include "compiled.h"
+#include "calculator.h"
+
+#if defined(__GNUC__) && (__GNUC__ >= 5) && (defined(__x86_64__) || defined(__i386__)) && !defined(CALC_NO_COLUMN_TARGETS)
+#define CALC_HAVE_COLUMN_TARGETS 1
+#endif
+
+static double foldInstruction(int op, double a, double b);
+
+CompiledExpression::CompiledExpression(){
+	_codeLength = _registerCount = _variableCount = 0;
+	_codeCapacity = _registerCapacity = 32;
+	_variableCapacity = 4;
+	
+	_code = new CalcInstruction[_codeCapacity];
+	_registers = new double[_registerCapacity];
+	_definitions = new int[_registerCapacity];
+	_variableNames = new BString[_variableCapacity];
+	_dependencies = NULL;
+	_dependencyCount = _dependencyCapacity = 0;
+	
+	_optimize = CALC_OPTIMIZE_STRICT;
+	_constantTable = _instructionTable = NULL;
+	_tableMask = 0;
+	memset(&_stats, 0, sizeof(_stats));
+	
+	_columnRegisters = NULL;
+	_columnScratch = NULL;
+	_columnCapacity = 0;
+	
+	_columnTarget = CALC_COLUMNS_GENERIC;
+	for (int target = CALC_COLUMNS_COUNT - 1; target > CALC_COLUMNS_GENERIC; target--){
+		if (columnTargetAvailable(target)){
+			_columnTarget = target;
+			break;
+		}
+	}
+}
+
+CompiledExpression::~CompiledExpression(){
+	delete [] _code;
+	delete [] _registers;
+	delete [] _definitions;
+	delete [] _variableNames;
+	delete [] _dependencies;
+	delete [] _columnRegisters;
+	delete [] _columnScratch;
+}
+
+void CompiledExpression::clear(){
+	_codeLength = _registerCount = _variableCount = _dependencyCount = 0;
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+void CompiledExpression::setDependencies(const CalcDependency *dependencies, int count){
+	if (_dependencyCapacity < count){
+		delete [] _dependencies;
+		_dependencyCapacity = count;
+		_dependencies = new CalcDependency[_dependencyCapacity];
+	}
+	
+	if (count > 0) memcpy(_dependencies, dependencies, count * sizeof(CalcDependency));
+	_dependencyCount = count;
+}
+
+const CalcDependency *CompiledExpression::dependencies(){
+	return _dependencies;
+}
+
+int CompiledExpression::countDependencies(){
+	return _dependencyCount;
+}
+
+void CompiledExpression::setOptimization(int level){
+	_optimize = level;
+}
+
+void CompiledExpression::getStats(CalcCompileStats *stats){
+	*stats = _stats;
+}
+
+const char *CompiledExpression::ruleName(int rule){
+	static const char *names[CALC_RULE_COUNT] = { "identity", "negation", "reciprocal", "power",
+		"integer", "reassociate", "degrees" };
+	
+	if ((rule < 0) || (rule >= CALC_RULE_COUNT)) return "unknown";
+	return names[rule];
+}
+
+int CompiledExpression::countVariables(){
+	return _variableCount;
+}
+
+const char *CompiledExpression::variableName(int index){
+	if ((index < 0) || (index >= _variableCount)) return NULL;
+	return _variableNames[index].String();
+}
+
+int CompiledExpression::variableIndex(const char *name){
+	for (int i = 0; i < _variableCount; i++)
+		if (!strcasecmp(_variableNames[i].String(), name)) return i;
+		
+	return -1;
+}
+
+int CompiledExpression::codeLength(){
+	return _codeLength;
+}
+
+
+
+//*******************************************************************
+//Building
+//*******************************************************************
+
+int CompiledExpression::addVariable(const char *name, int length){
+	//called by the parser for every unknown word, so it has to cope with repeats
+	for (int i = 0; i < _variableCount; i++)
+		if ((_variableNames[i].Length() == length) && !strncasecmp(_variableNames[i].String(), name, length)) return i;
+	
+	if (_variableCount == _variableCapacity){
+		BString *names = new BString[_variableCapacity * 2];
+		for (int i = 0; i < _variableCount; i++)
+			names[i] = _variableNames[i];
+		delete [] _variableNames;
+		_variableNames = names;
+		_variableCapacity *= 2;
+	}
+	
+	_variableNames[_variableCount].SetTo(name, length);
+	_variableNames[_variableCount].ToLower();
+	
+	return _variableCount++;
+}
+
+int CompiledExpression::addRegister(double value){
+	if (_registerCount == _registerCapacity){
+		double *registers = new double[_registerCapacity * 2];
+		memcpy(registers, _registers, _registerCount * sizeof(double));
+		delete [] _registers;
+		_registers = registers;
+		
+		int *definitions = new int[_registerCapacity * 2];
+		memcpy(definitions, _definitions, _registerCount * sizeof(int));
+		delete [] _definitions;
+		_definitions = definitions;
+		
+		_registerCapacity *= 2;
+	}
+	
+	_registers[_registerCount] = value;
+	_definitions[_registerCount] = CALC_REGISTER_VARIABLE;
+	return _registerCount++;
+}
+
+int CompiledExpression::addInstruction(int op, int a, int b){
+	if (_codeLength == _codeCapacity){
+		CalcInstruction *code = new CalcInstruction[_codeCapacity * 2];
+		memcpy(code, _code, _codeLength * sizeof(CalcInstruction));
+		delete [] _code;
+		_code = code;
+		_codeCapacity *= 2;
+	}
+	
+	CalcInstruction &ins = _code[_codeLength++];
+	ins.op = op;
+	ins.a = a;
+	ins.b = b;
+	ins.dst = (op == CALC_OP_END) ? a : addRegister(0);
+	if (op != CALC_OP_END) _definitions[ins.dst] = _codeLength - 1;
+	
+	return ins.dst;
+}
+
+static unsigned int hashBits(unsigned long long bits){
+	bits ^= bits >> 33;
+	bits *= 0xff51afd7ed558ccdULL;
+	bits ^= bits >> 33;
+	return (unsigned int)bits;
+}
+
+int CompiledExpression::constantRegister(double value){
+	//one register per distinct constant, compared bit for bit so 0 and -0 stay apart
+	if (!_optimize){
+		int reg = addRegister(value);
+		_definitions[reg] = CALC_REGISTER_CONSTANT;
+		return reg;
+	}
+	
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	
+	for (unsigned int h = hashBits(bits); ; h++){
+		int &slot = _constantTable[h & _tableMask];
+		if (slot < 0){
+			slot = addRegister(value);
+			_definitions[slot] = CALC_REGISTER_CONSTANT;
+			return slot;
+		}
+		if (!memcmp(&_registers[slot], &value, sizeof(double))) return slot;
+	}
+}
+
+int CompiledExpression::operandRegister(const CalcOperand &operand){
+	return (operand.reg == CALC_OPERAND_CONSTANT) ? constantRegister(operand.value) : operand.reg;
+}
+
+CalcOperand CompiledExpression::emit(int op, const CalcOperand &a, const CalcOperand &b){
+	bool unary = (b.reg == CALC_OPERAND_NONE);
+	CalcOperand result;
+	
+	if (_optimize && (a.reg == CALC_OPERAND_CONSTANT) && (unary || (b.reg == CALC_OPERAND_CONSTANT))){
+		result.reg = CALC_OPERAND_CONSTANT;
+		result.value = foldInstruction(op, a.value, b.value);
+		_stats.folded++;
+		return result;
+	}
+	
+	if (_optimize && simplify(op, a, b, result)) return result;
+	
+	int ra = operandRegister(a), rb = unary ? -1 : operandRegister(b);
+	
+	if (!_optimize){
+		result.reg = addInstruction(op, ra, rb);
+		return result;
+	}
+	
+	//commutative operators get their operands in one order, so x*y and y*x meet
+	bool commutative = (op == CALC_OP_ADD) || (op == CALC_OP_MUL) || (op == CALC_OP_AND) || (op == CALC_OP_OR);
+	if (commutative && (ra > rb)){
+		int swap = ra;
+		ra = rb;
+		rb = swap;
+	}
+	
+	for (unsigned int h = hashBits(((unsigned long long)op << 48) ^ ((unsigned long long)(ra + 1) << 24) ^ (rb + 1)); ; h++){
+		int &slot = _instructionTable[h & _tableMask];
+		
+		if (slot < 0){
+			slot = _codeLength;
+			result.reg = addInstruction(op, ra, rb);
+			return result;
+		}
+		
+		const CalcInstruction &ins = _code[slot];
+		if ((ins.op == op) && (ins.a == ra) && (ins.b == rb)){
+			_stats.shared++;
+			result.reg = ins.dst;
+			return result;
+		}
+	}
+}
+
+bool CompiledExpression::build(const CalcNode *nodes, int count, bool useRadians){
+	//lowers the parser's postorder node array, at most one instruction per operator node
+	if (count <= 0) return false;
+	
+	_codeLength = _registerCount = 0;
+	for (int i = 0; i < _variableCount; i++)
+		addRegister(0);
+	
+	memset(&_stats, 0, sizeof(_stats));
+	_stats.nodesBefore = count;
+	
+	//a node adds at most five registers (strict degree trig) or, with x^-63 in fast
+	//mode, twelve. The tables are kept under half full.
+	int tableSize = 16;
+	while (tableSize < 2 * (12 * count + _variableCount)) tableSize *= 2;
+	_tableMask = tableSize - 1;
+	_constantTable = new int[tableSize];
+	_instructionTable = new int[tableSize];
+	for (int i = 0; i < tableSize; i++)
+		_constantTable[i] = _instructionTable[i] = -1;
+	
+	CalcOperand *operands = new CalcOperand[count];
+	//the same pi the text path uses, so compiled and interpreted trig agree
+	const double piValue = CalcNumeric<double>::pi();
+	CalcOperand none = { CALC_OPERAND_NONE, 0 }, pi = { CALC_OPERAND_CONSTANT, piValue }, half = { CALC_OPERAND_CONSTANT, 180.0 };
+	CalcOperand toRadians = { CALC_OPERAND_CONSTANT, piValue / 180.0 }, toDegrees = { CALC_OPERAND_CONSTANT, 180.0 / piValue };
+	bool fast = (_optimize == CALC_OPTIMIZE_FAST);
+	bool built = true;
+	
+	for (int i = 0; (i < count) && built; i++){
+		const CalcNode &node = nodes[i];
+		CalcOperand a = (node.left >= 0) ? operands[node.left] : none;
+		CalcOperand b = (node.right >= 0) ? operands[node.right] : none;
+		CalcOperand &out = operands[i];
+		
+		switch (node.op){
+			case CALC_TOKEN_NUMBER:
+			case CALC_TOKEN_PI:
+			case CALC_TOKEN_ANS: out.reg = CALC_OPERAND_CONSTANT; out.value = node.value; break;
+			case CALC_TOKEN_VARIABLE: out.reg = node.left; out.value = 0; break;
+			
+			case '+': out = emit(CALC_OP_ADD, a, b); break;
+			case '-': out = emit(CALC_OP_SUB, a, b); break;
+			case '*': out = emit(CALC_OP_MUL, a, b); break;
+			case '/': out = emit(CALC_OP_DIV, a, b); break;
+			case '^': out = emit(CALC_OP_POW, a, b); break;
+			case '%': out = emit(CALC_OP_MOD, a, b); break;
+			case '>': out = emit(CALC_OP_SHR, a, b); break;
+			case '<': out = emit(CALC_OP_SHL, a, b); break;
+			case '&': out = emit(CALC_OP_AND, a, b); break;
+			case '|': out = emit(CALC_OP_OR, a, b); break;
+			case CALC_TOKEN_NEGATE: out = emit(CALC_OP_NEG, a, none); break;
+			
+			//degrees are converted with the same (x * pi) / 180 Calculator uses, as plain
+			//instructions, so the trig opcodes themselves always work in radians. Fast
+			//mode makes that one multiply, which reassociates with a constant factor.
+			case 's': case 'c': case 't': {
+				if (!useRadians && fast){
+					a = emit(CALC_OP_MUL, a, toRadians);
+					_stats.rules[CALC_RULE_DEGREES]++;
+				}
+				else if (!useRadians)
+					a = emit(CALC_OP_DIV, emit(CALC_OP_MUL, a, pi), half);
+				
+				int op = (node.op == 's') ? CALC_OP_SIN : (node.op == 'c') ? CALC_OP_COS : CALC_OP_TAN;
+				out = emit(op, a, none);
+				break;
+			}
+			
+			case 'S': case 'C': case 'T': {
+				int op = (node.op == 'S') ? CALC_OP_ASIN : (node.op == 'C') ? CALC_OP_ACOS : CALC_OP_ATAN;
+				out = emit(op, a, none);
+				
+				if (!useRadians && fast){
+					out = emit(CALC_OP_MUL, out, toDegrees);
+					_stats.rules[CALC_RULE_DEGREES]++;
+				}
+				else if (!useRadians)
+					out = emit(CALC_OP_DIV, emit(CALC_OP_MUL, out, half), pi);
+				break;
+			}
+			
+			default: built = false;
+		}
+	}
+	
+	if (built){
+		addInstruction(CALC_OP_END, operandRegister(operands[count - 1]), -1);
+		if (_optimize) removeDeadCode();
+		_stats.nodesAfter = _registerCount;
+		_stats.instructions = _codeLength - 1;
+	}
+	
+	delete [] operands;
+	delete [] _constantTable;
+	delete [] _instructionTable;
+	_constantTable = _instructionTable = NULL;
+	
+	#ifdef DEBUG
+	if (built) print(stdout);
+	#endif
+	
+	return built;
+}
+
+
+
+//*******************************************************************
+//Simplifying
+//*******************************************************************
+
+CalcOperand CompiledExpression::rewritten(int rule, const CalcOperand &result){
+	_stats.rules[rule]++;
+	return result;
+}
+
+const CalcInstruction *CompiledExpression::definition(const CalcOperand &operand, int op){
+	//the instruction with this opcode that set the operand's register, if one did
+	if (operand.reg < 0) return NULL;
+	
+	int index = _definitions[operand.reg];
+	if ((index < 0) || (_code[index].op != op)) return NULL;
+	
+	return &_code[index];
+}
+
+bool CompiledExpression::reassociate(int op, const CalcOperand &x, double c, CalcOperand &result){
+	//(y op k) op c to y op (k op c), for + and * whose instruction has a constant operand
+	const CalcInstruction *ins = definition(x, op);
+	if (ins == NULL) return false;
+	
+	int constant = (_definitions[ins->b] == CALC_REGISTER_CONSTANT) ? ins->b : ins->a;
+	if (_definitions[constant] != CALC_REGISTER_CONSTANT) return false;
+	
+	CalcOperand y = { (constant == ins->b) ? ins->a : ins->b, 0 };
+	CalcOperand k = { CALC_OPERAND_CONSTANT, foldInstruction(op, _registers[constant], c) };
+	
+	_stats.rules[CALC_RULE_REASSOCIATE]++;
+	result = emit(op, y, k);
+	return true;
+}
+
+static bool isPowerOfTwo(double value){
+	int exponent;
+	double mantissa = frexp(value, &exponent);
+	return (mantissa == 0.5) || (mantissa == -0.5);
+}
+
+bool CompiledExpression::simplify(int op, const CalcOperand &a, const CalcOperand &b, CalcOperand &result){
+	//Rewrites an operator into something cheaper, through emit() again so the
+	//result is folded and shared like anything else. Both operands are never
+	//constants here, so for a binary operator c is the one constant, if there is
+	//one, and x is the other operand.
+	bool fast = (_optimize == CALC_OPTIMIZE_FAST);
+	bool constantA = (a.reg == CALC_OPERAND_CONSTANT), constantB = (b.reg == CALC_OPERAND_CONSTANT);
+	double c = constantA ? a.value : b.value;
+	const CalcOperand &x = constantA ? b : a;
+	CalcOperand none = { CALC_OPERAND_NONE, 0 }, one = { CALC_OPERAND_CONSTANT, 1 };
+	const CalcInstruction *negated;
+	
+	switch (op){
+		case CALC_OP_ADD:
+			//x + -0 is x for every x, x + 0 isn't as -0 + 0 is +0
+			if ((constantA || constantB) && (c == 0) && (fast || signbit(c))){
+				result = rewritten(CALC_RULE_IDENTITY, x);
+				return true;
+			}
+			if ((negated = definition(b, CALC_OP_NEG)) != NULL){
+				CalcOperand y = { negated->a, 0 };
+				result = rewritten(CALC_RULE_NEGATION, emit(CALC_OP_SUB, a, y));
+				return true;
+			}
+			if ((negated = definition(a, CALC_OP_NEG)) != NULL){
+				CalcOperand y = { negated->a, 0 };
+				result = rewritten(CALC_RULE_NEGATION, emit(CALC_OP_SUB, b, y));
+				return true;
+			}
+			if (fast && (constantA || constantB)) return reassociate(op, x, c, result);
+			break;
+			
+		case CALC_OP_SUB:
+			//x - c is by definition x + -c, which lets x - 0 go and constants reassociate
+			if (constantB){
+				CalcOperand negative = { CALC_OPERAND_CONSTANT, -c };
+				result = emit(CALC_OP_ADD, a, negative);
+				return true;
+			}
+			if ((negated = definition(b, CALC_OP_NEG)) != NULL){
+				CalcOperand y = { negated->a, 0 };
+				result = rewritten(CALC_RULE_NEGATION, emit(CALC_OP_ADD, a, y));
+				return true;
+			}
+			break;
+			
+		case CALC_OP_MUL:
+			if (!constantA && !constantB) break;
+			if (c == 1){
+				result = rewritten(CALC_RULE_IDENTITY, x);
+				return true;
+			}
+			if (c == -1){
+				result = rewritten(CALC_RULE_NEGATION, emit(CALC_OP_NEG, x, none));
+				return true;
+			}
+			if (fast) return reassociate(op, x, c, result);
+			break;
+			
+		case CALC_OP_DIV: {
+			if (!constantB) break;
+			if (c == 1){
+				result = rewritten(CALC_RULE_IDENTITY, a);
+				return true;
+			}
+			if (c == -1){
+				result = rewritten(CALC_RULE_NEGATION, emit(CALC_OP_NEG, a, none));
+				return true;
+			}
+			
+			//multiplying by the reciprocal of a power of two rounds exactly as dividing
+			//does, as long as the reciprocal itself is exact
+			double reciprocal = 1 / c;
+			bool exact = isPowerOfTwo(c) && (reciprocal * c == 1);
+			if (exact || (fast && isnormal(c) && isnormal(reciprocal))){
+				CalcOperand factor = { CALC_OPERAND_CONSTANT, reciprocal };
+				result = rewritten(CALC_RULE_RECIPROCAL, emit(CALC_OP_MUL, a, factor));
+				return true;
+			}
+			break;
+		}
+			
+		case CALC_OP_POW: {
+			if (!constantB) break;
+			//pow(x, 0) is 1 even for a NaN or an infinity
+			if (c == 0){
+				result = rewritten(CALC_RULE_IDENTITY, one);
+				return true;
+			}
+			if (c == 1){
+				result = rewritten(CALC_RULE_IDENTITY, a);
+				return true;
+			}
+			if (!fast || (c != floor(c)) || (fabs(c) > CALC_POWER_LIMIT)) break;
+			
+			//x^n by repeated squaring, at most twice log2(n) multiplies
+			CalcOperand square = a, product = none;
+			for (int n = (int)fabs(c); ; ){
+				if (n & 1) product = (product.reg == CALC_OPERAND_NONE) ? square : emit(CALC_OP_MUL, product, square);
+				if ((n >>= 1) == 0) break;
+				square = emit(CALC_OP_MUL, square, square);
+			}
+			if (c < 0) product = emit(CALC_OP_DIV, one, product);
+			
+			result = rewritten(CALC_RULE_POWER, product);
+			return true;
+		}
+			
+		//shifting by nothing, or or-ing with 0 and and-ing with all ones, only
+		//truncates x to an integer. When x comes from one of these operators it
+		//already is one, unless it is too big to convert back, which fast mode ignores.
+		case CALC_OP_SHR:
+		case CALC_OP_SHL:
+		case CALC_OP_OR:
+		case CALC_OP_AND: {
+			if (!fast || !(constantB || (constantA && ((op == CALC_OP_OR) || (op == CALC_OP_AND))))) break;
+			if (c != ((op == CALC_OP_AND) ? -1 : 0)) break;
+			
+			if (definition(x, CALC_OP_SHR) || definition(x, CALC_OP_SHL) || definition(x, CALC_OP_OR) || definition(x, CALC_OP_AND)){
+				result = rewritten(CALC_RULE_INTEGER, x);
+				return true;
+			}
+			break;
+		}
+			
+		case CALC_OP_NEG:
+			if ((negated = definition(a, CALC_OP_NEG)) != NULL){
+				CalcOperand y = { negated->a, 0 };
+				result = rewritten(CALC_RULE_NEGATION, y);
+				return true;
+			}
+			break;
+	}
+	
+	return false;
+}
+
+void CompiledExpression::removeDeadCode(){
+	//Drops the instructions and constants nothing reaches any more, after rewrites
+	//have replaced them, and closes up the registers. Variables keep their slots
+	//as evaluate() copies them in by position.
+	bool *live = new bool[_registerCount];
+	int *renumbered = new int[_registerCount];
+	memset(live, 0, _registerCount * sizeof(bool));
+	
+	live[_code[_codeLength - 1].a] = true;
+	for (int i = _codeLength - 2; i >= 0; i--){
+		if (!live[_code[i].dst]) continue;
+		live[_code[i].a] = true;
+		if (_code[i].b >= 0) live[_code[i].b] = true;
+	}
+	
+	int registers = _variableCount;
+	for (int i = 0; i < _registerCount; i++){
+		if (i < _variableCount){
+			renumbered[i] = i;
+		}
+		else if (live[i]){
+			_registers[registers] = _registers[i];
+			_definitions[registers] = _definitions[i];
+			renumbered[i] = registers++;
+		}
+	}
+	
+	int length = 0;
+	for (int i = 0; i < _codeLength; i++){
+		CalcInstruction ins = _code[i];
+		if ((ins.op != CALC_OP_END) && !live[ins.dst]) continue;
+		
+		ins.dst = renumbered[ins.dst];
+		ins.a = renumbered[ins.a];
+		if (ins.b >= 0) ins.b = renumbered[ins.b];
+		if (ins.op != CALC_OP_END) _definitions[ins.dst] = length;
+		
+		_code[length++] = ins;
+	}
+	
+	_codeLength = length;
+	_registerCount = registers;
+	
+	delete [] live;
+	delete [] renumbered;
+}
+
+
+
+//*******************************************************************
+//Evaluation
+//*******************************************************************
+
+//One line per opcode, shared by the threaded and the switch dispatch and by the
+//column kernels below. Order must match the opcode enum. CALC_TO_INT64 is the
+//conversion of the bitwise operators, which the AVX-512 kernel replaces.
+#define CALC_TO_INT64 calcToInt64
+#define CALC_OPCODES(X) \
+	X(CALC_OP_ADD, r[pc->a] + r[pc->b]) \
+	X(CALC_OP_SUB, r[pc->a] - r[pc->b]) \
+	X(CALC_OP_MUL, r[pc->a] * r[pc->b]) \
+	X(CALC_OP_DIV, r[pc->a] / r[pc->b]) \
+	X(CALC_OP_POW, pow(r[pc->a], r[pc->b])) \
+	X(CALC_OP_MOD, fmod(r[pc->a], r[pc->b])) \
+	X(CALC_OP_SHR, calcShiftRight(CALC_TO_INT64(r[pc->a]), CALC_TO_INT64(r[pc->b]))) \
+	X(CALC_OP_SHL, calcShiftLeft(CALC_TO_INT64(r[pc->a]), CALC_TO_INT64(r[pc->b]))) \
+	X(CALC_OP_AND, CALC_TO_INT64(r[pc->a]) & CALC_TO_INT64(r[pc->b])) \
+	X(CALC_OP_OR, CALC_TO_INT64(r[pc->a]) | CALC_TO_INT64(r[pc->b])) \
+	X(CALC_OP_NEG, -r[pc->a]) \
+	X(CALC_OP_SIN, sin(r[pc->a])) \
+	X(CALC_OP_COS, cos(r[pc->a])) \
+	X(CALC_OP_TAN, tan(r[pc->a])) \
+	X(CALC_OP_ASIN, asin(r[pc->a])) \
+	X(CALC_OP_ACOS, acos(r[pc->a])) \
+	X(CALC_OP_ATAN, atan(r[pc->a]))
+
+static double foldInstruction(int op, double a, double b){
+	//one instruction on constants, through the same table evaluate() runs
+	double r[2] = { a, b };
+	CalcInstruction ins = { op, -1, 0, 1 };
+	const CalcInstruction *pc = &ins;
+	
+	switch (op){
+		#define CALC_FOLD(code, expr) case code: return expr;
+		CALC_OPCODES(CALC_FOLD)
+		#undef CALC_FOLD
+	}
+	
+	return 0;
+}
+
+double CompiledExpression::evaluate(const double *vars){
+	double *r = _registers;
+	const CalcInstruction *pc = _code;
+	
+	memcpy(r, vars, _variableCount * sizeof(double));
+	
+#ifdef __GNUC__
+	//threaded dispatch: every handler jumps straight to the next one, which gives
+	//the branch predictor one indirect jump per opcode instead of a single shared one
+	#define CALC_LABEL(code, expr) &&L_##code,
+	static const void *dispatch[] = { CALC_OPCODES(CALC_LABEL) &&L_CALC_OP_END };
+	#undef CALC_LABEL
+	
+	goto *dispatch[pc->op];
+	
+	#define CALC_HANDLER(code, expr) L_##code: r[pc->dst] = expr; pc++; goto *dispatch[pc->op];
+	CALC_OPCODES(CALC_HANDLER)
+	#undef CALC_HANDLER
+	
+L_CALC_OP_END:
+	return r[pc->a];
+#else
+	for (;; pc++){
+		switch (pc->op){
+			#define CALC_CASE(code, expr) case code: r[pc->dst] = expr; break;
+			CALC_OPCODES(CALC_CASE)
+			#undef CALC_CASE
+			
+			default: return r[pc->a];
+		}
+	}
+#endif
+}
+
+
+
+
+
+//*******************************************************************
+//Columnar evaluation
+//*******************************************************************
+
+//Stands in for the register file inside a column kernel, so r[pc->a] in the
+//opcode table reads the current row of register a and every kernel computes
+//exactly the expression evaluate() does.
+struct CalcColumnRow{
+	double *const *registers;
+	int row;
+	
+	double operator[](int index) const { return registers[index][row]; }
+};
+
+typedef void (*CalcColumnRunner)(const CalcInstruction *code, double *const *registers, int count);
+
+//One loop over the rows per opcode. The compiler vectorizes the arithmetic at the
+//Makefile's FULL optimization with its dynamic cost model, the math library calls
+//stay one row at a time so they round exactly as the scalar ones do. The bitwise
+//operators need packed int64 conversions, which only the AVX-512 target has, so
+//only it uses the branch-free calcToInt64Packed(); the others convert a row at
+//a time.
+#define CALC_COLUMN_CASE(code, expr) \
+	case code: \
+		for (int row = 0; row < count; row++){ \
+			CalcColumnRow r = { registers, row }; \
+			destination[row] = expr; \
+		} \
+		break;
+
+#define CALC_COLUMN_RUNNER(name) \
+	static void name(const CalcInstruction *code, double *const *registers, int count){ \
+		for (const CalcInstruction *pc = code; pc->op != CALC_OP_END; pc++){ \
+			double *destination = registers[pc->dst]; \
+			switch (pc->op){ \
+				CALC_OPCODES(CALC_COLUMN_CASE) \
+			} \
+		} \
+	}
+
+CALC_COLUMN_RUNNER(runColumnsGeneric)
+#ifdef CALC_HAVE_COLUMN_TARGETS
+__attribute__((target("sse4.2"))) CALC_COLUMN_RUNNER(runColumnsSSE4)
+__attribute__((target("avx2"))) CALC_COLUMN_RUNNER(runColumnsAVX2)
+#undef CALC_TO_INT64
+#define CALC_TO_INT64 calcToInt64Packed
+__attribute__((target("avx512f,avx512dq,prefer-vector-width=512"))) CALC_COLUMN_RUNNER(runColumnsAVX512)
+#undef CALC_TO_INT64
+#define CALC_TO_INT64 calcToInt64
+
+static const CalcColumnRunner sColumnRunners[CALC_COLUMNS_COUNT] = {
+	runColumnsGeneric, runColumnsSSE4, runColumnsAVX2, runColumnsAVX512
+};
+#else
+static const CalcColumnRunner sColumnRunners[CALC_COLUMNS_COUNT] = {
+	runColumnsGeneric, NULL, NULL, NULL
+};
+#endif
+
+#undef CALC_COLUMN_RUNNER
+#undef CALC_COLUMN_CASE
+
+bool CompiledExpression::columnTargetAvailable(int target){
+	switch (target){
+		case CALC_COLUMNS_GENERIC: return true;
+		
+		#ifdef CALC_HAVE_COLUMN_TARGETS
+		case CALC_COLUMNS_SSE4: __builtin_cpu_init(); return __builtin_cpu_supports("sse4.2");
+		case CALC_COLUMNS_AVX2: __builtin_cpu_init(); return __builtin_cpu_supports("avx2");
+		case CALC_COLUMNS_AVX512: __builtin_cpu_init(); return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+		#endif
+	}
+	
+	return false;
+}
+
+const char *CompiledExpression::columnTargetName(int target){
+	static const char *names[CALC_COLUMNS_COUNT] = { "generic", "sse4.2", "avx2", "avx512" };
+	
+	if ((target < 0) || (target >= CALC_COLUMNS_COUNT)) return "unknown";
+	return names[target];
+}
+
+bool CompiledExpression::setColumnTarget(int target){
+	if (!columnTargetAvailable(target)) return false;
+	
+	_columnTarget = target;
+	return true;
+}
+
+int CompiledExpression::columnTarget(){
+	return _columnTarget;
+}
+
+void CompiledExpression::evaluate(const double *const *columns, double *results, int count){
+	//every register but the variables gets a block of rows, and the constants are
+	//spread across theirs once. Variables are read straight from their columns and,
+	//when the answer is an instruction's, it is written straight into results.
+	if (_columnCapacity < _registerCount){
+		delete [] _columnRegisters;
+		delete [] _columnScratch;
+		_columnCapacity = _registerCount;
+		_columnRegisters = new double *[_columnCapacity];
+		_columnScratch = new double[_columnCapacity * CALC_COLUMN_BLOCK];
+	}
+	
+	int rows = (count < CALC_COLUMN_BLOCK) ? count : CALC_COLUMN_BLOCK;
+	for (int i = _variableCount; i < _registerCount; i++){
+		_columnRegisters[i] = _columnScratch + i * CALC_COLUMN_BLOCK;
+		for (int row = 0; row < rows; row++)
+			_columnRegisters[i][row] = _registers[i];
+	}
+	
+	int answer = _code[_codeLength - 1].a;
+	bool direct = (_codeLength > 1) && (_code[_codeLength - 2].dst == answer);
+	CalcColumnRunner run = sColumnRunners[_columnTarget];
+	
+	for (int start = 0; start < count; start += CALC_COLUMN_BLOCK){
+		rows = (count - start < CALC_COLUMN_BLOCK) ? count - start : CALC_COLUMN_BLOCK;
+		
+		for (int i = 0; i < _variableCount; i++)
+			_columnRegisters[i] = (double *)columns[i] + start;		//only ever read
+		if (direct) _columnRegisters[answer] = results + start;
+		
+		run(_code, _columnRegisters, rows);
+		
+		if (!direct) memcpy(results + start, _columnRegisters[answer], rows * sizeof(double));
+	}
+}
+
+
+
+void CompiledExpression::print(FILE *out){
+	static const char *names[] = {"add", "sub", "mul", "div", "pow", "mod", "shr", "shl", "and", "or",
+		"neg", "sin", "cos", "tan", "asin", "acos", "atan", "end"};
+	
+	for (int i = 0; i < _codeLength; i++){
+		const CalcInstruction &ins = _code[i];
+		
+		if (ins.op == CALC_OP_END)
+			fprintf(out, "%4d  %-5s r%d\n", i, names[ins.op], ins.a);
+		else if (ins.b < 0)
+			fprintf(out, "%4d  %-5s r%d = r%d\n", i, names[ins.op], ins.dst, ins.a);
+		else
+			fprintf(out, "%4d  %-5s r%d = r%d, r%d\n", i, names[ins.op], ins.dst, ins.a, ins.b);
+	}
+	
+	fprintf(out, "      %d nodes -> %d, %d folded, %d shared\n", _stats.nodesBefore, _stats.nodesAfter,
+		_stats.folded, _stats.shared);
+	
+	for (int rule = 0; rule < CALC_RULE_COUNT; rule++)
+		if (_stats.rules[rule]) fprintf(out, "      %s %d\n", ruleName(rule), _stats.rules[rule]);
+}
@@ -0,0 +1,185 @@
+#ifndef COMPILED_H
+#define COMPILED_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <String.h>
+
+struct CalcNode;
+struct CalcDependency;
+
+//Bytecode opcodes. Every instruction is three-address: registers[dst] = a op b
+enum{
+	CALC_OP_ADD = 0,
+	CALC_OP_SUB,
+	CALC_OP_MUL,
+	CALC_OP_DIV,
+	CALC_OP_POW,
+	CALC_OP_MOD,
+	CALC_OP_SHR,
+	CALC_OP_SHL,
+	CALC_OP_AND,
+	CALC_OP_OR,
+	CALC_OP_NEG,
+	CALC_OP_SIN,
+	CALC_OP_COS,
+	CALC_OP_TAN,
+	CALC_OP_ASIN,
+	CALC_OP_ACOS,
+	CALC_OP_ATAN,
+	CALC_OP_END,	//stops the dispatch loop, the answer is in register a
+	CALC_OP_COUNT
+};
+
+struct CalcInstruction{
+	int op;
+	int dst, a, b;
+};
+
+//A value while build() lowers the tree: a register, or a constant that has not
+//needed one yet, so constant sub-trees fold without leaving registers behind
+#define CALC_OPERAND_CONSTANT -1
+#define CALC_OPERAND_NONE -2
+
+//what sets a register that no instruction does
+#define CALC_REGISTER_VARIABLE -1
+#define CALC_REGISTER_CONSTANT -2
+
+struct CalcOperand{
+	int reg;
+	double value;
+};
+
+//How far build() goes. Strict only makes rewrites that give the same bits for
+//every input (NaN stays a NaN, its sign aside). Fast also reassociates, expands
+//x^n into multiplies (pow() in the C library isn't always correctly rounded, so
+//even x^2 and x*x can differ in the last bit) and takes reciprocals of any
+//constant, the way -ffast-math would.
+#define CALC_OPTIMIZE_NONE 0
+#define CALC_OPTIMIZE_STRICT 1
+#define CALC_OPTIMIZE_FAST 2
+
+//Rewrite rules, counted each time one fires
+#define CALC_RULE_IDENTITY 0		//x*1, x/1, x-0, x^1, x^0 (x+0 only in fast mode, for -0)
+#define CALC_RULE_NEGATION 1		//--x, x*-1, x/-1, x + -y, x - -y
+#define CALC_RULE_RECIPROCAL 2		//x/c to x*(1/c), strict only when c is a power of two
+#define CALC_RULE_POWER 3			//fast: x^n for whole |n| <= CALC_POWER_LIMIT by repeated squaring
+#define CALC_RULE_INTEGER 4			//fast: x|0, x&-1, x<<0, x>>0 when x is already an integer
+#define CALC_RULE_REASSOCIATE 5		//fast: (x + a) + b to x + (a + b), likewise for *
+#define CALC_RULE_DEGREES 6			//fast: degrees to radians as one multiply, merged with its neighbours
+#define CALC_RULE_COUNT 7
+
+#define CALC_POWER_LIMIT 64
+
+struct CalcCompileStats{
+	int nodesBefore;		//parsed nodes, every occurrence counted
+	int nodesAfter;			//distinct variables, constants and instructions left
+	int folded;				//operators computed while compiling
+	int shared;				//operators that reused an identical earlier one
+	int instructions;
+	int rules[CALC_RULE_COUNT];
+};
+
+//Column evaluation targets. Generic is whatever the compiler makes of the kernel
+//loops for the build's own processor. On x86 the same loops are also built for
+//SSE4.2, AVX2 and AVX-512, and the best the processor has is picked at run time.
+#define CALC_COLUMNS_GENERIC 0
+#define CALC_COLUMNS_SSE4 1
+#define CALC_COLUMNS_AVX2 2
+#define CALC_COLUMNS_AVX512 3
+#define CALC_COLUMNS_COUNT 4
+
+//rows run through the code per pass, small enough that the temporaries stay in cache
+#define CALC_COLUMN_BLOCK 512
+
+//An expression parsed once by Calculator::compile() and lowered to register
+//bytecode, for evaluating the same formula over and over with different inputs.
+//
+//The register file is laid out as [variables | constants | temporaries]. The
+//constants are loaded when the expression is built, so evaluate() only copies
+//the variables in and runs the instructions: no parsing, no strings and no
+//allocation per call. Variables are numbered in order of first appearance.
+//
+//The columnar evaluate() runs the same code over whole arrays: columns[i] holds
+//the values of variable i, one row per result. Each instruction is applied to a
+//block of rows at a time, with the arithmetic vectorized for the column target,
+//and every opcode computes exactly what the one row evaluate() does.
+//
+//build() optimizes as it lowers, unless told not to: constant sub-trees are
+//folded with the same arithmetic evaluate() would use, and identical
+//sub-expressions (and identical constants) are hash-consed so the code is a DAG
+//in which each is computed once. Algebraic rewrites and strength reduction run
+//on every operator before it is looked up, and whatever a rewrite leaves unused
+//is dropped at the end.
+class CompiledExpression{
+	private:
+		CalcInstruction *_code;
+		int _codeLength, _codeCapacity;
+
+		double *_registers;
+		int *_definitions;		//per register: the instruction that sets it, or CALC_REGISTER_
+		int _registerCount, _registerCapacity;
+
+		BString *_variableNames;
+		int _variableCount, _variableCapacity;
+
+		CalcDependency *_dependencies;		//the defined names it was built with, see Calculator::isCurrent()
+		int _dependencyCount, _dependencyCapacity;
+
+		//build() state: open addressed tables of constant registers and of instructions
+		int _optimize;
+		int *_constantTable, *_instructionTable;
+		int _tableMask;
+		CalcCompileStats _stats;
+
+		//per register row pointers and block storage for the columnar evaluate()
+		double **_columnRegisters;
+		double *_columnScratch;
+		int _columnCapacity;
+		int _columnTarget;
+
+		int addRegister(double value);
+		int addInstruction(int op, int a, int b);
+		int constantRegister(double value);
+		int operandRegister(const CalcOperand &operand);
+		CalcOperand emit(int op, const CalcOperand &a, const CalcOperand &b);
+		bool simplify(int op, const CalcOperand &a, const CalcOperand &b, CalcOperand &result);
+		bool reassociate(int op, const CalcOperand &x, double c, CalcOperand &result);
+		CalcOperand rewritten(int rule, const CalcOperand &result);
+		const CalcInstruction *definition(const CalcOperand &operand, int op);
+		void removeDeadCode();
+
+	public:
+		CompiledExpression(void);
+		~CompiledExpression(void);
+
+		void clear();
+		int addVariable(const char *name, int length);
+		bool build(const CalcNode *nodes, int count, bool useRadians);
+		void setDependencies(const CalcDependency *dependencies, int count);
+		const CalcDependency *dependencies();
+		int countDependencies();
+		void setOptimization(int level);		//one of the CALC_OPTIMIZE_ constants, strict by default
+		void getStats(CalcCompileStats *stats);
+		static const char *ruleName(int rule);
+
+		double evaluate(const double *vars);
+		void evaluate(const double *const *columns, double *results, int count);
+
+		bool setColumnTarget(int target);		//false if this processor can't run it
+		int columnTarget();
+		static bool columnTargetAvailable(int target);
+		static const char *columnTargetName(int target);
+
+		int countVariables();
+		const char *variableName(int index);
+		int variableIndex(const char *name);
+
+		int codeLength();
+		void print(FILE *out);
+};
+
+#endif
@@ -0,0 +1,381 @@
+#include <math.h>
+#include <float.h>
+
+#include "decimal.h"
+
+//*******************************************************************
+//Grisu2
+//*******************************************************************
+
+//f * 2^e, with f normalized to the top bit while digits are generated
+struct DecimalFp{
+	unsigned long long f;
+	int e;
+};
+
+//10^k for k = -348, -340 ... 340, rounded to 64 bits
+static const unsigned long long sPowerSignificands[87] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+	0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+	0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+	0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+	0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+	0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+	0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+	0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+	0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+	0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+	0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+	0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+	0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+	0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+	0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const short sPowerExponents[87] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+	-927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661,
+	-635, -608, -582, -555, -529, -502, -475, -449, -422, -396, -369,
+	-343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77,
+	-50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216,
+	242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508,
+	534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800,
+	827, 853, 880, 907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const unsigned long long sPowersOfTen[20] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+	10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+	1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+static DecimalFp multiply(const DecimalFp &x, const DecimalFp &y){
+	//the top 64 bits of the 128 bit product, rounded
+	unsigned long long a = x.f >> 32, b = x.f & 0xffffffffULL, c = y.f >> 32, d = y.f & 0xffffffffULL;
+	unsigned long long ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	unsigned long long middle = (bd >> 32) + (ad & 0xffffffffULL) + (bc & 0xffffffffULL) + (1ULL << 31);
+
+	DecimalFp product = { ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64 };
+	return product;
+}
+
+static DecimalFp normalize(DecimalFp x){
+	if (!(x.f >> 32)){ x.f <<= 32; x.e -= 32; }
+	if (!(x.f >> 48)){ x.f <<= 16; x.e -= 16; }
+	if (!(x.f >> 56)){ x.f <<= 8; x.e -= 8; }
+	if (!(x.f >> 60)){ x.f <<= 4; x.e -= 4; }
+	if (!(x.f >> 62)){ x.f <<= 2; x.e -= 2; }
+	if (!(x.f >> 63)){ x.f <<= 1; x.e -= 1; }
+	return x;
+}
+
+static DecimalFp cachedPower(int e, int *k){
+	//the cached power of ten that brings binary exponent e into -60 to -32, and k, its negated decimal exponent
+	double estimate = (-61 - e) * 0.30102999566398114 + 347;
+	int rounded = (int)estimate;
+	if (estimate - rounded > 0.0) rounded++;
+
+	int index = (rounded >> 3) + 1;
+	*k = 348 - index * 8;
+
+	DecimalFp power = { sPowerSignificands[index], sPowerExponents[index] };
+	return power;
+}
+
+static int digitCount(unsigned int n){
+	int count = 1;
+	while ((count < 10) && (n >= sPowersOfTen[count])) count++;
+	return count;
+}
+
+static void grisuRound(char *digits, int count, unsigned long long delta, unsigned long long rest, unsigned long long tenKappa, unsigned long long distance){
+	//steps the last digit down while that brings it closer to the value without leaving the interval
+	while ((rest < distance) && (delta - rest >= tenKappa)
+		&& ((rest + tenKappa < distance) || (distance - rest > rest + tenKappa - distance))){
+		digits[count - 1]--;
+		rest += tenKappa;
+	}
+}
+
+static int generateDigits(const DecimalFp &w, const DecimalFp &upper, unsigned long long delta, char *digits, int *k){
+	//the integer part of upper a digit at a time, then the fraction, until what is left is inside delta
+	DecimalFp one = { 1ULL << -upper.e, upper.e };
+	unsigned long long distance = upper.f - w.f;
+	unsigned int integral = (unsigned int)(upper.f >> -one.e);
+	unsigned long long fraction = upper.f & (one.f - 1);
+	int kappa = digitCount(integral), count = 0;
+
+	while (kappa > 0){
+		unsigned int divisor = (unsigned int)sPowersOfTen[kappa - 1];
+		unsigned int digit = integral / divisor;
+		integral %= divisor;
+		if (digit || count) digits[count++] = '0' + digit;
+		kappa--;
+
+		unsigned long long rest = ((unsigned long long)integral << -one.e) + fraction;
+		if (rest <= delta){
+			*k += kappa;
+			grisuRound(digits, count, delta, rest, sPowersOfTen[kappa] << -one.e, distance);
+			return count;
+		}
+	}
+
+	for (;;){
+		fraction *= 10;
+		delta *= 10;
+		int digit = (int)(fraction >> -one.e);
+		if (digit || count) digits[count++] = '0' + digit;
+		fraction &= one.f - 1;
+		kappa--;
+
+		if (fraction < delta){
+			*k += kappa;
+			grisuRound(digits, count, delta, fraction, one.f, distance * ((-kappa < 20) ? sPowersOfTen[-kappa] : 0));
+			return count;
+		}
+	}
+}
+
+static int grisu(unsigned long long f, int e, bool lowerCloser, char *digits, int *exponent){
+	//f * 2^e, whose neighbours are half an ulp away above and, at a power of two, a quarter below
+	DecimalFp value = { f, e };
+	DecimalFp upper = { (f << 1) + 1, e - 1 };
+	DecimalFp lower = { lowerCloser ? (f << 2) - 1 : (f << 1) - 1, lowerCloser ? e - 2 : e - 1 };
+
+	upper = normalize(upper);
+	lower.f <<= lower.e - upper.e;
+	lower.e = upper.e;
+
+	int k;
+	DecimalFp power = cachedPower(upper.e, &k);
+	DecimalFp w = multiply(normalize(value), power);
+	DecimalFp high = multiply(upper, power), low = multiply(lower, power);
+
+	//one unit in from each end covers the rounding in multiply()
+	low.f++;
+	high.f--;
+
+	int count = generateDigits(w, high, high.f - low.f, digits, &k);
+	*exponent = count + k - 1;
+	return count;
+}
+
+int decimalShortest(double value, char *digits, int *exponent){
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	int biased = (int)((bits >> 52) & 0x7ff);
+	unsigned long long f = bits & ((1ULL << 52) - 1);
+
+	if (biased == 0) return grisu(f, -1074, false, digits, exponent);
+	return grisu(f | (1ULL << 52), biased - 1075, (f == 0) && (biased > 1), digits, exponent);
+}
+
+int decimalShortest(float value, char *digits, int *exponent){
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	int biased = (int)((bits >> 23) & 0xff);
+	unsigned long long f = bits & ((1U << 23) - 1);
+
+	if (biased == 0) return grisu(f, -149, false, digits, exponent);
+	return grisu(f | (1ULL << 23), biased - 150, (f == 0) && (biased > 1), digits, exponent);
+}
+
+
+
+//*******************************************************************
+//Layout
+//*******************************************************************
+
+static int exponentLength(int exponent){
+	//e+05, e-123
+	return ((exponent >= 100) || (exponent <= -100)) ? 5 : 4;
+}
+
+static char *writeExponent(char *out, int exponent){
+	*out++ = 'e';
+	*out++ = (exponent < 0) ? '-' : '+';
+	if (exponent < 0) exponent = -exponent;
+
+	if (exponent >= 100) *out++ = '0' + exponent / 100;
+	*out++ = '0' + (exponent / 10) % 10;
+	*out++ = '0' + exponent % 10;
+	return out;
+}
+
+static int engineeringExponent(int exponent){
+	//rounded down to a multiple of three
+	return (exponent >= 0) ? (exponent / 3) * 3 : -((-exponent + 2) / 3) * 3;
+}
+
+static int layout(const char *digits, int count, int exponent, bool negative, int mode, int precision, char *buffer, int size){
+	//count digits from 10^exponent down, any past the end are zeros
+	int integral, fraction, leading = 0, shown = exponent;
+
+	if (mode == CALC_DECIMAL_SHORTEST){
+		if ((exponent < CALC_DECIMAL_PLAIN_LOW) || (exponent >= CALC_DECIMAL_PLAIN_HIGH)){
+			mode = CALC_DECIMAL_SCIENTIFIC;
+			precision = (count > 0) ? count - 1 : 0;
+		}
+		else{
+			mode = CALC_DECIMAL_FIXED;
+			precision = (count > exponent + 1) ? count - exponent - 1 : 0;
+		}
+	}
+
+	switch (mode){
+		case CALC_DECIMAL_FIXED:
+			integral = (exponent >= 0) ? exponent + 1 : 1;
+			fraction = precision;
+			leading = (exponent >= 0) ? 0 : 1;		//the 0 before the point, not one of the digits
+			break;
+
+		case CALC_DECIMAL_ENGINEERING:
+			shown = engineeringExponent(exponent);
+			integral = exponent - shown + 1;
+			fraction = (precision + 1 > integral) ? precision + 1 - integral : 0;
+			break;
+
+		default:
+			integral = 1;
+			fraction = precision;
+			break;
+	}
+
+	int length = (negative ? 1 : 0) + integral + ((fraction > 0) ? fraction + 1 : 0);
+	if (mode != CALC_DECIMAL_FIXED) length += exponentLength(shown);
+
+	if (length >= size){
+		if (size > 0) buffer[0] = '\0';
+		return length;
+	}
+
+	char *out = buffer;
+	int index = 0;		//of the next digit to write
+
+	if (negative) *out++ = '-';
+
+	if (leading){
+		*out++ = '0';
+		index = exponent + 1;		//negative, the zeros between the point and the first digit
+	}
+	else{
+		for (int i = 0; i < integral; i++, index++)
+			*out++ = (index < count) ? digits[index] : '0';
+	}
+
+	if (fraction > 0){
+		*out++ = '.';
+		for (int i = 0; i < fraction; i++, index++)
+			*out++ = ((index >= 0) && (index < count)) ? digits[index] : '0';
+	}
+
+	if (mode != CALC_DECIMAL_FIXED) out = writeExponent(out, shown);
+
+	*out = '\0';
+	return length;
+}
+
+static bool roundDigits(char *digits, int &count, int &exponent, int wanted){
+	//Cuts the digits down to wanted, rounding. Where the value itself is this close
+	//to them (within a tenth of the last digit kept) that rounds it the same way,
+	//unless the first digit dropped is near enough to a tie that the value could be
+	//on the other side of it.
+	if (count <= wanted) return true;
+	if (wanted < 0){
+		count = 0;
+		return true;
+	}
+
+	char first = digits[wanted];
+	if ((first >= '3') && (first <= '7')) return false;
+
+	count = wanted;
+	if (first >= '8'){
+		int i = wanted - 1;
+		while ((i >= 0) && (digits[i] == '9')) i--;
+
+		if (i < 0){
+			digits[0] = '1';
+			count = 1;
+			exponent++;
+		}
+		else{
+			digits[i]++;
+			count = i + 1;
+		}
+	}
+
+	return true;
+}
+
+static int formatDigits(double value, char *digits, int count, int exponent, int exactDigits, bool subnormal, int mode, int precision, char *buffer, int size){
+	bool negative = signbit(value);
+
+	if (mode == CALC_DECIMAL_SHORTEST)
+		return layout(digits, count, exponent, negative, mode, precision, buffer, size);
+
+	//the digits wanted, and whether this value is one the shortcut holds for
+	int wanted = (mode == CALC_DECIMAL_FIXED) ? exponent + 1 + precision : precision + 1;
+	if (!subnormal && (wanted <= exactDigits) && roundDigits(digits, count, exponent, wanted))
+		return layout(digits, count, exponent, negative, mode, precision, buffer, size);
+
+	if (mode == CALC_DECIMAL_FIXED)
+		return snprintf(buffer, size, "%.*f", precision, value);
+
+	char text[CALC_DECIMAL_MAX_PRECISION + 16];
+	snprintf(text, sizeof(text), "%.*e", precision, value);
+	return formatDecimalFromScientific(text, mode, precision, buffer, size);
+}
+
+int formatDecimal(double value, int mode, int precision, char *buffer, int size){
+	char digits[32];
+	int count = 0, exponent = 0;
+	double magnitude = fabs(value);
+
+	if (isnan(value) || isinf(value)) return snprintf(buffer, size, "%f", value);
+
+	if (magnitude != 0) count = decimalShortest(magnitude, digits, &exponent);
+	return formatDigits(value, digits, count, exponent, 15, (magnitude != 0) && (magnitude < DBL_MIN), mode, precision, buffer, size);
+}
+
+int formatDecimal(float value, int mode, int precision, char *buffer, int size){
+	char digits[32];
+	int count = 0, exponent = 0;
+	float magnitude = fabsf(value);
+
+	if (isnan(value) || isinf(value)) return snprintf(buffer, size, "%f", (double)value);
+
+	if (magnitude != 0) count = decimalShortest(magnitude, digits, &exponent);
+	return formatDigits(value, digits, count, exponent, 6, (magnitude != 0) && (magnitude < FLT_MIN), mode, precision, buffer, size);
+}
+
+int formatDecimalFromScientific(const char *scientific, int mode, int precision, char *buffer, int size){
+	const char *p = scientific;
+	char digits[CALC_DECIMAL_MAX_PRECISION + 16];
+	int count = 0;
+	bool negative = (*p == '-');
+
+	if ((*p == '-') || (*p == '+')) p++;
+	if ((*p < '0') || (*p > '9')) return snprintf(buffer, size, "%s", scientific);		//nan and inf
+
+	for (; ((*p >= '0') && (*p <= '9')) || (*p == '.'); p++)
+		if ((*p != '.') && (count < (int)sizeof(digits))) digits[count++] = *p;
+
+	int exponent = ((*p == 'e') || (*p == 'E')) ? atoi(p + 1) : 0;
+
+	//trailing zeros only matter to the shortest form, the others pad them back
+	while ((count > 0) && (digits[count - 1] == '0')) count--;
+	if (count == 0) exponent = 0;
+
+	return layout(digits, count, exponent, negative, mode, precision, buffer, size);
+}
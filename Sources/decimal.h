@@ -0,0 +1,48 @@
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+//Decimal response modes, see Calculator::setDecimalFormat()
+#define CALC_DECIMAL_SHORTEST 0			//the fewest digits that read back as the same value
+#define CALC_DECIMAL_FIXED 1			//precision digits after the point, as printf's %f
+#define CALC_DECIMAL_SCIENTIFIC 2		//precision digits after the point of d.ddde+xx, as printf's %e
+#define CALC_DECIMAL_ENGINEERING 3		//precision + 1 significant digits, with the exponent a multiple of three
+#define CALC_DECIMAL_MODE_COUNT 4
+
+#define CALC_DECIMAL_MAX_PRECISION 100
+//shortest output is written out in full from 10^-7 up to 10^21, in scientific outside that
+#define CALC_DECIMAL_PLAIN_LOW -7
+#define CALC_DECIMAL_PLAIN_HIGH 21
+
+//Shortest digits come from Grisu2 (Loitsch, "Printing floating-point numbers
+//quickly and accurately"): the value and the edges of the interval that rounds
+//back to it are scaled by a cached power of ten into 64 bit fixed point, and
+//digits are generated until they land inside. The digits always read back as
+//the same value, and are the shortest that do for all but a small fraction of
+//values, which get one more.
+//
+//The other modes start from those digits. Padding them out, or rounding them
+//where the first digit dropped is far enough from a tie, gives what printf would
+//as long as the digits asked for are within the type's precision. The rest
+//(ties, subnormals, more digits than the type holds) go to printf itself, so
+//the output is always exactly what printf writes.
+
+//value must be finite and above zero. Writes the significant digits, with no
+//point and no terminator, and returns how many. exponent is the power of ten of
+//the first digit. At most 17 digits.
+int decimalShortest(double value, char *digits, int *exponent);
+int decimalShortest(float value, char *digits, int *exponent);
+
+//returns the full length like snprintf, but writes nothing besides the terminator unless all of it fits
+int formatDecimal(double value, int mode, int precision, char *buffer, int size);
+int formatDecimal(float value, int mode, int precision, char *buffer, int size);
+
+//for the types printf has to produce the digits for. scientific is printf's %e
+//output, with as many digits as the mode needs (or the type holds, for shortest,
+//as trailing zeros are dropped), and is laid out the same way as the rest.
+int formatDecimalFromScientific(const char *scientific, int mode, int precision, char *buffer, int size);
+
+#endif
@@ -0,0 +1,68 @@
+#include "engine.h"
+
+static const CalcWord sWords[] = {
+	{ "sin", 's' }, { "cos", 'c' }, { "tan", 't' },
+	{ "asin", 'S' }, { "acos", 'C' }, { "atan", 'T' },
+	{ "and", '&' }, { "or", '|' },
+	{ "ans", CALC_TOKEN_ANS }, { "pi", CALC_TOKEN_PI }
+};
+
+void settingsDefaults(CalcSettings *settings){
+	settings->numericType = CALC_TYPE_DOUBLE;
+	settings->useRadians = false;
+	radixDefaults(&settings->responseFormat, 10);
+	settings->decimalMode = CALC_DECIMAL_SHORTEST;
+	settings->decimalPrecision = 6;
+}
+
+bool settingsValid(const CalcSettings &settings){
+	return numericTypeAvailable(settings.numericType) && radixValid(settings.responseFormat)
+		&& (settings.decimalMode >= 0) && (settings.decimalMode < CALC_DECIMAL_MODE_COUNT)
+		&& (settings.decimalPrecision >= 0) && (settings.decimalPrecision <= CALC_DECIMAL_MAX_PRECISION);
+}
+
+
+
+//*******************************************************************
+
+CalcEngine::CalcEngine(){
+	CalcSettings settings;
+	settingsDefaults(&settings);
+	setUp(settings);
+}
+
+CalcEngine::CalcEngine(const CalcSettings &settings){
+	setUp(settings);
+}
+
+void CalcEngine::setUp(const CalcSettings &settings){
+	_settings = settings;
+	_words = sWords;
+	_wordCount = sizeof(sWords) / sizeof(sWords[0]);
+
+	//The same order parenthetize() used to wrap operators in, with the pairs that
+	//belong together (* /, << >>, + -) sharing a level so that they associate
+	//left to right, ie. standard c style. Prefix operators bind tightest.
+	memset(_precedence, 0, sizeof(_precedence));
+	memset(_prefix, 0, sizeof(_prefix));
+
+	static const char *levels[] = { "+-", "|", "&", "<>", "%", "^", "*/", "sctSCTm" };		//m for unary minus
+	for (int level = 0; level < 8; level++)
+		for (const char *op = levels[level]; *op != '\0'; op++)
+			_precedence[(unsigned char)*op] = level + 1;
+
+	for (const char *op = levels[7]; *op != '\0'; op++)
+		_prefix[(unsigned char)*op] = true;
+}
+
+char CalcEngine::lookupWord(const char *word, int length) const{
+	for (int i = 0; i < _wordCount; i++)
+		if (((int)strlen(_words[i].name) == length) && !strncasecmp(word, _words[i].name, length)) return _words[i].type;
+
+	return CALC_TOKEN_WORD;
+}
+
+int CalcEngine::cacheMode() const{
+	return (_settings.decimalPrecision << 18) | (_settings.decimalMode << 16) | (_settings.numericType << 8)
+		| (_settings.responseFormat.base << 1) | (_settings.useRadians ? 1 : 0);
+}
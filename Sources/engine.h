@@ -0,0 +1,98 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#include "numeric.h"
+#include "radix.h"
+
+//Token and node codes. Operators keep their old single-byte codes
+//(sin -> 's', asin -> 'S', >> -> '>' and so on) so the tables below read
+//the same as the operator strings always have.
+#define CALC_TOKEN_NUMBER 'n'
+#define CALC_TOKEN_ANS 'a'
+#define CALC_TOKEN_PI 'p'
+#define CALC_TOKEN_NEGATE 'm'
+#define CALC_TOKEN_VARIABLE 'v'
+#define CALC_TOKEN_WORD 'w'
+#define CALC_TOKEN_LEFT_PAREN '('
+#define CALC_TOKEN_RIGHT_PAREN ')'
+#define CALC_TOKEN_END 'e'
+#define CALC_TOKEN_INVALID '?'
+#define CALC_TOKEN_BAD_NUMBER '!'		//a literal scanNumber() refused, only the part at fault is in the token
+#define CALC_TOKEN_COMMA ','				//between the arguments of a call
+#define CALC_TOKEN_CALL 'f'				//a function's name and its '(', on the operator stack until the ')'
+#define CALC_TOKEN_PARAMETER 'r'		//only in a function's body, left is which parameter
+#define CALC_TOKEN_SYMBOL 'y'			//likewise, a variable looked up when the function is called, left is its slot
+
+//Expression tree node. Nodes are stored in postorder in a flat array, so
+//children always come before their parent and evaluation is one forward sweep.
+struct CalcNode{
+	char op;
+	int left, right;		//indices into the node array, -1 if unused
+	double value;			//for CALC_TOKEN_VARIABLE left holds the variable's index
+	int start;				//where a number was in the source, so each numeric type can read it exactly
+	int literal;			//or where it is in the literal text, when it had to be rewritten for them
+};
+
+//A symbol something was built with, as it was then, see SymbolTable::isCurrent()
+struct CalcDependency{
+	int slot;
+	int version;
+};
+
+//Everything that decides what an expression means and how its answer is written
+struct CalcSettings{
+	int numericType;				//one of the CALC_TYPE_ constants
+	bool useRadians;
+	CalcRadixFormat responseFormat;
+	int decimalMode;				//one of the CALC_DECIMAL_ modes, for base 10 responses of the floating point types
+	int decimalPrecision;
+};
+
+void settingsDefaults(CalcSettings *settings);		//double, degrees, shortest base 10
+bool settingsValid(const CalcSettings &settings);	//and the numeric type available in this build
+
+//What the lexer knows a word as, matched case insensitively and as a whole
+struct CalcWord{
+	const char *name;
+	char type;				//token code
+};
+
+//The part of evaluation that doesn't change from one call to the next: the
+//settings, and the operator and word tables. An engine is only ever set up in its
+//constructor, and nothing it has changes after, so any number of Calculators on
+//any number of threads can share one without a lock. What a call does change
+//(the parser's scratch, 'ans', the cache) is kept in each Calculator.
+class CalcEngine{
+	private:
+		CalcSettings _settings;
+		const CalcWord *_words;
+		int _wordCount;
+		unsigned char _precedence[256];		//by token code, 0 for anything not an operator
+		bool _prefix[256];					//binds to what follows it alone
+
+		void setUp(const CalcSettings &settings);
+
+	public:
+		CalcEngine(void);					//settingsDefaults()
+		CalcEngine(const CalcSettings &settings);		//which must be valid, see settingsValid()
+
+		const CalcSettings &settings() const { return _settings; }
+
+		//the characters that are an infix operator on their own
+		bool isOperator(char c) const { return (_precedence[(unsigned char)c] != 0) && !_prefix[(unsigned char)c]; }
+		bool isPrefixOperator(char c) const { return _prefix[(unsigned char)c]; }
+		int precedence(char op) const { return _precedence[(unsigned char)op]; }
+
+		//the token code of a word, CALC_TOKEN_WORD if it isn't one
+		char lookupWord(const char *word, int length) const;
+
+		//the part of the settings a cached answer depends on
+		int cacheMode() const;
+};
+
+#endif
@@ -29,6 +29,8 @@ CalcView::CalcView(BRect frame, const char *name, int32 resizingmode, int32 flag
 	: BView(frame, name, resizingmode, flags | B_WILL_DRAW)
 {
 	_theCalc = new Calculator();	
+	_history = new AnswerHistory();
+	_theCalc->setHistory(_history);
 	
 	return;
 }
@@ -36,6 +38,7 @@ CalcView::CalcView(BRect frame, const char *name, int32 resizingmode, int32 flag
 CalcView::~CalcView()
 {
 	delete _theCalc;
+	delete _history;
 	delete _messenger;
 	
 	return;
@@ -252,6 +255,12 @@ void CalcView::LoadPrefs(){
 	
 	if (find_directory(B_USER_SETTINGS_DIRECTORY, &prefPath) != B_OK)
 		printf("\tUnable to find default user settings directory\n");
+	
+	//the answers of earlier sessions, for 'ans1' on. Without it they only last this one.
+	BPath historyPath(prefPath);
+	historyPath.Append(HISTORY_FILE);
+	if (!_history->open(historyPath.Path()))
+		printf("\tUnable to open the answer history\n");
 		
 	prefPath.Append(PREF_FILE);
 	
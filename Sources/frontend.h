@@ -12,6 +12,7 @@
 
 #define APP_SIG "application/x-vnd.gaz.gigocalc"
 #define PREF_FILE "gigocalc_settings"
+#define HISTORY_FILE "gigocalc_history"
 
 
 #define MSG_TEXT_IN 'IN'
@@ -41,6 +42,7 @@ class CalcView: public BView{
 		BMessenger *_messenger;
 	
 		Calculator *_theCalc;
+		AnswerHistory *_history;
 
 		BTextControl *_inputText, *_outputText;
 				
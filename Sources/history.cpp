@@ -0,0 +1,348 @@
+#include "history.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static calc_int64 recordSize(int expressionLength, int answerLength, int canonicalLength){
+	calc_int64 size = sizeof(HistoryRecord) + expressionLength + 1 + answerLength + 1
+		+ ((canonicalLength > 0) ? canonicalLength + 1 : 0);
+	return (size + 7) & ~(calc_int64)7;
+}
+
+static calc_uint64 sortKey(const char *text){
+	//big endian and zero filled, so the keys are in the order the texts are
+	calc_uint64 key = 0;
+	int i = 0;
+	
+	for (; (i < 8) && (text[i] != '\0'); i++)
+		key = (key << 8) | (unsigned char)text[i];
+	for (; i < 8; i++)
+		key <<= 8;
+	
+	return key;
+}
+
+AnswerHistory::AnswerHistory(){
+	_file = -1;
+	_map = NULL;
+	_mapSize = 0;
+	_header = NULL;
+
+	_offsets = NULL;
+	_keys = NULL;
+	_offsetCapacity = 0;
+	_sorted = NULL;
+	_sortedCount = _sortedCapacity = 0;
+	_scratch = NULL;
+	_scratchCapacity = 0;
+
+	reset();
+}
+
+AnswerHistory::~AnswerHistory(){
+	if (_map != NULL) munmap(_map, _mapSize);
+	if (_file >= 0) close(_file);
+
+	delete [] _offsets;
+	delete [] _keys;
+	delete [] _sorted;
+	delete [] _scratch;
+}
+
+bool AnswerHistory::mapSize(calc_int64 size){
+	//a file is grown and mapped again, memory is copied into a bigger mapping
+	char *map;
+
+	if (_file >= 0){
+		if (ftruncate(_file, size) != 0) return false;
+		map = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+	}
+	else{
+		map = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if ((map != MAP_FAILED) && (_map != NULL)) memcpy(map, _map, _header->end);
+	}
+
+	if (map == MAP_FAILED) return false;
+
+	if (_map != NULL) munmap(_map, _mapSize);
+	_map = map;
+	_mapSize = size;
+	_header = (HistoryHeader *)_map;
+	return true;
+}
+
+void AnswerHistory::reset(){
+	//back to empty and in memory
+	if (_map != NULL) munmap(_map, _mapSize);
+	if (_file >= 0) close(_file);
+	_map = NULL;
+	_file = -1;
+	_sortedCount = 0;
+
+	mapSize(CALC_HISTORY_INITIAL_SIZE);
+	memcpy(_header->magic, CALC_HISTORY_MAGIC, 8);
+	_header->count = 0;
+	_header->end = sizeof(HistoryHeader);
+}
+
+bool AnswerHistory::open(const char *path){
+	reset();
+
+	int file = ::open(path, O_RDWR | O_CREAT, 0644);
+	if (file < 0) return false;
+
+	//only one history writes a log at a time, the lock goes with the descriptor
+	if (flock(file, LOCK_EX | LOCK_NB) != 0){
+		close(file);
+		return false;
+	}
+
+	struct stat info;
+	if ((fstat(file, &info) != 0) || ((info.st_size > 0) && (info.st_size < (off_t)sizeof(HistoryHeader)))){
+		close(file);
+		return false;
+	}
+
+	munmap(_map, _mapSize);
+	_map = NULL;
+	_file = file;
+
+	bool fresh = (info.st_size == 0);
+	if (!mapSize(fresh ? CALC_HISTORY_INITIAL_SIZE : (calc_int64)info.st_size)){
+		reset();
+		return false;
+	}
+
+	if (fresh){
+		memcpy(_header->magic, CALC_HISTORY_MAGIC, 8);
+		_header->count = 0;
+		_header->end = sizeof(HistoryHeader);
+		return true;
+	}
+
+	if (memcmp(_header->magic, CALC_HISTORY_MAGIC, 8) || (_header->end < (calc_int64)sizeof(HistoryHeader))
+		|| (_header->end > _mapSize) || (_header->count < 0)){
+		reset();
+		return false;
+	}
+
+	//only the offsets are taken, and a record that doesn't fit is where the log ends
+	calc_int64 offset = sizeof(HistoryHeader);
+	int count = 0;
+
+	if (_offsetCapacity < _header->count) growOffsets((int)_header->count, 0);
+
+	while ((count < _header->count) && (offset + (calc_int64)sizeof(HistoryRecord) <= _header->end)){
+		const HistoryRecord *record = (const HistoryRecord *)(_map + offset);
+		if ((record->expressionLength < 0) || (record->answerLength < 0) || (record->canonicalLength < 0)) break;
+
+		calc_int64 size = recordSize(record->expressionLength, record->answerLength, record->canonicalLength);
+		if (offset + size > _header->end) break;
+
+		_keys[count] = sortKey((const char *)(record + 1));
+		_offsets[count++] = offset;
+		offset += size;
+	}
+
+	_header->count = count;
+	_header->end = offset;
+	return true;
+}
+
+void AnswerHistory::growOffsets(int capacity, int keep){
+	calc_int64 *offsets = new calc_int64[capacity];
+	calc_uint64 *keys = new calc_uint64[capacity];
+	
+	if (keep > 0){
+		memcpy(offsets, _offsets, keep * sizeof(calc_int64));
+		memcpy(keys, _keys, keep * sizeof(calc_uint64));
+	}
+	delete [] _offsets;
+	delete [] _keys;
+	
+	_offsets = offsets;
+	_keys = keys;
+	_offsetCapacity = capacity;
+}
+
+bool AnswerHistory::append(const char *expression, int expressionLength, const char *answer, const char *canonical,
+	double value, int numericType){
+	int answerLength = strlen(answer);
+	int canonicalLength = (canonical != NULL) ? strlen(canonical) : 0;
+	calc_int64 size = recordSize(expressionLength, answerLength, canonicalLength);
+
+	if (_header->end + size > _mapSize){
+		calc_int64 grown = _mapSize * 2;
+		while (grown < _header->end + size) grown *= 2;
+		if (!mapSize(grown)) return false;
+	}
+
+	//a count the offsets don't go up to isn't one this history wrote
+	int count = (int)_header->count;
+	if (count > _offsetCapacity) return false;
+	if (count == _offsetCapacity) growOffsets((_offsetCapacity < 1024) ? 1024 : 2 * _offsetCapacity, count);
+
+	HistoryRecord *record = (HistoryRecord *)(_map + _header->end);
+	record->expressionLength = expressionLength;
+	record->answerLength = answerLength;
+	record->canonicalLength = canonicalLength;
+	record->numericType = numericType;
+	record->value = value;
+
+	char *text = (char *)(record + 1);
+	memcpy(text, expression, expressionLength);
+	text[expressionLength] = '\0';
+	text += expressionLength + 1;
+	memcpy(text, answer, answerLength + 1);
+	if (canonicalLength > 0) memcpy(text + answerLength + 1, canonical, canonicalLength + 1);
+
+	//the record is all there before the header says so
+	_offsets[count] = _header->end;
+	_keys[count] = sortKey((const char *)(record + 1));
+	_header->end += size;
+	_header->count = count + 1;
+	return true;
+}
+
+const char *AnswerHistory::expression(int back) const{
+	if ((back < 0) || (back >= count())) return NULL;
+	return recordExpression(count() - 1 - back);
+}
+
+const char *AnswerHistory::answer(int back) const{
+	if ((back < 0) || (back >= count())) return NULL;
+
+	int entry = count() - 1 - back;
+	return recordExpression(entry) + record(entry)->expressionLength + 1;
+}
+
+const char *AnswerHistory::canonical(int back) const{
+	const char *text = answer(back);
+	if (text == NULL) return NULL;
+
+	int length = record(count() - 1 - back)->canonicalLength;
+	return (length > 0) ? text + strlen(text) + 1 : text;
+}
+
+double AnswerHistory::value(int back) const{
+	if ((back < 0) || (back >= count())) return 0;
+	return record(count() - 1 - back)->value;
+}
+
+int AnswerHistory::numericType(int back) const{
+	if ((back < 0) || (back >= count())) return 0;
+	return record(count() - 1 - back)->numericType;
+}
+
+
+
+//*******************************************************************
+
+int AnswerHistory::compare(int a, int b) const{
+	//by expression, then the newer first. Most are told apart by the keys alone.
+	if (_keys[a] != _keys[b]) return (_keys[a] < _keys[b]) ? -1 : 1;
+	
+	int order = strcmp(recordExpression(a), recordExpression(b));
+	if (order != 0) return order;
+	return (a > b) ? -1 : ((a < b) ? 1 : 0);
+}
+
+void AnswerHistory::sortEntries(int *entries, int count){
+	//bottom up merge sort, through _scratch
+	if (_scratchCapacity < count){
+		delete [] _scratch;
+		_scratchCapacity = count;
+		_scratch = new int[_scratchCapacity];
+	}
+
+	int *from = entries, *to = _scratch;
+	for (int width = 1; width < count; width *= 2){
+		for (int start = 0; start < count; start += 2 * width){
+			int middle = (start + width < count) ? start + width : count;
+			int stop = (start + 2 * width < count) ? start + 2 * width : count;
+			int i = start, j = middle, k = start;
+
+			while ((i < middle) && (j < stop))
+				to[k++] = (compare(from[j], from[i]) < 0) ? from[j++] : from[i++];
+			while (i < middle) to[k++] = from[i++];
+			while (j < stop) to[k++] = from[j++];
+		}
+
+		int *swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != entries) memcpy(entries, from, count * sizeof(int));
+}
+
+void AnswerHistory::sortTail(){
+	//sorts what was appended since the last search and merges it in from the back,
+	//each new entry binary searched and everything after it moved once
+	int total = count(), tail = total - _sortedCount;
+	if (tail <= 0) return;
+
+	if (_sortedCapacity < total){
+		int capacity = (total > 2 * _sortedCapacity) ? total : 2 * _sortedCapacity;
+		int *sorted = new int[capacity];
+		if (_sortedCount > 0) memcpy(sorted, _sorted, _sortedCount * sizeof(int));
+		delete [] _sorted;
+		_sorted = sorted;
+		_sortedCapacity = capacity;
+	}
+
+	int *added = _sorted + _sortedCount;
+	for (int i = 0; i < tail; i++)
+		added[i] = _sortedCount + i;
+	sortEntries(added, tail);
+
+	if (_sortedCount > 0){
+		memcpy(_scratch, added, tail * sizeof(int));
+
+		int high = _sortedCount;
+		for (int k = tail - 1; k >= 0; k--){
+			int entry = _scratch[k], low = 0, top = high;
+			while (low < top){
+				int middle = (low + top) / 2;
+				if (compare(_sorted[middle], entry) > 0) top = middle;
+				else low = middle + 1;
+			}
+
+			memmove(_sorted + low + k + 1, _sorted + low, (high - low) * sizeof(int));
+			_sorted[low + k] = entry;
+			high = low;
+		}
+	}
+
+	_sortedCount = total;
+}
+
+int AnswerHistory::findPrefix(const char *prefix, int length, int *backs, int count){
+	sortTail();
+
+	//the first expression that doesn't sort before the prefix
+	int low = 0, high = _sortedCount;
+	while (low < high){
+		int middle = (low + high) / 2;
+		if (strncmp(recordExpression(_sorted[middle]), prefix, length) < 0) low = middle + 1;
+		else high = middle;
+	}
+
+	//equal expressions are together with the newest first, so the rest are skipped
+	const char *last = NULL;
+	int found = 0, newest = this->count() - 1;
+
+	for (int i = low; (i < _sortedCount) && (found < count); i++){
+		const char *text = recordExpression(_sorted[i]);
+		if (strncmp(text, prefix, length) != 0) break;
+		if ((last != NULL) && !strcmp(text, last)) continue;
+
+		backs[found++] = newest - _sorted[i];
+		last = text;
+	}
+
+	return found;
+}
@@ -0,0 +1,95 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "numeric.h"
+
+#define CALC_HISTORY_MAGIC "GIGOhst1"
+#define CALC_HISTORY_INITIAL_SIZE 65536
+
+//At the start of the file. count and end are only moved on once a record is
+//all there, so a log cut short by a crash reads back as the entries before it.
+struct HistoryHeader{
+	char magic[8];
+	calc_int64 count;			//records
+	calc_int64 end;				//bytes in use, header included
+};
+
+//Each record is followed by its expression, answer and canonical text, every one
+//terminated, and padded so the next record starts on eight bytes.
+struct HistoryRecord{
+	int expressionLength;
+	int answerLength;
+	int canonicalLength;		//0 when the answer is already in the form the numeric types read
+	int numericType;			//the type the answer came from
+	double value;				//the answer as a double, what the compiled forms take as a constant
+};
+
+//Every answer calculate() gives, with the expression it came from, in an append
+//only log that is memory mapped, so 'ans1' and on bind straight to what was stored
+//and nothing is read or parsed when the log is opened but the record offsets.
+//Answers are numbered back from the newest: 0 is 'ans', 1 the one before it.
+//
+//Without a file the log is kept in anonymous memory the same way. The file is in
+//the machine's own byte order. Like a Calculator, a history is only used by one
+//thread at a time, and a file by one history at a time: it is locked while open,
+//so a second window or --history opening the same log keeps its answers in memory.
+class AnswerHistory{
+	private:
+		int _file;					//-1 when in memory only
+		char *_map;
+		calc_int64 _mapSize;
+		HistoryHeader *_header;
+
+		calc_int64 *_offsets;		//of every record, oldest first
+		calc_uint64 *_keys;			//the first eight characters of each expression, to sort by without going to the log
+		int _offsetCapacity;
+
+		//entries by expression, and the newest first among equal ones; those from
+		//_sortedCount on have been appended since the last prefix search
+		int *_sorted;
+		int _sortedCount, _sortedCapacity;
+		int *_scratch;
+		int _scratchCapacity;
+
+		bool mapSize(calc_int64 size);
+		void reset();
+		void growOffsets(int capacity, int keep);
+		const HistoryRecord *record(int entry) const { return (const HistoryRecord *)(_map + _offsets[entry]); }
+		const char *recordExpression(int entry) const { return (const char *)(record(entry) + 1); }
+		int compare(int a, int b) const;
+		void sortEntries(int *entries, int count);
+		void sortTail();
+
+	public:
+		AnswerHistory(void);			//empty, in memory
+		~AnswerHistory(void);
+
+		//Maps the log at path, creating it if there is none. False if it can't be,
+		//isn't a history or another history has it open, and the history is then
+		//empty and in memory.
+		bool open(const char *path);
+		bool isPersistent() const { return _file >= 0; }
+
+		int count() const { return (int)_header->count; }
+		bool append(const char *expression, int expressionLength, const char *answer, const char *canonical,
+			double value, int numericType);
+
+		//back from the newest, NULL or 0 past the oldest
+		const char *expression(int back) const;
+		const char *answer(int back) const;
+		const char *canonical(int back) const;			//the answer, as the numeric types read it
+		double value(int back) const;
+		int numericType(int back) const;
+
+		//Up to count of the distinct past expressions that start with prefix, in
+		//order, each as the newest answer it gave. Returns how many there were. The
+		//index behind it is sorted once, then only the entries since the last search
+		//are merged in, so with millions of entries a search is a binary search.
+		int findPrefix(const char *prefix, int length, int *backs, int count);
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef OS_H
+#define OS_H
+
+//system_time() from Haiku's OS.h, microseconds on the monotonic clock
+
+#include <time.h>
+#include <pthread.h>
+
+#include "SupportDefs.h"
+
+inline bigtime_t system_time(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (bigtime_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef STRING_H
+#define STRING_H
+
+//The part of Haiku's BString the engine and the command line use, with the same
+//behaviour: lengths are clipped at a NUL, and the text is always terminated.
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "SupportDefs.h"
+
+class BString{
+	private:
+		char *_data;
+		int32 _length, _capacity;
+
+		void reserve(int32 length){
+			if (length < _capacity) return;
+
+			int32 capacity = (_capacity > 0) ? _capacity : 16;
+			while (capacity <= length) capacity *= 2;
+
+			char *data = new char[capacity];
+			if (_data != NULL) memcpy(data, _data, _length + 1);
+			else data[0] = '\0';
+			delete[] _data;
+			_data = data;
+			_capacity = capacity;
+		}
+
+		static int32 clipped(const char *text, int32 length){
+			const char *end = (const char *)memchr(text, '\0', length);
+			return end ? (int32)(end - text) : length;
+		}
+
+	public:
+		BString(){ _data = NULL; _length = _capacity = 0; }
+		BString(const char *text){ _data = NULL; _length = _capacity = 0; SetTo(text); }
+		BString(const char *text, int32 length){ _data = NULL; _length = _capacity = 0; SetTo(text, length); }
+		BString(const BString &other){ _data = NULL; _length = _capacity = 0; SetTo(other.String(), other.Length()); }
+		~BString(){ delete[] _data; }
+
+		BString &operator=(const BString &other){ return (this == &other) ? *this : SetTo(other.String(), other.Length()); }
+		BString &operator=(const char *text){ return SetTo(text); }
+
+		const char *String() const { return _data ? _data : ""; }
+		int32 Length() const { return _length; }
+		char ByteAt(int32 index) const { return ((index < 0) || (index >= _length)) ? 0 : _data[index]; }
+		char operator[](int32 index) const { return _data[index]; }
+
+		BString &SetTo(const char *text){ return SetTo(text, text ? (int32)strlen(text) : 0); }
+		BString &SetTo(const char *text, int32 length){
+			_length = 0;
+			if (_data != NULL) _data[0] = '\0';
+			return Append(text, length);
+		}
+
+		BString &Append(const char *text){ return Append(text, text ? (int32)strlen(text) : 0); }
+		BString &Append(const char *text, int32 length){
+			if ((text == NULL) || (length <= 0)) return *this;
+			length = clipped(text, length);
+			if ((_data != NULL) && (text >= _data) && (text < _data + _capacity)){
+				int32 offset = text - _data;		//our own text, which reserve() may move
+				reserve(_length + length);
+				text = _data + offset;
+			}
+			else reserve(_length + length);
+			memmove(_data + _length, text, length);
+			_length += length;
+			_data[_length] = '\0';
+			return *this;
+		}
+		BString &Append(char c, int32 count){
+			if (count <= 0) return *this;
+			reserve(_length + count);
+			memset(_data + _length, c, count);
+			_length += count;
+			_data[_length] = '\0';
+			return *this;
+		}
+		BString &operator+=(const char *text){ return Append(text); }
+		BString &operator<<(const char *text){ return Append(text); }
+		BString &operator<<(const BString &other){ return Append(other.String(), other.Length()); }
+		BString &operator<<(int32 value){
+			char number[16];
+			sprintf(number, "%d", (int)value);
+			return Append(number);
+		}
+
+		BString &Truncate(int32 length){
+			if ((length >= 0) && (length < _length)){
+				_length = length;
+				_data[_length] = '\0';
+			}
+			return *this;
+		}
+
+		BString &ToLower(){
+			for (int32 i = 0; i < _length; i++) _data[i] = tolower(_data[i]);
+			return *this;
+		}
+
+		BString &IReplaceAll(const char *replace, const char *with){
+			int32 replaceLength = strlen(replace);
+			if (replaceLength == 0) return *this;
+
+			BString result;
+			for (int32 i = 0; i < _length; ){
+				if ((i + replaceLength <= _length) && !strncasecmp(_data + i, replace, replaceLength)){
+					result.Append(with);
+					i += replaceLength;
+				}
+				else result.Append(_data + i++, 1);
+			}
+			return SetTo(result.String(), result.Length());
+		}
+
+		bool operator==(const char *text) const { return !strcmp(String(), text ? text : ""); }
+		bool operator==(const BString &other) const { return (_length == other._length) && !memcmp(String(), other.String(), _length); }
+		bool operator!=(const BString &other) const { return !(*this == other); }
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef SUPPORTDEFS_H
+#define SUPPORTDEFS_H
+
+//Just enough of Haiku's SupportDefs.h to build the engine and the command line
+//on Linux, see the bench target in the Makefile.
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef int8_t int8;
+typedef uint8_t uint8;
+typedef int16_t int16;
+typedef uint16_t uint16;
+typedef int32_t int32;
+typedef uint32_t uint32;
+typedef int64_t int64;
+typedef uint64_t uint64;
+
+typedef int32 status_t;
+typedef int64 bigtime_t;
+
+#define B_OK 0
+#define B_ERROR (-1)
+
+#endif
@@ -1,31 +1,259 @@
-#include "frontend.h"
-
-int main( int argc, char **argv )
-{
-
-	if (argc == 1){
-		
-		BApplication *thisApp = new CalcApp;
-		thisApp->Run();
-		delete thisApp;	
-	}
-	else{
-	
-		Calculator theCalc;
-		BString expression, response;
-		int selStart = 0, selStop = 0;
-
-		expression.SetTo(argv[1]);
-			
-		int error = theCalc.calculate(&expression, &response, selStart, selStop);
-
-		if (!error){
-			printf("%s\n", response.String());
-		}
-		else{
-			printf("There was a syntactical error: %s\n", response.String());
-		}
-
-	}
-	return 0;
-} 
+//built without the window (CALC_NO_GUI, see the Makefile) only the command line modes are left
+#ifdef CALC_NO_GUI
+#include "calculator.h"
+#else
+#include "frontend.h"
+#endif
+#include "benchmark.h"
+#include "batch.h"
+#include "worksheet.h"
+#include "server.h"
+
+#include <signal.h>
+#include <unistd.h>
+
+static CalcServer *sServer = NULL;
+
+static void stopServer(int){
+	sServer->stop();
+}
+
+#ifdef CALC_STATS
+static void printPhaseStats(const CalcPhaseStats &stats){
+	for (int i = 0; i < CALC_PHASE_COUNT; i++)
+		printf("  %-10s %10lld ns\n", Calculator::phaseName(i), stats.nanoseconds[i]);
+	printf("  %-10s %10lld ns%s\n", "total", stats.total, stats.cacheHit ? " (cached)" : "");
+	
+	printf("  %d characters, %d tokens, %d nodes, %d reductions, at most %d operators pending\n",
+		stats.characters, stats.tokens, stats.nodes, stats.reductions, stats.deepestStack);
+	printf("  %d characters of answer, %d of response\n", stats.answerLength, stats.responseLength);
+}
+#endif
+
+int main( int argc, char **argv )
+{
+
+	if (argc == 1){
+		
+		#ifdef CALC_NO_GUI
+		printf("Built without the window, give an expression or --bench, --batch, --stats, --history, --sheet or --serve\n");
+		return 1;
+		#else
+		BApplication *thisApp = new CalcApp;
+		thisApp->Run();
+		delete thisApp;	
+		#endif
+	}
+	else if (!strcmp(argv[1], "--bench")){
+	
+		return runBenchmark(argc - 2, argv + 2);
+	}
+	else if (!strcmp(argv[1], "--batch")){
+	
+		//--batch [-t threads] [-c cache entries] [-T type] [file], reads stdin when there isn't a file
+		FILE *in = stdin;
+		int threads = 1, cacheSize = 0, numericType = CALC_TYPE_DOUBLE;
+		
+		for (int i = 2; i < argc; i++){
+			if (!strcmp(argv[i], "-t") && (i + 1 < argc)){
+				threads = atoi(argv[++i]);
+				if (threads <= 0) threads = countProcessors();
+			}
+			else if (!strcmp(argv[i], "-c") && (i + 1 < argc)){
+				cacheSize = atoi(argv[++i]);
+			}
+			else if (!strcmp(argv[i], "-T") && (i + 1 < argc)){
+				numericType = numericTypeByName(argv[++i]);
+				if (!numericTypeAvailable(numericType)){
+					printf("Unknown numeric type %s\n", argv[i]);
+					return 1;
+				}
+			}
+			else if (strcmp(argv[i], "-") && (in == stdin)){
+				in = fopen(argv[i], "r");
+				if (in == NULL){
+					printf("Unable to open %s\n", argv[i]);
+					return 1;
+				}
+			}
+		}
+		
+		runBatch(in, stdout, threads, cacheSize, numericType);
+		if (in != stdin) fclose(in);
+	}
+	else if (!strcmp(argv[1], "--stats")){
+	
+		//--stats [-T type] expression ..., each one evaluated in turn so later ones can use 'ans'
+		#ifndef CALC_STATS
+		printf("No statistics in this build, make it with STATS=TRUE\n");
+		return 1;
+		#else
+		Calculator theCalc;
+		const char *response;
+		int selStart, selStop, failed = 0;
+		CalcPhaseStats stats;
+		
+		for (int i = 2; i < argc; i++){
+			if (!strcmp(argv[i], "-T") && (i + 1 < argc)){
+				if (!theCalc.setNumericType(numericTypeByName(argv[++i]))){
+					printf("Unknown numeric type %s\n", argv[i]);
+					return 1;
+				}
+				continue;
+			}
+			
+			int error = theCalc.calculate(argv[i], strlen(argv[i]), &response, selStart, selStop);
+			if (error) failed++;
+			
+			printf("%s%s\n", error ? "There was a syntactical error: " : "", response);
+			
+			theCalc.getPhaseStats(&stats);
+			printPhaseStats(stats);
+		}
+		
+		return (failed > 0);
+		#endif
+	}
+	else if (!strcmp(argv[1], "--history")){
+	
+		//--history file [-s prefix] [expression ...], every answer logged to the file so later
+		//expressions, and later runs, can use 'ans1' on. -s lists past expressions starting with prefix.
+		AnswerHistory history;
+		const char *response;
+		int selStart, selStop, failed = 0;
+		
+		if ((argc < 3) || !history.open(argv[2])){
+			printf("Unable to open the history %s\n", (argc < 3) ? "" : argv[2]);
+			return 1;
+		}
+		
+		Calculator theCalc;
+		theCalc.setHistory(&history);
+		if (history.count() > 0){
+			BString last(history.answer(0));
+			theCalc.setLastAnswer(last);
+		}
+		
+		for (int i = 3; i < argc; i++){
+			if (!strcmp(argv[i], "-s") && (i + 1 < argc)){
+				int backs[20];
+				int found = history.findPrefix(argv[i + 1], strlen(argv[i + 1]), backs, 20);
+				
+				for (int j = 0; j < found; j++)
+					printf("ans%d\t%s = %s\n", backs[j], history.expression(backs[j]), history.answer(backs[j]));
+				i++;
+				continue;
+			}
+			
+			int error = theCalc.calculate(argv[i], strlen(argv[i]), &response, selStart, selStop);
+			if (error) failed++;
+			
+			printf("%s%s\n", error ? "There was a syntactical error: " : "", response);
+		}
+		
+		return (failed > 0);
+	}
+	else if (!strcmp(argv[1], "--sheet")){
+	
+		//--sheet file [-t threads] [name=formula ...], the file is a line per cell or function.
+		//Every cell is printed once computed, then after each change the cells it reached.
+		FILE *in = (argc > 2) ? fopen(argv[2], "r") : NULL;
+		if (in == NULL){
+			printf("Unable to open the worksheet %s\n", (argc > 2) ? argv[2] : "");
+			return 1;
+		}
+		
+		Worksheet sheet;
+		LineReader reader(in);
+		const char *line;
+		int length, number = 0, selStart, selStop, failed = 0;
+		
+		for (int i = 3; i + 1 < argc; i++)
+			if (!strcmp(argv[i], "-t")) sheet.setThreads(atoi(argv[++i]));
+		
+		while (reader.nextLine(line, length)){
+			number++;
+			if (length == 0) continue;
+			
+			int error = sheet.setLine(line, length, selStart, selStop);
+			if (error != CALC_OK){
+				printf("line %d, characters %d to %d: %s\n", number, selStart, selStop, Calculator::errorResponse(error));
+				failed++;
+			}
+		}
+		fclose(in);
+		
+		sheet.recalculate();
+		for (int cell = 0; cell < sheet.count(); cell++)
+			printf("%s = %s\n", sheet.name(cell), sheet.describe(cell));
+		
+		for (int i = 3; i < argc; i++){
+			if (!strcmp(argv[i], "-t")){
+				i++;
+				continue;
+			}
+			
+			if (sheet.setLine(argv[i], strlen(argv[i]), selStart, selStop) != CALC_OK) failed++;
+			printf("%s: %d cells recomputed\n", argv[i], sheet.recalculate());
+		}
+		
+		if (argc > 3){
+			for (int cell = 0; cell < sheet.count(); cell++)
+				printf("%s = %s\n", sheet.name(cell), sheet.describe(cell));
+		}
+		
+		return (failed > 0);
+	}
+	else if (!strcmp(argv[1], "--serve")){
+	
+		//--serve [-t threads] [-c cache entries] [-T type] [socket], JSON lines on stdin
+		//and stdout when there isn't a socket. See CalcServer for what they are.
+		const char *path = NULL;
+		int threads = 0, cacheSize = 0, numericType = CALC_TYPE_DOUBLE;
+		
+		for (int i = 2; i < argc; i++){
+			if (!strcmp(argv[i], "-t") && (i + 1 < argc)) threads = atoi(argv[++i]);
+			else if (!strcmp(argv[i], "-c") && (i + 1 < argc)) cacheSize = atoi(argv[++i]);
+			else if (!strcmp(argv[i], "-T") && (i + 1 < argc)){
+				numericType = numericTypeByName(argv[++i]);
+				if (!numericTypeAvailable(numericType)){
+					printf("Unknown numeric type %s\n", argv[i]);
+					return 1;
+				}
+			}
+			else if (strcmp(argv[i], "-")) path = argv[i];
+		}
+		
+		CalcServer server(threads, cacheSize, numericType);
+		if (path == NULL) return server.serveStream(STDIN_FILENO, STDOUT_FILENO);
+		
+		if (!server.listen(path)){
+			printf("Unable to listen on %s\n", path);
+			return 1;
+		}
+		
+		sServer = &server;
+		signal(SIGINT, stopServer);
+		signal(SIGTERM, stopServer);
+		server.run();
+	}
+	else{
+	
+		Calculator theCalc;
+		BString expression, response;
+		int selStart = 0, selStop = 0;
+
+		expression.SetTo(argv[1]);
+			
+		int error = theCalc.calculate(&expression, &response, selStart, selStop);
+
+		if (!error){
+			printf("%s\n", response.String());
+		}
+		else{
+			printf("There was a syntactical error: %s\n", response.String());
+		}
+
+	}
+	return 0;
+} 
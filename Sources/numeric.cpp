@@ -0,0 +1,97 @@
+#include "numeric.h"
+
+static const char *sTypeNames[CALC_TYPE_COUNT] = {
+	"float", "double", "long double", "int64", "int128", "float128",
+	"int8", "int16", "int32", "uint8", "uint16", "uint32", "uint64",
+	"bigint"
+};
+
+static const int sTypeBits[CALC_TYPE_COUNT] = {
+	32, 64, sizeof(long double) * 8, 64, 128, 128,
+	8, 16, 32, 8, 16, 32, 64,
+	BIGINT_MAX_BITS
+};
+
+const char *numericTypeName(int type){
+	if ((type < 0) || (type >= CALC_TYPE_COUNT)) return "unknown";
+	return sTypeNames[type];
+}
+
+int numericTypeByName(const char *name){
+	for (int i = 0; i < CALC_TYPE_COUNT; i++)
+		if (!strcasecmp(sTypeNames[i], name)) return i;
+	
+	//a few friendlier spellings for the command line
+	if (!strcasecmp(name, "long")) return CALC_TYPE_LONG_DOUBLE;
+	if (!strcasecmp(name, "quad")) return CALC_TYPE_FLOAT128;
+	if (!strcasecmp(name, "big")) return CALC_TYPE_BIGINT;
+	
+	//and the short programmer spellings, i8 ... u64
+	if ((name[0] == 'i') || (name[0] == 'I') || (name[0] == 'u') || (name[0] == 'U')){
+		bool isUnsigned = (name[0] == 'u') || (name[0] == 'U');
+		switch (atoi(name + 1)){
+			case 8: return isUnsigned ? CALC_TYPE_UINT8 : CALC_TYPE_INT8;
+			case 16: return isUnsigned ? CALC_TYPE_UINT16 : CALC_TYPE_INT16;
+			case 32: return isUnsigned ? CALC_TYPE_UINT32 : CALC_TYPE_INT32;
+			case 64: return isUnsigned ? CALC_TYPE_UINT64 : CALC_TYPE_INT64;
+		}
+	}
+	
+	return -1;
+}
+
+bool numericTypeAvailable(int type){
+	switch (type){
+		case CALC_TYPE_FLOAT:
+		case CALC_TYPE_DOUBLE:
+		case CALC_TYPE_LONG_DOUBLE:
+		case CALC_TYPE_INT64:
+		case CALC_TYPE_INT8:
+		case CALC_TYPE_INT16:
+		case CALC_TYPE_INT32:
+		case CALC_TYPE_UINT8:
+		case CALC_TYPE_UINT16:
+		case CALC_TYPE_UINT32:
+		case CALC_TYPE_UINT64:
+		case CALC_TYPE_BIGINT:
+			return true;
+		
+		#ifdef CALC_HAVE_INT128
+		case CALC_TYPE_INT128: return true;
+		#endif
+		#ifdef CALC_HAVE_FLOAT128
+		case CALC_TYPE_FLOAT128: return true;
+		#endif
+	}
+	
+	return false;
+}
+
+bool numericTypeIsInteger(int type){
+	switch (type){
+		case CALC_TYPE_FLOAT:
+		case CALC_TYPE_DOUBLE:
+		case CALC_TYPE_LONG_DOUBLE:
+		case CALC_TYPE_FLOAT128:
+			return false;
+	}
+	
+	return (type >= 0) && (type < CALC_TYPE_COUNT);
+}
+
+bool numericTypeIsSigned(int type){
+	switch (type){
+		case CALC_TYPE_UINT8:
+		case CALC_TYPE_UINT16:
+		case CALC_TYPE_UINT32:
+		case CALC_TYPE_UINT64:
+			return false;
+	}
+	
+	return (type >= 0) && (type < CALC_TYPE_COUNT);
+}
+
+int numericTypeBits(int type){
+	if ((type < 0) || (type >= CALC_TYPE_COUNT)) return 0;
+	return sTypeBits[type];
+}
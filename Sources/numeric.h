@@ -0,0 +1,497 @@
+#ifndef NUMERIC_H
+#define NUMERIC_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <strings.h>
+
+#if defined(__SIZEOF_FLOAT128__) && !defined(CALC_NO_FLOAT128)
+#define CALC_HAVE_FLOAT128 1
+extern "C" {
+#include <quadmath.h>
+}
+#endif
+
+#if defined(__SIZEOF_INT128__)
+#define CALC_HAVE_INT128 1
+#endif
+
+#include "bigint.h"
+#include "decimal.h"
+#include "scan.h"
+
+/*********************************************************************
+	Numeric backends for Calculator.
+
+	Calculator::solve<T>() evaluates the parsed expression entirely in T, and
+	everything type specific lives in CalcNumeric<T>: reading a literal,
+	applying an operator, and writing the answer back out as text. The
+	floating point types share one template, the integer types another, so
+	adding a type is a matter of a typedef and a line in Calculator::calculate().
+	BigInt has its own, and is the one type that prints itself in other bases.
+*********************************************************************/
+
+//Numeric types, see Calculator::setNumericType()
+#define CALC_TYPE_FLOAT 0
+#define CALC_TYPE_DOUBLE 1
+#define CALC_TYPE_LONG_DOUBLE 2
+#define CALC_TYPE_INT64 3
+#define CALC_TYPE_INT128 4
+#define CALC_TYPE_FLOAT128 5
+//programmer mode, exact fixed width integers that wrap around
+#define CALC_TYPE_INT8 6
+#define CALC_TYPE_INT16 7
+#define CALC_TYPE_INT32 8
+#define CALC_TYPE_UINT8 9
+#define CALC_TYPE_UINT16 10
+#define CALC_TYPE_UINT32 11
+#define CALC_TYPE_UINT64 12
+//arbitrary precision integers, up to BIGINT_MAX_BITS
+#define CALC_TYPE_BIGINT 13
+#define CALC_TYPE_COUNT 14
+
+//apply() error codes, the same values as the Calculator error codes
+#define CALC_NUMERIC_OK 0
+#define CALC_NUMERIC_INVALID_OPERATOR 1
+#define CALC_NUMERIC_DIVISION_BY_ZERO 8
+#define CALC_NUMERIC_OVERFLOW 9
+
+const char *numericTypeName(int type);
+int numericTypeByName(const char *name);		//-1 if unknown
+bool numericTypeAvailable(int type);
+bool numericTypeIsInteger(int type);
+bool numericTypeIsSigned(int type);				//false for the unsigned programmer types
+int numericTypeBits(int type);					//storage width (the limit for bigint), 0 if unknown
+
+typedef signed char calc_int8;
+typedef unsigned char calc_uint8;
+typedef short calc_int16;
+typedef unsigned short calc_uint16;
+typedef int calc_int32;
+typedef unsigned int calc_uint32;
+typedef long long calc_int64;
+typedef unsigned long long calc_uint64;
+#ifdef CALC_HAVE_INT128
+typedef __int128 calc_int128;
+typedef unsigned __int128 calc_uint128;
+#endif
+#ifdef CALC_HAVE_FLOAT128
+typedef __float128 calc_float128;
+#endif
+
+
+
+//*******************************************************************
+//The bitwise operators on floating point values, shared with compiled
+//expressions so both give the same answer. Values are truncated to a
+//calc_int64: NaN becomes 0 and anything out of range its nearest end. Shift
+//counts outside 0..63 give 0, or -1 for a negative value shifted right.
+//*******************************************************************
+
+template <typename T>
+inline calc_int64 calcToInt64(T value){
+	if (value != value) return 0;
+	if (value >= (T)9223372036854775808.0) return (calc_int64)(~0ULL >> 1);
+	if (value <= -(T)9223372036854775808.0) return (calc_int64)~(~0ULL >> 1);
+	return (calc_int64)value;
+}
+
+//The same for double without a branch, for the column kernel of a target with
+//packed int64 conversions (AVX-512DQ). An out of range value is cleared to 0 on
+//its bits before the conversion, which then can't trap and can be done a vector
+//at a time; masks put the saturated ends and NaN's 0 back. One row at a time the
+//branches above are cheaper.
+inline calc_int64 calcToInt64Packed(double value){
+	calc_uint64 bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	calc_uint64 magnitude = bits & (~0ULL >> 1);
+	calc_uint64 inRange = -(calc_uint64)(magnitude < 0x43e0000000000000ULL);		//below 2^63
+	calc_uint64 safeBits = bits & inRange;
+	double safe;
+	memcpy(&safe, &safeBits, sizeof(safe));
+
+	calc_uint64 sign = (calc_uint64)((calc_int64)bits >> 63);
+	calc_uint64 result = ((calc_uint64)(calc_int64)safe & inRange) | (((~0ULL >> 1) ^ sign) & ~inRange);
+	calc_uint64 nan = -(calc_uint64)(magnitude > 0x7ff0000000000000ULL);
+	return (calc_int64)(result & ~nan);
+}
+
+inline calc_int64 calcShiftLeft(calc_int64 value, calc_int64 count){
+	return (calc_int64)(((calc_uint64)value << (count & 63)) & -(calc_uint64)((calc_uint64)count < 64));
+}
+
+inline calc_int64 calcShiftRight(calc_int64 value, calc_int64 count){
+	//past the word every bit is a copy of the sign, which is what 63 gives
+	return value >> (((calc_uint64)count < 64) ? count : 63);
+}
+
+
+
+//*******************************************************************
+//Per type math library calls. float goes through double, as it always has.
+//*******************************************************************
+
+inline float calcSin(float x) { return sin((double)x); }
+inline float calcCos(float x) { return cos((double)x); }
+inline float calcTan(float x) { return tan((double)x); }
+inline float calcAsin(float x) { return asin((double)x); }
+inline float calcAcos(float x) { return acos((double)x); }
+inline float calcAtan(float x) { return atan((double)x); }
+inline float calcPow(float x, float y) { return pow((double)x, (double)y); }
+inline float calcMod(float x, float y) { return fmod((double)x, (double)y); }
+inline float calcPi(float) { return M_PI; }
+inline float calcParse(const char *text, float) { return strtof(text, NULL); }
+
+inline double calcSin(double x) { return sin(x); }
+inline double calcCos(double x) { return cos(x); }
+inline double calcTan(double x) { return tan(x); }
+inline double calcAsin(double x) { return asin(x); }
+inline double calcAcos(double x) { return acos(x); }
+inline double calcAtan(double x) { return atan(x); }
+inline double calcPow(double x, double y) { return pow(x, y); }
+inline double calcMod(double x, double y) { return fmod(x, y); }
+inline double calcPi(double) { return M_PI; }
+inline double calcParse(const char *text, double) { return scanDouble(text); }
+
+inline long double calcSin(long double x) { return sinl(x); }
+inline long double calcCos(long double x) { return cosl(x); }
+inline long double calcTan(long double x) { return tanl(x); }
+inline long double calcAsin(long double x) { return asinl(x); }
+inline long double calcAcos(long double x) { return acosl(x); }
+inline long double calcAtan(long double x) { return atanl(x); }
+inline long double calcPow(long double x, long double y) { return powl(x, y); }
+inline long double calcMod(long double x, long double y) { return fmodl(x, y); }
+inline long double calcPi(long double) { return 3.14159265358979323846264338327950288L; }
+inline long double calcParse(const char *text, long double) { return strtold(text, NULL); }
+
+#ifdef CALC_HAVE_FLOAT128
+inline calc_float128 calcSin(calc_float128 x) { return sinq(x); }
+inline calc_float128 calcCos(calc_float128 x) { return cosq(x); }
+inline calc_float128 calcTan(calc_float128 x) { return tanq(x); }
+inline calc_float128 calcAsin(calc_float128 x) { return asinq(x); }
+inline calc_float128 calcAcos(calc_float128 x) { return acosq(x); }
+inline calc_float128 calcAtan(calc_float128 x) { return atanq(x); }
+inline calc_float128 calcPow(calc_float128 x, calc_float128 y) { return powq(x, y); }
+inline calc_float128 calcMod(calc_float128 x, calc_float128 y) { return fmodq(x, y); }
+inline calc_float128 calcPi(calc_float128) { return M_PIq; }
+inline calc_float128 calcParse(const char *text, calc_float128) { return strtoflt128(text, NULL); }
+#endif
+
+//float and double have their own shortest digits, see decimal.h. The wider types
+//have printf write all the digits they hold, which is what shortest means for them.
+inline int calcFormat(float x, char *buffer, int size, int mode, int precision) { return formatDecimal(x, mode, precision, buffer, size); }
+inline int calcFormat(double x, char *buffer, int size, int mode, int precision) { return formatDecimal(x, mode, precision, buffer, size); }
+
+inline int calcFormat(long double x, char *buffer, int size, int mode, int precision){
+	char text[CALC_DECIMAL_MAX_PRECISION + 16];
+	if (mode == CALC_DECIMAL_FIXED) return snprintf(buffer, size, "%.*Lf", precision, x);
+	
+	snprintf(text, sizeof(text), "%.*Le", (mode == CALC_DECIMAL_SHORTEST) ? 20 : precision, x);
+	return formatDecimalFromScientific(text, mode, precision, buffer, size);
+}
+
+#ifdef CALC_HAVE_FLOAT128
+inline int calcFormat(calc_float128 x, char *buffer, int size, int mode, int precision){
+	char text[CALC_DECIMAL_MAX_PRECISION + 16];
+	if (mode == CALC_DECIMAL_FIXED) return quadmath_snprintf(buffer, size, "%.*Qf", precision, x);
+	
+	quadmath_snprintf(text, sizeof(text), "%.*Qe", (mode == CALC_DECIMAL_SHORTEST) ? 35 : precision, x);
+	return formatDecimalFromScientific(text, mode, precision, buffer, size);
+}
+#endif
+
+
+
+//*******************************************************************
+//Floating point types
+//*******************************************************************
+
+template <typename T>
+struct CalcNumeric{
+	static const bool isInteger = false;
+
+	static int parse(const char *text, T &value) { value = calcParse(text, T()); return CALC_NUMERIC_OK; }
+	static T pi() { return calcPi(T()); }
+	static int format(T value, char *buffer, int size, int mode, int precision) { return calcFormat(value, buffer, size, mode, precision); }
+	static int formatRadix(T, int, char *, int) { return -1; }
+	static int formatSize(T, int) { return 0; }
+	static calc_int64 toInteger(T value) { return calcToInt64(value); }
+
+	static int apply(char op, T firstOp, T secondOp, bool radians, T &result){
+		//the conversions are written out the same way Calculator always has: (x * PI) / 180
+		switch (op){
+			case '+': result = firstOp + secondOp; break;
+			case '-': result = firstOp - secondOp; break;
+			case '*': result = firstOp * secondOp; break;
+			case '/': result = firstOp / secondOp; break;
+			case '^': result = calcPow(firstOp, secondOp); break;
+
+			case '%': result = calcMod(firstOp, secondOp); break;		//sign of the dividend, like the integers
+
+			case '>': result = calcShiftRight(toInteger(firstOp), toInteger(secondOp)); break;
+			case '<': result = calcShiftLeft(toInteger(firstOp), toInteger(secondOp)); break;
+			case '&': result = toInteger(firstOp) & toInteger(secondOp); break;
+			case '|': result = toInteger(firstOp) | toInteger(secondOp); break;
+
+			case 'm': result = -firstOp; break;
+
+			case 's': result = calcSin(radians ? firstOp : (firstOp * pi() / 180)); break;
+			case 'c': result = calcCos(radians ? firstOp : (firstOp * pi() / 180)); break;
+			case 't': result = calcTan(radians ? firstOp : (firstOp * pi() / 180)); break;
+			case 'S': result = radians ? calcAsin(firstOp) : (calcAsin(firstOp) * 180 / pi()); break;
+			case 'C': result = radians ? calcAcos(firstOp) : (calcAcos(firstOp) * 180 / pi()); break;
+			case 'T': result = radians ? calcAtan(firstOp) : (calcAtan(firstOp) * 180 / pi()); break;
+
+			default: return CALC_NUMERIC_INVALID_OPERATOR;
+		}
+
+		return CALC_NUMERIC_OK;
+	}
+};
+
+
+
+//*******************************************************************
+//Integer types, used for int64/int128 and the fixed width programmer types.
+//Nothing here goes through floating point: literals are read digit by digit,
+//arithmetic wraps at the type's width (it is done on the unsigned type U, so
+//overflow is defined), division truncates, dividing by zero is an error and
+//the trig functions are refused.
+//*******************************************************************
+
+//The unsigned type U's arithmetic is done in. The types narrower than int would
+//be promoted to a signed int, where 65535 * 65535 overflows, so they use unsigned.
+template <typename U> struct CalcWiden { typedef U type; };
+template <> struct CalcWiden<calc_uint8> { typedef unsigned int type; };
+template <> struct CalcWiden<calc_uint16> { typedef unsigned int type; };
+
+template <typename T, typename U>
+struct CalcIntegerNumeric{
+	typedef typename CalcWiden<U>::type W;
+
+	static const bool isInteger = true;
+	static const bool isSigned = ((T)-1 < 0);
+	static const int bits = sizeof(T) * 8;
+
+	static T pi() { return 3; }
+	static calc_int64 toInteger(T value) { return (calc_int64)value; }
+	static int formatRadix(T, int, char *, int) { return -1; }
+	static int formatSize(T, int) { return 0; }
+
+	static int parse(const char *text, T &result){
+		//decimal with an optional fraction and exponent, truncated toward zero,
+		//or hex with a 0x prefix
+		const char *p = text;
+		bool negative = false;
+		U value = 0;
+
+		if ((*p == '-') || (*p == '+')) negative = (*p++ == '-');
+
+		if ((p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X'))){
+			for (p += 2; ; p++){
+				int digit;
+				if ((*p >= '0') && (*p <= '9')) digit = *p - '0';
+				else if ((*p >= 'a') && (*p <= 'f')) digit = *p - 'a' + 10;
+				else if ((*p >= 'A') && (*p <= 'F')) digit = *p - 'A' + 10;
+				else break;
+				value = (U)(value * 16 + digit);
+			}
+			result = (T)(negative ? (U)0 - value : value);
+			return CALC_NUMERIC_OK;
+		}
+
+		const char *mantissa = p;
+		int wholeDigits = 0, fractionDigits = 0;
+		while ((*p >= '0') && (*p <= '9')) { p++; wholeDigits++; }
+		if (*p == '.'){
+			p++;
+			while ((*p >= '0') && (*p <= '9')) { p++; fractionDigits++; }
+		}
+
+		int exponent = 0;
+		if (((*p == 'e') || (*p == 'E')) && ((p[1] == '-') || (p[1] == '+') || ((p[1] >= '0') && (p[1] <= '9')))){
+			bool negativeExponent = false;
+			p++;
+			if ((*p == '-') || (*p == '+')) negativeExponent = (*p++ == '-');
+			while ((*p >= '0') && (*p <= '9') && (exponent < 100000))
+				exponent = exponent * 10 + (*p++ - '0');
+			if (negativeExponent) exponent = -exponent;
+		}
+
+		//the exponent moves the point, everything to the right of it is dropped
+		int point = wholeDigits + exponent;
+		int taken = 0;
+		for (const char *d = mantissa; (taken < point) && (taken < wholeDigits + fractionDigits); d++){
+			if (*d == '.') continue;
+			value = (U)(value * 10 + (*d - '0'));
+			taken++;
+		}
+		for (; taken < point; taken++)
+			value = (U)(value * 10);
+
+		result = (T)(negative ? (U)0 - value : value);
+		return CALC_NUMERIC_OK;
+	}
+
+	static int format(T value, char *buffer, int size, int, int){
+		char digits[64];
+		int count = 0;
+		bool negative = isSigned && (value < 0);
+		U magnitude = negative ? (U)0 - (U)value : (U)value;
+
+		do{
+			digits[count++] = '0' + (int)(magnitude % 10);
+			magnitude /= 10;
+		}while (magnitude != 0);
+
+		int length = 0, full = count + (negative ? 1 : 0);
+		if (negative && (length < size - 1)) buffer[length++] = '-';
+		while ((count > 0) && (length < size - 1))
+			buffer[length++] = digits[--count];
+		buffer[length] = '\0';
+
+		return full;
+	}
+
+	static T power(T base, T exponent){
+		//repeated squaring, negative exponents truncate to 0 except for bases of 1 and -1
+		if (isSigned && (exponent < 0)){
+			if (base == 1) return 1;
+			if (base == (T)-1) return (exponent & 1) ? (T)-1 : 1;
+			return 0;
+		}
+
+		U result = 1, b = (U)base;
+		while (exponent != 0){
+			if (exponent & 1) result = (U)((W)result * (W)b);
+			b = (U)((W)b * (W)b);
+			exponent = (T)(exponent >> 1);
+		}
+		return (T)result;
+	}
+
+	static int apply(char op, T firstOp, T secondOp, bool, T &result){
+		//the only signed division that overflows is minimum / -1, it wraps back to minimum
+		const T minimum = (T)((U)1 << (bits - 1));
+		const bool overflows = isSigned && (firstOp == minimum) && (secondOp == (T)-1);
+		const bool shiftInRange = !(isSigned && (secondOp < 0)) && ((U)secondOp < (U)bits);
+
+		switch (op){
+			case '+': result = (T)(U)((U)firstOp + (U)secondOp); break;
+			case '-': result = (T)(U)((U)firstOp - (U)secondOp); break;
+			case '*': result = (T)(U)((W)(U)firstOp * (W)(U)secondOp); break;
+
+			case '/': {
+				if (secondOp == 0) return CALC_NUMERIC_DIVISION_BY_ZERO;
+				result = overflows ? minimum : (T)(firstOp / secondOp);
+				break;
+			}
+
+			case '%': {
+				if (secondOp == 0) return CALC_NUMERIC_DIVISION_BY_ZERO;
+				result = overflows ? 0 : (T)(firstOp % secondOp);
+				break;
+			}
+
+			case '^': result = power(firstOp, secondOp); break;
+
+			case '<': result = shiftInRange ? (T)(U)((W)(U)firstOp << (int)secondOp) : 0; break;
+			case '>': result = shiftInRange ? (T)(firstOp >> (int)secondOp) : ((isSigned && (firstOp < 0)) ? (T)-1 : 0); break;
+			case '&': result = firstOp & secondOp; break;
+			case '|': result = firstOp | secondOp; break;
+
+			case 'm': result = (T)(U)((U)0 - (U)firstOp); break;
+
+			default: return CALC_NUMERIC_INVALID_OPERATOR;
+		}
+
+		return CALC_NUMERIC_OK;
+	}
+};
+
+template <> struct CalcNumeric<calc_int8> : CalcIntegerNumeric<calc_int8, calc_uint8> {};
+template <> struct CalcNumeric<calc_int16> : CalcIntegerNumeric<calc_int16, calc_uint16> {};
+template <> struct CalcNumeric<calc_int32> : CalcIntegerNumeric<calc_int32, calc_uint32> {};
+template <> struct CalcNumeric<calc_int64> : CalcIntegerNumeric<calc_int64, calc_uint64> {};
+template <> struct CalcNumeric<calc_uint8> : CalcIntegerNumeric<calc_uint8, calc_uint8> {};
+template <> struct CalcNumeric<calc_uint16> : CalcIntegerNumeric<calc_uint16, calc_uint16> {};
+template <> struct CalcNumeric<calc_uint32> : CalcIntegerNumeric<calc_uint32, calc_uint32> {};
+template <> struct CalcNumeric<calc_uint64> : CalcIntegerNumeric<calc_uint64, calc_uint64> {};
+#ifdef CALC_HAVE_INT128
+template <> struct CalcNumeric<calc_int128> : CalcIntegerNumeric<calc_int128, calc_uint128> {};
+#endif
+
+
+
+//*******************************************************************
+//Arbitrary precision integers. The same rules as the fixed width
+//integers, except nothing wraps: a result over BIGINT_MAX_BITS is an
+//overflow error instead. Values are taken and returned by reference, so
+//solve() reuses each node's limbs from one calculation to the next.
+//*******************************************************************
+
+template <>
+struct CalcNumeric<BigInt>{
+	static const bool isInteger = true;
+
+	static BigInt pi() { return BigInt(3); }
+	static calc_int64 toInteger(const BigInt &value) { return value.lowBits(); }
+
+	static int parse(const char *text, BigInt &result){
+		return result.parse(text) ? CALC_NUMERIC_OK : CALC_NUMERIC_OVERFLOW;
+	}
+
+	static int format(const BigInt &value, char *buffer, int size, int, int) { return value.format(buffer, size, 10); }
+	static int formatRadix(const BigInt &value, int base, char *buffer, int size) { return value.format(buffer, size, base); }
+	static int formatSize(const BigInt &value, int base) { return value.formatSize(base); }
+
+	static int apply(char op, const BigInt &firstOp, const BigInt &secondOp, bool, BigInt &result){
+		bool fits = true;
+
+		switch (op){
+			case '+': BigInt::add(result, firstOp, secondOp); break;
+			case '-': BigInt::subtract(result, firstOp, secondOp); break;
+			case '*': fits = BigInt::multiply(result, firstOp, secondOp); break;
+			case '^': fits = BigInt::power(result, firstOp, secondOp); break;
+
+			case '/':
+			case '%': {
+				BigInt *quotient = (op == '/') ? &result : NULL, *remainder = (op == '%') ? &result : NULL;
+				if (!BigInt::divide(quotient, remainder, firstOp, secondOp)) return CALC_NUMERIC_DIVISION_BY_ZERO;
+				break;
+			}
+
+			//a negative count shifts the other way, there is no width to fall off the end of
+			case '<':
+			case '>': {
+				if ((secondOp.length() > 1) && !firstOp.isZero()){
+					fits = (op == '>') != secondOp.isNegative();
+					if (fits) BigInt::shiftRight(result, firstOp, (long long)1 << 40);
+					break;
+				}
+
+				long long bits = secondOp.lowBits();
+				bool left = (op == '<') == (bits >= 0);
+				if (bits < 0) bits = -bits;
+
+				if (left) fits = BigInt::shiftLeft(result, firstOp, bits);
+				else BigInt::shiftRight(result, firstOp, bits);
+				break;
+			}
+
+			case '&': BigInt::bitwiseAnd(result, firstOp, secondOp); break;
+			case '|': BigInt::bitwiseOr(result, firstOp, secondOp); break;
+
+			case 'm': BigInt::negate(result, firstOp); break;
+
+			default: return CALC_NUMERIC_INVALID_OPERATOR;
+		}
+
+		return fits ? CALC_NUMERIC_OK : CALC_NUMERIC_OVERFLOW;
+	}
+};
+
+#endif
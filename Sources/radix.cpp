@@ -0,0 +1,187 @@
+#include "radix.h"
+
+static const char *sDigits = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+//per base, the largest power below 2^32 and its digit count, and log2 for the powers of two
+static const unsigned int sChunks[CALC_RADIX_MAX + 1] = {
+	0, 0, 2147483648u, 3486784401u, 1073741824u, 1220703125u, 2176782336u, 1977326743u,
+	1073741824u, 3486784401u, 1000000000u, 2357947691u, 429981696u, 815730721u, 1475789056u, 2562890625u,
+	268435456u, 410338673u, 612220032u, 893871739u, 1280000000u, 1801088541u, 2494357888u, 3404825447u,
+	191102976u, 244140625u, 308915776u, 387420489u, 481890304u, 594823321u, 729000000u, 887503681u,
+	1073741824u, 1291467969u, 1544804416u, 1838265625u, 2176782336u
+};
+
+static const char sChunkDigits[CALC_RADIX_MAX + 1] = {
+	0, 0, 31, 20, 15, 13, 12, 11, 10, 10, 9, 9, 8, 8, 8, 8,
+	7, 7, 7, 7, 7, 7, 7, 7, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6
+};
+
+static const char sShifts[CALC_RADIX_MAX + 1] = {
+	0, 0, 1, 0, 2, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0,
+	4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	5, 0, 0, 0, 0
+};
+
+void radixDefaults(CalcRadixFormat *format, int base){
+	format->base = base;
+	format->width = CALC_RADIX_WIDTH_DEFAULT;
+	format->group = 0;
+	format->separator = '_';
+	format->isSigned = false;
+	format->prefix = false;
+	format->upperCase = false;
+}
+
+bool radixValid(const CalcRadixFormat &format){
+	return (format.base >= CALC_RADIX_MIN) && (format.base <= CALC_RADIX_MAX)
+		&& (format.width >= CALC_RADIX_WIDTH_DEFAULT) && (format.width <= 4096)
+		&& (format.group >= 0) && (format.separator != '\0');
+}
+
+unsigned int radixChunk(int base, int *digits){
+	*digits = sChunkDigits[base];
+	return sChunks[base];
+}
+
+int radixShift(int base){
+	return sShifts[base];
+}
+
+int radixWidth(int bits, int base){
+	int shift = sShifts[base];
+	if (shift > 0) return (bits + shift - 1) / shift;
+
+	unsigned long long largest = (bits >= 64) ? ~0ULL : ((1ULL << bits) - 1);
+	int count = 0;
+	do{
+		largest /= base;
+		count++;
+	}while (largest != 0);
+
+	return count;
+}
+
+char *radixWriteChunk(char *out, unsigned int chunk, int base, int count){
+	for (int i = count - 1; i >= 0; i--){
+		out[i] = sDigits[chunk % base];
+		chunk /= base;
+	}
+
+	return out + count;
+}
+
+int radixDigits(unsigned long long value, int base, char *digits){
+	int shift = sShifts[base];
+
+	if (shift > 0){
+		//right to left into the end of a buffer the digits can't outgrow, then moved up
+		char scratch[64];
+		char *out = scratch + sizeof(scratch);
+
+		if (shift == 1){
+			//binary four digits at a time
+			static const char nibbles[16][4] = {
+				{'0','0','0','0'}, {'0','0','0','1'}, {'0','0','1','0'}, {'0','0','1','1'},
+				{'0','1','0','0'}, {'0','1','0','1'}, {'0','1','1','0'}, {'0','1','1','1'},
+				{'1','0','0','0'}, {'1','0','0','1'}, {'1','0','1','0'}, {'1','0','1','1'},
+				{'1','1','0','0'}, {'1','1','0','1'}, {'1','1','1','0'}, {'1','1','1','1'}
+			};
+			while (value > 15){
+				out -= 4;
+				memcpy(out, nibbles[value & 15], 4);
+				value >>= 4;
+			}
+		}
+
+		do{
+			*--out = sDigits[value & (base - 1)];
+			value >>= shift;
+		}while (value != 0);
+
+		int count = scratch + sizeof(scratch) - out;
+		memcpy(digits, out, count);
+		return count;
+	}
+
+	//every chunk but the most significant has all its digits, the first only as many as it needs
+	unsigned int chunks[3];
+	unsigned long long chunk = sChunks[base];
+	int chunkCount = 0;
+
+	while (value >= chunk){
+		unsigned long long quotient = value / chunk;
+		chunks[chunkCount++] = (unsigned int)(value - quotient * chunk);
+		value = quotient;
+	}
+
+	unsigned int first = (unsigned int)value;
+	int count = 0;
+	do{
+		count++;
+		first /= base;
+	}while (first != 0);
+
+	char *out = radixWriteChunk(digits, (unsigned int)value, base, count);
+	while (chunkCount > 0)
+		out = radixWriteChunk(out, chunks[--chunkCount], base, sChunkDigits[base]);
+
+	return out - digits;
+}
+
+static int prefixLength(const CalcRadixFormat &format){
+	if (!format.prefix) return 0;
+	return ((format.base == 2) || (format.base == 8) || (format.base == 16)) ? 2 : 0;
+}
+
+int radixLayoutSize(int count, int width, const CalcRadixFormat &format){
+	int digits = (count > width) ? count : width;
+	int separators = (format.group > 0) ? (digits - 1) / format.group : 0;
+
+	return 1 + prefixLength(format) + digits + separators + 1;		//sign and terminator
+}
+
+int radixLayout(const char *digits, int count, bool negative, int width, const CalcRadixFormat &format, char *buffer, int size){
+	int total = (count > width) ? count : width;
+	int zeros = total - count;
+	int prefix = prefixLength(format);
+	int length = (negative ? 1 : 0) + prefix + total + ((format.group > 0) ? (total - 1) / format.group : 0);
+
+	if (length >= size){
+		if (size > 0) buffer[0] = '\0';
+		return length;
+	}
+
+	char *out = buffer;
+	if (negative) *out++ = '-';
+	if (prefix > 0){
+		*out++ = '0';
+		*out++ = (format.base == 2) ? 'b' : ((format.base == 8) ? 'o' : 'x');
+	}
+
+	if ((format.group == 0) && !format.upperCase){
+		//nothing to do to the digits but copy them
+		memset(out, '0', zeros);
+		memcpy(out + zeros, digits, count);
+		out[total] = '\0';
+		return length;
+	}
+
+	//the groups are counted from the right, so the first one may be short
+	int untilSeparator = (format.group > 0) ? ((total - 1) % format.group) + 1 : total + 1;
+
+	for (int i = 0; i < total; i++){
+		if (untilSeparator == 0){
+			*out++ = format.separator;
+			untilSeparator = format.group;
+		}
+		untilSeparator--;
+
+		char c = (i < zeros) ? '0' : digits[i - zeros];
+		if (format.upperCase && (c >= 'a')) c -= 'a' - 'A';
+		*out++ = c;
+	}
+
+	*out = '\0';
+	return out - buffer;
+}
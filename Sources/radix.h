@@ -0,0 +1,46 @@
+#ifndef RADIX_H
+#define RADIX_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define CALC_RADIX_MIN 2
+#define CALC_RADIX_MAX 36
+#define CALC_RADIX_WIDTH_DEFAULT -1
+
+//How a response in a base other than ten is written, see Calculator::setResponseBase()
+struct CalcRadixFormat{
+	int base;				//CALC_RADIX_MIN to CALC_RADIX_MAX
+	int width;				//minimum digits, zero padded. CALC_RADIX_WIDTH_DEFAULT pads integer types to their full width.
+	int group;				//digits per group counting from the right, 0 for none
+	char separator;			//between groups
+	bool isSigned;			//a minus sign and the magnitude, rather than two's complement
+	bool prefix;			//0b, 0o or 0x in the bases that have one
+	bool upperCase;			//digits past 9 as A to Z
+};
+
+//Conversion is table driven. Bases that are powers of two are cut straight out
+//of the bits. Any other base is divided out a chunk at a time, by the largest
+//power of the base that fits in 32 bits, so a 64 bit value takes at most three
+//wide divisions and the digits of each chunk come from 32 bit arithmetic.
+void radixDefaults(CalcRadixFormat *format, int base);		//plain digits, padded as they always were
+bool radixValid(const CalcRadixFormat &format);
+
+unsigned int radixChunk(int base, int *digits);			//the largest power of base below 2^32, and how many digits it has
+int radixShift(int base);								//log2 of base if it is a power of two, 0 if not
+int radixWidth(int bits, int base);						//digits in the largest value that many bits wide
+
+//digits of value, lowercase, most significant first and not terminated. At most 64 of them.
+int radixDigits(unsigned long long value, int base, char *digits);
+//digits of one chunk, padded to count digits with zeros. Returns the end.
+char *radixWriteChunk(char *out, unsigned int chunk, int base, int count);
+
+//Lays digits (lowercase, as radixDigits() writes them) out as format says: the
+//sign, the prefix, zeros up to width digits and the group separators. Returns
+//the full length like snprintf, but writes nothing besides the terminator unless
+//all of it fits. radixLayoutSize() is enough room, terminator included.
+int radixLayout(const char *digits, int count, bool negative, int width, const CalcRadixFormat &format, char *buffer, int size);
+int radixLayoutSize(int count, int width, const CalcRadixFormat &format);
+
+#endif
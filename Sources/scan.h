@@ -0,0 +1,52 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+//Number scanner errors
+#define CALC_SCAN_OK 0
+#define CALC_SCAN_NO_DIGITS 1			//a prefix or a point with no digits
+#define CALC_SCAN_BAD_DIGIT 2			//a digit the base doesn't have
+#define CALC_SCAN_BAD_SEPARATOR 3		//'_' anywhere but between two digits
+#define CALC_SCAN_BAD_EXPONENT 4		//an 'e' with no digits after it
+#define CALC_SCAN_BAD_POINT 5			//a second point, or one in a 0x, 0b or 0o literal
+
+//A literal as the lexer reads it: decimal with an optional point and exponent,
+//or an integer in hex, binary or octal with a 0x, 0b or 0o prefix. Any of the
+//digits may be grouped with '_', which only goes between two digits.
+struct CalcNumberScan{
+	int length;				//characters of the literal, or read before the error
+	int error;				//CALC_SCAN_
+	int errorStart, errorStop;		//the characters at fault, from the start of the literal
+	int base;				//2, 8, 10 or 16
+	bool plain;				//no point, separator or 0b/0o prefix, so strtod and the numeric types read it as it is
+	int mantissaLength;		//characters before the exponent
+	int exponent;			//of the digits with the point taken out, decimal only
+	double value;			//correctly rounded
+};
+
+//Scans the literal at the start of text, reading no further than length, and
+//returns scan->error. Nothing depends on the locale: the decimal point is always '.'.
+//
+//The value is one multiply or divide when the digits fit in 53 bits and the power
+//of ten is one a double holds exactly (Clinger's fast path), which covers most of
+//what is typed in by hand. Up to 19 digits and any exponent, it comes from 128 bit
+//products with a table of powers (Eisel-Lemire). What neither can be sure of,
+//near ties and subnormals, is rewritten without point or separators and handed to
+//strtod, which has nothing locale dependent left to read.
+int scanNumber(const char *text, int length, CalcNumberScan *scan);
+
+//The literal in the form all the numeric types read: decimal digits with the point
+//folded into the exponent, or hex with a 0x prefix. Returns the length like
+//snprintf, canonicalNumberSize() is always enough room.
+int canonicalNumber(const char *text, const CalcNumberScan &scan, char *buffer, int size);
+int canonicalNumberSize(const CalcNumberScan &scan);
+
+//a terminated literal with an optional sign, like 'ans', read up to the first
+//character that can't be part of it. What scanNumber() doesn't take (inf, nan)
+//goes to strtod.
+double scanDouble(const char *text);
+
+#endif
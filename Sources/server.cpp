@@ -0,0 +1,747 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "batch.h"
+
+#ifdef CALC_SERVER_EPOLL
+#include <sys/epoll.h>
+#endif
+
+struct ServerWorker{
+	CalcServer *server;
+	pthread_t thread;
+	int wake[2];					//new connections come down this pipe, NULL to stop
+	int poller;						//the epoll descriptor, -1 with poll()
+	ServerConnection *connections;
+};
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0				//SIGPIPE is ignored in run() then
+#endif
+
+//*******************************************************************
+//The few parts of JSON a request needs. Nothing is copied: strings are
+//unescaped where they are in the line, which only ever makes them shorter.
+
+static int skipBlank(const char *text, int pos, int length){
+	while ((pos < length) && ((text[pos] == ' ') || (text[pos] == '\t') || (text[pos] == '\r') || (text[pos] == '\n')))
+		pos++;
+	return pos;
+}
+
+static int valueEnd(const char *text, int pos, int length){
+	//just past the value starting at pos, -1 if there isn't one
+	if (pos >= length) return -1;
+
+	if (text[pos] == '"'){
+		for (pos++; pos < length; pos++){
+			if (text[pos] == '\\') pos++;
+			else if (text[pos] == '"') return pos + 1;
+		}
+		return -1;
+	}
+
+	if ((text[pos] == '{') || (text[pos] == '[')){
+		int depth = 0;
+		while (pos < length){
+			char c = text[pos];
+			if (c == '"'){
+				pos = valueEnd(text, pos, length);
+				if (pos < 0) return -1;
+				continue;
+			}
+			if ((c == '{') || (c == '[')) depth++;
+			else if ((c == '}') || (c == ']')){
+				if (--depth == 0) return pos + 1;
+			}
+			pos++;
+		}
+		return -1;
+	}
+
+	//true, false or null
+	static const char *words[] = { "true", "false", "null" };
+	for (int i = 0; i < 3; i++){
+		int size = strlen(words[i]);
+		if ((pos + size <= length) && !memcmp(text + pos, words[i], size)) return pos + size;
+	}
+
+	//or a number, checked as strictly as the rest, as an "id" is sent back as it is
+	if (text[pos] == '-') pos++;
+	int digits = pos;
+	while ((pos < length) && charIs(text[pos], CALC_CHAR_DIGIT))
+		pos++;
+	if (pos == digits) return -1;
+
+	if ((pos < length) && (text[pos] == '.')){
+		digits = ++pos;
+		while ((pos < length) && charIs(text[pos], CALC_CHAR_DIGIT))
+			pos++;
+		if (pos == digits) return -1;
+	}
+
+	if ((pos < length) && ((text[pos] | 0x20) == 'e')){
+		pos++;
+		if ((pos < length) && ((text[pos] == '-') || (text[pos] == '+'))) pos++;
+		digits = pos;
+		while ((pos < length) && charIs(text[pos], CALC_CHAR_DIGIT))
+			pos++;
+		if (pos == digits) return -1;
+	}
+
+	return pos;
+}
+
+static int hexValue(char c){
+	if ((c >= '0') && (c <= '9')) return c - '0';
+	if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+	return -1;
+}
+
+static int unescape(char *text, int start, int end){
+	//the string value from start to end, quotes included, unescaped over itself
+	//from start. Its length, -1 if an escape is bad.
+	int out = start;
+
+	for (int pos = start + 1; pos < end - 1; pos++){
+		char c = text[pos];
+		if (c != '\\'){
+			text[out++] = c;
+			continue;
+		}
+
+		c = text[++pos];
+		switch (c){
+			case 'b': text[out++] = '\b'; break;
+			case 'f': text[out++] = '\f'; break;
+			case 'n': text[out++] = '\n'; break;
+			case 'r': text[out++] = '\r'; break;
+			case 't': text[out++] = '\t'; break;
+			case '"': case '\\': case '/': text[out++] = c; break;
+			case 'u':{
+				if (pos + 4 >= end - 1) return -1;
+				int code = 0;
+				for (int i = 1; i <= 4; i++){
+					int digit = hexValue(text[pos + i]);
+					if (digit < 0) return -1;
+					code = code * 16 + digit;
+				}
+				pos += 4;
+
+				//surrogates only come up outside what an expression can have in it
+				if (code < 0x80) text[out++] = code;
+				else if (code < 0x800){
+					text[out++] = 0xC0 | (code >> 6);
+					text[out++] = 0x80 | (code & 0x3F);
+				}
+				else{
+					text[out++] = 0xE0 | (code >> 12);
+					text[out++] = 0x80 | ((code >> 6) & 0x3F);
+					text[out++] = 0x80 | (code & 0x3F);
+				}
+				break;
+			}
+			default: return -1;
+		}
+	}
+
+	return out - start;
+}
+
+static void append(const char *text, int length, char *&output, int &outputLength, int &outputCapacity){
+	if (outputLength + length > outputCapacity){
+		int capacity = (outputCapacity * 2 > outputLength + length) ? outputCapacity * 2 : outputLength + length + 256;
+		char *grown = new char[capacity];
+		if (outputLength > 0) memcpy(grown, output, outputLength);
+		delete [] output;
+		output = grown;
+		outputCapacity = capacity;
+	}
+
+	memcpy(output + outputLength, text, length);
+	outputLength += length;
+}
+
+static void appendString(const char *text, char *&output, int &outputLength, int &outputCapacity){
+	//quoted and escaped, runs without anything to escape copied whole
+	static const char hex[] = "0123456789abcdef";
+	append("\"", 1, output, outputLength, outputCapacity);
+
+	int run = 0, i = 0;
+	for (; text[i] != '\0'; i++){
+		unsigned char c = text[i];
+		if ((c >= 0x20) && (c != '"') && (c != '\\')) continue;
+
+		append(text + run, i - run, output, outputLength, outputCapacity);
+		char escape[6] = {'\\', (char)c, 0, 0, 0, 0};
+		if (c < 0x20){
+			escape[1] = 'u';
+			escape[2] = escape[3] = '0';
+			escape[4] = hex[c >> 4];
+			escape[5] = hex[c & 15];
+			append(escape, 6, output, outputLength, outputCapacity);
+		}
+		else append(escape, 2, output, outputLength, outputCapacity);
+		run = i + 1;
+	}
+
+	append(text + run, i - run, output, outputLength, outputCapacity);
+	append("\"", 1, output, outputLength, outputCapacity);
+}
+
+static void appendNumber(int value, char *&output, int &outputLength, int &outputCapacity){
+	char text[16];
+	append(text, snprintf(text, sizeof(text), "%d", value), output, outputLength, outputCapacity);
+}
+
+
+
+//*******************************************************************
+
+void CalcServer::handleRequest(Calculator *calc, char *line, int length, char *&output, int &outputLength,
+	int &outputCapacity){
+	int idStart = -1, idEnd = -1;
+	int exprStart = -1, exprLength = 0;
+	CalcSettings settings = calc->engine()->settings();
+	bool changed = false;
+	const char *problem = NULL;
+
+	int pos = skipBlank(line, 0, length);
+	if ((pos == length) || (line[pos] != '{')) problem = "Malformed request.";
+	else pos = skipBlank(line, pos + 1, length);
+
+	if ((problem == NULL) && (pos < length) && (line[pos] == '}')) pos++;
+	else while (problem == NULL){
+		//"key": value, the keys are compared as they were sent
+		int keyEnd = ((pos < length) && (line[pos] == '"')) ? valueEnd(line, pos, length) : -1;
+		if (keyEnd < 0){ problem = "Malformed request."; break; }
+		const char *key = line + pos + 1;
+		int keyLength = keyEnd - pos - 2;
+
+		pos = skipBlank(line, keyEnd, length);
+		if ((pos == length) || (line[pos] != ':')){ problem = "Malformed request."; break; }
+		int start = skipBlank(line, pos + 1, length);
+		int end = valueEnd(line, start, length);
+		if (end < 0){ problem = "Malformed request."; break; }
+		bool isString = (line[start] == '"');
+
+		if ((keyLength == 2) && !memcmp(key, "id", 2)){
+			idStart = start;
+			idEnd = end;
+		}
+		else if ((keyLength == 4) && !memcmp(key, "expr", 4)){
+			exprLength = isString ? unescape(line, start, end) : -1;
+			if (exprLength < 0){ problem = "\"expr\" must be a string."; break; }
+			//the numbers are read again when it is solved, up to what ends them
+			line[start + exprLength] = '\0';
+			exprStart = start;
+		}
+		else if ((keyLength == 4) && !memcmp(key, "base", 4)){
+			int base = 0;
+			for (int i = start; (i < end) && (base <= 36); i++)
+				base = charIs(line[i], CALC_CHAR_DIGIT) ? base * 10 + line[i] - '0' : 99;
+			if ((base < 2) || (base > 36)){ problem = "\"base\" must be from 2 to 36."; break; }
+			changed |= (settings.responseFormat.base != base);
+			settings.responseFormat.base = base;
+		}
+		else if ((keyLength == 4) && !memcmp(key, "trig", 4)){
+			int modeLength = isString ? unescape(line, start, end) : -1;
+			bool radians = (modeLength == 7) && !strncasecmp(line + start, "radians", 7);
+			if (!radians && ((modeLength != 7) || strncasecmp(line + start, "degrees", 7))){
+				problem = "\"trig\" must be \"radians\" or \"degrees\".";
+				break;
+			}
+			changed |= (settings.useRadians != radians);
+			settings.useRadians = radians;
+		}
+		else if ((keyLength == 4) && !memcmp(key, "type", 4)){
+			int nameLength = isString ? unescape(line, start, end) : -1;
+			int type = -1;
+			if (nameLength >= 0){
+				line[start + nameLength] = '\0';
+				type = numericTypeByName(line + start);
+			}
+			if (type < 0){ problem = "Unknown numeric type."; break; }
+			changed |= (settings.numericType != type);
+			settings.numericType = type;
+		}
+
+		pos = skipBlank(line, end, length);
+		if ((pos < length) && (line[pos] == ',')){
+			pos = skipBlank(line, pos + 1, length);
+			continue;
+		}
+		if ((pos < length) && (line[pos] == '}')) pos++;
+		else problem = "Malformed request.";
+		break;
+	}
+
+	if ((problem == NULL) && (skipBlank(line, pos, length) != length)) problem = "Malformed request.";
+
+	append("{\"id\":", 6, output, outputLength, outputCapacity);
+	if (idStart >= 0) append(line + idStart, idEnd - idStart, output, outputLength, outputCapacity);
+	else append("null", 4, output, outputLength, outputCapacity);
+
+	//options change the session before its expression is evaluated, and only
+	//when they are different, as a change gives the session an engine of its own
+	if ((problem == NULL) && changed && !calc->setSettings(settings))
+		problem = "Numeric type not available in this build.";
+
+	if (problem != NULL){
+		append(",\"ok\":false,\"error\":", 20, output, outputLength, outputCapacity);
+		appendString(problem, output, outputLength, outputCapacity);
+		append("}\n", 2, output, outputLength, outputCapacity);
+		return;
+	}
+
+	if (exprStart < 0){
+		//only options
+		append(",\"ok\":true}\n", 12, output, outputLength, outputCapacity);
+		return;
+	}
+
+	const char *response;
+	int selStart = 0, selStop = 0;
+	if (calc->calculate(line + exprStart, exprLength, &response, selStart, selStop) == CALC_OK){
+		append(",\"ok\":true,\"result\":", 20, output, outputLength, outputCapacity);
+		appendString(response, output, outputLength, outputCapacity);
+	}
+	else{
+		append(",\"ok\":false,\"error\":", 20, output, outputLength, outputCapacity);
+		appendString(response, output, outputLength, outputCapacity);
+		append(",\"start\":", 9, output, outputLength, outputCapacity);
+		appendNumber(selStart, output, outputLength, outputCapacity);
+		append(",\"stop\":", 8, output, outputLength, outputCapacity);
+		appendNumber(selStop, output, outputLength, outputCapacity);
+	}
+	append("}\n", 2, output, outputLength, outputCapacity);
+}
+
+bool CalcServer::handleLines(ServerConnection *connection, bool all){
+	//answers every whole line read, and with all what is left as well. False if
+	//what is left is already too long to be a request.
+	char *input = connection->input;
+	int start = 0;
+
+	for (;;){
+		char *newline = (char *)memchr(input + start, '\n', connection->inputLength - start);
+		if ((newline == NULL) && (!all || (start == connection->inputLength))) break;
+
+		int end = (newline != NULL) ? newline - input : connection->inputLength;
+		if (skipBlank(input, start, end) < end)
+			handleRequest(connection->calc, input + start, end - start, connection->output, connection->outputLength,
+				connection->outputCapacity);
+		start = (newline != NULL) ? end + 1 : end;
+	}
+
+	connection->inputLength -= start;
+	if ((start > 0) && (connection->inputLength > 0)) memmove(input, input + start, connection->inputLength);
+	return connection->inputLength <= SERVER_MAX_LINE;
+}
+
+
+
+//*******************************************************************
+
+static void setNonBlocking(int fd){
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static ServerConnection *newConnection(int fd, const CalcEngine *engine, int cacheSize){
+	ServerConnection *connection = new ServerConnection;
+	connection->fd = fd;
+	connection->calc = new Calculator(engine);
+	connection->calc->setCacheSize(cacheSize);
+	connection->inputCapacity = SERVER_READ_SIZE;
+	connection->input = new char[connection->inputCapacity];
+	connection->inputLength = 0;
+	connection->outputCapacity = SERVER_READ_SIZE;
+	connection->output = new char[connection->outputCapacity];
+	connection->outputLength = connection->outputSent = 0;
+	connection->writable = connection->closing = false;
+	connection->previous = connection->next = NULL;
+	return connection;
+}
+
+void CalcServer::closeConnection(ServerConnection *connection){
+	close(connection->fd);
+	delete connection->calc;
+	delete [] connection->input;
+	delete [] connection->output;
+	delete connection;
+}
+
+bool CalcServer::readInput(ServerConnection *connection){
+	//one read per time the connection is ready, if there is more it still is.
+	//False at the end of the input, or on an error.
+	if (connection->inputCapacity - connection->inputLength < SERVER_READ_SIZE){
+		connection->inputCapacity = connection->inputLength + 2 * SERVER_READ_SIZE;
+		char *input = new char[connection->inputCapacity];
+		memcpy(input, connection->input, connection->inputLength);
+		delete [] connection->input;
+		connection->input = input;
+	}
+
+	int got = read(connection->fd, connection->input + connection->inputLength, SERVER_READ_SIZE);
+	if (got > 0){
+		connection->inputLength += got;
+		return true;
+	}
+
+	return (got < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR));
+}
+
+bool CalcServer::writeOutput(ServerConnection *connection){
+	//as much as the socket takes, writable is left set if that wasn't all of it.
+	//False if the connection is gone.
+	while (connection->outputSent < connection->outputLength){
+		int sent = send(connection->fd, connection->output + connection->outputSent,
+			connection->outputLength - connection->outputSent, MSG_NOSIGNAL);
+		if (sent < 0){
+			if (errno == EINTR) continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) return false;
+			connection->writable = true;
+			return true;
+		}
+		connection->outputSent += sent;
+	}
+
+	connection->outputLength = connection->outputSent = 0;
+	connection->writable = false;
+	return true;
+}
+
+
+
+//*******************************************************************
+
+CalcServer::CalcServer(int threads, int cacheSize, int numericType){
+	//an unavailable type falls back to double, as in runBatch()
+	CalcSettings settings;
+	settingsDefaults(&settings);
+	settings.numericType = numericType;
+	if (!settingsValid(settings)) settings.numericType = CALC_TYPE_DOUBLE;
+
+	_engine = new CalcEngine(settings);
+	_cacheSize = cacheSize;
+	_listener = -1;
+	_path = NULL;
+	pipe(_stop);
+	_workerCount = (threads > 0) ? threads : countProcessors();
+	_workers = NULL;
+}
+
+CalcServer::~CalcServer(){
+	if (_listener >= 0){
+		close(_listener);
+		unlink(_path);
+	}
+
+	close(_stop[0]);
+	close(_stop[1]);
+	delete [] _path;
+	delete _engine;
+}
+
+bool CalcServer::listen(const char *path){
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) return false;
+	strcpy(address.sun_path, path);
+
+	_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (_listener < 0) return false;
+
+	//a socket left by a server that is gone is replaced, one still answering is not
+	struct stat status;
+	if ((stat(path, &status) == 0) && S_ISSOCK(status.st_mode)){
+		if (connect(_listener, (struct sockaddr *)&address, sizeof(address)) == 0){
+			close(_listener);
+			_listener = -1;
+			return false;
+		}
+		unlink(path);
+	}
+
+	if ((bind(_listener, (struct sockaddr *)&address, sizeof(address)) < 0) || (::listen(_listener, 128) < 0)){
+		close(_listener);
+		_listener = -1;
+		return false;
+	}
+
+	setNonBlocking(_listener);
+	_path = new char[strlen(path) + 1];
+	strcpy(_path, path);
+	return true;
+}
+
+void CalcServer::stop(){
+	char stop = 0;
+	write(_stop[1], &stop, 1);
+}
+
+void CalcServer::run(){
+	signal(SIGPIPE, SIG_IGN);
+
+	_workers = new ServerWorker[_workerCount];
+	for (int i = 0; i < _workerCount; i++){
+		ServerWorker &worker = _workers[i];
+		worker.server = this;
+		worker.connections = NULL;
+		pipe(worker.wake);
+#ifdef CALC_SERVER_EPOLL
+		worker.poller = epoll_create(SERVER_MAX_EVENTS);
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = NULL;
+		epoll_ctl(worker.poller, EPOLL_CTL_ADD, worker.wake[0], &event);
+#else
+		worker.poller = -1;
+#endif
+		pthread_create(&worker.thread, NULL, runWorker, &worker);
+	}
+
+	//connections are dealt out in turn, each stays with its worker to the end
+	int next = 0;
+	struct pollfd ready[2];
+	ready[0].fd = _stop[0];
+	ready[1].fd = _listener;
+	ready[0].events = ready[1].events = POLLIN;
+
+	for (;;){
+		if (poll(ready, 2, -1) <= 0) continue;
+		if (ready[0].revents != 0){
+			char stop;
+			read(_stop[0], &stop, 1);
+			break;
+		}
+
+		int fd;
+		while ((fd = accept(_listener, NULL, NULL)) >= 0){
+			setNonBlocking(fd);
+			ServerConnection *connection = newConnection(fd, _engine, _cacheSize);
+			write(_workers[next].wake[1], &connection, sizeof(connection));
+			next = (next + 1) % _workerCount;
+		}
+	}
+
+	for (int i = 0; i < _workerCount; i++){
+		ServerConnection *none = NULL;
+		write(_workers[i].wake[1], &none, sizeof(none));
+	}
+
+	for (int i = 0; i < _workerCount; i++){
+		ServerWorker &worker = _workers[i];
+		pthread_join(worker.thread, NULL);
+
+		while (worker.connections != NULL){
+			ServerConnection *connection = worker.connections;
+			worker.connections = connection->next;
+			closeConnection(connection);
+		}
+
+		close(worker.wake[0]);
+		close(worker.wake[1]);
+		if (worker.poller >= 0) close(worker.poller);
+	}
+
+	delete [] _workers;
+	_workers = NULL;
+}
+
+void *CalcServer::runWorker(void *data){
+	ServerWorker *worker = (ServerWorker *)data;
+	worker->server->serve(worker);
+	return NULL;
+}
+
+//*******************************************************************
+//A worker's loop. A connection is read when it has input, answered, and
+//written to straight away; only what the socket doesn't take then waits for
+//it to be writable, and the connection isn't read again until that is gone.
+
+#ifdef CALC_SERVER_EPOLL
+static void watch(ServerWorker *worker, ServerConnection *connection, bool adding){
+	struct epoll_event event;
+	event.events = connection->writable ? EPOLLOUT : EPOLLIN;
+	event.data.ptr = connection;
+	epoll_ctl(worker->poller, adding ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, connection->fd, &event);
+}
+#else
+static void watch(ServerWorker *, ServerConnection *, bool){
+	//poll() is given the events to wait for each time round instead
+}
+#endif
+
+bool CalcServer::serveReady(ServerWorker *worker, ServerConnection *connection, bool readable, bool writable){
+	//false once the connection should be closed
+	bool wasWritable = connection->writable;
+
+	if (writable){
+		if (!writeOutput(connection)) return false;
+		if (connection->closing && !connection->writable) return false;
+	}
+	if (readable){
+		//at the end of the input a last line without a newline is answered too, and
+		//a client that has only shut its side still gets what the socket didn't take
+		bool open = readInput(connection);
+		if (!handleLines(connection, !open) || !writeOutput(connection)) return false;
+		if (!open){
+			if (!connection->writable) return false;
+			connection->closing = true;
+		}
+	}
+
+	if (connection->writable != wasWritable) watch(worker, connection, false);
+	return true;
+}
+
+bool CalcServer::takeConnections(ServerWorker *worker){
+	//from the wake pipe, false once told to stop
+	ServerConnection *connections[SERVER_MAX_EVENTS];
+	int got = read(worker->wake[0], connections, sizeof(connections));
+
+	for (int i = 0; i < got / (int)sizeof(ServerConnection *); i++){
+		ServerConnection *connection = connections[i];
+		if (connection == NULL) return false;
+
+		connection->next = worker->connections;
+		if (worker->connections != NULL) worker->connections->previous = connection;
+		worker->connections = connection;
+		watch(worker, connection, true);
+	}
+
+	return true;
+}
+
+void CalcServer::dropConnection(ServerWorker *worker, ServerConnection *connection){
+	//closing the descriptor takes it out of the epoll set too
+	if (connection->previous != NULL) connection->previous->next = connection->next;
+	else worker->connections = connection->next;
+	if (connection->next != NULL) connection->next->previous = connection->previous;
+	closeConnection(connection);
+}
+
+#ifdef CALC_SERVER_EPOLL
+
+void CalcServer::serve(ServerWorker *worker){
+	struct epoll_event events[SERVER_MAX_EVENTS];
+
+	for (;;){
+		int count = epoll_wait(worker->poller, events, SERVER_MAX_EVENTS, -1);
+
+		for (int i = 0; i < count; i++){
+			ServerConnection *connection = (ServerConnection *)events[i].data.ptr;
+			if (connection == NULL){
+				if (!takeConnections(worker)) return;
+				continue;
+			}
+
+			//a hang up is found out by whichever of the two the connection is waiting on
+			bool hangup = events[i].events & (EPOLLHUP | EPOLLERR);
+			bool readable = hangup || (events[i].events & EPOLLIN);
+			bool writable = hangup || (events[i].events & EPOLLOUT);
+			if (!serveReady(worker, connection, readable && !connection->writable, writable && connection->writable))
+				dropConnection(worker, connection);
+		}
+	}
+}
+
+#else
+
+void CalcServer::serve(ServerWorker *worker){
+	//the set is built again every time round, which only costs what poll() would anyway
+	struct pollfd *ready = NULL;
+	ServerConnection **watched = NULL;
+	int capacity = 0;
+
+	for (;;){
+		int count = 1;
+		for (ServerConnection *connection = worker->connections; connection != NULL; connection = connection->next)
+			count++;
+
+		if (count > capacity){
+			delete [] ready;
+			delete [] watched;
+			capacity = 2 * count;
+			ready = new struct pollfd[capacity];
+			watched = new ServerConnection *[capacity];
+		}
+
+		ready[0].fd = worker->wake[0];
+		ready[0].events = POLLIN;
+		count = 1;
+		for (ServerConnection *connection = worker->connections; connection != NULL; connection = connection->next){
+			ready[count].fd = connection->fd;
+			ready[count].events = connection->writable ? POLLOUT : POLLIN;
+			watched[count++] = connection;
+		}
+
+		if (poll(ready, count, -1) <= 0) continue;
+
+		for (int i = 1; i < count; i++){
+			short events = ready[i].revents;
+			if (events == 0) continue;
+
+			ServerConnection *connection = watched[i];
+			bool hangup = events & (POLLHUP | POLLERR | POLLNVAL);
+			bool readable = hangup || (events & POLLIN);
+			bool writable = hangup || (events & POLLOUT);
+			if (!serveReady(worker, connection, readable && !connection->writable, writable && connection->writable))
+				dropConnection(worker, connection);
+		}
+
+		if ((ready[0].revents != 0) && !takeConnections(worker)) break;
+	}
+
+	delete [] ready;
+	delete [] watched;
+}
+
+#endif
+
+
+
+//*******************************************************************
+
+int CalcServer::serveStream(int in, int out){
+	//blocking on both, and answering every read as soon as it is in
+	ServerConnection *connection = newConnection(in, _engine, _cacheSize);
+	bool reading = true;
+	int failed = 0;
+
+	while (reading){
+		reading = readInput(connection);
+
+		if (!handleLines(connection, !reading)){
+			failed = 1;
+			break;
+		}
+
+		for (int i = 0; i < connection->outputLength; ){
+			int written = write(out, connection->output + i, connection->outputLength - i);
+			if (written < 0){
+				if (errno == EINTR) continue;
+				reading = false;
+				failed = 1;
+				break;
+			}
+			i += written;
+		}
+		connection->outputLength = 0;
+	}
+
+	connection->fd = -1;
+	closeConnection(connection);
+	return failed;
+}
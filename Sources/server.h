@@ -0,0 +1,95 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "calculator.h"
+
+//epoll where there is one, poll() anywhere else
+#if defined(__linux__) && !defined(CALC_NO_EPOLL)
+#define CALC_SERVER_EPOLL
+#endif
+
+#define SERVER_READ_SIZE 16384			//read at a time from a connection
+#define SERVER_MAX_LINE (1 << 20)		//a longer request closes the connection
+#define SERVER_MAX_EVENTS 64
+
+struct ServerWorker;
+
+//A client and its session: 'ans', the options it has set and, when the server has
+//one, a cache, in a Calculator of its own that shares the server's engine.
+struct ServerConnection{
+	int fd;
+	Calculator *calc;
+	char *input;
+	int inputLength, inputCapacity;
+	char *output;
+	int outputLength, outputSent, outputCapacity;
+	bool writable;					//waiting on the socket to take the rest of output
+	bool closing;					//the input has ended, closed once output is all sent
+	ServerConnection *previous, *next;		//in its worker's list
+};
+
+//Evaluates requests sent as JSON lines, one object per line:
+//
+//	{"id": 7, "expr": "ans*2", "base": 10, "trig": "radians", "type": "int64"}
+//
+//and answers each with a line, in the order they came:
+//
+//	{"id":7,"ok":true,"result":"26"}
+//	{"id":8,"ok":false,"error":"Unmatched parens.","start":2,"stop":3}
+//
+//where start and stop select what is wrong in the expression, as in the window.
+//Only "expr" is needed. "id" is given back as it was sent. "base", "trig" and
+//"type" change the connection's session, and stay until changed again, like the
+//settings of the window do. Requests can be sent without waiting for answers.
+//
+//Each worker thread runs an event loop over the connections it was given, so a
+//request is read, evaluated and answered on one thread without being handed
+//on, and a connection's requests are evaluated in order. The listening thread
+//only accepts, and deals the connections out to the workers in turn.
+class CalcServer{
+	private:
+		CalcEngine *_engine;
+		int _cacheSize;
+		int _listener;
+		char *_path;
+		int _stop[2];					//a pipe stop() writes to, which is safe from a signal handler
+
+		ServerWorker *_workers;
+		int _workerCount;
+
+		static void *runWorker(void *data);
+		void serve(ServerWorker *worker);
+		bool serveReady(ServerWorker *worker, ServerConnection *connection, bool readable, bool writable);
+		bool takeConnections(ServerWorker *worker);
+		void dropConnection(ServerWorker *worker, ServerConnection *connection);
+		static bool readInput(ServerConnection *connection);
+		static bool writeOutput(ServerConnection *connection);
+		static bool handleLines(ServerConnection *connection, bool all);
+		static void closeConnection(ServerConnection *connection);
+
+	public:
+		//threads 0 for one per processor, a cacheSize above zero gives every session a
+		//cache, numericType is what sessions start with, see runBatch()
+		CalcServer(int threads, int cacheSize, int numericType);
+		~CalcServer(void);
+
+		bool listen(const char *path);		//a Unix domain socket, replacing any stale one at path
+		void run();							//accepts until stop(), then waits for the workers
+		void stop();						//from any thread, or a signal handler
+
+		//one session over a pair of descriptors, stdin and stdout say, until the input
+		//ends. Non-zero if it stopped early, at a line too long or output that closed.
+		int serveStream(int in, int out);
+
+		//the answer line for one request line, appended to output. Strings in the
+		//line are unescaped where they are.
+		static void handleRequest(Calculator *calc, char *line, int length, char *&output, int &outputLength,
+			int &outputCapacity);
+};
+
+#endif
@@ -8,14 +8,25 @@
 
 #include <String.h> //thank god
 
+//Character classes, so a test is one table lookup rather than a chain of compares
+#define CALC_CHAR_BLANK 0x01			//' ' and '\t', what the lexer skips
+#define CALC_CHAR_DIGIT 0x02
+#define CALC_CHAR_LETTER 0x04
+#define CALC_CHAR_UPPER 0x08
+
+extern const unsigned char gCharClasses[256];
+
+inline bool charIs(char c, int classes){
+	return (gCharClasses[(unsigned char)c] & classes) != 0;
+}
+
 bool contains(BString *str, char c);
 int countOccurances(BString *str, char c);
 int findNthOccurance(BString *str, char c, int n);
-int findCharBeforePosition(BString *str, char c, int p); 
+int findCharBeforePosition(BString *str, char c, int p);
 int findCharAfterPosition(BString *str, char c, int p);
 
 int findElementOfSetBeforePosition(BString *str, BString *set, char *whichElement, int p);
 int findElementOfSetAfterPosition(BString *str, BString *set, char *whichElement, int p);
 
-
-#endif
\ No newline at end of file
+#endif
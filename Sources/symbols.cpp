@@ -0,0 +1,241 @@
+#include "symbols.h"
+#include "strutil.h"
+
+static char *copyOf(const char *text, int length){
+	char *copy = new char[length + 1];
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+	return copy;
+}
+
+SymbolTable::SymbolTable(){
+	_count = 0;
+	_capacity = 16;
+	_symbols = new CalcSymbol[_capacity];
+	_tableMask = 31;
+	_table = new int[_tableMask + 1];
+	memset(_table, -1, (_tableMask + 1) * sizeof(int));
+	_version = _sequence = 0;
+}
+
+SymbolTable::~SymbolTable(){
+	for (int i = 0; i < _count; i++){
+		release(_symbols[i]);
+		delete [] _symbols[i].name;
+	}
+
+	delete [] _symbols;
+	delete [] _table;
+}
+
+void SymbolTable::clear(){
+	//versions carry on, so nothing built before compares as current by chance
+	for (int i = 0; i < _count; i++){
+		release(_symbols[i]);
+		delete [] _symbols[i].name;
+	}
+
+	_count = 0;
+	memset(_table, -1, (_tableMask + 1) * sizeof(int));
+}
+
+void SymbolTable::release(CalcSymbol &symbol){
+	//everything a definition owns, the name stays
+	delete [] symbol.answer;
+	delete [] symbol.canonical;
+	delete [] symbol.definition;
+	delete [] symbol.nodes;
+	delete [] symbol.literals;
+	delete [] symbol.dependencies;
+
+	symbol.answer = symbol.canonical = symbol.definition = symbol.literals = NULL;
+	symbol.nodes = NULL;
+	symbol.dependencies = NULL;
+	symbol.value = 0;
+	symbol.definitionLength = symbol.parameterCount = symbol.nodeCount = symbol.literalLength = 0;
+	symbol.dependencyCount = symbol.sequence = 0;
+	symbol.error = 0;
+}
+
+unsigned int SymbolTable::hash(const char *name, int length){
+	//FNV-1a over the lowercased name
+	unsigned int h = 2166136261u;
+
+	for (int i = 0; i < length; i++){
+		char c = name[i];
+		if (charIs(c, CALC_CHAR_UPPER)) c += 'a' - 'A';
+		h = (h ^ (unsigned char)c) * 16777619u;
+	}
+
+	return h;
+}
+
+int SymbolTable::probe(const char *name, int length, unsigned int h) const{
+	//the table position of the name, or of the empty one where it would go
+	int position = h & _tableMask;
+
+	for (;;){
+		int slot = _table[position];
+		if (slot < 0) return position;
+
+		const CalcSymbol &symbol = _symbols[slot];
+		if ((symbol.hash == h) && (symbol.length == length) && !strncasecmp(symbol.name, name, length)) return position;
+
+		position = (position + 1) & _tableMask;
+	}
+}
+
+void SymbolTable::growTable(){
+	//kept at most half full, so a probe is short even for names that aren't there
+	delete [] _table;
+	_tableMask = 2 * _tableMask + 1;
+	_table = new int[_tableMask + 1];
+	memset(_table, -1, (_tableMask + 1) * sizeof(int));
+
+	for (int slot = 0; slot < _count; slot++){
+		int position = _symbols[slot].hash & _tableMask;
+		while (_table[position] >= 0)
+			position = (position + 1) & _tableMask;
+		_table[position] = slot;
+	}
+}
+
+int SymbolTable::find(const char *name, int length) const{
+	return _table[probe(name, length, hash(name, length))];
+}
+
+int SymbolTable::intern(const char *name, int length){
+	unsigned int h = hash(name, length);
+	int position = probe(name, length, h);
+	if (_table[position] >= 0) return _table[position];
+
+	if (2 * (_count + 1) > _tableMask + 1){
+		growTable();
+		position = probe(name, length, h);
+	}
+
+	if (_count == _capacity){
+		//the definitions are moved, not copied, so only the array is new
+		CalcSymbol *symbols = new CalcSymbol[_capacity * 2];
+		memcpy(symbols, _symbols, _count * sizeof(CalcSymbol));
+		delete [] _symbols;
+		_symbols = symbols;
+		_capacity *= 2;
+	}
+
+	int slot = _count++;
+	CalcSymbol &symbol = _symbols[slot];
+	symbol.name = copyOf(name, length);
+	symbol.length = length;
+	symbol.hash = h;
+	symbol.type = CALC_SYMBOL_UNDEFINED;
+	symbol.version = 0;
+	symbol.answer = symbol.canonical = symbol.definition = symbol.literals = NULL;
+	symbol.nodes = NULL;
+	symbol.dependencies = NULL;
+	release(symbol);
+
+	_table[position] = slot;
+	return slot;
+}
+
+void SymbolTable::defineVariable(int slot, const char *answer, const char *canonical, double value){
+	CalcSymbol &symbol = _symbols[slot];
+	release(symbol);
+
+	symbol.type = CALC_SYMBOL_VARIABLE;
+	symbol.version = ++_version;
+	symbol.answer = copyOf(answer, strlen(answer));
+	if (canonical != NULL) symbol.canonical = copyOf(canonical, strlen(canonical));
+	symbol.value = value;
+}
+
+void SymbolTable::defineFunction(int slot, const char *definition, int definitionLength, int parameterCount,
+	const CalcNode *nodes, int nodeCount, const char *literals, int literalLength,
+	const CalcDependency *dependencies, int dependencyCount){
+	CalcSymbol &symbol = _symbols[slot];
+
+	//the definition may be the one being replaced, when it is parsed again
+	char *text = copyOf(definition, definitionLength);
+	release(symbol);
+
+	symbol.type = CALC_SYMBOL_FUNCTION;
+	symbol.version = ++_version;
+	symbol.sequence = ++_sequence;
+	symbol.definition = text;
+	symbol.definitionLength = definitionLength;
+	symbol.parameterCount = parameterCount;
+
+	symbol.nodes = new CalcNode[nodeCount];
+	memcpy(symbol.nodes, nodes, nodeCount * sizeof(CalcNode));
+	symbol.nodeCount = nodeCount;
+	symbol.literals = new char[literalLength + 1];
+	if (literalLength > 0) memcpy(symbol.literals, literals, literalLength);
+	symbol.literalLength = literalLength;
+
+	if (dependencyCount > 0){
+		symbol.dependencies = new CalcDependency[dependencyCount];
+		memcpy(symbol.dependencies, dependencies, dependencyCount * sizeof(CalcDependency));
+	}
+	symbol.dependencyCount = dependencyCount;
+}
+
+void SymbolTable::setError(int slot, int error){
+	//the definition is kept to parse again once what it calls changes, and it is
+	//counted as built on what there is now, so it isn't stale until then
+	CalcSymbol &symbol = _symbols[slot];
+
+	delete [] symbol.nodes;
+	delete [] symbol.literals;
+	symbol.nodes = NULL;
+	symbol.literals = NULL;
+	symbol.nodeCount = symbol.literalLength = 0;
+
+	for (int i = 0; i < symbol.dependencyCount; i++)
+		symbol.dependencies[i].version = _symbols[symbol.dependencies[i].slot].version;
+
+	symbol.version = ++_version;
+	symbol.sequence = ++_sequence;
+	symbol.error = error;
+}
+
+
+
+//*******************************************************************
+
+bool SymbolTable::isCurrent(const CalcDependency *dependencies, int count) const{
+	for (int i = 0; i < count; i++)
+		if (_symbols[dependencies[i].slot].version != dependencies[i].version) return false;
+
+	return true;
+}
+
+bool SymbolTable::dependsOn(int slot, int on) const{
+	//definitions can't be circular, so this always ends
+	const CalcSymbol &symbol = _symbols[slot];
+
+	for (int i = 0; i < symbol.dependencyCount; i++){
+		int callee = symbol.dependencies[i].slot;
+		if ((callee == on) || dependsOn(callee, on)) return true;
+	}
+
+	return false;
+}
+
+int SymbolTable::staleFunctions(int *slots) const{
+	//a function is parsed after everything it inlined, so by sequence is an order
+	//in which the stale ones can each be parsed again once those before them are
+	int found = 0;
+
+	for (int slot = 0; slot < _count; slot++){
+		const CalcSymbol &symbol = _symbols[slot];
+		if ((symbol.type != CALC_SYMBOL_FUNCTION) || isCurrent(symbol.dependencies, symbol.dependencyCount)) continue;
+
+		int i = found++;
+		for (; (i > 0) && (_symbols[slots[i - 1]].sequence > symbol.sequence); i--)
+			slots[i] = slots[i - 1];
+		slots[i] = slot;
+	}
+
+	return found;
+}
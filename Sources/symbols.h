@@ -0,0 +1,99 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#include "engine.h"
+
+#define CALC_SYMBOL_UNDEFINED 0		//a name that has been seen, but not given anything yet
+#define CALC_SYMBOL_VARIABLE 1
+#define CALC_SYMBOL_FUNCTION 2
+
+#define CALC_MAX_PARAMETERS 8
+
+struct CalcSymbol{
+	char *name;					//the table's own copy, as it was first written
+	int length;
+	unsigned int hash;
+	int type;					//one of the CALC_SYMBOL_ constants
+	int version;				//new with every definition, 0 before the first
+
+	//a variable's answer, kept the way the history keeps them
+	char *answer;
+	char *canonical;			//NULL when the answer is already in the form the numeric types read
+	double value;
+
+	//a function: its whole definition, and the body parsed with every call in it
+	//inlined, numbers and all in literals
+	char *definition;
+	int definitionLength;
+	int parameterCount;
+	CalcNode *nodes;
+	int nodeCount;
+	char *literals;
+	int literalLength;
+	CalcDependency *dependencies;		//the functions it inlined, as they were then
+	int dependencyCount;
+	int sequence;				//when it was last parsed, so the ones it inlined always have lower
+	int error;					//CALC_OK, or why the definition no longer parses
+};
+
+//The names a session has defined, interned: each is hashed and compared once,
+//when it is first seen, and from then on is a slot number that stays the same
+//however often it is redefined. The parser resolves names to slots, so what
+//it binds costs an array index, not a lookup.
+//
+//Variables are bound by value when used. A function keeps its body as nodes
+//with the functions it calls already inlined, so calling it is a copy of those
+//nodes, and each definition records the version of every function it inlined.
+//Redefining one leaves staleFunctions() to say which definitions (and
+//isCurrent() which compiled expressions) were built on the old one; nothing
+//else needs to be parsed again.
+class SymbolTable{
+	private:
+		CalcSymbol *_symbols;
+		int _count, _capacity;
+		int *_table;				//open addressed slots, -1 where empty
+		int _tableMask;
+		int _version;				//the last version handed out
+		int _sequence;
+
+		static unsigned int hash(const char *name, int length);
+		int probe(const char *name, int length, unsigned int h) const;
+		void growTable();
+		void release(CalcSymbol &symbol);
+
+	public:
+		SymbolTable(void);
+		~SymbolTable(void);
+
+		void clear();
+
+		//the slot of a name, added as undefined if it is new. Names are matched case
+		//insensitively, like every other word.
+		int intern(const char *name, int length);
+		int find(const char *name, int length) const;		//-1 if it has never been seen
+
+		int count() const { return _count; }
+		const CalcSymbol *symbol(int slot) const { return &_symbols[slot]; }
+
+		void defineVariable(int slot, const char *answer, const char *canonical, double value);
+		void defineFunction(int slot, const char *definition, int definitionLength, int parameterCount,
+			const CalcNode *nodes, int nodeCount, const char *literals, int literalLength,
+			const CalcDependency *dependencies, int dependencyCount);
+		void setError(int slot, int error);		//a function that no longer parses, a new version all the same
+
+		//false if any of the symbols has been defined again since
+		bool isCurrent(const CalcDependency *dependencies, int count) const;
+		//whether the function in slot inlined on, itself or through another
+		bool dependsOn(int slot, int on) const;
+		//the functions built on an old version of another, oldest first, which
+		//is an order each can be parsed again in. Parsing them again can leave
+		//others stale in turn, until none are. slots needs room for count().
+		int staleFunctions(int *slots) const;
+};
+
+#endif
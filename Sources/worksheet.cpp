@@ -0,0 +1,552 @@
+#include "worksheet.h"
+#include "batch.h"
+
+//One recalculate() spread over threads. Everything below lock is only touched with it held.
+struct SheetRun{
+	Worksheet *sheet;
+	int mark;
+	int total;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cellsReady;
+	int readyCount;					//cells in the worksheet's _ready
+	int done;
+};
+
+Worksheet::Worksheet(){
+	_cellCount = 0;
+	_cellCapacity = 64;
+	_cells = new SheetCell[_cellCapacity];
+	_threads = 1;
+
+	_dirtyCount = _blockedCount = 0;
+	_dirtyCapacity = _blockedCapacity = 16;
+	_dirty = new int[_dirtyCapacity];
+	_blocked = new int[_blockedCapacity];
+	_mark = 0;
+
+	_order = _ready = _from = NULL;
+	_scratchCapacity = 0;
+}
+
+Worksheet::~Worksheet(){
+	for (int i = 0; i < _cellCount; i++){
+		delete _cells[i].compiled;
+		delete [] _cells[i].inputs;
+		delete [] _cells[i].arguments;
+		delete [] _cells[i].dependents;
+	}
+
+	delete [] _cells;
+	delete [] _dirty;
+	delete [] _blocked;
+	delete [] _order;
+	delete [] _ready;
+	delete [] _from;
+}
+
+void Worksheet::setThreads(int threads){
+	_threads = (threads > 0) ? threads : countProcessors();
+}
+
+Calculator *Worksheet::calculator(){
+	return &_calc;
+}
+
+int Worksheet::count(){
+	return _cellCount;
+}
+
+int Worksheet::find(const char *name, int length){
+	return _names.find(name, length);
+}
+
+const char *Worksheet::name(int cell){
+	return _names.symbol(cell)->name;
+}
+
+bool Worksheet::isDefined(int cell){
+	return _cells[cell].defined;
+}
+
+double Worksheet::value(int cell){
+	return _cells[cell].value;
+}
+
+int Worksheet::error(int cell){
+	return _cells[cell].error;
+}
+
+const char *Worksheet::describe(int cell){
+	const SheetCell &c = _cells[cell];
+	_description.SetTo("");
+
+	if (c.error == CALC_OK){
+		char text[64];
+		formatDecimal(c.value, CALC_DECIMAL_SHORTEST, 0, text, sizeof(text));
+		_description << text;
+		return _description.String();
+	}
+
+	//an error that came through an input is told as the cell it started at
+	if (c.errorCell != cell) _description << "In " << name(c.errorCell) << ": ";
+	if (c.error == CALC_CIRCULAR_REFERENCE) _description << "Circular reference: " << _cells[c.errorCell].cycle << ".";
+	else _description << Calculator::errorResponse(c.error);
+
+	return _description.String();
+}
+
+
+
+//*******************************************************************
+
+void Worksheet::appendTo(int *&list, int &count, int &capacity, int value){
+	if (count == capacity){
+		int *grown = new int[capacity * 2];
+		memcpy(grown, list, count * sizeof(int));
+		delete [] list;
+		list = grown;
+		capacity *= 2;
+	}
+
+	list[count++] = value;
+}
+
+void Worksheet::removeFrom(int *list, int &count, int value){
+	//order doesn't matter in any of the lists, so the last takes its place
+	for (int i = 0; i < count; i++){
+		if (list[i] == value){
+			list[i] = list[--count];
+			return;
+		}
+	}
+}
+
+int Worksheet::addCell(const char *name, int length){
+	//the cell of a name, new and undefined if it hasn't been seen
+	int cell = _names.intern(name, length);
+	if (cell < _cellCount) return cell;
+
+	if (_cellCount == _cellCapacity){
+		//the cells own what they point to, so only the array is new
+		SheetCell *cells = new SheetCell[_cellCapacity * 2];
+		for (int i = 0; i < _cellCount; i++)
+			cells[i] = _cells[i];
+		delete [] _cells;
+		_cells = cells;
+		_cellCapacity *= 2;
+	}
+
+	SheetCell &c = _cells[_cellCount++];
+	c.defined = false;
+	c.compiled = NULL;
+	c.ownError = c.error = CALC_UNKNOWN_NAME;
+	c.errorStart = c.errorStop = 0;
+	c.errorCell = cell;
+	c.inputs = NULL;
+	c.arguments = NULL;
+	c.inputCount = 0;
+	c.dependentCapacity = 4;
+	c.dependents = new int[c.dependentCapacity];
+	c.dependentCount = 0;
+	c.linked = false;
+	c.value = 0;
+	c.dirty = false;
+	c.mark = c.pending = 0;
+
+	return cell;
+}
+
+void Worksheet::growScratch(){
+	if (_scratchCapacity >= _cellCount) return;
+
+	delete [] _order;
+	delete [] _ready;
+	delete [] _from;
+	_scratchCapacity = 2 * _cellCount;
+	_order = new int[_scratchCapacity];
+	_ready = new int[_scratchCapacity];
+	_from = new int[_scratchCapacity];
+}
+
+void Worksheet::markDirty(int cell){
+	if (_cells[cell].dirty) return;
+
+	_cells[cell].dirty = true;
+	appendTo(_dirty, _dirtyCount, _dirtyCapacity, cell);
+}
+
+void Worksheet::compileCell(int cell){
+	//the names in the formula become the compiled form's variables, and each one's cell its input
+	SheetCell &c = _cells[cell];
+	int start = 0, stop = 0;
+
+	delete [] c.inputs;
+	delete [] c.arguments;
+	c.inputs = NULL;
+	c.arguments = NULL;
+	c.inputCount = 0;
+	if (c.compiled == NULL) c.compiled = new CompiledExpression;
+
+	c.ownError = _calc.compile(&c.formula, c.compiled, start, stop);
+	c.errorStart = start;
+	c.errorStop = stop;
+	if (c.ownError != CALC_OK) return;
+
+	int count = c.compiled->countVariables();
+	int *inputs = new int[count];
+	c.arguments = new double[count];
+	c.inputCount = count;
+	c.inputs = inputs;
+
+	//addCell() can move the cells, so c isn't used past here
+	CompiledExpression *compiled = c.compiled;
+	for (int i = 0; i < count; i++){
+		const char *input = compiled->variableName(i);
+		inputs[i] = addCell(input, strlen(input));
+	}
+}
+
+bool Worksheet::findCycle(int cell){
+	//A cycle would run from the cell through its inputs and back to it, so it is
+	//searched for upstream. Only a cell something depends on can be on one, or
+	//name itself. The path found is kept for the error, and where the formula
+	//starts it.
+	SheetCell &c = _cells[cell];
+	int found = -1;
+
+	for (int i = 0; i < c.inputCount; i++)
+		if (c.inputs[i] == cell) found = cell;
+
+	if ((found < 0) && (c.dependentCount > 0)){
+		growScratch();
+		int mark = ++_mark, count = 0;
+
+		for (int i = 0; i < c.inputCount; i++){
+			int input = c.inputs[i];
+			if (_cells[input].mark == mark) continue;
+			_cells[input].mark = mark;
+			_from[input] = cell;
+			_order[count++] = input;
+		}
+
+		//breadth first, so the path found is a shortest one
+		for (int i = 0; (i < count) && (found < 0); i++){
+			const SheetCell &next = _cells[_order[i]];
+			if (!next.linked) continue;
+
+			for (int j = 0; j < next.inputCount; j++){
+				int input = next.inputs[j];
+				if (input == cell){
+					found = _order[i];
+					break;
+				}
+				if (_cells[input].mark == mark) continue;
+
+				_cells[input].mark = mark;
+				_from[input] = _order[i];
+				_order[count++] = input;
+			}
+		}
+	}
+
+	if (found < 0) return false;
+
+	//_from leads back to the cell, the reverse of the order the formulas name each other in
+	int length = 0, first = cell;
+	for (int at = found; at != cell; at = _from[at])
+		_ready[length++] = first = at;
+	
+	c.cycle.SetTo(name(cell));
+	while (length > 0)
+		c.cycle << " -> " << name(_ready[--length]);
+	c.cycle << " -> " << name(cell);
+	
+	//and the error selects where the formula names the first cell on it
+	const char *formula = c.formula.String(), *input = name(first);
+	int inputLength = strlen(input);
+	c.errorStart = 0;
+	c.errorStop = c.formula.Length();
+	
+	for (int pos = 0; pos < c.formula.Length();){
+		int start = pos;
+		while ((pos < c.formula.Length()) && charIs(formula[pos], CALC_CHAR_LETTER))
+			pos++;
+		
+		if ((pos - start == inputLength) && !strncasecmp(formula + start, input, inputLength)){
+			c.errorStart = start;
+			c.errorStop = pos;
+			break;
+		}
+		if (pos == start) pos++;
+	}
+	return true;
+}
+
+bool Worksheet::link(int cell){
+	//into the graph as its inputs' dependent, unless that closes a cycle
+	SheetCell &c = _cells[cell];
+
+	if (findCycle(cell)){
+		c.ownError = CALC_CIRCULAR_REFERENCE;
+		return false;
+	}
+
+	for (int i = 0; i < c.inputCount; i++){
+		SheetCell &input = _cells[c.inputs[i]];
+		appendTo(input.dependents, input.dependentCount, input.dependentCapacity, cell);
+	}
+	c.linked = true;
+	return true;
+}
+
+void Worksheet::unlink(int cell){
+	SheetCell &c = _cells[cell];
+
+	if (c.linked){
+		for (int i = 0; i < c.inputCount; i++){
+			SheetCell &input = _cells[c.inputs[i]];
+			removeFrom(input.dependents, input.dependentCount, cell);
+		}
+	}
+	else removeFrom(_blocked, _blockedCount, cell);
+
+	c.linked = false;
+}
+
+void Worksheet::relinkBlocked(){
+	//a change can break a cycle, so each cell left out tries again
+	int kept = 0;
+
+	for (int i = 0; i < _blockedCount; i++){
+		int cell = _blocked[i];
+		_cells[cell].ownError = CALC_OK;
+
+		if (link(cell)) markDirty(cell);
+		else _blocked[kept++] = cell;
+	}
+
+	_blockedCount = kept;
+}
+
+int Worksheet::setCell(const char *name, int nameLength, const char *formula, int formulaLength, int &selStart, int &selStop){
+	//a name is one word, and not one the lexer already knows
+	selStart = 0;
+	selStop = nameLength;
+	if (nameLength == 0) return CALC_BAD_DEFINITION;
+	for (int i = 0; i < nameLength; i++)
+		if (!charIs(name[i], CALC_CHAR_LETTER)) return CALC_BAD_DEFINITION;
+	if (_calc.engine()->lookupWord(name, nameLength) != CALC_TOKEN_WORD) return CALC_BAD_DEFINITION;
+
+	int cell = addCell(name, nameLength);
+	unlink(cell);
+
+	_cells[cell].formula.SetTo(formula, formulaLength);
+	_cells[cell].defined = true;
+	compileCell(cell);
+
+	if (!link(cell)) appendTo(_blocked, _blockedCount, _blockedCapacity, cell);
+	relinkBlocked();
+	markDirty(cell);
+
+	selStart = _cells[cell].errorStart;
+	selStop = _cells[cell].errorStop;
+	return _cells[cell].ownError;
+}
+
+int Worksheet::setLine(const char *line, int length, int &selStart, int &selStop){
+	//'name = formula' is a cell, the rest (function definitions mostly) is the Calculator's
+	int pos = 0, nameStart, nameStop;
+	while ((pos < length) && charIs(line[pos], CALC_CHAR_BLANK))
+		pos++;
+	nameStart = pos;
+	while ((pos < length) && charIs(line[pos], CALC_CHAR_LETTER))
+		pos++;
+	nameStop = pos;
+	while ((pos < length) && charIs(line[pos], CALC_CHAR_BLANK))
+		pos++;
+
+	if ((nameStop > nameStart) && (pos < length) && (line[pos] == '=') && ((pos + 1 == length) || (line[pos + 1] != '='))){
+		int error = setCell(line + nameStart, nameStop - nameStart, line + pos + 1, length - pos - 1, selStart, selStop);
+		int offset = (error == CALC_BAD_DEFINITION) ? nameStart : pos + 1;
+		selStart += offset;
+		selStop += offset;
+		return error;
+	}
+
+	const char *response;
+	if (_calc.calculate(line, length, &response, selStart, selStop)) return CALC_INVALID_EXPRESSION;
+
+	//cells built on a function that has just changed, or that called one that wasn't there
+	for (int cell = 0; cell < _cellCount; cell++){
+		SheetCell &c = _cells[cell];
+		if (!c.defined || (c.ownError == CALC_CIRCULAR_REFERENCE)) continue;
+		if ((c.ownError == CALC_OK) && _calc.isCurrent(c.compiled)) continue;
+
+		unlink(cell);
+		compileCell(cell);
+		if (!link(cell)) appendTo(_blocked, _blockedCount, _blockedCapacity, cell);
+		markDirty(cell);
+	}
+	relinkBlocked();
+
+	return CALC_OK;
+}
+
+
+
+//*******************************************************************
+
+void Worksheet::computeCell(int cell){
+	//its inputs are all computed by now, or weren't reached as nothing changed them
+	SheetCell &c = _cells[cell];
+	c.errorCell = cell;
+
+	if (c.ownError != CALC_OK){
+		c.error = c.ownError;
+		return;
+	}
+
+	for (int i = 0; i < c.inputCount; i++){
+		const SheetCell &input = _cells[c.inputs[i]];
+		if (input.error != CALC_OK){
+			c.error = input.error;
+			c.errorCell = input.errorCell;
+			return;
+		}
+		c.arguments[i] = input.value;
+	}
+
+	c.value = c.compiled->evaluate(c.arguments);
+	c.error = CALC_OK;
+}
+
+int Worksheet::releaseDependents(int cell, int mark, int readyCount){
+	//the dependents this pass reached have one input fewer to wait for, and those
+	//with none left go on _ready. Returns its new count.
+	const SheetCell &c = _cells[cell];
+
+	for (int i = 0; i < c.dependentCount; i++){
+		SheetCell &dependent = _cells[c.dependents[i]];
+		if ((dependent.mark == mark) && (--dependent.pending == 0)) _ready[readyCount++] = c.dependents[i];
+	}
+
+	return readyCount;
+}
+
+int Worksheet::recalculate(){
+	//Everything downstream of a dirty cell, found breadth first into _order, then
+	//computed as each cell's last pending input is: Kahn's algorithm, with the
+	//pending counts only over the cells this pass reached.
+	if (_dirtyCount == 0) return 0;
+
+	growScratch();
+	int mark = ++_mark, count = 0;
+
+	for (int i = 0; i < _dirtyCount; i++){
+		int cell = _dirty[i];
+		_cells[cell].dirty = false;
+		if (_cells[cell].mark == mark) continue;
+
+		_cells[cell].mark = mark;
+		_order[count++] = cell;
+	}
+	_dirtyCount = 0;
+
+	for (int i = 0; i < count; i++){
+		const SheetCell &c = _cells[_order[i]];
+		for (int j = 0; j < c.dependentCount; j++){
+			int dependent = c.dependents[j];
+			if (_cells[dependent].mark == mark) continue;
+
+			_cells[dependent].mark = mark;
+			_order[count++] = dependent;
+		}
+	}
+
+	int readyCount = 0;
+	for (int i = 0; i < count; i++){
+		SheetCell &c = _cells[_order[i]];
+		c.pending = 0;
+		for (int j = 0; c.linked && (j < c.inputCount); j++)
+			if (_cells[c.inputs[j]].mark == mark) c.pending++;
+
+		if (c.pending == 0) _ready[readyCount++] = _order[i];
+	}
+
+	if ((_threads > 1) && (count >= SHEET_PARALLEL_MINIMUM)){
+		runParallel(count, readyCount);
+		return count;
+	}
+
+	while (readyCount > 0){
+		int cell = _ready[--readyCount];
+		computeCell(cell);
+		readyCount = releaseDependents(cell, mark, readyCount);
+	}
+
+	return count;
+}
+
+void *Worksheet::runWorker(void *data){
+	SheetRun *run = (SheetRun *)data;
+	run->sheet->work(run);
+	return NULL;
+}
+
+void Worksheet::work(SheetRun *run){
+	//takes up to SHEET_BATCH ready cells, computes them without the lock, and
+	//then releases their dependents under it
+	int batch[SHEET_BATCH];
+
+	pthread_mutex_lock(&run->lock);
+	for (;;){
+		while ((run->readyCount == 0) && (run->done < run->total))
+			pthread_cond_wait(&run->cellsReady, &run->lock);
+		if (run->done == run->total) break;
+
+		int taken = (run->readyCount < SHEET_BATCH) ? run->readyCount : SHEET_BATCH;
+		run->readyCount -= taken;
+		memcpy(batch, _ready + run->readyCount, taken * sizeof(int));
+		pthread_mutex_unlock(&run->lock);
+
+		for (int i = 0; i < taken; i++)
+			computeCell(batch[i]);
+
+		pthread_mutex_lock(&run->lock);
+		int before = run->readyCount;
+		for (int i = 0; i < taken; i++)
+			run->readyCount = releaseDependents(batch[i], run->mark, run->readyCount);
+		run->done += taken;
+
+		if ((run->readyCount > before + 1) || (run->done == run->total)) pthread_cond_broadcast(&run->cellsReady);
+		else if (run->readyCount > before) pthread_cond_signal(&run->cellsReady);
+	}
+	pthread_mutex_unlock(&run->lock);
+}
+
+void Worksheet::runParallel(int count, int readyCount){
+	//the calling thread is one of the workers
+	SheetRun run;
+	run.sheet = this;
+	run.mark = _mark;
+	run.total = count;
+	run.readyCount = readyCount;
+	run.done = 0;
+	pthread_mutex_init(&run.lock, NULL);
+	pthread_cond_init(&run.cellsReady, NULL);
+
+	int helpers = _threads - 1;
+	pthread_t *threads = new pthread_t[helpers];
+	for (int i = 0; i < helpers; i++)
+		pthread_create(&threads[i], NULL, runWorker, &run);
+
+	work(&run);
+
+	for (int i = 0; i < helpers; i++)
+		pthread_join(threads[i], NULL);
+	delete [] threads;
+
+	pthread_mutex_destroy(&run.lock);
+	pthread_cond_destroy(&run.cellsReady);
+}
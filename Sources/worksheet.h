@@ -0,0 +1,123 @@
+#ifndef WORKSHEET_H
+#define WORKSHEET_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "calculator.h"
+
+#define SHEET_PARALLEL_MINIMUM 512		//cells to recompute before it is worth starting threads
+#define SHEET_BATCH 32					//ready cells a thread takes at a time
+
+struct SheetRun;
+
+struct SheetCell{
+	BString formula;
+	BString cycle;				//the path of the cycle it would close, when that is its error
+	bool defined;				//false for a name only referenced so far
+	CompiledExpression *compiled;
+	int ownError;				//what is wrong with the cell itself: its formula, a cycle through it, or not being defined
+	int errorStart, errorStop;	//in the formula
+
+	int *inputs;				//the cells its formula names, one for each variable of the compiled form
+	double *arguments;			//their values, gathered when it is computed
+	int inputCount;
+	int *dependents;			//the cells that name it, unless it or they are in a cycle
+	int dependentCount, dependentCapacity;
+	bool linked;				//whether it is among its inputs' dependents
+
+	double value;
+	int error;					//CALC_OK, its own error, or one of an input's
+	int errorCell;				//where the error started
+
+	bool dirty;
+	int mark;					//the recalculate() that last reached it
+	int pending;				//inputs left to compute in that one
+};
+
+//A worksheet of named cells, each an expression over other cells, kept as a
+//dependency graph so a change only recomputes what it reaches.
+//
+//Each cell is compiled once when it is set, with the cells it names as the
+//compiled form's variables, so computing it is gathering their values and
+//running its bytecode, and the answers are doubles like the compiled form's.
+//Setting a cell marks it dirty; recalculate() walks from the dirty cells to
+//everything downstream, and computes those in topological order, each once
+//all of its inputs are. A cell with nothing pending is independent of every
+//other such cell, so with more than one thread they are taken from a shared
+//ready list by each thread in turn.
+//
+//A formula that would close a cycle is refused a place in the graph: its cell
+//gets CALC_CIRCULAR_REFERENCE with the path of the cycle, and everything it
+//reaches gets the error through it, until a change elsewhere breaks the cycle.
+//
+//Lines that define functions, 'f(x) = ...', go to the worksheet's Calculator,
+//and cells that call a function are compiled again when it is redefined. Only
+//one thread at a time may use a worksheet.
+class Worksheet{
+	private:
+		Calculator _calc;
+		SymbolTable _names;			//cell names, a cell's index is its slot
+		SheetCell *_cells;
+		int _cellCount, _cellCapacity;
+		int _threads;
+
+		int *_dirty;				//cells set since the last recalculate()
+		int _dirtyCount, _dirtyCapacity;
+		int *_blocked;				//cells left out of the graph for closing a cycle
+		int _blockedCount, _blockedCapacity;
+		int _mark;
+
+		//recalculate() and findCycle() scratch: the cells reached, the ones ready to
+		//compute, and the cell each was reached from
+		int *_order, *_ready, *_from;
+		int _scratchCapacity;
+
+		BString _description;
+
+		int addCell(const char *name, int length);
+		void growScratch();
+		static void appendTo(int *&list, int &count, int &capacity, int value);
+		static void removeFrom(int *list, int &count, int value);
+		void markDirty(int cell);
+		void compileCell(int cell);
+		bool findCycle(int cell);
+		bool link(int cell);
+		void unlink(int cell);
+		void relinkBlocked();
+		void computeCell(int cell);
+		int releaseDependents(int cell, int mark, int readyCount);
+
+		static void *runWorker(void *data);
+		void work(SheetRun *run);
+		void runParallel(int count, int readyCount);
+
+	public:
+		Worksheet(void);
+		~Worksheet(void);
+
+		void setThreads(int threads);			//1 by default, 0 for one per processor
+		Calculator *calculator();				//for the functions cells can call
+
+		//Sets a cell to a formula, or with a line: 'name = formula' sets a cell, anything
+		//else is given to the Calculator. The error of the cell or line, with where in the
+		//formula or line it is; a cell with one is still set, and still has dependents.
+		int setCell(const char *name, int nameLength, const char *formula, int formulaLength, int &selStart, int &selStop);
+		int setLine(const char *line, int length, int &selStart, int &selStop);
+
+		//computes every cell a change since the last call reaches, returns how many
+		int recalculate();
+
+		int count();
+		int find(const char *name, int length);		//-1 if there is no such cell
+		const char *name(int cell);
+		bool isDefined(int cell);
+		double value(int cell);
+		int error(int cell);
+		//the value as text, or what is wrong and where it came from, valid until the next call
+		const char *describe(int cell);
+};
+
+#endif